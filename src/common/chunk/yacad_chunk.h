@@ -0,0 +1,33 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __YACAD_CHUNK_H__
+#define __YACAD_CHUNK_H__
+
+/* A chunk of task output, sent by a Runner to the Core logs endpoint:
+ * a one-line text header, then the bytes. The sequence starts at 0 for
+ * each task; the size is the size of the bytes before compression. */
+
+#define YACAD_CHUNK_HEADER "%lu %lu %c %zu\n" // task id, sequence, kind, size
+#define YACAD_CHUNK_HEADER_MAX 80
+
+#define YACAD_CHUNK_RAW 'r'
+#define YACAD_CHUNK_ZLIB 'z'
+#define YACAD_CHUNK_END 'e' // no bytes: the task output is complete
+
+#define YACAD_CHUNK_SIZE 16384 // the largest chunk, before compression
+
+#endif /* __YACAD_CHUNK_H__ */
@@ -22,7 +22,6 @@ static struct tm dgcm(void) {
 
      time(&t);
      localtime_r(&t, &result);
-     result.tm_sec = 0;
      result.tm_yday = 0;
 
      return result;
@@ -31,6 +30,7 @@ static struct tm dgcm(void) {
 static get_current_minute_fn current_get_current_minute = dgcm;
 
 typedef struct {
+     unsigned long sec:60; // only second 0 without a seconds field
      unsigned long min:60;
      unsigned long hour:24;
      unsigned long dom:31;
@@ -38,75 +38,177 @@ typedef struct {
      unsigned long dow:7;
 } cronspec_t;
 
+/* a spec that never fires (e.g. "0 0 30 1 *") gives up after a full Gregorian cycle */
+#define MAX_YEARS 400
+
 typedef struct yacad_cron_impl_s {
      yacad_cron_t fn;
      logger_t log;
      cronspec_t spec;
+     long interval; // "@every": seconds between checks, 0 for a spec
      get_current_minute_fn get_current_minute;
+     bool_t cached; // valid until the clock reaches it
+     struct tm cache_tm;
+     struct timeval cache;
+     int jitter; // seconds
+     unsigned int seed;
 } yacad_cron_impl_t;
 
 #define BIT_1(field, bit) do { (field) |= 1UL << (bit); } while(0)
 #define BIT_0(field, bit) do { (field) &= ~(1UL << (bit)); } while(0)
 #define ISBIT(field, bit) (((field) >> (bit)) & 1UL)
 
-static bool_t lookup(yacad_cron_impl_t *this, unsigned long field, int *min, int max, const char *fieldname) {
-     int i;
-     bool_t result = false, done = false;
-     this->log(trace, "lookup %s: bitfield is %lx", fieldname, field);
-     if (ISBIT(field, *min)) {
-          this->log(trace, "lookup %s: found min %2d", fieldname, *min);
-          result = true;
-     } else {
-          for (i = *min + 1; !done && i < max; i++) {
-               this->log(trace, "lookup %s: checking bit %d/%d => %s", fieldname, i, max, ISBIT(field, i) ? "true" : "false");
-               if (ISBIT(field, i)) {
-                    this->log(trace, "lookup %s: found %2d", fieldname, i);
-                    *min = i;
-                    done = true;
-               }
-          }
-          if (!done) {
-               (*min)++;
+/* The first set bit at or after from, or -1 */
+static int next_bit(unsigned long field, int from) {
+     unsigned long mask;
+     int result = -1;
+     if (from < (int)(8 * sizeof(unsigned long))) {
+          mask = field & (~0UL << from);
+          if (mask != 0) {
+               result = __builtin_ctzl(mask);
           }
      }
-     this->log(trace, "lookup %s: min=%d, result=%s", fieldname, *min, result ? "true" : "false");
      return result;
 }
 
+static bool_t is_leap(int year) {
+     return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+static int days_in_month(int year, int mon) {
+     static const int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+     return days[mon] + (mon == 1 && is_leap(year) ? 1 : 0);
+}
+
+/* Day of week (0 is Sunday) of the first day of the month; Sakamoto's method */
+static int first_wday(int year, int mon) {
+     static const int t[] = {0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4};
+     int y = year - (mon < 2 ? 1 : 0);
+     return (y + y / 4 - y / 100 + y / 400 + t[mon] + 1) % 7;
+}
+
+/* The days of the month (bit n is day n) allowed by both the dom and the dow fields */
+static unsigned long month_days(yacad_cron_impl_t *this, int year, int mon) {
+     unsigned long result = 0;
+     unsigned long week = this->spec.dow;
+     int wday = first_wday(year, mon), n = days_in_month(year, mon), d;
+
+     // the dow field rotated so that bit 0 is the weekday of day 1, then repeated over the month
+     week = ((week >> wday) | (week << (7 - wday))) & 0x7fUL;
+     for (d = 1; d <= n; d += 7) {
+          result |= week << d;
+     }
+     return result & this->spec.dom & ((1UL << (n + 1)) - 1);
+}
+
+/* Compares the calendar fields only: no mktime */
+static bool_t is_before(struct tm *a, struct tm *b) {
+     int da[] = {a->tm_year, a->tm_mon, a->tm_mday, a->tm_hour, a->tm_min, a->tm_sec};
+     int db[] = {b->tm_year, b->tm_mon, b->tm_mday, b->tm_hour, b->tm_min, b->tm_sec};
+     int i;
+     for (i = 0; i < 6; i++) {
+          if (da[i] != db[i]) {
+               return da[i] < db[i];
+          }
+     }
+     return false;
+}
+
 static struct timeval next(yacad_cron_impl_t *this) {
      struct timeval result;
-     time_t t;
-     struct tm tm;
-     bool_t done = false;
+     struct tm tm = this->get_current_minute();
+     int year, mon, mday, hour, min, sec, found, end;
 
-     tm = this->get_current_minute();
-     tm.tm_min++;
+     if (this->cached && is_before(&tm, &(this->cache_tm))) {
+          return this->cache;
+     }
 
-     do {
-          /* inspired by http://stackoverflow.com/questions/321494/calculate-when-a-cron-job-will-be-executed-then-next-time */
-          t = mktime(&tm);
-          localtime_r(&t, &tm);
-          this->log(trace, ">>>> more: %s", ctime(&t));
-          if (!lookup(this, this->spec.mon, &(tm.tm_mon), 12, "month")) {
-               tm.tm_mday = tm.tm_wday = tm.tm_hour = tm.tm_min = 0;
-          } else if (!lookup(this, this->spec.dom, &(tm.tm_mday), 31, "day of month")) {
-               tm.tm_hour = tm.tm_min = 0;
-          } else if (!lookup(this, this->spec.dow, &(tm.tm_wday), 7, "day of week")) {
-               tm.tm_hour = tm.tm_min = 0;
-          } else if (!lookup(this, this->spec.hour, &(tm.tm_hour), 24, "hour")) {
-               tm.tm_min = 0;
-          } else if (!lookup(this, this->spec.min, &(tm.tm_min), 60, "minute")) {
+     if (this->interval > 0) {
+          result.tv_sec = mktime(&tm) + this->interval;
+          localtime_r(&result.tv_sec, &(this->cache_tm));
+     } else {
+          // the calendar is normalized once, then each field jumps to its next allowed value
+          year = tm.tm_year + 1900;
+          mon = tm.tm_mon;
+          mday = tm.tm_mday;
+          hour = tm.tm_hour;
+          if (this->spec.sec == 1UL) {
+               // no seconds field: the next minute
+               min = tm.tm_min + 1;
+               sec = 0;
           } else {
-               done = true;
+               min = tm.tm_min;
+               sec = tm.tm_sec + 1;
+          }
+          end = year + MAX_YEARS;
+
+          while (year < end) {
+               if ((found = next_bit(this->spec.mon, mon)) < 0) {
+                    year++;
+                    mon = 0;
+                    mday = 1;
+                    hour = min = sec = 0;
+               } else if (found > mon) {
+                    mon = found;
+                    mday = 1;
+                    hour = min = sec = 0;
+               } else if ((found = next_bit(month_days(this, year, mon), mday)) < 0) {
+                    mon++;
+                    mday = 1;
+                    hour = min = sec = 0;
+               } else if (found > mday) {
+                    mday = found;
+                    hour = min = sec = 0;
+               } else if ((found = next_bit(this->spec.hour, hour)) < 0) {
+                    mday++;
+                    hour = min = sec = 0;
+               } else if (found > hour) {
+                    hour = found;
+                    min = sec = 0;
+               } else if ((found = next_bit(this->spec.min, min)) < 0) {
+                    hour++;
+                    min = sec = 0;
+               } else if (found > min) {
+                    min = found;
+                    sec = 0;
+               } else if ((found = next_bit(this->spec.sec, sec)) < 0) {
+                    min++;
+                    sec = 0;
+               } else {
+                    sec = found;
+                    break;
+               }
+               if (mon == 12) {
+                    year++;
+                    mon = 0;
+               }
+          }
+
+          if (year >= end) {
+               this->log(warn, "Cron spec never fires");
           }
-     } while (!done);
 
-     t = mktime(&tm);
-     this->log(trace, ">>>> next is %s", ctime(&t));
+          memset(&tm, 0, sizeof(struct tm));
+          tm.tm_year = year - 1900;
+          tm.tm_mon = mon;
+          tm.tm_mday = mday;
+          tm.tm_hour = hour;
+          tm.tm_min = min;
+          tm.tm_sec = sec;
+          tm.tm_isdst = -1;
+          this->cache_tm = tm;
+
+          result.tv_sec = mktime(&tm);
+     }
 
-     result.tv_sec = t;
      result.tv_usec = 0;
+     if (this->jitter > 0) {
+          result.tv_sec += rand_r(&(this->seed)) % (this->jitter + 1);
+     }
+     this->log(trace, "cron next is %s", ctime(&result.tv_sec));
 
+     this->cache = result;
+     this->cached = true;
      return result;
 }
 
@@ -154,30 +256,77 @@ static unsigned long parse_field_step(unsigned long val, const char *field, int
      return result;
 }
 
-static unsigned long parse_field_list(const char *field, int *offset, int max) {
+/* "H", or "H(min-max)", optionally followed by "/step": a value (or the first step) derived from the
+ * hash, i.e. stable for a given key; lo-hi is the default range */
+static unsigned long parse_field_hash(const char *field, int *offset, int lo, int hi, int max, unsigned long hash) {
      unsigned long result = 0;
-     unsigned long val;
-     int numin, numax, i;
-     bool_t cont = true;
-     do {
-          numin = parse_num(field, offset);
+     int numin = lo, numax = hi, num, i;
 
+     *offset = *offset + 1;
+     if (field[*offset] == '(') {
+          *offset = *offset + 1;
+          numin = parse_num(field, offset);
           if (field[*offset] == '-') {
                *offset = *offset + 1;
                numax = parse_num(field, offset);
           } else {
                numax = numin;
           }
+          if (field[*offset] == ')') {
+               *offset = *offset + 1;
+          }
+          if (numax >= max) {
+               numax = max - 1;
+          }
+          if (numin > numax) {
+               numin = numax;
+          }
+     }
 
-          val = 0UL;
-          for (i = numin; i <= numax && i < max; i++) {
-               BIT_1(val, i);
+     if (field[*offset] == '/') {
+          *offset = *offset + 1;
+          num = parse_num(field, offset);
+          if (num < 1) {
+               num = 1;
           }
+          for (i = numin + hash % num; i <= numax; i += num) {
+               BIT_1(result, i);
+          }
+     } else {
+          BIT_1(result, numin + hash % (numax - numin + 1));
+     }
+
+     return result;
+}
 
-          if (field[*offset] == '/') {
-               result |= parse_field_step(val, field, offset, numin, max);
+static unsigned long parse_field_list(const char *field, int *offset, int lo, int hi, int max, unsigned long hash) {
+     unsigned long result = 0;
+     unsigned long val;
+     int numin, numax, i;
+     bool_t cont = true;
+     do {
+          if (field[*offset] == 'H') {
+               result |= parse_field_hash(field, offset, lo, hi, max, hash);
           } else {
-               result |= val;
+               numin = parse_num(field, offset);
+
+               if (field[*offset] == '-') {
+                    *offset = *offset + 1;
+                    numax = parse_num(field, offset);
+               } else {
+                    numax = numin;
+               }
+
+               val = 0UL;
+               for (i = numin; i <= numax && i < max; i++) {
+                    BIT_1(val, i);
+               }
+
+               if (field[*offset] == '/') {
+                    result |= parse_field_step(val, field, offset, numin, max);
+               } else {
+                    result |= val;
+               }
           }
 
           if (field[*offset] == ',') {
@@ -189,7 +338,8 @@ static unsigned long parse_field_list(const char *field, int *offset, int max) {
      return result;
 }
 
-static unsigned long parse_field(const char *field, int *offset, int max) {
+/* lo-hi is the range of "H"; max is the size of the field */
+static unsigned long parse_field(const char *field, int *offset, int lo, int hi, int max, unsigned long hash) {
      unsigned long result;
      int i;
      switch (field[*offset]) {
@@ -202,11 +352,21 @@ static unsigned long parse_field(const char *field, int *offset, int max) {
           result = parse_field_step(result, field, offset, 0, max);
           break;
      default:
-          result = parse_field_list(field, offset, max);
+          result = parse_field_list(field, offset, lo, hi, max, hash);
      }
      return result;
 }
 
+/* FNV-1a of the key, then of the field index: each field gets its own spread */
+static unsigned long field_hash(const char *key, int index) {
+     unsigned long long result = 14695981039346656037ULL;
+     for (; key != NULL && *key; key++) {
+          result = (result ^ (unsigned char)*key) * 1099511628211ULL;
+     }
+     result = (result ^ (unsigned char)index) * 1099511628211ULL;
+     return (unsigned long)(result >> 16);
+}
+
 static void skip_blanks(const char *field, int *offset) {
      bool_t cont = true;
      do {
@@ -222,32 +382,98 @@ static void skip_blanks(const char *field, int *offset) {
      } while(cont);
 }
 
+static int count_fields(const char *cronspec) {
+     int result = 0, offset = 0;
+     skip_blanks(cronspec, &offset);
+     while (cronspec[offset] != '\0') {
+          result++;
+          while (cronspec[offset] != '\0' && cronspec[offset] != ' ' && cronspec[offset] != '\t' && cronspec[offset] != '\n') {
+               offset++;
+          }
+          skip_blanks(cronspec, &offset);
+     }
+     return result;
+}
+
+/* "@every 1h30m", "@every 10s"; a number without unit is in seconds */
+static long parse_interval(const char *cronspec, int *offset) {
+     long result = 0;
+     int num;
+     bool_t cont = true;
+     skip_blanks(cronspec, offset);
+     do {
+          num = parse_num(cronspec, offset);
+          switch (cronspec[*offset]) {
+          case 'd':
+               num *= 24;
+               /* fall through */
+          case 'h':
+               num *= 60;
+               /* fall through */
+          case 'm':
+               num *= 60;
+               /* fall through */
+          case 's':
+               *offset = *offset + 1;
+               break;
+          default:
+               cont = false;
+          }
+          result += num;
+     } while (cont && cronspec[*offset] >= '0' && cronspec[*offset] <= '9');
+     return result;
+}
+
 static yacad_cron_t impl_fn = {
      .next = (yacad_cron_next_fn)next,
      .free = (yacad_cron_free_fn)free_,
 };
 
-yacad_cron_t *yacad_cron_parse(logger_t log, const char *cronspec) {
+yacad_cron_t *yacad_cron_parse(logger_t log, const char *cronspec, const char *key, int jitter) {
      yacad_cron_impl_t *result = malloc(sizeof(yacad_cron_impl_t));
      int offset = 0;
+     bool_t valid = true;
 
      result->fn = impl_fn;
      result->log = log;
+     result->interval = 0;
 
      skip_blanks(cronspec, &offset);
-     result->spec.min = parse_field(cronspec, &offset, 60);
-     skip_blanks(cronspec, &offset);
-     result->spec.hour = parse_field(cronspec, &offset, 24);
-     skip_blanks(cronspec, &offset);
-     result->spec.dom = parse_field(cronspec, &offset, 31);
-     skip_blanks(cronspec, &offset);
-     result->spec.mon = parse_field(cronspec, &offset, 12);
-     skip_blanks(cronspec, &offset);
-     result->spec.dow = parse_field(cronspec, &offset, 7);
+     if (!strncmp(cronspec + offset, "@every", 6)) {
+          offset += 6;
+          result->interval = parse_interval(cronspec, &offset);
+          valid = result->interval > 0;
+     } else {
+          if (count_fields(cronspec) == 6) {
+               result->spec.sec = parse_field(cronspec, &offset, 0, 59, 60, field_hash(key, 6));
+               skip_blanks(cronspec, &offset);
+          } else {
+               result->spec.sec = 1UL;
+          }
+          result->spec.min = parse_field(cronspec, &offset, 0, 59, 60, field_hash(key, 0));
+          skip_blanks(cronspec, &offset);
+          result->spec.hour = parse_field(cronspec, &offset, 0, 23, 24, field_hash(key, 1));
+          skip_blanks(cronspec, &offset);
+          // H days stay in 1-28, valid in every month
+          result->spec.dom = parse_field(cronspec, &offset, 1, 28, 31, field_hash(key, 2));
+          skip_blanks(cronspec, &offset);
+          result->spec.mon = parse_field(cronspec, &offset, 0, 11, 12, field_hash(key, 3));
+          skip_blanks(cronspec, &offset);
+          result->spec.dow = parse_field(cronspec, &offset, 0, 6, 7, field_hash(key, 4));
+     }
 
      result->get_current_minute = current_get_current_minute;
+     result->cached = false;
+     result->jitter = jitter;
+     result->seed = (unsigned int)(field_hash(key, 5) ^ (unsigned long)time(NULL));
+
+     if (!valid) {
+          log(warn, "Invalid cron interval: %s", cronspec);
+          free(result);
+          result = NULL;
+     }
 
-     return I(result);
+     return result == NULL ? NULL : I(result);
 }
 
 void set_get_current_minute_fn(get_current_minute_fn fn) {
@@ -31,9 +31,18 @@ struct yacad_cron_s {
      yacad_cron_free_fn free;
 };
 
-yacad_cron_t *yacad_cron_parse(logger_t log, const char *cronspec);
+/**
+ * Parses a five-field cron spec, or a six-field one starting with the seconds, or an "@every 10s"
+ * interval (units s, m, h, d). An "H" field (or "H(min-max)", optionally with "/step") takes a
+ * value derived from the key, to spread the schedules of different keys over the period.
+ *
+ * @param key the hash key of the "H" fields, usually the project name; may be NULL
+ * @param jitter a random delay, up to that many seconds, added to each next time; 0 for none
+ */
+yacad_cron_t *yacad_cron_parse(logger_t log, const char *cronspec, const char *key, int jitter);
 
 /**
+ * The function returns the current time, to the second.
  * Must be called before \ref yacad_cron_parse.
  */
 void set_get_current_minute_fn(get_current_minute_fn fn);
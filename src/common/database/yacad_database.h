@@ -23,16 +23,20 @@ typedef struct yacad_database_s yacad_database_t;
 typedef struct yacad_statement_s yacad_statement_t;
 
 typedef bool_t (*yacad_database_need_install_fn)(yacad_database_t *this);
+typedef long (*yacad_database_get_version_fn)(yacad_database_t *this);
 typedef void (*yacad_database_set_installed_fn)(yacad_database_t *this);
 typedef yacad_statement_t *(*yacad_database_select_fn)(yacad_database_t *this, const char *statement);
 typedef yacad_statement_t *(*yacad_database_update_fn)(yacad_database_t *this, const char *statement);
+typedef bool_t (*yacad_database_begin_fn)(yacad_database_t *this);
 typedef void (*yacad_database_free_fn)(yacad_database_t *this);
 
 struct yacad_database_s {
      yacad_database_need_install_fn need_install;
+     yacad_database_get_version_fn get_version;
      yacad_database_set_installed_fn set_installed;
      yacad_database_select_fn select;
      yacad_database_update_fn update;
+     yacad_database_begin_fn begin; // "begin immediate", false if the database stays busy: does not wait like run() does
      yacad_database_free_fn free;
 };
 
@@ -41,7 +45,8 @@ typedef void (*yacad_select_fn)(yacad_statement_t *this, void *data);
 /* Contrarily to sqlite, my column indexes always start at 0. */
 typedef void (*yacad_statement_bind_int_fn)(yacad_statement_t *this, int index, long value);
 typedef void (*yacad_statement_bind_string_fn)(yacad_statement_t *this, int index, const char *value);
-typedef void (*yacad_statement_run_fn)(yacad_statement_t *this, yacad_select_fn select, void *data);
+/* true if the statement ran to its end */
+typedef bool_t (*yacad_statement_run_fn)(yacad_statement_t *this, yacad_select_fn select, void *data);
 typedef long (*yacad_statement_get_rowid_fn)(yacad_statement_t *this);
 typedef long (*yacad_statement_get_int_fn)(yacad_statement_t *this, int index);
 typedef const char *(*yacad_statement_get_string_fn)(yacad_statement_t *this, int index);
@@ -58,5 +63,7 @@ struct yacad_statement_s {
 };
 
 yacad_database_t *yacad_database_new(logger_t log, const char *database_name);
+/* the database must exist */
+yacad_database_t *yacad_database_new_readonly(logger_t log, const char *database_name);
 
 #endif /* __YACAD_DATABASE_H__ */
@@ -16,11 +16,16 @@
 
 #include "yacad_database_sqlite3.h"
 
-#define DB_VERSION 1L
+#define DB_VERSION 5L
 
 #define STMT_CREATE_TABLE "create table PARAM (KEY not null, VALUE not null)"
 #define STMT_SELECT "select VALUE from PARAM where KEY=?"
 #define STMT_INSERT "insert into PARAM (KEY,VALUE) values (?,?)"
+#define STMT_DELETE "delete from PARAM where KEY=?"
+#define STMT_PRAGMA_BUSY_TIMEOUT "pragma busy_timeout=250"
+#define STMT_PRAGMA_AUTO_VACUUM "pragma auto_vacuum=incremental"
+#define STMT_PRAGMA_WAL "pragma journal_mode=wal"
+#define STMT_BEGIN "begin immediate"
 
 static sqlite3_fn_t sqlite3_fn = {
      .errmsg              = sqlite3_errmsg           ,
@@ -88,8 +93,8 @@ static void bind_string(yacad_statement_impl_t *this, int index, const char *val
      sqlcheck(this, this->sql_fn->bind_text64(this->query, index + 1, value, strlen(value), SQLITE_TRANSIENT, SQLITE_UTF8), warn);
 }
 
-static void select_run(yacad_statement_impl_t *this, yacad_select_fn select, void *data) {
-     bool_t done = false;
+static bool_t select_run(yacad_statement_impl_t *this, yacad_select_fn select, void *data) {
+     bool_t done = false, result = false;
      int err;
 
      this->log(trace, " - executing select");
@@ -97,7 +102,7 @@ static void select_run(yacad_statement_impl_t *this, yacad_select_fn select, voi
           err = this->sql_fn->step(this->query);
           switch(err) {
           case SQLITE_DONE:
-               done = true;
+               done = result = true;
                break;
           case SQLITE_BUSY:
                this->log(info, "Database is busy, waiting one second");
@@ -114,10 +119,11 @@ static void select_run(yacad_statement_impl_t *this, yacad_select_fn select, voi
                done = true;
           }
      } while (!done);
+     return result;
 }
 
-static void update_run(yacad_statement_impl_t *this, yacad_select_fn select, void *data) {
-     bool_t done = false;
+static bool_t update_run(yacad_statement_impl_t *this, yacad_select_fn select, void *data) {
+     bool_t done = false, result = false;
      int err;
 
      this->log(trace, " - executing update");
@@ -126,7 +132,7 @@ static void update_run(yacad_statement_impl_t *this, yacad_select_fn select, voi
           switch(err) {
           case SQLITE_DONE:
                this->rowid = (long)this->sql_fn->last_insert_rowid(this->db);
-               done = true;
+               done = result = true;
                break;
           case SQLITE_BUSY:
                this->log(info, "Database is busy, waiting one second");
@@ -144,6 +150,7 @@ static void update_run(yacad_statement_impl_t *this, yacad_select_fn select, voi
                done = true;
           }
      } while (!done);
+     return result;
 }
 
 static long get_rowid(yacad_statement_impl_t *this) {
@@ -187,26 +194,37 @@ static yacad_statement_t update_fn = {
      .free = (yacad_statement_free_fn)free__,
 };
 
-static void _need_install(yacad_statement_t *this, bool_t *result) {
+static void _get_version(yacad_statement_t *this, long *result) {
      long ver = this->get_int(this, 0);
-     if (ver == DB_VERSION) {
-          *result = false;
+     if (ver > *result) {
+          *result = ver;
      }
 }
 
-static bool_t need_install(yacad_database_impl_t *this) {
-     bool_t result = true;
+/* 0 if the database was never installed */
+static long get_version(yacad_database_impl_t *this) {
+     long result = 0;
      yacad_statement_t *stmt = I(this)->select(I(this), STMT_SELECT);
      if (stmt != NULL) {
           stmt->bind_string(stmt, 0, "dbversion");
-          stmt->run(stmt, (yacad_select_fn)_need_install, &result);
+          stmt->run(stmt, (yacad_select_fn)_get_version, &result);
           stmt->free(stmt);
      }
      return result;
 }
 
+static bool_t need_install(yacad_database_impl_t *this) {
+     return get_version(this) != DB_VERSION;
+}
+
 static void set_installed(yacad_database_impl_t *this) {
-     yacad_statement_t *stmt = I(this)->update(I(this), STMT_INSERT);
+     yacad_statement_t *stmt = I(this)->update(I(this), STMT_DELETE);
+     if (stmt != NULL) {
+          stmt->bind_string(stmt, 0, "dbversion");
+          stmt->run(stmt, NULL, NULL);
+          stmt->free(stmt);
+     }
+     stmt = I(this)->update(I(this), STMT_INSERT);
      if (stmt != NULL) {
           stmt->bind_string(stmt, 0, "dbversion");
           stmt->bind_int(stmt, 1, DB_VERSION);
@@ -232,16 +250,28 @@ static yacad_statement_impl_t *new_statement(yacad_database_impl_t *this, const
 
 static yacad_statement_t *select_(yacad_database_impl_t *this, const char *statement) {
      yacad_statement_impl_t *result = new_statement(this, statement);
+     if (result == NULL) {
+          return NULL;
+     }
      result->fn = select_fn;
      return I(result);
 }
 
 static yacad_statement_t *update(yacad_database_impl_t *this, const char *statement) {
      yacad_statement_impl_t *result = new_statement(this, statement);
+     if (result == NULL) {
+          return NULL;
+     }
      result->fn = update_fn;
      return I(result);
 }
 
+/* Gives up after the busy timeout */
+static bool_t begin(yacad_database_impl_t *this) {
+     this->log(debug, "%s", STMT_BEGIN);
+     return sqlcheck(this, this->sql_fn->exec(this->db, STMT_BEGIN, NULL, NULL, NULL), info);
+}
+
 static void free_(yacad_database_impl_t *this) {
      this->sql_fn->close(this->db);
      free(this);
@@ -249,24 +279,47 @@ static void free_(yacad_database_impl_t *this) {
 
 static yacad_database_t impl_fn = {
      .need_install = (yacad_database_need_install_fn)need_install,
+     .get_version = (yacad_database_get_version_fn)get_version,
      .set_installed = (yacad_database_set_installed_fn)set_installed,
      .select = (yacad_database_select_fn)select_,
      .update = (yacad_database_update_fn)update,
+     .begin = (yacad_database_begin_fn)begin,
      .free = (yacad_database_free_fn)free_,
 };
 
-yacad_database_t *yacad_database_new(logger_t log, const char *database_name) {
-     yacad_database_impl_t *result = malloc(sizeof(yacad_database_impl_t));
+static bool_t initialize(logger_t log, const char *database_name) {
      static bool_t init = false;
-     sqlite3 *db;
-
      if (!init) {
           if (!sqlcheck0(NULL, log, sqlite3_fn.initialize(), debug)) {
                log(error, "Could not initialize database: %s", database_name);
-               return NULL;
+               return false;
           }
           init = true;
      }
+     return true;
+}
+
+static yacad_database_t *database_new(logger_t log, sqlite3 *db) {
+     yacad_database_impl_t *result = malloc(sizeof(yacad_database_impl_t));
+
+     /* several connections (scheduler, retention, query) share the same file */
+     sqlcheck0(db, log, sqlite3_fn.exec(db, STMT_PRAGMA_BUSY_TIMEOUT, NULL, NULL, NULL), warn);
+
+     result->fn = impl_fn;
+     result->log = log;
+     result->db = db;
+     result->sql_fn_copy = sqlite3_fn;
+     result->sql_fn = &(result->sql_fn_copy);
+
+     return I(result);
+}
+
+yacad_database_t *yacad_database_new(logger_t log, const char *database_name) {
+     sqlite3 *db;
+
+     if (!initialize(log, database_name)) {
+          return NULL;
+     }
 
      if (!sqlcheck0(NULL, log, sqlite3_fn.open(database_name, &db, SQLITE_OPEN_READWRITE, NULL), debug)) {
           log(debug, "Creating database: %s", database_name);
@@ -274,6 +327,8 @@ yacad_database_t *yacad_database_new(logger_t log, const char *database_name) {
                log(error, "Could not create database: %s", database_name);
                return NULL;
           }
+          /* must be set before the first table is created, see yacad_retention */
+          sqlcheck0(db, log, sqlite3_fn.exec(db, STMT_PRAGMA_AUTO_VACUUM, NULL, NULL, NULL), warn);
           log(debug, "Creating table: PARAM");
           if (!sqlcheck0(db, log, sqlite3_fn.exec(db, STMT_CREATE_TABLE, NULL, NULL, NULL), debug)) {
                log(error, "Could not create table");
@@ -282,13 +337,25 @@ yacad_database_t *yacad_database_new(logger_t log, const char *database_name) {
           }
      }
 
-     result->fn = impl_fn;
-     result->log = log;
-     result->db = db;
-     result->sql_fn_copy = sqlite3_fn;
-     result->sql_fn = &(result->sql_fn_copy);
+     /* readers do not block the writer */
+     sqlcheck0(db, log, sqlite3_fn.exec(db, STMT_PRAGMA_WAL, NULL, NULL, NULL), warn);
 
-     return I(result);
+     return database_new(log, db);
+}
+
+yacad_database_t *yacad_database_new_readonly(logger_t log, const char *database_name) {
+     sqlite3 *db;
+
+     if (!initialize(log, database_name)) {
+          return NULL;
+     }
+
+     if (!sqlcheck0(NULL, log, sqlite3_fn.open(database_name, &db, SQLITE_OPEN_READONLY, NULL), warn)) {
+          log(error, "Could not open database: %s", database_name);
+          return NULL;
+     }
+
+     return database_new(log, db);
 }
 
 void yacad_database_set_sqlite_fn(sqlite3_fn_t fn) {
@@ -0,0 +1,123 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "yacad_sha256.h"
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static const uint32_t k[64] = {
+     0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+     0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+     0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+     0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+     0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+     0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+     0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+     0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static void transform(yacad_sha256_t *sha, const unsigned char *block) {
+     uint32_t w[64], a, b, c, d, e, f, g, h, t1, t2;
+     int i;
+
+     for (i = 0; i < 16; i++) {
+          w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 | (uint32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
+     }
+     for (i = 16; i < 64; i++) {
+          w[i] = (ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10)) + w[i - 7]
+               + (ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3)) + w[i - 16];
+     }
+
+     a = sha->h[0]; b = sha->h[1]; c = sha->h[2]; d = sha->h[3];
+     e = sha->h[4]; f = sha->h[5]; g = sha->h[6]; h = sha->h[7];
+     for (i = 0; i < 64; i++) {
+          t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+          t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+          h = g; g = f; f = e; e = d + t1;
+          d = c; c = b; b = a; a = t1 + t2;
+     }
+     sha->h[0] += a; sha->h[1] += b; sha->h[2] += c; sha->h[3] += d;
+     sha->h[4] += e; sha->h[5] += f; sha->h[6] += g; sha->h[7] += h;
+}
+
+void yacad_sha256_init(yacad_sha256_t *sha) {
+     static const uint32_t h0[8] = {
+          0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+     };
+     memcpy(sha->h, h0, sizeof(h0));
+     sha->length = 0;
+     sha->fill = 0;
+}
+
+void yacad_sha256_update(yacad_sha256_t *sha, const void *bytes, size_t size) {
+     const unsigned char *b = bytes;
+     size_t n;
+
+     sha->length += size;
+     while (size > 0) {
+          if (sha->fill == 0 && size >= 64) {
+               // whole blocks straight from the input
+               transform(sha, b);
+               n = 64;
+          } else {
+               n = 64 - sha->fill;
+               if (n > size) {
+                    n = size;
+               }
+               memcpy(sha->block + sha->fill, b, n);
+               sha->fill += n;
+               if (sha->fill == 64) {
+                    transform(sha, sha->block);
+                    sha->fill = 0;
+               }
+          }
+          b += n;
+          size -= n;
+     }
+}
+
+void yacad_sha256_final(yacad_sha256_t *sha, char hex[YACAD_SHA256_HEX]) {
+     uint64_t bits = sha->length * 8;
+     unsigned char pad[72];
+     size_t n = (sha->fill < 56 ? 56 : 120) - sha->fill;
+     int i;
+
+     memset(pad, 0, sizeof(pad));
+     pad[0] = 0x80;
+     for (i = 0; i < 8; i++) {
+          pad[n + i] = (unsigned char)(bits >> (56 - 8 * i));
+     }
+     yacad_sha256_update(sha, pad, n + 8);
+
+     for (i = 0; i < 8; i++) {
+          snprintf(hex + 8 * i, 9, "%08x", sha->h[i]);
+     }
+}
+
+bool_t yacad_sha256_file(int fd, char hex[YACAD_SHA256_HEX]) {
+     yacad_sha256_t sha;
+     char buffer[65536];
+     off_t offset = 0;
+     ssize_t n;
+
+     yacad_sha256_init(&sha);
+     while ((n = pread(fd, buffer, sizeof(buffer), offset)) > 0) {
+          yacad_sha256_update(&sha, buffer, n);
+          offset += n;
+     }
+     yacad_sha256_final(&sha, hex);
+     return n == 0;
+}
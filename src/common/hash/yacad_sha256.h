@@ -0,0 +1,42 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __YACAD_SHA256_H__
+#define __YACAD_SHA256_H__
+
+#include <stdint.h>
+
+#include "yacad.h"
+
+/* SHA-256 (FIPS 180-4), the key of the artifacts store */
+
+#define YACAD_SHA256_HEX 65 // 64 hex digits and the NUL
+
+typedef struct {
+     uint32_t h[8];
+     uint64_t length; // in bytes
+     unsigned char block[64];
+     size_t fill;
+} yacad_sha256_t;
+
+void yacad_sha256_init(yacad_sha256_t *sha);
+void yacad_sha256_update(yacad_sha256_t *sha, const void *bytes, size_t size);
+void yacad_sha256_final(yacad_sha256_t *sha, char hex[YACAD_SHA256_HEX]);
+
+/* Hashes a whole file, from its start; false on read error */
+bool_t yacad_sha256_file(int fd, char hex[YACAD_SHA256_HEX]);
+
+#endif /* __YACAD_SHA256_H__ */
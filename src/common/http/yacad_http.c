@@ -0,0 +1,139 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "yacad_http.h"
+
+static struct addrinfo *resolve(logger_t log, const char *name, int flags) {
+     struct addrinfo hints, *result = NULL;
+     const char *colon = strrchr(name, ':');
+     char *host;
+     size_t n;
+     int err;
+
+     if (colon == NULL) {
+          log(error, "Invalid address, expected host:port: %s", name);
+     } else {
+          n = colon - name;
+          host = alloca(n + 1);
+          memcpy(host, name, n);
+          host[n] = '\0';
+          memset(&hints, 0, sizeof(hints));
+          hints.ai_family = AF_UNSPEC;
+          hints.ai_socktype = SOCK_STREAM;
+          hints.ai_flags = flags;
+          err = getaddrinfo(strcmp(host, "*") ? host : NULL, colon + 1, &hints, &result);
+          if (err != 0) {
+               log(error, "Could not resolve %s: %s", name, gai_strerror(err));
+               result = NULL;
+          }
+     }
+     return result;
+}
+
+int yacad_http_listen(logger_t log, const char *name) {
+     int result = -1, on = 1;
+     struct addrinfo *addrs = resolve(log, name, AI_PASSIVE), *a;
+
+     for (a = addrs; result < 0 && a != NULL; a = a->ai_next) {
+          result = socket(a->ai_family, a->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, a->ai_protocol);
+          if (result >= 0) {
+               setsockopt(result, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+               if (bind(result, a->ai_addr, a->ai_addrlen) != 0 || listen(result, 16) != 0) {
+                    close(result);
+                    result = -1;
+               }
+          }
+     }
+     if (addrs != NULL) {
+          if (result < 0) {
+               log(error, "Could not listen on %s: %s", name, strerror(errno));
+          }
+          freeaddrinfo(addrs);
+     }
+     return result;
+}
+
+/* The socket is non-blocking until it is connected, so that an unreachable peer fails within the connect timeout */
+static bool_t connect_within(int fd, const struct sockaddr *addr, socklen_t len) {
+     bool_t result;
+     struct pollfd p = { fd, POLLOUT, 0 };
+     int flags = fcntl(fd, F_GETFL), error = 0;
+     socklen_t n = sizeof(error);
+
+     fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+     result = connect(fd, addr, len) == 0;
+     if (!result && errno == EINPROGRESS) {
+          if (poll(&p, 1, YACAD_HTTP_CONNECT_TIMEOUT * 1000) != 1) {
+               errno = ETIMEDOUT;
+          } else if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &n) == 0) {
+               result = error == 0;
+               errno = error;
+          }
+     }
+     fcntl(fd, F_SETFL, flags);
+     return result;
+}
+
+int yacad_http_connect(logger_t log, const char *name) {
+     int result = -1;
+     struct addrinfo *addrs = resolve(log, name, 0), *a;
+     struct timeval timeout = { YACAD_HTTP_TIMEOUT, 0 };
+
+     for (a = addrs; result < 0 && a != NULL; a = a->ai_next) {
+          result = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+          if (result >= 0) {
+               setsockopt(result, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+               setsockopt(result, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+               if (!connect_within(result, a->ai_addr, a->ai_addrlen)) {
+                    close(result);
+                    result = -1;
+               }
+          }
+     }
+     if (addrs != NULL) {
+          if (result < 0) {
+               log(warn, "Could not connect to %s: %s", name, strerror(errno));
+          }
+          freeaddrinfo(addrs);
+     }
+     return result;
+}
+
+int yacad_http_status(int fd) {
+     int result = 0;
+     char line[256];
+     size_t n = 0;
+     ssize_t r = 1;
+     time_t deadline = time(NULL) + YACAD_HTTP_TIMEOUT;
+
+     // byte by byte: the line is short, and what follows is not ours to read; a peer that trickles it is dropped
+     while (r > 0 && n < sizeof(line) - 1 && (n == 0 || line[n - 1] != '\n') && time(NULL) < deadline) {
+          r = read(fd, line + n, 1);
+          if (r > 0) {
+               n++;
+          }
+     }
+     line[n] = '\0';
+     if (sscanf(line, "HTTP/%*d.%*d %d", &result) != 1) {
+          result = 0;
+     }
+     return result;
+}
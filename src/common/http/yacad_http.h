@@ -0,0 +1,38 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __YACAD_HTTP_H__
+#define __YACAD_HTTP_H__
+
+#include "yacad.h"
+
+/* The bare HTTP/1.0 needed by the artifacts transfers: one request per
+ * connection. The names are "host:port"; "*" listens on all the
+ * interfaces. */
+
+#define YACAD_HTTP_TIMEOUT 60 // seconds without progress before a transfer fails
+#define YACAD_HTTP_CONNECT_TIMEOUT 10 // seconds before a connection attempt fails
+
+/* A non-blocking listening socket; -1 on error */
+int yacad_http_listen(logger_t log, const char *name);
+
+/* A blocking connected socket, with connect, send and receive timeouts; -1 on error */
+int yacad_http_connect(logger_t log, const char *name);
+
+/* Reads the status line of the response, within YACAD_HTTP_TIMEOUT; 0 on error */
+int yacad_http_status(int fd);
+
+#endif /* __YACAD_HTTP_H__ */
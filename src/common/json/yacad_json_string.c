@@ -0,0 +1,32 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "yacad_json_string.h"
+
+char *yacad_json_string(const char *value) {
+     char *result;
+     json_string_t *jvalue = json_new_string(stdlib_memory);
+     json_output_stream_t *out = new_json_output_stream_from_string(&result, stdlib_memory);
+     json_visitor_t *writer = json_write_to(out, stdlib_memory, 0);
+
+     jvalue->add_string(jvalue, "%s", value);
+     jvalue->accept(jvalue, writer);
+
+     writer->free(writer);
+     out->free(out);
+     jvalue->accept(jvalue, json_kill());
+     return result;
+}
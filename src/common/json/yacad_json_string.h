@@ -0,0 +1,25 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __YACAD_JSON_STRING_H__
+#define __YACAD_JSON_STRING_H__
+
+#include "yacad.h"
+
+/* The value as a JSON string: quoted and escaped by the json writer. To be freed. */
+char *yacad_json_string(const char *value);
+
+#endif /* __YACAD_JSON_STRING_H__ */
@@ -0,0 +1,168 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "yacad_locality.h"
+#include "common/json/yacad_json_finder.h"
+#include "common/json/yacad_json_string.h"
+
+typedef struct yacad_locality_impl_s {
+     yacad_locality_t fn;
+     cad_array_t *workspaces; // char*
+     cad_array_t *artifacts; // char*, oldest first
+} yacad_locality_impl_t;
+
+static int find(cad_array_t *strings, const char *string) {
+     int result = -1, i, n = strings->count(strings);
+     for (i = 0; result < 0 && i < n; i++) {
+          if (!strcmp(*(char**)strings->get(strings, i), string)) {
+               result = i;
+          }
+     }
+     return result;
+}
+
+static void add_workspace(yacad_locality_impl_t *this, const char *project_name) {
+     char *name;
+     if (find(this->workspaces, project_name) < 0) {
+          name = strdup(project_name);
+          this->workspaces->insert(this->workspaces, this->workspaces->count(this->workspaces), &name);
+     }
+}
+
+static void add_artifact(yacad_locality_impl_t *this, const char *hash) {
+     int i = find(this->artifacts, hash);
+     char *h;
+
+     // the most recent last
+     if (i >= 0) {
+          h = *(char**)this->artifacts->get(this->artifacts, i);
+          this->artifacts->del(this->artifacts, i);
+     } else {
+          h = strdup(hash);
+          if (this->artifacts->count(this->artifacts) == YACAD_LOCALITY_ARTIFACTS) {
+               free(*(char**)this->artifacts->get(this->artifacts, 0));
+               this->artifacts->del(this->artifacts, 0);
+          }
+     }
+     this->artifacts->insert(this->artifacts, this->artifacts->count(this->artifacts), &h);
+}
+
+static bool_t has_workspace(yacad_locality_impl_t *this, const char *project_name) {
+     return find(this->workspaces, project_name) >= 0;
+}
+
+static bool_t has_artifact(yacad_locality_impl_t *this, const char *hash) {
+     return find(this->artifacts, hash) >= 0;
+}
+
+static void serialize_strings(cad_array_t *strings, FILE *out) {
+     int i, n = strings->count(strings);
+     char *string;
+     for (i = 0; i < n; i++) {
+          string = yacad_json_string(*(char**)strings->get(strings, i));
+          fprintf(out, "%s%s", i == 0 ? "" : ",", string);
+          free(string);
+     }
+}
+
+static char *serialize(yacad_locality_impl_t *this) {
+     char *result = NULL;
+     size_t size = 0;
+     FILE *out = open_memstream(&result, &size);
+
+     fprintf(out, "{\"workspaces\":[");
+     serialize_strings(this->workspaces, out);
+     fprintf(out, "],\"artifacts\":[");
+     serialize_strings(this->artifacts, out);
+     fprintf(out, "]}");
+     fclose(out);
+
+     return result;
+}
+
+static void free_strings(cad_array_t *strings) {
+     int i, n = strings->count(strings);
+     for (i = 0; i < n; i++) {
+          free(*(char**)strings->get(strings, i));
+     }
+     strings->free(strings);
+}
+
+static void free_(yacad_locality_impl_t *this) {
+     free_strings(this->workspaces);
+     free_strings(this->artifacts);
+     free(this);
+}
+
+static yacad_locality_t impl_fn = {
+     .add_workspace = (yacad_locality_add_workspace_fn)add_workspace,
+     .add_artifact = (yacad_locality_add_artifact_fn)add_artifact,
+     .has_workspace = (yacad_locality_has_workspace_fn)has_workspace,
+     .has_artifact = (yacad_locality_has_artifact_fn)has_artifact,
+     .serialize = (yacad_locality_serialize_fn)serialize,
+     .free = (yacad_locality_free_fn)free_,
+};
+
+yacad_locality_t *yacad_locality_new(void) {
+     yacad_locality_impl_t *result = malloc(sizeof(yacad_locality_impl_t));
+
+     result->fn = impl_fn;
+     result->workspaces = cad_new_array(stdlib_memory, sizeof(char*));
+     result->artifacts = cad_new_array(stdlib_memory, sizeof(char*));
+
+     return I(result);
+}
+
+static void unserialize_strings(logger_t log, json_value_t *desc, const char *key, yacad_locality_t *locality, bool_t workspaces) {
+     yacad_json_finder_t *a = yacad_json_finder_new(log, json_type_array, "%s");
+     yacad_json_finder_t *s = yacad_json_finder_new(log, json_type_string, "%s/%d");
+     json_array_t *jarray;
+     json_string_t *jstring;
+     char *string;
+     int i, n;
+     size_t c;
+
+     a->visit(a, desc, key);
+     jarray = a->get_array(a);
+     n = jarray == NULL ? 0 : jarray->count(jarray);
+     for (i = 0; i < n; i++) {
+          s->visit(s, desc, key, i);
+          jstring = s->get_string(s);
+          if (jstring != NULL) {
+               c = jstring->utf8(jstring, "", 0) + 1;
+               string = malloc(c);
+               jstring->utf8(jstring, string, c);
+               if (workspaces) {
+                    locality->add_workspace(locality, string);
+               } else {
+                    locality->add_artifact(locality, string);
+               }
+               free(string);
+          }
+     }
+
+     I(s)->free(I(s));
+     I(a)->free(I(a));
+}
+
+yacad_locality_t *yacad_locality_unserialize(logger_t log, json_value_t *desc) {
+     yacad_locality_t *result = yacad_locality_new();
+
+     unserialize_strings(log, desc, "workspaces", result, true);
+     unserialize_strings(log, desc, "artifacts", result, false);
+
+     return result;
+}
@@ -0,0 +1,51 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __YACAD_LOCALITY_H__
+#define __YACAD_LOCALITY_H__
+
+#include "yacad.h"
+
+/**
+ * What a runner holds locally: the project workspaces, and the hashes
+ * of the artifacts it published last. Sent with each task query, so
+ * that the Core prefers the tasks that can reuse them.
+ */
+
+#define YACAD_LOCALITY_ARTIFACTS 256 // the most recent hashes only
+
+typedef struct yacad_locality_s yacad_locality_t;
+
+typedef void (*yacad_locality_add_workspace_fn)(yacad_locality_t *this, const char *project_name);
+typedef void (*yacad_locality_add_artifact_fn)(yacad_locality_t *this, const char *hash);
+typedef bool_t (*yacad_locality_has_workspace_fn)(yacad_locality_t *this, const char *project_name);
+typedef bool_t (*yacad_locality_has_artifact_fn)(yacad_locality_t *this, const char *hash);
+typedef char *(*yacad_locality_serialize_fn)(yacad_locality_t *this);
+typedef void (*yacad_locality_free_fn)(yacad_locality_t *this);
+
+struct yacad_locality_s {
+     yacad_locality_add_workspace_fn add_workspace;
+     yacad_locality_add_artifact_fn add_artifact;
+     yacad_locality_has_workspace_fn has_workspace;
+     yacad_locality_has_artifact_fn has_artifact;
+     yacad_locality_serialize_fn serialize;
+     yacad_locality_free_fn free;
+};
+
+yacad_locality_t *yacad_locality_new(void);
+yacad_locality_t *yacad_locality_unserialize(logger_t log, json_value_t *desc);
+
+#endif /* __YACAD_LOCALITY_H__ */
@@ -19,6 +19,8 @@
 #include "yacad_message_reply_get_task.h"
 #include "yacad_message_query_set_result.h"
 #include "yacad_message_reply_set_result.h"
+#include "yacad_message_query_list_tasks.h"
+#include "yacad_message_reply_list_tasks.h"
 #include "common/json/yacad_json_finder.h"
 
 yacad_message_t *yacad_message_unserialize(logger_t log, const char *serial, cad_hash_t *env) {
@@ -45,6 +47,10 @@ yacad_message_t *yacad_message_unserialize(logger_t log, const char *serial, cad
           result = (yacad_message_t *)yacad_message_query_set_result_unserialize(log, jserial, env);
      } else if (!strcmp(type, "reply_set_result")) {
           result = (yacad_message_t *)yacad_message_reply_set_result_unserialize(log, jserial, env);
+     } else if (!strcmp(type, "query_list_tasks")) {
+          result = (yacad_message_t *)yacad_message_query_list_tasks_unserialize(log, jserial, env);
+     } else if (!strcmp(type, "reply_list_tasks")) {
+          result = (yacad_message_t *)yacad_message_reply_list_tasks_unserialize(log, jserial, env);
      } else {
           log(warn, "Invalid message: %s", serial);
      }
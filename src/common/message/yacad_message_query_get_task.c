@@ -21,6 +21,7 @@
 typedef struct yacad_message_query_get_task_impl_s {
      yacad_message_query_get_task_t fn;
      yacad_runnerid_t *runnerid;
+     yacad_locality_t *locality;
 } yacad_message_query_get_task_impl_t;
 
 static void accept(yacad_message_query_get_task_impl_t *this, yacad_message_visitor_t *visitor) {
@@ -30,14 +31,19 @@ static void accept(yacad_message_query_get_task_impl_t *this, yacad_message_visi
 static char *serialize(yacad_message_query_get_task_impl_t *this) {
      char *result = NULL;
      const char *runnerid = this->runnerid->serialize(this->runnerid);
-     int n = snprintf("", 0, "{\"type\":\"query_get_task\",\"runner\":%s}", runnerid) + 1;
+     char *locality = this->locality == NULL ? strdup("{}") : this->locality->serialize(this->locality);
+     int n = snprintf("", 0, "{\"type\":\"query_get_task\",\"runner\":%s,\"locality\":%s}", runnerid, locality) + 1;
      result = malloc(n);
-     snprintf(result, n, "{\"type\":\"query_get_task\",\"runner\":%s}", runnerid);
+     snprintf(result, n, "{\"type\":\"query_get_task\",\"runner\":%s,\"locality\":%s}", runnerid, locality);
+     free(locality);
      return result;
 }
 
 static void free_(yacad_message_query_get_task_impl_t *this) {
      this->runnerid->free(this->runnerid);
+     if (this->locality != NULL) {
+          this->locality->free(this->locality);
+     }
      free(this);
 }
 
@@ -45,6 +51,10 @@ static yacad_runnerid_t *get_runnerid(yacad_message_query_get_task_impl_t *this)
      return this->runnerid;
 }
 
+static yacad_locality_t *get_locality(yacad_message_query_get_task_impl_t *this) {
+     return this->locality;
+}
+
 static yacad_message_query_get_task_t impl_fn = {
      .fn = {
           .accept = (yacad_message_accept_fn)accept,
@@ -52,23 +62,48 @@ static yacad_message_query_get_task_t impl_fn = {
           .free = (yacad_message_free_fn)free_,
      },
      .get_runnerid = (yacad_message_query_get_task_get_runnerid_fn)get_runnerid,
+     .get_locality = (yacad_message_query_get_task_get_locality_fn)get_locality,
 };
 
-yacad_message_query_get_task_t *yacad_message_query_get_task_new(logger_t log, yacad_runnerid_t *runnerid) {
+yacad_message_query_get_task_t *yacad_message_query_get_task_new(logger_t log, yacad_runnerid_t *runnerid, yacad_locality_t *locality) {
      yacad_message_query_get_task_impl_t *result = malloc(sizeof(yacad_message_query_get_task_impl_t));
+     json_input_stream_t *in;
+     json_value_t *jlocality;
+     char *serial;
+
      result->fn = impl_fn;
      result->runnerid = yacad_runnerid_unserialize(log, (char*)runnerid->serialize(runnerid));
+     result->locality = NULL;
+     if (locality != NULL) {
+          serial = locality->serialize(locality);
+          in = new_json_input_stream_from_string(serial, stdlib_memory);
+          jlocality = json_parse(in, NULL, stdlib_memory);
+          if (jlocality != NULL) {
+               result->locality = yacad_locality_unserialize(log, jlocality);
+               jlocality->free(jlocality);
+          }
+          in->free(in);
+          free(serial);
+     }
      return I(result);
 }
 
 yacad_message_query_get_task_t *yacad_message_query_get_task_unserialize(logger_t log, json_value_t *jserial, cad_hash_t *env) {
      yacad_message_query_get_task_impl_t *result = malloc(sizeof(yacad_message_query_get_task_impl_t));
      yacad_json_finder_t *v = yacad_json_finder_new(log, json_type_object, "runner");
+     yacad_json_finder_t *l = yacad_json_finder_new(log, json_type_object, "locality");
+     json_value_t *jlocality;
 
      v->visit(v, jserial);
      result->fn = impl_fn;
      result->runnerid = yacad_runnerid_new(log, v->get_value(v));
 
+     // optional: older runners do not send it
+     l->visit(l, jserial);
+     jlocality = l->get_value(l);
+     result->locality = jlocality == NULL ? NULL : yacad_locality_unserialize(log, jlocality);
+
+     I(l)->free(I(l));
      I(v)->free(I(v));
      return I(result);
 }
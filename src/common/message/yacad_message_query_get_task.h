@@ -19,17 +19,20 @@
 
 #include "yacad_message.h"
 #include "common/runnerid/yacad_runnerid.h"
+#include "common/locality/yacad_locality.h"
 
 typedef struct yacad_message_query_get_task_s yacad_message_query_get_task_t;
 
 typedef yacad_runnerid_t *(*yacad_message_query_get_task_get_runnerid_fn)(yacad_message_query_get_task_t *this);
+typedef yacad_locality_t *(*yacad_message_query_get_task_get_locality_fn)(yacad_message_query_get_task_t *this); // may be NULL
 
 struct yacad_message_query_get_task_s {
      yacad_message_t fn;
      yacad_message_query_get_task_get_runnerid_fn get_runnerid;
+     yacad_message_query_get_task_get_locality_fn get_locality;
 };
 
-yacad_message_query_get_task_t *yacad_message_query_get_task_new(logger_t log, yacad_runnerid_t *runnerid);
+yacad_message_query_get_task_t *yacad_message_query_get_task_new(logger_t log, yacad_runnerid_t *runnerid, yacad_locality_t *locality);
 yacad_message_query_get_task_t *yacad_message_query_get_task_unserialize(logger_t log, json_value_t *jserial, cad_hash_t *env);
 
 #endif /* __YACAD_MESSAGE_QUERY_GET_TASK_H__ */
@@ -0,0 +1,125 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "yacad_message_query_list_tasks.h"
+#include "yacad_message_visitor.h"
+#include "common/json/yacad_json_finder.h"
+#include "common/json/yacad_json_string.h"
+
+typedef struct yacad_message_query_list_tasks_impl_s {
+     yacad_message_query_list_tasks_t fn;
+     yacad_task_filter_t filter;
+     char *project;
+} yacad_message_query_list_tasks_impl_t;
+
+static void accept(yacad_message_query_list_tasks_impl_t *this, yacad_message_visitor_t *visitor) {
+     visitor->visit_query_list_tasks(visitor, I(this));
+}
+
+static const yacad_task_filter_t *get_filter(yacad_message_query_list_tasks_impl_t *this) {
+     return &(this->filter);
+}
+
+static char *serialize(yacad_message_query_list_tasks_impl_t *this) {
+     char *result = NULL;
+     char *project = "", *jproject, status[32] = "";
+     int n;
+
+     if (this->project != NULL) {
+          jproject = yacad_json_string(this->project);
+          n = snprintf("", 0, ",\"project\":%s", jproject) + 1;
+          project = alloca(n);
+          snprintf(project, n, ",\"project\":%s", jproject);
+          free(jproject);
+     }
+     if (this->filter.by_status) {
+          snprintf(status, 32, ",\"status\":%d", (int)this->filter.status);
+     }
+
+     n = snprintf("", 0, "{\"type\":\"query_list_tasks\"%s%s,\"since\":%ld,\"until\":%ld,\"before\":%lu,\"limit\":%d}",
+                  project, status, (long)this->filter.since, (long)this->filter.until, this->filter.before, this->filter.limit) + 1;
+     result = malloc(n);
+     snprintf(result, n, "{\"type\":\"query_list_tasks\"%s%s,\"since\":%ld,\"until\":%ld,\"before\":%lu,\"limit\":%d}",
+              project, status, (long)this->filter.since, (long)this->filter.until, this->filter.before, this->filter.limit);
+
+     return result;
+}
+
+static void free_(yacad_message_query_list_tasks_impl_t *this) {
+     free(this->project);
+     free(this);
+}
+
+static yacad_message_query_list_tasks_t impl_fn = {
+     .fn = {
+          .accept = (yacad_message_accept_fn)accept,
+          .serialize = (yacad_message_serialize_fn)serialize,
+          .free = (yacad_message_free_fn)free_,
+     },
+     .get_filter = (yacad_message_query_list_tasks_get_filter_fn)get_filter,
+};
+
+yacad_message_query_list_tasks_t *yacad_message_query_list_tasks_new(logger_t log, const yacad_task_filter_t *filter) {
+     yacad_message_query_list_tasks_impl_t *result = malloc(sizeof(yacad_message_query_list_tasks_impl_t));
+
+     result->fn = impl_fn;
+     result->filter = *filter;
+     result->project = filter->project == NULL ? NULL : strdup(filter->project);
+     result->filter.project = result->project;
+
+     return I(result);
+}
+
+static long get_long(yacad_json_finder_t *v, json_value_t *jserial, const char *key, long defval) {
+     json_number_t *jnumber;
+     v->visit(v, jserial, key);
+     jnumber = v->get_number(v);
+     return jnumber == NULL ? defval : (long)jnumber->to_int(jnumber);
+}
+
+yacad_message_query_list_tasks_t *yacad_message_query_list_tasks_unserialize(logger_t log, json_value_t *jserial, cad_hash_t *env) {
+     yacad_message_query_list_tasks_impl_t *result = malloc(sizeof(yacad_message_query_list_tasks_impl_t));
+     yacad_json_finder_t *v = yacad_json_finder_new(log, json_type_number, "%s");
+     yacad_json_finder_t *s = yacad_json_finder_new(log, json_type_string, "%s");
+     json_string_t *jproject;
+     json_number_t *jstatus;
+     size_t n;
+
+     result->fn = impl_fn;
+     result->project = NULL;
+
+     s->visit(s, jserial, "project");
+     jproject = s->get_string(s);
+     if (jproject != NULL) {
+          n = jproject->utf8(jproject, "", 0) + 1;
+          result->project = malloc(n);
+          jproject->utf8(jproject, result->project, n);
+     }
+     result->filter.project = result->project;
+
+     v->visit(v, jserial, "status");
+     jstatus = v->get_number(v);
+     result->filter.by_status = jstatus != NULL;
+     result->filter.status = jstatus == NULL ? task_new : (yacad_task_status_t)jstatus->to_int(jstatus);
+
+     result->filter.since = (time_t)get_long(v, jserial, "since", 0);
+     result->filter.until = (time_t)get_long(v, jserial, "until", 0);
+     result->filter.before = (unsigned long)get_long(v, jserial, "before", 0);
+     result->filter.limit = (int)get_long(v, jserial, "limit", 0);
+
+     I(s)->free(I(s));
+     I(v)->free(I(v));
+     return I(result);
+}
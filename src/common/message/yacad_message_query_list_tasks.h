@@ -0,0 +1,45 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __YACAD_MESSAGE_QUERY_LIST_TASKS_H__
+#define __YACAD_MESSAGE_QUERY_LIST_TASKS_H__
+
+#include "yacad_message.h"
+#include "common/task/yacad_task.h"
+
+/* Tasks are listed newest first, one page at a time. */
+typedef struct {
+     const char *project;        // NULL for all the projects
+     bool_t by_status;
+     yacad_task_status_t status; // only if by_status
+     time_t since;               // 0 for no lower bound on the task timestamp
+     time_t until;               // 0 for no upper bound (excluded)
+     unsigned long before;       // only the tasks with a lower id (the "next" of the previous page); 0 for the first page
+     int limit;                  // page size; 0 for the default
+} yacad_task_filter_t;
+
+typedef struct yacad_message_query_list_tasks_s yacad_message_query_list_tasks_t;
+
+typedef const yacad_task_filter_t *(*yacad_message_query_list_tasks_get_filter_fn)(yacad_message_query_list_tasks_t *this);
+
+struct yacad_message_query_list_tasks_s {
+     yacad_message_t fn;
+     yacad_message_query_list_tasks_get_filter_fn get_filter;
+};
+
+yacad_message_query_list_tasks_t *yacad_message_query_list_tasks_new(logger_t log, const yacad_task_filter_t *filter);
+yacad_message_query_list_tasks_t *yacad_message_query_list_tasks_unserialize(logger_t log, json_value_t *jserial, cad_hash_t *env);
+
+#endif /* __YACAD_MESSAGE_QUERY_LIST_TASKS_H__ */
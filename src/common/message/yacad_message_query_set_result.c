@@ -50,9 +50,9 @@ static char *serialize(yacad_message_query_set_result_impl_t *this) {
      const char * success = this->success ? "true" : "false";
      int n;
 
-     n = snprintf("", 0, "{\"type\":\"query_set_result\",\"runner\":%s,\"task\":%s,\"success\":%s", runnerid, task, success) + 1;
+     n = snprintf("", 0, "{\"type\":\"query_set_result\",\"runner\":%s,\"task\":%s,\"success\":%s}", runnerid, task, success) + 1;
      result = malloc(n);
-     snprintf(result, n, "{\"type\":\"query_set_result\",\"runner\":%s,\"task\":%s,\"success\":%s", runnerid, task, success);
+     snprintf(result, n, "{\"type\":\"query_set_result\",\"runner\":%s,\"task\":%s,\"success\":%s}", runnerid, task, success);
 
      free(task);
 
@@ -68,8 +68,12 @@ static char *serialize(yacad_message_reply_get_task_impl_t *this) {
 static void free_(yacad_message_reply_get_task_impl_t *this) {
      if (this->serial != NULL) {
           this->runnerid->free(this->runnerid);
-          this->scm->free(this->scm);
-          this->task->free(this->task);
+          if (this->scm != NULL) {
+               this->scm->free(this->scm);
+          }
+          if (this->task != NULL) {
+               this->task->free(this->task);
+          }
           this->serial->accept(this->serial, json_kill());
      }
      free(this);
@@ -124,14 +128,18 @@ yacad_message_reply_get_task_t *yacad_message_reply_get_task_unserialize(logger_
      result->serial = t->resolve(t, jserial);
      v->visit(v, result->serial, "runner");
      result->runnerid = yacad_runnerid_new(log, v->get_value(v));
+     // no scm nor task when the Core has no task for the runner
      v->visit(v, result->serial, "scm");
-     result->scm = yacad_scm_new(log, v->get_value(v), root_path);
+     result->scm = v->get_value(v) == NULL ? NULL : yacad_scm_new(log, v->get_value(v), root_path);
      v->visit(v, result->serial, "task");
      task = v->get_value(v);
 
-     task->accept(task, wtask);
-
-     result->task = yacad_task_unserialize(log, stask);
+     if (task == NULL) {
+          result->task = NULL;
+     } else {
+          task->accept(task, wtask);
+          result->task = yacad_task_unserialize(log, stask);
+     }
 
      wtask->free(wtask);
      out_task->free(out_task);
@@ -0,0 +1,168 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "yacad_message_reply_list_tasks.h"
+#include "yacad_message_visitor.h"
+#include "common/json/yacad_json_finder.h"
+#include "common/json/yacad_json_string.h"
+
+#define TASK_FORMAT "{\"id\":%lu,\"status\":%d,\"project\":%s,\"timestamp\":%ld,\"dispatched\":%ld,\"eta\":%ld,\"finished\":%ld}"
+
+typedef struct yacad_message_reply_list_tasks_impl_s {
+     yacad_message_reply_list_tasks_t fn;
+     cad_array_t *tasks; // yacad_task_summary_t, the project names are owned
+     unsigned long next;
+} yacad_message_reply_list_tasks_impl_t;
+
+static void accept(yacad_message_reply_list_tasks_impl_t *this, yacad_message_visitor_t *visitor) {
+     visitor->visit_reply_list_tasks(visitor, I(this));
+}
+
+static int count(yacad_message_reply_list_tasks_impl_t *this) {
+     return this->tasks->count(this->tasks);
+}
+
+static const yacad_task_summary_t *get(yacad_message_reply_list_tasks_impl_t *this, int index) {
+     return this->tasks->get(this->tasks, index);
+}
+
+static void add(yacad_message_reply_list_tasks_impl_t *this, const yacad_task_summary_t *task) {
+     yacad_task_summary_t summary = *task;
+     summary.project = strdup(task->project == NULL ? "" : task->project);
+     this->tasks->insert(this->tasks, this->tasks->count(this->tasks), &summary);
+}
+
+static unsigned long get_next(yacad_message_reply_list_tasks_impl_t *this) {
+     return this->next;
+}
+
+static void set_next(yacad_message_reply_list_tasks_impl_t *this, unsigned long next) {
+     this->next = next;
+}
+
+static char *serialize(yacad_message_reply_list_tasks_impl_t *this) {
+     char *result;
+     int i, n = this->tasks->count(this->tasks);
+     size_t len, size = 64;
+     yacad_task_summary_t *task;
+     char **projects = malloc((n + 1) * sizeof(char*));
+
+     for (i = 0; i < n; i++) {
+          task = this->tasks->get(this->tasks, i);
+          projects[i] = yacad_json_string(task->project);
+          size += snprintf("", 0, "," TASK_FORMAT, task->id, (int)task->status, projects[i],
+                           (long)task->timestamp, (long)task->dispatched, (long)task->eta, (long)task->finished);
+     }
+
+     result = malloc(size);
+     len = snprintf(result, size, "{\"type\":\"reply_list_tasks\",\"next\":%lu,\"tasks\":[", this->next);
+     for (i = 0; i < n; i++) {
+          task = this->tasks->get(this->tasks, i);
+          len += snprintf(result + len, size - len, "%s" TASK_FORMAT, i == 0 ? "" : ",", task->id, (int)task->status, projects[i],
+                          (long)task->timestamp, (long)task->dispatched, (long)task->eta, (long)task->finished);
+          free(projects[i]);
+     }
+     snprintf(result + len, size - len, "]}");
+     free(projects);
+
+     return result;
+}
+
+static void free_(yacad_message_reply_list_tasks_impl_t *this) {
+     int i, n = this->tasks->count(this->tasks);
+     yacad_task_summary_t *task;
+     for (i = 0; i < n; i++) {
+          task = this->tasks->get(this->tasks, i);
+          free((char*)task->project);
+     }
+     this->tasks->free(this->tasks);
+     free(this);
+}
+
+static yacad_message_reply_list_tasks_t impl_fn = {
+     .fn = {
+          .accept = (yacad_message_accept_fn)accept,
+          .serialize = (yacad_message_serialize_fn)serialize,
+          .free = (yacad_message_free_fn)free_,
+     },
+     .count = (yacad_message_reply_list_tasks_count_fn)count,
+     .get = (yacad_message_reply_list_tasks_get_fn)get,
+     .add = (yacad_message_reply_list_tasks_add_fn)add,
+     .get_next = (yacad_message_reply_list_tasks_get_next_fn)get_next,
+     .set_next = (yacad_message_reply_list_tasks_set_next_fn)set_next,
+};
+
+yacad_message_reply_list_tasks_t *yacad_message_reply_list_tasks_new(logger_t log) {
+     yacad_message_reply_list_tasks_impl_t *result = malloc(sizeof(yacad_message_reply_list_tasks_impl_t));
+
+     result->fn = impl_fn;
+     result->tasks = cad_new_array(stdlib_memory, sizeof(yacad_task_summary_t));
+     result->next = 0;
+
+     return I(result);
+}
+
+static long get_long(yacad_json_finder_t *v, json_value_t *jvalue, const char *key) {
+     json_number_t *jnumber;
+     v->visit(v, jvalue, key);
+     jnumber = v->get_number(v);
+     return jnumber == NULL ? 0 : (long)jnumber->to_int(jnumber);
+}
+
+yacad_message_reply_list_tasks_t *yacad_message_reply_list_tasks_unserialize(logger_t log, json_value_t *jserial, cad_hash_t *env) {
+     yacad_message_reply_list_tasks_impl_t *result = (yacad_message_reply_list_tasks_impl_t *)yacad_message_reply_list_tasks_new(log);
+     yacad_json_finder_t *a = yacad_json_finder_new(log, json_type_array, "%s");
+     yacad_json_finder_t *v = yacad_json_finder_new(log, json_type_number, "%s");
+     yacad_json_finder_t *s = yacad_json_finder_new(log, json_type_string, "%s");
+     json_array_t *jtasks;
+     json_value_t *jtask;
+     json_string_t *jproject;
+     yacad_task_summary_t task;
+     char *project;
+     size_t n;
+     int i;
+
+     result->next = (unsigned long)get_long(v, jserial, "next");
+
+     a->visit(a, jserial, "tasks");
+     jtasks = a->get_array(a);
+     if (jtasks != NULL) {
+          for (i = 0; i < jtasks->count(jtasks); i++) {
+               jtask = jtasks->get(jtasks, i);
+               task.id = (unsigned long)get_long(v, jtask, "id");
+               task.status = (yacad_task_status_t)get_long(v, jtask, "status");
+               task.timestamp = (time_t)get_long(v, jtask, "timestamp");
+               task.dispatched = (time_t)get_long(v, jtask, "dispatched");
+               task.eta = (time_t)get_long(v, jtask, "eta");
+               task.finished = (time_t)get_long(v, jtask, "finished");
+               s->visit(s, jtask, "project");
+               jproject = s->get_string(s);
+               project = NULL;
+               if (jproject != NULL) {
+                    n = jproject->utf8(jproject, "", 0) + 1;
+                    project = malloc(n);
+                    jproject->utf8(jproject, project, n);
+               }
+               task.project = project;
+               I(result)->add(I(result), &task);
+               free(project);
+          }
+     }
+
+     I(s)->free(I(s));
+     I(v)->free(I(v));
+     I(a)->free(I(a));
+     return I(result);
+}
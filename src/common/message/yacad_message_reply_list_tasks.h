@@ -0,0 +1,53 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __YACAD_MESSAGE_REPLY_LIST_TASKS_H__
+#define __YACAD_MESSAGE_REPLY_LIST_TASKS_H__
+
+#include "yacad_message.h"
+#include "common/task/yacad_task.h"
+
+typedef struct {
+     unsigned long id;
+     yacad_task_status_t status;
+     const char *project;
+     time_t timestamp;
+     time_t dispatched; // 0 if not dispatched yet
+     time_t eta;        // expected end of a dispatched task, 0 if unknown
+     time_t finished;   // 0 if not finished yet
+} yacad_task_summary_t;
+
+typedef struct yacad_message_reply_list_tasks_s yacad_message_reply_list_tasks_t;
+
+typedef int (*yacad_message_reply_list_tasks_count_fn)(yacad_message_reply_list_tasks_t *this);
+typedef const yacad_task_summary_t *(*yacad_message_reply_list_tasks_get_fn)(yacad_message_reply_list_tasks_t *this, int index);
+typedef void (*yacad_message_reply_list_tasks_add_fn)(yacad_message_reply_list_tasks_t *this, const yacad_task_summary_t *task);
+/* the "before" of the next page, 0 if this is the last page */
+typedef unsigned long (*yacad_message_reply_list_tasks_get_next_fn)(yacad_message_reply_list_tasks_t *this);
+typedef void (*yacad_message_reply_list_tasks_set_next_fn)(yacad_message_reply_list_tasks_t *this, unsigned long next);
+
+struct yacad_message_reply_list_tasks_s {
+     yacad_message_t fn;
+     yacad_message_reply_list_tasks_count_fn count;
+     yacad_message_reply_list_tasks_get_fn get;
+     yacad_message_reply_list_tasks_add_fn add;
+     yacad_message_reply_list_tasks_get_next_fn get_next;
+     yacad_message_reply_list_tasks_set_next_fn set_next;
+};
+
+yacad_message_reply_list_tasks_t *yacad_message_reply_list_tasks_new(logger_t log);
+yacad_message_reply_list_tasks_t *yacad_message_reply_list_tasks_unserialize(logger_t log, json_value_t *jserial, cad_hash_t *env);
+
+#endif /* __YACAD_MESSAGE_REPLY_LIST_TASKS_H__ */
@@ -23,17 +23,23 @@
 #include "yacad_message_reply_get_task.h"
 #include "yacad_message_query_set_result.h"
 #include "yacad_message_reply_set_result.h"
+#include "yacad_message_query_list_tasks.h"
+#include "yacad_message_reply_list_tasks.h"
 
 typedef void (*yacad_message_visitor_visit_query_get_task_fn)(yacad_message_visitor_t *this, yacad_message_query_get_task_t *message);
 typedef void (*yacad_message_visitor_visit_reply_get_task_fn)(yacad_message_visitor_t *this, yacad_message_reply_get_task_t *message);
 typedef void (*yacad_message_visitor_visit_query_set_result_fn)(yacad_message_visitor_t *this, yacad_message_query_set_result_t *message);
 typedef void (*yacad_message_visitor_visit_reply_set_result_fn)(yacad_message_visitor_t *this, yacad_message_reply_set_result_t *message);
+typedef void (*yacad_message_visitor_visit_query_list_tasks_fn)(yacad_message_visitor_t *this, yacad_message_query_list_tasks_t *message);
+typedef void (*yacad_message_visitor_visit_reply_list_tasks_fn)(yacad_message_visitor_t *this, yacad_message_reply_list_tasks_t *message);
 
 struct yacad_message_visitor_s {
      yacad_message_visitor_visit_query_get_task_fn visit_query_get_task;
      yacad_message_visitor_visit_reply_get_task_fn visit_reply_get_task;
      yacad_message_visitor_visit_query_set_result_fn visit_query_set_result;
      yacad_message_visitor_visit_reply_set_result_fn visit_reply_set_result;
+     yacad_message_visitor_visit_query_list_tasks_fn visit_query_list_tasks;
+     yacad_message_visitor_visit_reply_list_tasks_fn visit_reply_list_tasks;
 };
 
 #endif /* __YACAD_MESSAGE_VISITOR_H__ */
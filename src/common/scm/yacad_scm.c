@@ -15,6 +15,7 @@
 */
 
 #include "yacad_scm.h"
+#include "yacad_scm_custom.h"
 #include "yacad_scm_git.h"
 #include "common/json/yacad_json_finder.h"
 
@@ -35,6 +36,8 @@ yacad_scm_t *yacad_scm_new(logger_t log, json_value_t *desc, const char *root_pa
           n = jtype->utf8(jtype, type, n);
           if (!strncmp("git", type, n)) {
                result = yacad_scm_git_new(log, root_path, desc);
+          } else if (!strncmp("custom", type, n)) {
+               result = yacad_scm_custom_new(log, root_path, desc);
           } else {
                log(warn, "scm type not supported: %s", type);
           }
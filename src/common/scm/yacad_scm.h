@@ -21,15 +21,25 @@
 
 typedef struct yacad_scm_s yacad_scm_t;
 
-typedef bool_t (*yacad_scm_check_fn)(yacad_scm_t *this);
-typedef void (*yacad_scm_fill_env_fn)(yacad_scm_t *this, cad_hash_t *env);
+/* called for each tracked ref that changed since its last build; env holds "ref" (the oid),
+ * "branch" and "refname" (the tracked name) */
+typedef void (*yacad_scm_on_change_fn)(cad_hash_t *env, void *data);
+
+/* returns the number of changed refs */
+typedef int (*yacad_scm_check_fn)(yacad_scm_t *this, yacad_scm_on_change_fn on_change, void *data);
+/* sets the oid of the last build of a tracked ref, e.g. restored from the database */
+typedef void (*yacad_scm_set_built_fn)(yacad_scm_t *this, const char *refname, const char *oid);
 typedef json_value_t *(*yacad_scm_get_desc_fn)(yacad_scm_t *this);
+/* the shell commands that check the ref out in dir, fetching from <mirrors_url>/... if not NULL, else from the upstream;
+ * NULL if the scm does not prepare workspaces */
+typedef char *(*yacad_scm_get_checkout_fn)(yacad_scm_t *this, const char *ref, const char *dir, const char *mirrors_url);
 typedef void (*yacad_scm_free_fn)(yacad_scm_t *this);
 
 struct yacad_scm_s {
      yacad_scm_check_fn check;
-     yacad_scm_fill_env_fn fill_env;
+     yacad_scm_set_built_fn set_built;
      yacad_scm_get_desc_fn get_desc;
+     yacad_scm_get_checkout_fn get_checkout;
      yacad_scm_free_fn free;
 };
 
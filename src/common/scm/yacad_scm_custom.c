@@ -1,113 +1,433 @@
-#if 0
-/* TODO -- DEAD CODE -- to refactor */
-
-yacad_task_t *new_task(char *buffer) {
-     char *project_name;
-     char *runner_name;
-     char *action;
-     char *junk;
-     if (buffer[0] == '\0') {
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+
+#include "yacad_scm_custom.h"
+#include "common/json/yacad_json_finder.h"
+
+#define DEFAULT_TIMEOUT 300
+#define READ_SIZE 4096
+/* seconds a helper is given to exit after SIGTERM, before SIGKILL */
+#define STOP_GRACE 5
+
+/* A helper process; the shared ones are also registered in helpers */
+typedef struct {
+     pthread_mutex_t lock; // one request at a time
+     pid_t pid; // 0 if not running
+     int fd; // our end of the helper stdin/stdout socket
+     char *buffer; // what was read but not yet returned
+     size_t length;
+     size_t capacity;
+     unsigned long next_id;
+     int refcount;
+     bool_t shared;
+     char *command; // -> _
+     char _[0];
+} helper_t;
+
+static pthread_mutex_t helpers_lock = PTHREAD_MUTEX_INITIALIZER;
+static cad_hash_t *helpers = NULL; // command -> shared helper_t
+
+typedef struct yacad_scm_custom_s {
+     yacad_scm_t fn;
+     logger_t log;
+     json_value_t *desc;
+     char *sdesc; // the serialized desc
+     helper_t *helper;
+     cad_hash_t *built; // refname -> ref of its last build
+     int timeout; // seconds to wait for a reply
+     char *root_path; // -> _
+     char _[0];
+} yacad_scm_custom_t;
+
+static bool_t helper_start(logger_t log, helper_t *helper) {
+     int sv[2];
+     pid_t pid;
+
+     if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+          log(error, "Could not create the helper socket: %s", strerror(errno));
+          return false;
+     }
+     pid = fork();
+     if (pid < 0) {
+          log(error, "Could not fork the helper: %s", strerror(errno));
+          close(sv[0]);
+          close(sv[1]);
+          return false;
+     }
+     if (pid == 0) {
+          // in the helper; dup2 clears the close-on-exec flag
+          dup2(sv[1], 0);
+          dup2(sv[1], 1);
+          execl("/bin/sh", "sh", "-c", helper->command, (char *)NULL);
+          _exit(127);
+     }
+     close(sv[1]);
+     helper->fd = sv[0];
+     helper->pid = pid;
+     helper->length = 0;
+     log(info, "Started scm helper %d: %s", (int)pid, helper->command);
+     return true;
+}
+
+static void helper_stop(logger_t log, helper_t *helper) {
+     int status;
+     time_t deadline;
+     pid_t pid;
+
+     if (helper->pid != 0) {
+          close(helper->fd);
+          kill(helper->pid, SIGTERM);
+          deadline = time(NULL) + STOP_GRACE;
+          pid = waitpid(helper->pid, &status, WNOHANG);
+          while (pid == 0 && time(NULL) < deadline) {
+               usleep(100000);
+               pid = waitpid(helper->pid, &status, WNOHANG);
+          }
+          if (pid == 0) {
+               log(warn, "scm helper %d ignored SIGTERM, killing it", (int)helper->pid);
+               kill(helper->pid, SIGKILL);
+               waitpid(helper->pid, &status, 0);
+          }
+          log(info, "Stopped scm helper %d: %s", (int)helper->pid, helper->command);
+          helper->pid = 0;
+     }
+}
+
+/* Sends the request line and returns the reply line (to free), or NULL if the helper failed;
+ * a failed helper is stopped, and started again at the next request. */
+static char *helper_request(logger_t log, helper_t *helper, const char *request, int timeout) {
+     char *result = NULL, *eol;
+     size_t n = strlen(request), sent = 0;
+     struct pollfd pfd;
+     ssize_t count;
+
+     if (helper->pid == 0 && !helper_start(log, helper)) {
           return NULL;
      }
-     project_name = buffer;
-     runner_name = strchr(project_name, '\n');
-     if (runner_name == NULL) {
-          runner_name = action = "";
-     } else {
-          *runner_name = '\0';
-          runner_name++;
-          action = strchr(runner_name, '\n');
-          if (action == NULL) {
-               action = "";
-          } else {
-               *action = '\0';
-               action++;
-               junk = strchr(action, '\n');
-               if (junk != NULL) {
-                    *junk = '\0';
+
+     while (sent < n) {
+          // no SIGPIPE if the helper died
+          count = send(helper->fd, request + sent, n - sent, MSG_NOSIGNAL);
+          if (count < 0 && errno != EINTR) {
+               log(warn, "Could not write to scm helper %s: %s", helper->command, strerror(errno));
+               helper_stop(log, helper);
+               return NULL;
+          }
+          if (count > 0) {
+               sent += count;
+          }
+     }
+
+     pfd.fd = helper->fd;
+     pfd.events = POLLIN;
+     while ((eol = memchr(helper->buffer, '\n', helper->length)) == NULL) {
+          if (helper->capacity - helper->length < READ_SIZE) {
+               helper->capacity += READ_SIZE;
+               helper->buffer = realloc(helper->buffer, helper->capacity);
+          }
+          count = poll(&pfd, 1, timeout * 1000);
+          if (count == 0) {
+               log(warn, "Timeout waiting for scm helper %s", helper->command);
+               helper_stop(log, helper);
+               return NULL;
+          }
+          if (count > 0) {
+               count = recv(helper->fd, helper->buffer + helper->length, helper->capacity - helper->length, 0);
+               if (count == 0) {
+                    log(warn, "Scm helper exited: %s", helper->command);
+                    helper_stop(log, helper);
+                    return NULL;
                }
           }
+          if (count < 0 && errno != EINTR) {
+               log(warn, "Could not read from scm helper %s: %s", helper->command, strerror(errno));
+               helper_stop(log, helper);
+               return NULL;
+          }
+          if (count > 0) {
+               helper->length += count;
+          }
      }
-     return yacad_task_new(0, project_name, runner_name, action);
+
+     n = eol - helper->buffer;
+     result = strndup(helper->buffer, n);
+     helper->length -= n + 1;
+     memmove(helper->buffer, eol + 1, helper->length);
+
+     return result;
 }
 
-static char *read_fd(int fd, const char *script) {
-     char *buffer;
-     int i = 0, n;
-     size_t c;
-     bool_t done = false;
+static helper_t *helper_get(const char *command, bool_t shared) {
+     helper_t *result = NULL;
 
-     buffer = malloc(c = 4096);
-     do {
-          if (i == c) {
-               buffer = realloc(buffer, c *= 2);
+     pthread_mutex_lock(&helpers_lock);
+     if (shared) {
+          if (helpers == NULL) {
+               helpers = cad_new_hash(stdlib_memory, cad_hash_strings);
           }
-          n = read(fd, buffer + i, c - i);
-          if (n == 0) {
-               done = true;
-          } else if (n < 0) {
-               fprintf(stderr, "**** %s: error read: %s\n", script, strerror(errno));
-               done = true;
-          } else {
-               i += n;
+          result = helpers->get(helpers, command);
+     }
+     if (result != NULL) {
+          result->refcount++;
+     } else {
+          result = malloc(sizeof(helper_t) + strlen(command) + 1);
+          pthread_mutex_init(&(result->lock), NULL);
+          result->pid = 0;
+          result->fd = -1;
+          result->buffer = NULL;
+          result->length = result->capacity = 0;
+          result->next_id = 1;
+          result->refcount = 1;
+          result->shared = shared;
+          result->command = result->_;
+          strcpy(result->command, command);
+          if (shared) {
+               helpers->set(helpers, command, result);
           }
-     } while (!done);
-     buffer[i] = '\0';
+     }
+     pthread_mutex_unlock(&helpers_lock);
 
-     return buffer;
+     return result;
 }
 
-static yacad_task_t *next_task(yacad_conf_impl_t *this) {
-     yacad_task_t *result = NULL;
-     const char *script = "yacad_scheduler.sh";
-     int res;
-     int pid;
-     int io[2];
-     char *buffer;
+static void helper_release(logger_t log, helper_t *helper) {
+     pthread_mutex_lock(&helpers_lock);
+     if (--helper->refcount == 0) {
+          if (helper->shared) {
+               helpers->del(helpers, helper->command);
+          }
+          helper_stop(log, helper);
+          pthread_mutex_destroy(&(helper->lock));
+          free(helper->buffer);
+          free(helper);
+     }
+     pthread_mutex_unlock(&helpers_lock);
+}
 
-     res = pipe(io);
-     if (res < 0) {
-          fprintf(stderr, "**** pipe(2): %s: %s\n", script, strerror(errno));
-     } else {
-          pid = fork();
+static char *to_string(json_value_t *value) {
+     char *result;
+     json_output_stream_t *out = new_json_output_stream_from_string(&result, stdlib_memory);
+     json_visitor_t *writer = json_write_to(out, stdlib_memory, 0);
 
-          if (pid == 0) {
-               // in script
-               res = close(io[0]);
-               if (res < 0) {
-                    fprintf(stderr, "**** close(2): %s: %s\n", script, strerror(errno));
-                    exit(1);
-               }
-               res = dup2(io[1], 1);
-               if (res < 0) {
-                    fprintf(stderr, "**** dup2(2): %s: %s\n", script, strerror(errno));
-                    exit(1);
+     value->accept(value, writer);
+
+     writer->free(writer);
+     out->free(out);
+     return result;
+}
+
+static void fill_jbuilt(cad_hash_t *built, int index, const char *refname, const char *ref, json_object_t *jbuilt) {
+     json_string_t *jref = json_new_string(stdlib_memory);
+     jref->add_string(jref, "%s", ref);
+     jbuilt->set(jbuilt, refname, (json_value_t *)jref);
+}
+
+static char *check_request(yacad_scm_custom_t *this, unsigned long id) {
+     json_object_t *jbuilt = json_new_object(stdlib_memory);
+     json_string_t *jroot_path = json_new_string(stdlib_memory);
+     char *sbuilt, *sroot_path, *result;
+     size_t n;
+
+     this->built->iterate(this->built, (cad_hash_iterator_fn)fill_jbuilt, jbuilt);
+     sbuilt = to_string((json_value_t *)jbuilt);
+     jroot_path->add_string(jroot_path, "%s", this->root_path);
+     sroot_path = to_string((json_value_t *)jroot_path);
+
+     n = snprintf("", 0, "{\"id\":%lu,\"action\":\"check\",\"root_path\":%s,\"scm\":%s,\"built\":%s}\n", id, sroot_path, this->sdesc, sbuilt) + 1;
+     result = malloc(n);
+     snprintf(result, n, "{\"id\":%lu,\"action\":\"check\",\"root_path\":%s,\"scm\":%s,\"built\":%s}\n", id, sroot_path, this->sdesc, sbuilt);
+
+     jroot_path->accept(jroot_path, json_kill());
+     jbuilt->accept(jbuilt, json_kill());
+     free(sroot_path);
+     free(sbuilt);
+     return result;
+}
+
+static void set_built(yacad_scm_custom_t *this, const char *refname, const char *ref) {
+     free(this->built->set(this->built, refname, strdup(ref)));
+}
+
+static void env_cleaner(cad_hash_t *env, int index, const char *key, char *value, void *data) {
+     free(value);
+}
+
+/* Reads one change of the reply into env; returns false if it is not an object */
+static bool_t read_change(json_value_t *jchange, cad_hash_t *env, logger_t log) {
+     yacad_json_finder_t *o = yacad_json_finder_new(log, json_type_object, "");
+     yacad_json_finder_t *s = yacad_json_finder_new(log, json_type_string, "%s");
+     json_object_t *jobject;
+     json_string_t *jstring;
+     const char **keys;
+     char *value;
+     int i, n = 0;
+     size_t c;
+
+     o->visit(o, jchange);
+     jobject = o->get_object(o);
+     if (jobject != NULL) {
+          n = jobject->count(jobject);
+          keys = alloca(n * sizeof(char *));
+          jobject->keys(jobject, keys);
+          for (i = 0; i < n; i++) {
+               s->visit(s, jchange, keys[i]);
+               jstring = s->get_string(s);
+               if (jstring != NULL) {
+                    c = jstring->utf8(jstring, "", 0) + 1;
+                    value = malloc(c);
+                    jstring->utf8(jstring, value, c);
+                    free(env->set(env, keys[i], value));
                }
-               execlp(script, script, NULL);
-               fprintf(stderr, "**** execlp(2): %s: %s\n", script, strerror(errno));
-               exit(1);
           }
+     }
 
-          // in core
-          res = close(io[1]);
-          if (res < 0) {
-               fprintf(stderr, "**** close(2): %s: %s\n", script, strerror(errno));
-               exit(1);
-          }
-          buffer = read_fd(io[0], script);
-          waitpid(pid, &res, 0);
-          if (WIFEXITED(res)) {
-               result = new_task(buffer);
-          } else if (WIFSIGNALED(res)) {
-               fprintf(stderr, "**** %s: signalled\n", script);
+     I(s)->free(I(s));
+     I(o)->free(I(o));
+     return jobject != NULL;
+}
+
+static int check(yacad_scm_custom_t *this, yacad_scm_on_change_fn on_change, void *data) {
+     int result = 0;
+     yacad_json_finder_t *v = yacad_json_finder_new(this->log, json_type_number, "id");
+     yacad_json_finder_t *a = yacad_json_finder_new(this->log, json_type_array, "changes");
+     json_input_stream_t *in;
+     json_value_t *jreply;
+     json_number_t *jid;
+     json_array_t *jchanges;
+     cad_hash_t *env;
+     unsigned long id;
+     char *request, *reply;
+     const char *refname, *ref;
+     int i, n;
+
+     pthread_mutex_lock(&(this->helper->lock));
+     id = this->helper->next_id++;
+     request = check_request(this, id);
+     reply = helper_request(this->log, this->helper, request, this->timeout);
+     pthread_mutex_unlock(&(this->helper->lock));
+
+     if (reply != NULL) {
+          in = new_json_input_stream_from_string(reply, stdlib_memory);
+          jreply = json_parse(in, NULL, stdlib_memory);
+          if (jreply == NULL) {
+               this->log(warn, "Invalid reply from scm helper %s: %s", this->helper->command, reply);
           } else {
-               fprintf(stderr, "**** %s: exit status %d\n", script, WEXITSTATUS(res));
+               v->visit(v, jreply);
+               jid = v->get_number(v);
+               a->visit(a, jreply);
+               jchanges = a->get_array(a);
+               if (jid == NULL || (unsigned long)jid->to_int(jid) != id) {
+                    this->log(warn, "Unexpected reply from scm helper %s: %s", this->helper->command, reply);
+               } else if (jchanges != NULL) {
+                    n = jchanges->count(jchanges);
+                    for (i = 0; i < n; i++) {
+                         env = cad_new_hash(stdlib_memory, cad_hash_strings);
+                         if (read_change(jchanges->get(jchanges, i), env, this->log)) {
+                              refname = env->get(env, "refname");
+                              ref = env->get(env, "ref");
+                              if (refname != NULL && ref != NULL) {
+                                   set_built(this, refname, ref);
+                              }
+                              on_change(env, data);
+                              result++;
+                         }
+                         env->clean(env, (cad_hash_iterator_fn)env_cleaner, NULL);
+                         env->free(env);
+                    }
+               }
+               jreply->accept(jreply, json_kill());
           }
-
-          free(buffer);
+          in->free(in);
+          free(reply);
      }
+     free(request);
 
+     I(a)->free(I(a));
+     I(v)->free(I(v));
      return result;
 }
 
-#endif
+static json_value_t *get_desc(yacad_scm_custom_t *this) {
+     return this->desc;
+}
+
+static char *get_checkout(yacad_scm_custom_t *this, const char *ref, const char *dir, const char *mirrors_url) {
+     // the task command knows how to get its sources
+     return NULL;
+}
+
+static void free_(yacad_scm_custom_t *this) {
+     helper_release(this->log, this->helper);
+     this->built->clean(this->built, (cad_hash_iterator_fn)env_cleaner, NULL);
+     this->built->free(this->built);
+     free(this->sdesc);
+     free(this);
+}
+
+static yacad_scm_t custom_fn = {
+     .check = (yacad_scm_check_fn)check,
+     .set_built = (yacad_scm_set_built_fn)set_built,
+     .get_desc = (yacad_scm_get_desc_fn)get_desc,
+     .get_checkout = (yacad_scm_get_checkout_fn)get_checkout,
+     .free = (yacad_scm_free_fn)free_,
+};
+
+yacad_scm_t *yacad_scm_custom_new(logger_t log, const char *root_path, json_value_t *desc) {
+     yacad_scm_custom_t *result = NULL;
+     yacad_json_finder_t *s = yacad_json_finder_new(log, json_type_string, "command");
+     yacad_json_finder_t *c = yacad_json_finder_new(log, json_type_const, "shared");
+     yacad_json_finder_t *t = yacad_json_finder_new(log, json_type_number, "timeout");
+     json_string_t *jcommand;
+     json_const_t *jshared;
+     json_number_t *jtimeout;
+     char *command;
+     size_t n;
+
+     s->visit(s, desc);
+     jcommand = s->get_string(s);
+     if (jcommand == NULL) {
+          log(error, "No custom scm command");
+     } else {
+          n = jcommand->utf8(jcommand, "", 0) + 1;
+          command = alloca(n);
+          jcommand->utf8(jcommand, command, n);
+          c->visit(c, desc);
+          jshared = c->get_const(c);
+          t->visit(t, desc);
+          jtimeout = t->get_number(t);
+
+          result = malloc(sizeof(yacad_scm_custom_t) + strlen(root_path) + 1);
+          result->fn = custom_fn;
+          result->log = log;
+          result->desc = desc;
+          result->sdesc = to_string(desc);
+          // the helper is started at the first check
+          result->helper = helper_get(command, jshared != NULL && jshared->value(jshared) == json_true);
+          result->built = cad_new_hash(stdlib_memory, cad_hash_strings);
+          result->timeout = jtimeout == NULL ? DEFAULT_TIMEOUT : (int)jtimeout->to_int(jtimeout);
+          result->root_path = result->_;
+          strcpy(result->root_path, root_path);
+     }
+
+     I(t)->free(I(t));
+     I(c)->free(I(c));
+     I(s)->free(I(s));
+     return I(result);
+}
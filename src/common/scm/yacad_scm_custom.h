@@ -0,0 +1,35 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __YACAD_SCM_CUSTOM_H__
+#define __YACAD_SCM_CUSTOM_H__
+
+#include "yacad_scm.h"
+
+/* A scm checked by a long-lived helper process ("command", run by
+ * /bin/sh), started at the first check and restarted if it dies. With
+ * "shared": true, all the scms of the same command share one helper.
+ *
+ * The helper reads one JSON request per line on its standard input:
+ *     {"id":1,"action":"check","root_path":"...","scm":<desc>,"built":{"<refname>":"<ref>",...}}
+ * and writes one JSON reply per line on its standard output:
+ *     {"id":1,"changes":[{"refname":"...","ref":"...","branch":"...",...},...]}
+ * Each change creates a task; all its string members go to the task
+ * environment. "refname" and "ref" are sent back in "built" afterwards. */
+
+yacad_scm_t *yacad_scm_custom_new(logger_t log, const char *root_path, json_value_t *desc);
+
+#endif /* __YACAD_SCM_CUSTOM_H__ */
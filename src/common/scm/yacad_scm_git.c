@@ -14,22 +14,53 @@
   along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <fnmatch.h>
 #include <git2.h>
 
 #include "yacad_scm_git.h"
 #include "common/json/yacad_json_finder.h"
 
-#define REMOTE_NAME "yacad_upstream"
+#define MIRRORS_DIR "mirrors"
+#define MIRROR_REFSPEC "+refs/heads/*:refs/heads/*"
+#define DEFAULT_REFS "HEAD"
+#define TAGS_PREFIX "refs/tags/"
+#define TAGS_REFSPEC "+refs/tags/*:refs/tags/*"
+/* cached tree diffs per mirror; the cache is emptied when full */
+#define MAX_CACHED_DIFFS 256
+
+typedef enum {
+     fetch_full, // download the objects of the tracked refs into the mirror
+     fetch_refs, // only follow the ref advertisement, no object is downloaded
+} fetch_mode_t;
+
+/* The bare repository shared by all the scms of the same upstream url */
+typedef struct {
+     git_repository *repo;
+     pthread_mutex_t lock; // one fetch at a time, also protects diffs
+     cad_hash_t *diffs; // "<old oid>..<new oid>" -> cad_array_t of char *: the changed paths
+     int refcount;
+     char *upstream_url; // -> _
+     char _[0];
+} mirror_t;
+
+static pthread_mutex_t mirrors_lock = PTHREAD_MUTEX_INITIALIZER;
+static cad_hash_t *mirrors = NULL; // upstream url -> mirror_t
+static long object_cache = 0; // libgit2 object cache bound, in MiB; the cache is process-wide
 
 typedef struct yacad_scm_git_s {
      yacad_scm_t fn;
      logger_t log;
-     git_repository *repo;
+     mirror_t *mirror;
      git_remote *remote;
      int fetch_percent;
      int index_percent;
      json_value_t *desc;
-     char *root_path; // -> _
+     cad_array_t *refs; // char *: the tracked ref patterns, matched with fnmatch(3)
+     cad_hash_t *built; // tracked ref name -> oid of its last build
+     cad_array_t *include; // char *: build only if a changed path matches one of them (all paths if empty)
+     cad_array_t *exclude; // char *: ... and does not match any of them
+     fetch_mode_t fetch_mode;
+     char *root_path; // -> _, the mirror path
      char *upstream_url; // -> _ + root_path
      char _[0];
 } yacad_scm_git_t;
@@ -83,62 +114,375 @@ static bool_t __gitcheck(logger_t log, int giterr, level_t level, const char *gi
 
 #define gitcheck(log, gitaction, level) __gitcheck(log, (gitaction), (level), #gitaction, __LINE__)
 
-static void fill_env(yacad_scm_git_t *this, cad_hash_t *env){
+static void free_strings(cad_array_t *strings) {
+     int i, n = strings->count(strings);
+     for (i = 0; i < n; i++) {
+          free(*(char **)strings->get(strings, i));
+     }
+     strings->free(strings);
+}
+
+static void clean_diff(cad_hash_t *diffs, int index, const char *key, cad_array_t *paths, void *data) {
+     free_strings(paths);
+}
+
+static void clear_diffs(mirror_t *mirror) {
+     mirror->diffs->clean(mirror->diffs, (cad_hash_iterator_fn)clean_diff, NULL);
+}
+
+static void mirror_release(mirror_t *mirror) {
+     pthread_mutex_lock(&mirrors_lock);
+     if (--mirror->refcount == 0) {
+          mirrors->del(mirrors, mirror->upstream_url);
+          clear_diffs(mirror);
+          mirror->diffs->free(mirror->diffs);
+          git_repository_free(mirror->repo);
+          pthread_mutex_destroy(&(mirror->lock));
+          free(mirror);
+     }
+     pthread_mutex_unlock(&mirrors_lock);
+}
+
+/* Opens (or initializes) the bare repository of the upstream url, or shares it if it is already open. */
+static mirror_t *mirror_get(logger_t log, const char *path, const char *upstream_url) {
+     mirror_t *result;
+
+     pthread_mutex_lock(&mirrors_lock);
+     if (mirrors == NULL) {
+          mirrors = cad_new_hash(stdlib_memory, cad_hash_strings);
+     }
+     result = mirrors->get(mirrors, upstream_url);
+     if (result != NULL) {
+          result->refcount++;
+     } else {
+          result = malloc(sizeof(mirror_t) + strlen(upstream_url) + 1);
+          result->repo = NULL;
+          result->refcount = 1;
+          result->upstream_url = result->_;
+          strcpy(result->upstream_url, upstream_url);
+          if (!gitcheck(log, git_repository_open_bare(&(result->repo), path), debug)) {
+               log(info, "Initializing repository: %s for %s", path, upstream_url);
+               if (!gitcheck(log, git_repository_init(&(result->repo), path, true), error)) {
+                    free(result);
+                    result = NULL;
+               }
+          }
+          if (result != NULL) {
+               pthread_mutex_init(&(result->lock), NULL);
+               result->diffs = cad_new_hash(stdlib_memory, cad_hash_strings);
+               mirrors->set(mirrors, upstream_url, result);
+          }
+     }
+     pthread_mutex_unlock(&mirrors_lock);
+
+     return result;
+}
+
+/* FNV-1a, to name the mirror after its upstream url */
+static unsigned long long url_hash(const char *url) {
+     unsigned long long result = 14695981039346656037ULL;
+     for (; *url; url++) {
+          result = (result ^ (unsigned char)*url) * 1099511628211ULL;
+     }
+     return result;
+}
+
+static bool_t is_tracked(yacad_scm_git_t *this, const char *name) {
+     int i, n = this->refs->count(this->refs);
+     char **pattern;
+
+     for (i = 0; i < n; i++) {
+          pattern = this->refs->get(this->refs, i);
+          if (fnmatch(*pattern, name, 0) == 0) {
+               return true;
+          }
+     }
+     return false;
+}
+
+/* The tracked refs advertised by the remote whose oid is not the built one: ref name -> oid.
+ * The remote must be connected. Returns NULL if the refs could not be listed. */
+static cad_hash_t *ls_changed(yacad_scm_git_t *this) {
+     cad_hash_t *result = NULL;
      const git_remote_head **heads;
+     size_t szheads = 0, i;
+     char oid[GIT_OID_HEXSZ + 1];
+     const char *built;
+
+     if (gitcheck(this->log, git_remote_ls(&heads, &szheads, this->remote), warn)) {
+          result = cad_new_hash(stdlib_memory, cad_hash_strings);
+          for (i = 0; i < szheads; i++) {
+               if (is_tracked(this, heads[i]->name)) {
+                    git_oid_tostr(oid, GIT_OID_HEXSZ + 1, &heads[i]->oid);
+                    built = this->built->get(this->built, heads[i]->name);
+                    if (built == NULL || strcmp(built, oid)) {
+                         result->set(result, heads[i]->name, strdup(oid));
+                    }
+               }
+          }
+     }
+
+     return result;
+}
+
+static git_tree *lookup_tree(yacad_scm_git_t *this, const char *oidstr) {
+     git_oid oid;
+     git_object *object = NULL, *tree = NULL;
+
+     if (gitcheck(this->log, git_oid_fromstr(&oid, oidstr), warn)
+         && gitcheck(this->log, git_object_lookup(&object, this->mirror->repo, &oid, GIT_OBJ_ANY), warn)) {
+          // commits and tags
+          gitcheck(this->log, git_object_peel(&tree, object, GIT_OBJ_TREE), warn);
+     }
+     git_object_free(object);
+
+     return (git_tree *)tree;
+}
+
+/* The paths changed between two oids, or NULL if they cannot be compared (e.g. the old one is gone).
+ * The diffs are cached in the mirror, so that the projects of the same upstream share them. */
+static cad_array_t *changed_paths(yacad_scm_git_t *this, const char *old_oid, const char *new_oid) {
+     cad_array_t *result;
+     size_t n = snprintf("", 0, "%s..%s", old_oid, new_oid) + 1;
+     char *key = alloca(n), *path;
+     git_tree *old_tree, *new_tree;
+     git_diff *diff;
+     const git_diff_delta *delta;
+     size_t i, count;
+
+     snprintf(key, n, "%s..%s", old_oid, new_oid);
+     result = this->mirror->diffs->get(this->mirror->diffs, key);
+     if (result == NULL) {
+          old_tree = lookup_tree(this, old_oid);
+          new_tree = lookup_tree(this, new_oid);
+          if (old_tree != NULL && new_tree != NULL
+              && gitcheck(this->log, git_diff_tree_to_tree(&diff, this->mirror->repo, old_tree, new_tree, NULL), warn)) {
+               result = cad_new_array(stdlib_memory, sizeof(char *));
+               count = git_diff_num_deltas(diff);
+               for (i = 0; i < count; i++) {
+                    delta = git_diff_get_delta(diff, i);
+                    path = strdup(delta->new_file.path);
+                    result->insert(result, result->count(result), &path);
+                    if (strcmp(delta->old_file.path, delta->new_file.path)) {
+                         path = strdup(delta->old_file.path);
+                         result->insert(result, result->count(result), &path);
+                    }
+               }
+               git_diff_free(diff);
+
+               if (this->mirror->diffs->count(this->mirror->diffs) >= MAX_CACHED_DIFFS) {
+                    clear_diffs(this->mirror);
+               }
+               this->mirror->diffs->set(this->mirror->diffs, key, result);
+          }
+          git_tree_free(new_tree);
+          git_tree_free(old_tree);
+     }
+
+     return result;
+}
+
+static bool_t matches(cad_array_t *patterns, const char *path) {
+     int i, n = patterns->count(patterns);
+
+     for (i = 0; i < n; i++) {
+          if (fnmatch(*(char **)patterns->get(patterns, i), path, 0) == 0) {
+               return true;
+          }
+     }
+     return false;
+}
+
+static bool_t paths_match(yacad_scm_git_t *this, cad_array_t *paths) {
+     int i, n = paths->count(paths);
+     const char *path;
+
+     for (i = 0; i < n; i++) {
+          path = *(char **)paths->get(paths, i);
+          if ((this->include->count(this->include) == 0 || matches(this->include, path)) && !matches(this->exclude, path)) {
+               return true;
+          }
+     }
+     return false;
+}
+
+static void set_built(yacad_scm_git_t *this, const char *refname, const char *oid) {
+     free(this->built->set(this->built, refname, strdup(oid)));
+}
+
+typedef struct {
+     yacad_scm_git_t *scm;
+     yacad_scm_on_change_fn on_change;
+     void *data;
+     int count;
+} changed_context_t;
+
+static void env_cleaner(cad_hash_t *env, int index, const char *key, char *value, void *data) {
+     free(value);
+}
+
+static void notify_changed(cad_hash_t *changed, int index, const char *refname, const char *oid, changed_context_t *context) {
+     yacad_scm_git_t *this = context->scm;
+     const char *built = this->built->get(this->built, refname);
+     cad_array_t *paths;
+     cad_hash_t *env;
      git_buf branch = {NULL,0,0};
-     size_t szheads = 0;
-     char ref[GIT_OID_HEXSZ + 1];
 
-     if (gitcheck(this->log, git_remote_ls(&heads, &szheads, this->remote), error) && szheads > 0) {
-          // The first one is HEAD
-          git_oid_tostr(ref, GIT_OID_HEXSZ + 1, &heads[0]->oid);
+     if (built != NULL && this->fetch_mode == fetch_full && (this->include->count(this->include) > 0 || this->exclude->count(this->exclude) > 0)) {
+          paths = changed_paths(this, built, oid);
+          if (paths != NULL && !paths_match(this, paths)) {
+               this->log(info, "Ref does not need building, no matching path changed: %s %s (%s)", this->upstream_url, refname, oid);
+               set_built(this, refname, oid);
+               return;
+          }
      }
-     gitcheck(this->log, git_remote_default_branch(&branch, this->remote), warn);
 
-     env->set(env, "ref", strdup(ref));
-     env->set(env, "branch", strdup(branch.ptr));
+     env = cad_new_hash(stdlib_memory, cad_hash_strings);
 
+     if (!strcmp(refname, "HEAD") && gitcheck(this->log, git_remote_default_branch(&branch, this->remote), warn)) {
+          env->set(env, "branch", strdup(branch.ptr));
+     } else {
+          env->set(env, "branch", strdup(refname));
+     }
+     env->set(env, "ref", strdup(oid));
+     env->set(env, "refname", strdup(refname));
      free(branch.ptr);
+
+     this->log(info, "Ref needs building: %s %s (%s)", this->upstream_url, refname, oid);
+     set_built(this, refname, oid);
+     context->on_change(env, context->data);
+     context->count++;
+
+     env->clean(env, (cad_hash_iterator_fn)env_cleaner, NULL);
+     env->free(env);
 }
 
-static bool_t check(yacad_scm_git_t *this) {
-     bool_t result = false;
+static int check(yacad_scm_git_t *this, yacad_scm_on_change_fn on_change, void *data) {
+     changed_context_t context = { this, on_change, data, 0 };
      bool_t downloaded;
+     cad_hash_t *changed;
 
+     pthread_mutex_lock(&(this->mirror->lock));
      if (!gitcheck(this->log, git_remote_connect(this->remote, GIT_DIRECTION_FETCH), error)) {
           // Could not connect to remote
      } else {
-          this->fetch_percent = this->index_percent = -1;
+          // the ref advertisement is enough to know which refs changed since their last build
+          changed = ls_changed(this);
+          if (changed == NULL) {
+               git_remote_disconnect(this->remote);
+          } else if (changed->count(changed) == 0) {
+               git_remote_disconnect(this->remote);
+               this->log(debug, "Remote is up-to-date: %s", this->upstream_url);
+          } else if (this->fetch_mode == fetch_refs) {
+               git_remote_disconnect(this->remote);
+               changed->iterate(changed, (cad_hash_iterator_fn)notify_changed, &context);
+          } else {
+               this->fetch_percent = this->index_percent = -1;
 #if LIBGIT2_SOVERSION >= 22
-          downloaded = gitcheck(this->log, git_remote_download(this->remote, NULL), warn);
+               downloaded = gitcheck(this->log, git_remote_download(this->remote, NULL), warn);
 #elif LIBGIT2_SOVERSION == 21
-          downloaded = gitcheck(this->log, git_remote_download(this->remote), warn);
+               downloaded = gitcheck(this->log, git_remote_download(this->remote), warn);
 #endif
-          git_remote_disconnect(this->remote);
-          if (downloaded) {
-               if (!gitcheck(this->log, git_remote_update_tips(this->remote, NULL, NULL), error)) {
-                    // Could not update tips
-               } else if (this->fetch_percent == -1 && this->index_percent == -1) {
-                    this->log(debug, "Remote is up-to-date: %s", this->upstream_url);
-               } else if (this->fetch_percent != 100 || this->index_percent != 100) {
-                    this->log(warn, "Download incomplete: network %3d%%  /  indexing %3d%%", this->fetch_percent, this->index_percent);
-               } else {
-                    this->log(info, "Remote needs building: %s", this->upstream_url);
-                    result = true;
+               git_remote_disconnect(this->remote);
+               if (downloaded) {
+                    if (!gitcheck(this->log, git_remote_update_tips(this->remote, NULL, NULL), error)) {
+                         // Could not update tips
+                    } else if (this->fetch_percent != -1 && (this->fetch_percent != 100 || this->index_percent != 100)) {
+                         this->log(warn, "Download incomplete: network %3d%%  /  indexing %3d%%", this->fetch_percent, this->index_percent);
+                    } else {
+                         changed->iterate(changed, (cad_hash_iterator_fn)notify_changed, &context);
+                    }
                }
           }
+          if (changed != NULL) {
+               changed->clean(changed, (cad_hash_iterator_fn)env_cleaner, NULL);
+               changed->free(changed);
+          }
      }
+     pthread_mutex_unlock(&(this->mirror->lock));
 
-     return result;
+     return context.count;
 }
 
 static json_value_t *get_desc(yacad_scm_git_t *this) {
      return this->desc;
 }
 
+/* single-quoted for the shell */
+static void put_quoted(FILE *out, const char *string) {
+     fputc('\'', out);
+     for (; *string; string++) {
+          if (*string == '\'') {
+               fputs("'\\''", out);
+          } else {
+               fputc(*string, out);
+          }
+     }
+     fputc('\'', out);
+}
+
+/* The mirror is shared by the slots: it is locked (if flock(1) is there) while it is created and while it fetches;
+ * each slot has its own workspace. The mirror fetches only when it misses the ref, first from the Core
+ * mirror, then from the upstream. A known workspace is reset and cleaned in place; a new one is a worktree of the
+ * mirror, which shares its objects. */
+static char *get_checkout(yacad_scm_git_t *this, const char *ref, const char *dir, const char *mirrors_url) {
+     char *result = NULL, *core_url;
+     size_t size = 0;
+     int n;
+     FILE *out = open_memstream(&result, &size);
+
+     fputs("(\n"
+           "set -e\n"
+           "mirror=", out);
+     put_quoted(out, this->root_path);
+     fputs("; dir=", out);
+     put_quoted(out, dir);
+     fputs("; ref=", out);
+     put_quoted(out, ref);
+     fputs("\n"
+           "has_ref() { git -C \"$1\" cat-file -e \"$ref^{commit}\" 2>/dev/null; }\n"
+           "fetch() { git -C \"$1\" fetch -q \"$2\" \"$3\" '" TAGS_REFSPEC "'; }\n"
+           "(\n"
+           "  ! command -v flock >/dev/null || flock 8\n"
+           "  [ -d \"$mirror\" ] || git init -q --bare \"$mirror\"\n", out);
+     if (mirrors_url != NULL) {
+          n = snprintf("", 0, "%s/%016llx.git", mirrors_url, url_hash(this->upstream_url)) + 1;
+          core_url = alloca(n);
+          snprintf(core_url, n, "%s/%016llx.git", mirrors_url, url_hash(this->upstream_url));
+          fputs("  has_ref \"$mirror\" || fetch \"$mirror\" ", out);
+          put_quoted(out, core_url);
+          fputs(" '" MIRROR_REFSPEC "' || :\n", out);
+     }
+     fputs("  has_ref \"$mirror\" || fetch \"$mirror\" ", out);
+     put_quoted(out, this->upstream_url);
+     fputs(" '" MIRROR_REFSPEC "'\n"
+           ") 8>\"$mirror.lock\"\n"
+           "if [ -e \"$dir/.git\" ]; then\n"
+           "  has_ref \"$dir\" || fetch \"$dir\" \"$mirror\" '+refs/heads/*:refs/remotes/yacad/*'\n"
+           "  git -C \"$dir\" checkout -q -f --detach \"$ref\"\n"
+           "  git -C \"$dir\" clean -q -f -d -x\n"
+           "else\n"
+           "  git -C \"$mirror\" worktree prune\n"
+           "  git -C \"$mirror\" worktree add -q -f --detach \"$dir\" \"$ref\"\n"
+           "fi\n"
+           ")", out);
+     fclose(out);
+
+     return result;
+}
+
+static void free_refs(yacad_scm_git_t *this) {
+     free_strings(this->refs);
+     free_strings(this->include);
+     free_strings(this->exclude);
+     this->built->clean(this->built, (cad_hash_iterator_fn)env_cleaner, NULL);
+     this->built->free(this->built);
+}
+
 static void free_(yacad_scm_git_t *this) {
+     free_refs(this);
      git_remote_free(this->remote);
-     git_repository_free(this->repo);
+     mirror_release(this->mirror);
      free(this);
      yacad_git_shutdown();
 }
@@ -172,10 +516,100 @@ static int yacad_git_credentials(git_cred **out, const char *url, const char *us
      return git_cred_ssh_key_from_agent(out, username_from_url);
 }
 
+static void read_patterns(yacad_scm_git_t *this, cad_array_t *patterns, const char *path) {
+     yacad_json_finder_t *r = yacad_json_finder_new(this->log, json_type_string, path);
+     json_string_t *jpattern;
+     char *pattern;
+     size_t n;
+     int i;
+
+     for (i = 0, r->visit(r, this->desc, i); (jpattern = r->get_string(r)) != NULL; r->visit(r, this->desc, ++i)) {
+          n = jpattern->utf8(jpattern, "", 0) + 1;
+          pattern = malloc(n);
+          jpattern->utf8(jpattern, pattern, n);
+          patterns->insert(patterns, i, &pattern);
+     }
+
+     I(r)->free(I(r));
+}
+
+static void read_refs(yacad_scm_git_t *this) {
+     char *ref;
+
+     read_patterns(this, this->refs, "refs/%d");
+     if (this->refs->count(this->refs) == 0) {
+          ref = strdup(DEFAULT_REFS);
+          this->refs->insert(this->refs, 0, &ref);
+     }
+     read_patterns(this, this->include, "paths/include/%d");
+     read_patterns(this, this->exclude, "paths/exclude/%d");
+}
+
+static void read_fetch_mode(yacad_scm_git_t *this) {
+     yacad_json_finder_t *s = yacad_json_finder_new(this->log, json_type_string, "%s");
+     yacad_json_finder_t *v = yacad_json_finder_new(this->log, json_type_number, "%s");
+     json_string_t *jmode;
+     json_number_t *jnumber;
+     char *mode = NULL;
+     size_t n;
+
+     this->fetch_mode = fetch_full;
+     s->visit(s, this->desc, "fetch");
+     jmode = s->get_string(s);
+     if (jmode != NULL) {
+          n = jmode->utf8(jmode, "", 0) + 1;
+          mode = alloca(n);
+          jmode->utf8(jmode, mode, n);
+          if (!strcmp(mode, "refs")) {
+               this->fetch_mode = fetch_refs;
+          } else if (!strcmp(mode, "shallow")) {
+               this->log(warn, "Shallow fetch is not supported by libgit2 %d, only following the refs: %s", LIBGIT2_SOVERSION, this->upstream_url);
+               this->fetch_mode = fetch_refs;
+          } else if (strcmp(mode, "full")) {
+               this->log(warn, "Unknown fetch mode \"%s\", fetching in full: %s", mode, this->upstream_url);
+          }
+     }
+     if (this->fetch_mode == fetch_refs && (this->include->count(this->include) > 0 || this->exclude->count(this->exclude) > 0)) {
+          this->log(warn, "Paths are ignored without objects to compare: %s", this->upstream_url);
+     }
+
+     v->visit(v, this->desc, "object_cache");
+     jnumber = v->get_number(v);
+     if (jnumber != NULL) {
+          pthread_mutex_lock(&mirrors_lock);
+          if (jnumber->to_int(jnumber) > object_cache) {
+               object_cache = jnumber->to_int(jnumber);
+               gitcheck(this->log, git_libgit2_opts(GIT_OPT_SET_CACHE_MAX_SIZE, (ssize_t)object_cache * 1024 * 1024), warn);
+          }
+          pthread_mutex_unlock(&mirrors_lock);
+     }
+
+     I(v)->free(I(v));
+     I(s)->free(I(s));
+}
+
+/* Tags are not fetched by the default refspec */
+static bool_t fetch_tags(yacad_scm_git_t *this) {
+     bool_t result = true;
+     int i, n = this->refs->count(this->refs);
+     char **pattern;
+
+     for (i = 0; i < n; i++) {
+          pattern = this->refs->get(this->refs, i);
+          if (!strncmp(*pattern, TAGS_PREFIX, strlen(TAGS_PREFIX))) {
+               result = gitcheck(this->log, git_remote_add_fetch(this->remote, TAGS_REFSPEC), error);
+               break;
+          }
+     }
+
+     return result;
+}
+
 static yacad_scm_t git_fn = {
      .check = (yacad_scm_check_fn)check,
-     .fill_env = (yacad_scm_fill_env_fn)fill_env,
+     .set_built = (yacad_scm_set_built_fn)set_built,
      .get_desc = (yacad_scm_get_desc_fn)get_desc,
+     .get_checkout = (yacad_scm_get_checkout_fn)get_checkout,
      .free = (yacad_scm_free_fn)free_,
 };
 
@@ -184,7 +618,9 @@ yacad_scm_t *yacad_scm_git_new(logger_t log, const char *root_path, json_value_t
      yacad_scm_git_t *result = NULL;
      git_remote_callbacks callbacks = GIT_REMOTE_CALLBACKS_INIT;
      char *upstream_url = NULL;
-     size_t szurl = 0, szpath = strlen(root_path) + 5;
+     const char *slash = strrchr(root_path, '/');
+     int szdir = slash == NULL ? 1 : slash - root_path;
+     size_t szurl = 0, szpath;
      json_string_t *jurl;
      yacad_json_finder_t *u = yacad_json_finder_new(log, json_type_string, "upstream_url");
 
@@ -198,43 +634,41 @@ yacad_scm_t *yacad_scm_git_new(logger_t log, const char *root_path, json_value_t
      upstream_url = malloc(szurl);
      jurl->utf8(jurl, upstream_url, szurl);
 
+     // the projects of the same upstream share <projects root>/mirrors/<url hash>.git
+     szpath = snprintf("", 0, "%.*s/%s/%016llx.git", szdir, slash == NULL ? "." : root_path, MIRRORS_DIR, url_hash(upstream_url)) + 1;
      sz = sizeof(yacad_scm_git_t) + szpath + szurl;
      result = malloc(sz);
 
      result->fn = git_fn;
      result->log = log;
-     result->repo = NULL;
+     result->mirror = NULL;
      result->remote = NULL;
      result->desc = desc;
+     result->refs = cad_new_array(stdlib_memory, sizeof(char *));
+     result->built = cad_new_hash(stdlib_memory, cad_hash_strings);
+     result->include = cad_new_array(stdlib_memory, sizeof(char *));
+     result->exclude = cad_new_array(stdlib_memory, sizeof(char *));
+     read_refs(result);
 
      result->fetch_percent = result->index_percent = -1;
      result->root_path = result->_;
      result->upstream_url = result->_ + szpath;
-     snprintf(result->root_path, szpath, "%s.git", root_path);
+     snprintf(result->root_path, szpath, "%.*s/%s/%016llx.git", szdir, slash == NULL ? "." : root_path, MIRRORS_DIR, url_hash(upstream_url));
      snprintf(result->upstream_url, szurl, "%s", upstream_url);
 
      yacad_git_init();
+     read_fetch_mode(result);
 
-     if (gitcheck(log, git_repository_open_bare(&(result->repo), result->root_path), debug)) {
-#if LIBGIT2_SOVERSION >= 22
-          if (!gitcheck(log, git_remote_delete(result->repo, REMOTE_NAME), error)) {
-               goto error;
-          }
-#elif LIBGIT2_SOVERSION == 21
-          if (gitcheck(log, git_remote_load(&(result->remote), result->repo, REMOTE_NAME), debug)) {
-               if (!gitcheck(log, git_remote_delete(result->remote), error)) {
-                    goto error;
-               }
-               git_remote_free(result->remote);
-          }
-#endif
-     } else {
-          log(info, "Initializing repository: %s", result->root_path);
-          if (!gitcheck(log, git_repository_init(&(result->repo), result->root_path, true), error)) {
-               goto error;
-          }
+     result->mirror = mirror_get(log, result->root_path, result->upstream_url);
+     if (result->mirror == NULL) {
+          goto error;
      }
-     if (!gitcheck(log, git_remote_create(&(result->remote), result->repo, REMOTE_NAME, upstream_url), error)) {
+     // anonymous: the remote is not saved in the shared repository configuration
+     if (!gitcheck(log, git_remote_create_anonymous(&(result->remote), result->mirror->repo, upstream_url, MIRROR_REFSPEC), error)) {
+          goto error;
+     }
+
+     if (!fetch_tags(result)) {
           goto error;
      }
 
@@ -253,8 +687,11 @@ ret:
 
 error:
      if (result) {
+          free_refs(result);
           git_remote_free(result->remote);
-          git_repository_free(result->repo);
+          if (result->mirror != NULL) {
+               mirror_release(result->mirror);
+          }
           free(result);
           result = NULL;
      }
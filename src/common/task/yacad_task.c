@@ -24,6 +24,8 @@ typedef struct yacad_task_impl_s {
      logger_t log;
      unsigned long id;
      time_t timestamp;
+     time_t dispatched; // 0 until sent to a runner
+     time_t eta;        // expected completion time, 0 if unknown
      yacad_task_status_t status;
      int taskindex;
      json_value_t *task;
@@ -31,6 +33,7 @@ typedef struct yacad_task_impl_s {
      json_value_t *run;
      yacad_runnerid_t *runnerid;
      cad_hash_t *env;
+     json_value_t *owned; // the JSON tree task points into
      char project_name[0];
 } yacad_task_impl_t;
 
@@ -46,6 +49,22 @@ static time_t get_timestamp(yacad_task_impl_t *this) {
      return this->timestamp;
 }
 
+static time_t get_dispatched(yacad_task_impl_t *this) {
+     return this->dispatched;
+}
+
+static void set_dispatched(yacad_task_impl_t *this, time_t dispatched) {
+     this->dispatched = dispatched;
+}
+
+static time_t get_eta(yacad_task_impl_t *this) {
+     return this->eta;
+}
+
+static void set_eta(yacad_task_impl_t *this, time_t eta) {
+     this->eta = eta;
+}
+
 static yacad_task_status_t get_status(yacad_task_impl_t *this) {
      return this->status;
 }
@@ -100,13 +119,13 @@ static char *serialize(yacad_task_impl_t *this) {
 
      n = 1 + snprintf(
           "", 0,
-          "{\"id\":%lu,\"timestamp\":%lu,\"status\":%d,\"taskindex\":%d,\"task\":%s,\"project_name\":\"%s\",\"env\":%s}",
-          this->id, (unsigned long)this->timestamp, (int)this->status, this->taskindex, stask, this->project_name, senv);
+          "{\"id\":%lu,\"timestamp\":%lu,\"dispatched\":%lu,\"eta\":%lu,\"status\":%d,\"taskindex\":%d,\"task\":%s,\"project_name\":\"%s\",\"env\":%s}",
+          this->id, (unsigned long)this->timestamp, (unsigned long)this->dispatched, (unsigned long)this->eta, (int)this->status, this->taskindex, stask, this->project_name, senv);
      result = malloc(n);
      snprintf(
           result, n,
-          "{\"id\":%lu,\"timestamp\":%lu,\"status\":%d,\"taskindex\":%d,\"task\":%s,\"project_name\":\"%s\",\"env\":%s}",
-          this->id, (unsigned long)this->timestamp, (int)this->status, this->taskindex, stask, this->project_name, senv);
+          "{\"id\":%lu,\"timestamp\":%lu,\"dispatched\":%lu,\"eta\":%lu,\"status\":%d,\"taskindex\":%d,\"task\":%s,\"project_name\":\"%s\",\"env\":%s}",
+          this->id, (unsigned long)this->timestamp, (unsigned long)this->dispatched, (unsigned long)this->eta, (int)this->status, this->taskindex, stask, this->project_name, senv);
 
      jenv->accept(jenv, json_kill());
 
@@ -151,6 +170,10 @@ static void env_cleaner(cad_hash_t *env, int index, const char *key, char *value
 static void free_(yacad_task_impl_t *this) {
      this->env->clean(this->env, (cad_hash_iterator_fn)env_cleaner, this);
      this->env->free(this->env);
+     this->runnerid->free(this->runnerid);
+     if (this->owned != NULL) {
+          this->owned->accept(this->owned, json_kill());
+     }
      free(this);
 }
 
@@ -158,6 +181,10 @@ static yacad_task_t impl_fn = {
      .get_id = (yacad_task_get_id_fn)get_id,
      .set_id = (yacad_task_set_id_fn)set_id,
      .get_timestamp = (yacad_task_get_timestamp_fn)get_timestamp,
+     .get_dispatched = (yacad_task_get_dispatched_fn)get_dispatched,
+     .set_dispatched = (yacad_task_set_dispatched_fn)set_dispatched,
+     .get_eta = (yacad_task_get_eta_fn)get_eta,
+     .set_eta = (yacad_task_set_eta_fn)set_eta,
      .get_status = (yacad_task_get_status_fn)get_status,
      .set_status = (yacad_task_set_status_fn)set_status,
      .get_runnerid = (yacad_task_get_runnerid_fn)get_runnerid,
@@ -191,6 +218,7 @@ static yacad_task_impl_t *_task_new(logger_t log, json_value_t *task, const char
      strcpy(result->project_name, project_name);
 
      result->taskindex = taskindex;
+     result->dispatched = result->eta = 0;
 
      I(finder)->free(I(finder));
 
@@ -217,6 +245,7 @@ yacad_task_t *yacad_task_new(logger_t log, json_value_t *task, cad_hash_t *env,
      I(template)->free(I(template));
 
      result = _task_new(log, resolved_task, project_name, taskindex);
+     result->owned = resolved_task;
      result->id = 0;
      time(&(result->timestamp));
      result->status = task_new;
@@ -231,6 +260,8 @@ yacad_task_t *yacad_task_unserialize(logger_t log, char *serial) {
      json_object_t *jserial = (json_object_t *)json_parse(ser, NULL, stdlib_memory);
      json_number_t *jid = (json_number_t *)jserial->get(jserial, "id");
      json_number_t *jtimestamp = (json_number_t *)jserial->get(jserial, "timestamp");
+     json_number_t *jdispatched = (json_number_t *)jserial->get(jserial, "dispatched");
+     json_number_t *jeta = (json_number_t *)jserial->get(jserial, "eta");
      json_number_t *jstatus = (json_number_t *)jserial->get(jserial, "status");
      json_number_t *jtaskindex = (json_number_t *)jserial->get(jserial, "taskindex");
      json_object_t *jtask = (json_object_t *)jserial->get(jserial, "task");
@@ -244,14 +275,23 @@ yacad_task_t *yacad_task_unserialize(logger_t log, char *serial) {
      char *key;
 
      c = jproject_name->utf8(jproject_name, "", 0) + 1;
-     project_name = malloc(c);
+     project_name = alloca(c);
      jproject_name->utf8(jproject_name, project_name, c);
 
      taskindex = (int)jtaskindex->to_int(jtaskindex);
 
-     result = (yacad_task_impl_t *)yacad_task_new(log, (json_value_t *)jtask, NULL, project_name, taskindex);
+     // The serialized task is already resolved: no need to go through a template, just keep the parsed tree
+     result = _task_new(log, (json_value_t *)jtask, project_name, taskindex);
+     result->owned = (json_value_t *)jserial;
      result->id = (unsigned long)jid->to_int(jid);
      result->timestamp = (time_t)jtimestamp->to_int(jtimestamp);
+     // older serials have no dispatch information
+     if (jdispatched != NULL) {
+          result->dispatched = (time_t)jdispatched->to_int(jdispatched);
+     }
+     if (jeta != NULL) {
+          result->eta = (time_t)jeta->to_int(jeta);
+     }
      result->status = (yacad_task_status_t)jstatus->to_int(jstatus);
      result->env = cad_new_hash(stdlib_memory, cad_hash_strings);
      n = jenv->count(jenv);
@@ -265,9 +305,10 @@ yacad_task_t *yacad_task_unserialize(logger_t log, char *serial) {
                jstring->utf8(jstring, key, c);
                result->env->set(result->env, keys[i], key);
           }
+          free(keys);
      }
 
-     jserial->accept(jserial, json_kill());
+     ser->free(ser);
 
      return I(result);
 }
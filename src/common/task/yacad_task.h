@@ -32,6 +32,10 @@ typedef enum {
 typedef unsigned long (*yacad_task_get_id_fn)(yacad_task_t *this);
 typedef void (*yacad_task_set_id_fn)(yacad_task_t *this, unsigned long id);
 typedef time_t (*yacad_task_get_timestamp_fn)(yacad_task_t *this);
+typedef time_t (*yacad_task_get_dispatched_fn)(yacad_task_t *this);
+typedef void (*yacad_task_set_dispatched_fn)(yacad_task_t *this, time_t dispatched);
+typedef time_t (*yacad_task_get_eta_fn)(yacad_task_t *this);
+typedef void (*yacad_task_set_eta_fn)(yacad_task_t *this, time_t eta);
 typedef yacad_task_status_t (*yacad_task_get_status_fn)(yacad_task_t *this);
 typedef void (*yacad_task_set_status_fn)(yacad_task_t *this, yacad_task_status_t status);
 typedef json_value_t *(*yacad_task_get_source_fn)(yacad_task_t *this);
@@ -49,6 +53,10 @@ struct yacad_task_s {
      yacad_task_get_id_fn get_id;
      yacad_task_set_id_fn set_id;
      yacad_task_get_timestamp_fn get_timestamp;
+     yacad_task_get_dispatched_fn get_dispatched;
+     yacad_task_set_dispatched_fn set_dispatched;
+     yacad_task_get_eta_fn get_eta;
+     yacad_task_set_eta_fn set_eta;
      yacad_task_get_status_fn get_status;
      yacad_task_set_status_fn set_status;
      yacad_task_get_source_fn get_source;
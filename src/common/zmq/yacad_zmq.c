@@ -39,6 +39,7 @@ typedef struct yacad_zmq_socket_impl_s {
      logger_t log;
      void *socket;
      int type;
+     bool_t bound;
      char addr[0];
 } yacad_zmq_socket_impl_t;
 
@@ -48,7 +49,9 @@ typedef struct yacad_zmq_poller_impl_s {
      cad_array_t *zitems; /* array of zmq_pollitem_t */
      cad_hash_t *sockets;
      cad_hash_t *on_pollin;
+     cad_hash_t *on_pollin_bytes;
      cad_hash_t *on_pollout;
+     cad_array_t *on_fdin; /* array of fdin_t */
      yacad_timeout_fn timeout;
      yacad_on_timeout_fn on_timeout;
      char *stopaddr;
@@ -56,18 +59,39 @@ typedef struct yacad_zmq_poller_impl_s {
      yacad_zmq_socket_t *stopsocket;
 } yacad_zmq_poller_impl_t;
 
+typedef struct {
+     int fd;
+     yacad_on_fdin_fn on_fdin;
+} fdin_t;
+
 static void send(yacad_zmq_socket_impl_t *this, const char *message) {
      zmqcheck(this->log, zmq_send(this->socket, message, strlen(message), 0), warn);
 }
 
+static bool_t send_bytes(yacad_zmq_socket_impl_t *this, const void *message, size_t size) {
+     bool_t result = true;
+     if (zmq_send(this->socket, message, size, ZMQ_DONTWAIT) == -1) {
+          result = false;
+          if (zmq_errno() != EAGAIN) {
+               this->log(warn, "zmq_send: error: %s", zmq_strerror(zmq_errno()));
+          }
+     }
+     return result;
+}
+
 static void free_socket(yacad_zmq_socket_impl_t *this) {
-     zmqcheck(this->log, zmq_disconnect(this->socket, this->addr), error);
+     if (this->bound) {
+          zmqcheck(this->log, zmq_unbind(this->socket, this->addr), error);
+     } else {
+          zmqcheck(this->log, zmq_disconnect(this->socket, this->addr), error);
+     }
      zmqcheck(this->log, zmq_close(this->socket), error);
      free(this);
 }
 
 static yacad_zmq_socket_t socket_fn = {
      .send = (yacad_zmq_socket_send_fn)send,
+     .send_bytes = (yacad_zmq_socket_send_bytes_fn)send_bytes,
      .free = (yacad_zmq_socket_free_fn)free_socket,
 };
 
@@ -75,6 +99,10 @@ static yacad_zmq_socket_impl_t *yacad_zmq_socket_new(logger_t log, const char *a
      yacad_zmq_socket_impl_t *result = NULL;
      void *socket = zmq_socket(zmq_context, type);
      if (socket != NULL) {
+          if (type == ZMQ_SUB) {
+               // all the messages
+               zmqcheck(log, zmq_setsockopt(socket, ZMQ_SUBSCRIBE, "", 0), warn);
+          }
           if (!zmqcheck(log, connect(socket, addr), error)) {
                zmqcheck(log, zmq_close(socket), warn);
           } else {
@@ -83,6 +111,7 @@ static yacad_zmq_socket_impl_t *yacad_zmq_socket_new(logger_t log, const char *a
                result->log = log;
                result->socket = socket;
                result->type = type;
+               result->bound = connect == zmq_bind;
                strcpy(result->addr, addr);
           }
      }
@@ -125,10 +154,39 @@ static void on_pollin(yacad_zmq_poller_impl_t *this, yacad_zmq_socket_impl_t *so
      register_action(this, socket, on_pollin, this->on_pollin, ZMQ_POLLIN);
 }
 
+static void on_pollin_bytes(yacad_zmq_poller_impl_t *this, yacad_zmq_socket_impl_t *socket, yacad_on_pollin_bytes_fn on_pollin_bytes) {
+     register_action(this, socket, on_pollin_bytes, this->on_pollin_bytes, ZMQ_POLLIN);
+}
+
 static void on_pollout(yacad_zmq_poller_impl_t *this, yacad_zmq_socket_impl_t *socket, yacad_on_pollout_fn on_pollout) {
      register_action(this, socket, on_pollout, this->on_pollout, ZMQ_POLLOUT);
 }
 
+static void on_fdin(yacad_zmq_poller_impl_t *this, int fd, yacad_on_fdin_fn on_fdin) {
+     zmq_pollitem_t zitem;
+     fdin_t fdin = { fd, on_fdin };
+
+     memset(&zitem, 0, sizeof(zmq_pollitem_t));
+     zitem.fd = fd;
+     zitem.events = ZMQ_POLLIN;
+     this->zitems->insert(this->zitems, this->zitems->count(this->zitems), &zitem);
+     this->on_fdin->insert(this->on_fdin, this->on_fdin->count(this->on_fdin), &fdin);
+}
+
+static yacad_on_fdin_fn get_on_fdin(yacad_zmq_poller_impl_t *this, int fd) {
+     yacad_on_fdin_fn result = NULL;
+     fdin_t *fdin;
+     int i, n = this->on_fdin->count(this->on_fdin);
+
+     for (i = 0; result == NULL && i < n; i++) {
+          fdin = this->on_fdin->get(this->on_fdin, i);
+          if (fdin->fd == fd) {
+               result = fdin->on_fdin;
+          }
+     }
+     return result;
+}
+
 static void set_timeout(yacad_zmq_poller_impl_t *this, yacad_timeout_fn timeout, yacad_on_timeout_fn on_timeout) {
      this->timeout = timeout;
      this->on_timeout = on_timeout;
@@ -149,7 +207,9 @@ static void run(yacad_zmq_poller_impl_t *this, void *data) {
      struct timeval now, tmout;
      long timeout;
      yacad_on_pollin_fn on_pollin;
+     yacad_on_pollin_bytes_fn on_pollin_bytes;
      yacad_on_pollout_fn on_pollout;
+     yacad_on_fdin_fn on_fdin;
      bool_t found;
      int n, c = 0;
      char *strmsgin = NULL;
@@ -165,7 +225,7 @@ static void run(yacad_zmq_poller_impl_t *this, void *data) {
           } else {
                gettimeofday(&now, NULL);
                this->timeout(I(this), &tmout, data);
-               timeout = 1000L * (tmout.tv_sec - now.tv_sec);
+               timeout = 1000L * (tmout.tv_sec - now.tv_sec) + (tmout.tv_usec - now.tv_usec) / 1000L;
                if (timeout < 0) {
                     timeout = 0;
                }
@@ -178,27 +238,38 @@ static void run(yacad_zmq_poller_impl_t *this, void *data) {
                r = true;
                for (i = 0; i < zn; i++) {
 
-                    if (zitems[i].revents & ZMQ_POLLIN) {
+                    if (zitems[i].socket == NULL) {
+                         if (zitems[i].revents & ZMQ_POLLIN) {
+                              on_fdin = get_on_fdin(this, zitems[i].fd);
+                              r = on_fdin(I(this), zitems[i].fd, data);
+                              this->running &= r;
+                              found = true;
+                         }
+                    } else if (zitems[i].revents & ZMQ_POLLIN) {
                          if (!zmqcheck(this->log, zmq_msg_init(&msg), error) ||
                              !zmqcheck(this->log, n = zmq_msg_recv(&msg, zitems[i].socket, 0), error)) {
                               this->running = false;
                          } else {
                               if (n > 0) {
-                                   if (c < n) {
+                                   if (c <= n) {
                                         if (c == 0) {
-                                             strmsgin = malloc(c = 4096);
-                                        } else {
-                                             do {
-                                                  c *= 2;
-                                             } while (c < n);
-                                             strmsgin = realloc(strmsgin, c);
+                                             c = 4096;
                                         }
+                                        while (c <= n) {
+                                             c *= 2;
+                                        }
+                                        strmsgin = realloc(strmsgin, c);
                                    }
                                    memcpy(strmsgin, zmq_msg_data(&msg), n);
                                    zmqcheck(this->log, zmq_msg_close(&msg), warn);
                                    strmsgin[n] = '\0';
+                                   on_pollin_bytes = this->on_pollin_bytes->get(this->on_pollin_bytes, zitems[i].socket);
                                    on_pollin = this->on_pollin->get(this->on_pollin, zitems[i].socket);
-                                   if (on_pollin == NULL) {
+                                   if (on_pollin_bytes != NULL) {
+                                        socket = this->sockets->get(this->sockets, zitems[i].socket);
+                                        r = on_pollin_bytes(I(this), socket, strmsgin, n, data);
+                                        this->running &= r;
+                                   } else if (on_pollin == NULL) {
                                         this->log(warn, "No pollin callback, lost message: %s", strmsgin);
                                    } else {
                                         socket = this->sockets->get(this->sockets, zitems[i].socket);
@@ -232,9 +303,12 @@ static void run(yacad_zmq_poller_impl_t *this, void *data) {
           }
      } while (this->running);
 
+     free(strmsgin);
      this->zitems->clear(this->zitems);
+     this->on_fdin->clear(this->on_fdin);
      this->sockets->clean(this->sockets, clean_nothing, NULL);
      this->on_pollin->clean(this->on_pollin, clean_nothing, NULL);
+     this->on_pollin_bytes->clean(this->on_pollin_bytes, clean_nothing, NULL);
      this->on_pollout->clean(this->on_pollout, clean_nothing, NULL);
 }
 
@@ -242,7 +316,9 @@ static void free_poller(yacad_zmq_poller_impl_t *this) {
      this->zitems->free(this->zitems);
      this->sockets->free(this->sockets);
      this->on_pollin->free(this->on_pollin);
+     this->on_pollin_bytes->free(this->on_pollin_bytes);
      this->on_pollout->free(this->on_pollout);
+     this->on_fdin->free(this->on_fdin);
      this->stopsocket->free(this->stopsocket);
      free(this->stopaddr);
      free(this);
@@ -250,7 +326,9 @@ static void free_poller(yacad_zmq_poller_impl_t *this) {
 
 static yacad_zmq_poller_t poller_fn = {
      .on_pollin=(yacad_zmq_poller_on_pollin_fn)on_pollin,
+     .on_pollin_bytes=(yacad_zmq_poller_on_pollin_bytes_fn)on_pollin_bytes,
      .on_pollout=(yacad_zmq_poller_on_pollout_fn)on_pollout,
+     .on_fdin=(yacad_zmq_poller_on_fdin_fn)on_fdin,
      .set_timeout = (yacad_zmq_poller_set_timeout_fn)set_timeout,
      .stop=(yacad_zmq_poller_stop_fn)stop,
      .run=(yacad_zmq_poller_run_fn)run,
@@ -300,7 +378,9 @@ yacad_zmq_poller_t *yacad_zmq_poller_new(logger_t log) {
      result->zitems = cad_new_array(stdlib_memory, sizeof(zmq_pollitem_t));
      result->sockets = cad_new_hash(stdlib_memory, hash_pointers);
      result->on_pollin = cad_new_hash(stdlib_memory, hash_pointers);
+     result->on_pollin_bytes = cad_new_hash(stdlib_memory, hash_pointers);
      result->on_pollout = cad_new_hash(stdlib_memory, hash_pointers);
+     result->on_fdin = cad_new_array(stdlib_memory, sizeof(fdin_t));
      result->stopaddr = stopaddr;
      result->timeout = NULL;
      result->running = false;
@@ -23,12 +23,16 @@ typedef struct yacad_zmq_poller_s yacad_zmq_poller_t;
 typedef struct yacad_zmq_socket_s yacad_zmq_socket_t;
 
 typedef bool_t (*yacad_on_pollin_fn)(yacad_zmq_poller_t *poller, yacad_zmq_socket_t *socket, const char *message, void *data);
+typedef bool_t (*yacad_on_pollin_bytes_fn)(yacad_zmq_poller_t *poller, yacad_zmq_socket_t *socket, const void *message, size_t size, void *data);
 typedef bool_t (*yacad_on_pollout_fn)(yacad_zmq_poller_t *poller, yacad_zmq_socket_t *socket, char * const*message, void *data);
+typedef bool_t (*yacad_on_fdin_fn)(yacad_zmq_poller_t *poller, int fd, void *data);
 typedef bool_t (*yacad_on_timeout_fn)(yacad_zmq_poller_t *poller, void *data);
 typedef void (*yacad_timeout_fn)(yacad_zmq_poller_t *poller, struct timeval *timeout, void *data);
 
 typedef void (*yacad_zmq_poller_on_pollin_fn)(yacad_zmq_poller_t *this, yacad_zmq_socket_t *socket, yacad_on_pollin_fn on_pollin);
+typedef void (*yacad_zmq_poller_on_pollin_bytes_fn)(yacad_zmq_poller_t *this, yacad_zmq_socket_t *socket, yacad_on_pollin_bytes_fn on_pollin_bytes);
 typedef void (*yacad_zmq_poller_on_pollout_fn)(yacad_zmq_poller_t *this, yacad_zmq_socket_t *socket, yacad_on_pollout_fn on_pollout);
+typedef void (*yacad_zmq_poller_on_fdin_fn)(yacad_zmq_poller_t *this, int fd, yacad_on_fdin_fn on_fdin);
 typedef void (*yacad_zmq_poller_set_timeout_fn)(yacad_zmq_poller_t *this, yacad_timeout_fn timeout, yacad_on_timeout_fn on_timeout);
 typedef void (*yacad_zmq_poller_stop_fn)(yacad_zmq_poller_t *this);
 typedef void (*yacad_zmq_poller_run_fn)(yacad_zmq_poller_t *this, void *data);
@@ -36,7 +40,9 @@ typedef void (*yacad_zmq_poller_free_fn)(yacad_zmq_poller_t *this);
 
 struct yacad_zmq_poller_s {
      yacad_zmq_poller_on_pollin_fn on_pollin;
+     yacad_zmq_poller_on_pollin_bytes_fn on_pollin_bytes; // binary messages, not NUL-terminated
      yacad_zmq_poller_on_pollout_fn on_pollout;
+     yacad_zmq_poller_on_fdin_fn on_fdin; // a plain file descriptor, e.g. a signalfd
      yacad_zmq_poller_set_timeout_fn set_timeout;
      yacad_zmq_poller_stop_fn stop;
      yacad_zmq_poller_run_fn run;
@@ -46,10 +52,12 @@ struct yacad_zmq_poller_s {
 yacad_zmq_poller_t *yacad_zmq_poller_new(logger_t log);
 
 typedef void (*yacad_zmq_socket_send_fn)(yacad_zmq_socket_t *this, const char *message);
+typedef bool_t (*yacad_zmq_socket_send_bytes_fn)(yacad_zmq_socket_t *this, const void *message, size_t size);
 typedef void (*yacad_zmq_socket_free_fn)(yacad_zmq_socket_t *this);
 
 struct yacad_zmq_socket_s {
      yacad_zmq_socket_send_fn send;
+     yacad_zmq_socket_send_bytes_fn send_bytes; // never blocks: false if the message could not be queued
      yacad_zmq_socket_free_fn free;
 };
 
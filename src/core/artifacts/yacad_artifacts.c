@@ -0,0 +1,592 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+
+#include "yacad_artifacts.h"
+#include "common/hash/yacad_sha256.h"
+#include "common/http/yacad_http.h"
+
+#define MAX_CONNECTIONS 64
+#define HEAD_MAX 8192
+#define MANIFEST_MAX 1048576
+#define TRANSFER_SIZE 1048576 // bytes moved per event, so that one transfer does not hold the others
+
+typedef enum {
+     state_head = 0, // reading the request line and headers
+     state_put, // receiving an object
+     state_post, // receiving a manifest
+     state_reply, // sending the status line and headers
+     state_send, // sending a file
+} state_t;
+
+typedef struct {
+     int fd;
+     state_t state;
+     time_t last; // of the last progress
+     char head[HEAD_MAX];
+     size_t head_size;
+     int file; // being received or sent; -1 if none
+     char *tmp; // the path of the received object, until checked
+     char hash[YACAD_SHA256_HEX];
+     unsigned long task;
+     char *body; // the manifest
+     size_t body_size;
+     size_t remaining; // bytes to receive or to send
+     off_t offset;
+     int pipe[2]; // to splice from the socket to the file
+     char reply[256];
+     size_t reply_size, reply_sent;
+} connection_t;
+
+typedef struct yacad_artifacts_impl_s {
+     yacad_artifacts_t fn;
+     yacad_conf_t *conf;
+     int stop[2];
+     pthread_t worker;
+     bool_t started;
+     connection_t *connections[MAX_CONNECTIONS];
+} yacad_artifacts_impl_t;
+
+static char *new_path(const char *format, ...) {
+     va_list args;
+     char *result;
+     size_t n;
+
+     va_start(args, format);
+     n = vsnprintf("", 0, format, args) + 1;
+     va_end(args);
+     result = malloc(n);
+     va_start(args, format);
+     vsnprintf(result, n, format, args);
+     va_end(args);
+     return result;
+}
+
+static bool_t valid_hash(const char *hash) {
+     int i;
+     for (i = 0; i < YACAD_SHA256_HEX - 1 && ((hash[i] >= '0' && hash[i] <= '9') || (hash[i] >= 'a' && hash[i] <= 'f')); i++) {
+     }
+     return i == YACAD_SHA256_HEX - 1 && hash[i] == '\0';
+}
+
+/* A relative path that stays below its root: no empty, "." or ".." component */
+static bool_t valid_path(const char *path) {
+     bool_t result = *path != '\0';
+     const char *c = path, *end;
+     size_t n;
+
+     while (result && *c != '\0') {
+          end = strchrnul(c, '/');
+          n = end - c;
+          result = n > 0 && !(n == 1 && c[0] == '.') && !(n == 2 && c[0] == '.' && c[1] == '.') && memchr(c, '\n', n) == NULL;
+          c = *end == '/' ? end + 1 : end;
+          if (*end == '/' && *c == '\0') {
+               result = false;
+          }
+     }
+     return result;
+}
+
+/* %XX escapes, in place */
+static void url_decode(char *target) {
+     char *in = target, *out = target;
+     unsigned int x;
+
+     while (*in != '\0') {
+          if (in[0] == '%' && isxdigit(in[1]) && isxdigit(in[2]) && sscanf(in + 1, "%2x", &x) == 1 && x != 0) {
+               *out++ = (char)x;
+               in += 3;
+          } else {
+               *out++ = *in++;
+          }
+     }
+     *out = '\0';
+}
+
+static char *object_path(yacad_artifacts_impl_t *this, const char *hash) {
+     return new_path("%s/objects/%.2s/%s", this->conf->get_artifacts_path(this->conf), hash, hash + 2);
+}
+
+/* The garbage collector removes the least recently used task artifacts first */
+static void touch_task(yacad_artifacts_impl_t *this, unsigned long task) {
+     char *path = new_path("%s/tasks/%lu", this->conf->get_artifacts_path(this->conf), task);
+     utimensat(AT_FDCWD, path, NULL, 0);
+     free(path);
+}
+
+static void make_parent(yacad_artifacts_impl_t *this, const char *path) {
+     char *dir = strdupa(path);
+     dir = dirname(dir);
+     if (mkpath(dir, 0700) != 0 && errno != EEXIST) {
+          this->conf->log(warn, "Could not create directory: %s (%s)", dir, strerror(errno));
+     }
+}
+
+static void close_connection(yacad_artifacts_impl_t *this, int i) {
+     connection_t *c = this->connections[i];
+
+     close(c->fd);
+     if (c->file >= 0) {
+          close(c->file);
+     }
+     if (c->tmp != NULL) {
+          unlink(c->tmp);
+          free(c->tmp);
+     }
+     if (c->pipe[0] >= 0) {
+          close(c->pipe[0]);
+          close(c->pipe[1]);
+     }
+     free(c->body);
+     free(c);
+     this->connections[i] = NULL;
+}
+
+static void set_reply(connection_t *c, int status, const char *reason, size_t size) {
+     c->reply_size = snprintf(c->reply, sizeof(c->reply), "HTTP/1.0 %d %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", status, reason, size);
+     c->reply_sent = 0;
+     c->state = state_reply;
+}
+
+/* HEAD or GET a file; GET sends it after the reply */
+static void start_get(yacad_artifacts_impl_t *this, connection_t *c, const char *path, bool_t send) {
+     struct stat st;
+
+     c->file = open(path, O_RDONLY | O_CLOEXEC);
+     if (c->file < 0 || fstat(c->file, &st) != 0 || !S_ISREG(st.st_mode)) {
+          set_reply(c, 404, "Not Found", 0);
+          if (c->file >= 0) {
+               close(c->file);
+               c->file = -1;
+          }
+     } else {
+          set_reply(c, 200, "OK", st.st_size);
+          c->offset = 0;
+          c->remaining = st.st_size;
+          if (!send) {
+               close(c->file);
+               c->file = -1;
+          }
+     }
+}
+
+static void finish_put(yacad_artifacts_impl_t *this, connection_t *c) {
+     char hash[YACAD_SHA256_HEX];
+     char *path;
+
+     if (!yacad_sha256_file(c->file, hash)) {
+          set_reply(c, 500, "Internal Server Error", 0);
+     } else if (strcmp(hash, c->hash)) {
+          this->conf->log(warn, "Artifact upload does not match its hash: %s", c->hash);
+          set_reply(c, 422, "Unprocessable Entity", 0);
+     } else {
+          path = object_path(this, c->hash);
+          make_parent(this, path);
+          // a concurrent upload of the same blob may have won: it is the same content
+          if (link(c->tmp, path) != 0 && errno != EEXIST) {
+               this->conf->log(warn, "Could not store artifact %s: %s", path, strerror(errno));
+               set_reply(c, 500, "Internal Server Error", 0);
+          } else {
+               set_reply(c, 201, "Created", 0);
+          }
+          free(path);
+     }
+     close(c->file);
+     c->file = -1;
+     unlink(c->tmp);
+     free(c->tmp);
+     c->tmp = NULL;
+}
+
+static void start_put(yacad_artifacts_impl_t *this, connection_t *c, const char *extra, size_t size, size_t length) {
+     c->tmp = new_path("%s/tmp/put-XXXXXX", this->conf->get_artifacts_path(this->conf));
+     make_parent(this, c->tmp);
+     c->file = mkostemp(c->tmp, O_CLOEXEC);
+     if (c->file < 0 || pipe2(c->pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+          this->conf->log(warn, "Could not receive artifact: %s", strerror(errno));
+          set_reply(c, 500, "Internal Server Error", 0);
+          free(c->tmp);
+          c->tmp = NULL;
+     } else {
+          if (size > length) {
+               size = length;
+          }
+          if (size > 0 && write(c->file, extra, size) != size) {
+               this->conf->log(warn, "Could not write artifact: %s", strerror(errno));
+          }
+          c->remaining = length - size;
+          c->state = state_put;
+          if (c->remaining == 0) {
+               finish_put(this, c);
+          }
+     }
+}
+
+/* Kept next to the task artifacts: the result cache hashes it (see core/cache/yacad_cache.h) */
+static void save_manifest(yacad_artifacts_impl_t *this, connection_t *c) {
+     char *path = new_path("%s/tasks/%lu.manifest", this->conf->get_artifacts_path(this->conf), c->task);
+     char *tmp = new_path("%s.tmp", path);
+     int fd;
+
+     make_parent(this, path);
+     fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+     if (fd < 0 || write(fd, c->body, c->body_size) != c->body_size || close(fd) != 0 || rename(tmp, path) != 0) {
+          this->conf->log(warn, "Task %lu: could not save the artifacts manifest: %s", c->task, strerror(errno));
+          unlink(tmp);
+     }
+     free(tmp);
+     free(path);
+}
+
+/* Each line: "<hash> <path>"; the path is relative to the task artifacts */
+static void link_manifest(yacad_artifacts_impl_t *this, connection_t *c) {
+     const char *artifacts_path = this->conf->get_artifacts_path(this->conf);
+     char *line, *next, *path, *object, *task_path;
+     int linked = 0, failed = 0;
+
+     c->body[c->body_size] = '\0';
+     save_manifest(this, c);
+     // even without artifacts, for the garbage collector to find the manifest
+     task_path = new_path("%s/tasks/%lu", artifacts_path, c->task);
+     if (mkpath(task_path, 0700) != 0 && errno != EEXIST) {
+          this->conf->log(warn, "Could not create directory: %s (%s)", task_path, strerror(errno));
+     }
+     free(task_path);
+     for (line = c->body; line != NULL && *line != '\0'; line = next) {
+          next = strchr(line, '\n');
+          if (next != NULL) {
+               *next++ = '\0';
+          }
+          path = line + YACAD_SHA256_HEX;
+          if (strlen(line) < YACAD_SHA256_HEX || line[YACAD_SHA256_HEX - 1] != ' ') {
+               failed++;
+          } else {
+               line[YACAD_SHA256_HEX - 1] = '\0';
+               if (!valid_hash(line) || !valid_path(path)) {
+                    failed++;
+               } else {
+                    object = object_path(this, line);
+                    task_path = new_path("%s/tasks/%lu/%s", artifacts_path, c->task, path);
+                    make_parent(this, task_path);
+                    unlink(task_path);
+                    if (link(object, task_path) == 0) {
+                         linked++;
+                    } else {
+                         this->conf->log(warn, "Task %lu: could not link artifact %s: %s", c->task, path, strerror(errno));
+                         failed++;
+                    }
+                    free(task_path);
+                    free(object);
+               }
+          }
+     }
+
+     this->conf->log(info, "Task %lu: %d artifacts", c->task, linked);
+     touch_task(this, c->task);
+     if (failed == 0) {
+          set_reply(c, 200, "OK", 0);
+     } else {
+          // incomplete artifacts must not be reused by the result cache
+          task_path = new_path("%s/tasks/%lu.manifest", artifacts_path, c->task);
+          unlink(task_path);
+          free(task_path);
+          set_reply(c, 409, "Conflict", 0);
+     }
+}
+
+static void start_post(yacad_artifacts_impl_t *this, connection_t *c, const char *extra, size_t size, size_t length) {
+     if (length > MANIFEST_MAX) {
+          set_reply(c, 413, "Payload Too Large", 0);
+     } else {
+          if (size > length) {
+               size = length;
+          }
+          c->body = malloc(length + 1);
+          memcpy(c->body, extra, size);
+          c->body_size = size;
+          c->remaining = length - size;
+          c->state = state_post;
+          if (c->remaining == 0) {
+               link_manifest(this, c);
+          }
+     }
+}
+
+static void route(yacad_artifacts_impl_t *this, connection_t *c, char *body, size_t size) {
+     char method[8], target[1024], *length_header, *task_path;
+     size_t length = 0;
+     int n = 0;
+     bool_t get;
+
+     length_header = strcasestr(c->head, "\r\ncontent-length:");
+     if (length_header != NULL) {
+          length = strtoul(length_header + 17, NULL, 10);
+     }
+
+     if (sscanf(c->head, "%7s %1023s HTTP/", method, target) != 2) {
+          set_reply(c, 400, "Bad Request", 0);
+     } else {
+          url_decode(target);
+          get = !strcmp(method, "GET");
+          if (!strncmp(target, "/objects/", 9) && valid_hash(target + 9)) {
+               strcpy(c->hash, target + 9);
+               if (get || !strcmp(method, "HEAD")) {
+                    task_path = object_path(this, c->hash);
+                    // a runner told that the object exists does not upload it: the GC grace delay starts again
+                    utimensat(AT_FDCWD, task_path, NULL, 0);
+                    start_get(this, c, task_path, get);
+                    free(task_path);
+               } else if (!strcmp(method, "PUT")) {
+                    start_put(this, c, body, size, length);
+               } else {
+                    set_reply(c, 405, "Method Not Allowed", 0);
+               }
+          } else if (sscanf(target, "/tasks/%lu%n", &c->task, &n) == 1 && n > 0) {
+               if (target[n] == '\0' && !strcmp(method, "POST")) {
+                    start_post(this, c, body, size, length);
+               } else if (target[n] == '/' && valid_path(target + n + 1) && (get || !strcmp(method, "HEAD"))) {
+                    task_path = new_path("%s/tasks/%lu/%s", this->conf->get_artifacts_path(this->conf), c->task, target + n + 1);
+                    start_get(this, c, task_path, get);
+                    free(task_path);
+                    if (get) {
+                         touch_task(this, c->task);
+                    }
+               } else {
+                    set_reply(c, 404, "Not Found", 0);
+               }
+          } else {
+               set_reply(c, 404, "Not Found", 0);
+          }
+     }
+}
+
+static void read_head(yacad_artifacts_impl_t *this, int i) {
+     connection_t *c = this->connections[i];
+     ssize_t n = read(c->fd, c->head + c->head_size, HEAD_MAX - 1 - c->head_size);
+     char *end;
+
+     if (n == 0 || (n < 0 && errno != EAGAIN)) {
+          close_connection(this, i);
+     } else if (n > 0) {
+          c->head_size += n;
+          c->head[c->head_size] = '\0';
+          end = memmem(c->head, c->head_size, "\r\n\r\n", 4);
+          if (end != NULL) {
+               end[2] = '\0';
+               route(this, c, end + 4, c->head_size - (end + 4 - c->head));
+          } else if (c->head_size == HEAD_MAX - 1) {
+               set_reply(c, 431, "Request Header Fields Too Large", 0);
+          }
+     }
+}
+
+static void receive_object(yacad_artifacts_impl_t *this, int i) {
+     connection_t *c = this->connections[i];
+     ssize_t n, m = 0, moved;
+
+     n = splice(c->fd, NULL, c->pipe[1], NULL, c->remaining < TRANSFER_SIZE ? c->remaining : TRANSFER_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+     for (moved = 0; n > 0 && moved < n && m >= 0; moved += m) {
+          m = splice(c->pipe[0], NULL, c->file, NULL, n - moved, SPLICE_F_MOVE);
+     }
+     if (n == 0 || (n < 0 && errno != EAGAIN) || m < 0) {
+          // the upload is incomplete: the temporary file is removed
+          close_connection(this, i);
+     } else if (n > 0) {
+          c->remaining -= n;
+          if (c->remaining == 0) {
+               finish_put(this, c);
+          }
+     }
+}
+
+static void receive_manifest(yacad_artifacts_impl_t *this, int i) {
+     connection_t *c = this->connections[i];
+     ssize_t n = read(c->fd, c->body + c->body_size, c->remaining);
+
+     if (n == 0 || (n < 0 && errno != EAGAIN)) {
+          close_connection(this, i);
+     } else if (n > 0) {
+          c->body_size += n;
+          c->remaining -= n;
+          if (c->remaining == 0) {
+               link_manifest(this, c);
+          }
+     }
+}
+
+static void send_reply(yacad_artifacts_impl_t *this, int i) {
+     connection_t *c = this->connections[i];
+     ssize_t n = send(c->fd, c->reply + c->reply_sent, c->reply_size - c->reply_sent, MSG_NOSIGNAL);
+
+     if (n < 0 && errno != EAGAIN) {
+          close_connection(this, i);
+     } else if (n > 0) {
+          c->reply_sent += n;
+          if (c->reply_sent == c->reply_size) {
+               if (c->file >= 0 && c->remaining > 0) {
+                    c->state = state_send;
+               } else {
+                    close_connection(this, i);
+               }
+          }
+     }
+}
+
+static void send_file(yacad_artifacts_impl_t *this, int i) {
+     connection_t *c = this->connections[i];
+     ssize_t n = sendfile(c->fd, c->file, &c->offset, c->remaining < TRANSFER_SIZE ? c->remaining : TRANSFER_SIZE);
+
+     if (n == 0 || (n < 0 && errno != EAGAIN)) {
+          close_connection(this, i);
+     } else if (n > 0) {
+          c->remaining -= n;
+          if (c->remaining == 0) {
+               close_connection(this, i);
+          }
+     }
+}
+
+static void accept_connections(yacad_artifacts_impl_t *this, int listener) {
+     connection_t *c;
+     int i, fd = 0;
+
+     for (i = 0; fd >= 0 && i < MAX_CONNECTIONS; i++) {
+          if (this->connections[i] == NULL) {
+               fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+               if (fd >= 0) {
+                    c = calloc(1, sizeof(connection_t));
+                    c->fd = fd;
+                    c->state = state_head;
+                    c->last = time(NULL);
+                    c->file = -1;
+                    c->pipe[0] = c->pipe[1] = -1;
+                    this->connections[i] = c;
+               }
+          }
+     }
+}
+
+static void *worker_routine(yacad_artifacts_impl_t *this) {
+     struct pollfd fds[MAX_CONNECTIONS + 2];
+     int map[MAX_CONNECTIONS + 2];
+     int listener, i, n;
+     bool_t running = true;
+     time_t now;
+     connection_t *c;
+
+     set_thread_name("artifacts");
+
+     listener = yacad_http_listen(this->conf->log, this->conf->get_artifacts_name(this->conf));
+     running = listener >= 0;
+     while (running) {
+          fds[0].fd = this->stop[0];
+          fds[0].events = POLLIN;
+          fds[1].fd = listener;
+          fds[1].events = POLLIN;
+          n = 2;
+          for (i = 0; i < MAX_CONNECTIONS; i++) {
+               c = this->connections[i];
+               if (c != NULL) {
+                    fds[n].fd = c->fd;
+                    fds[n].events = c->state == state_reply || c->state == state_send ? POLLOUT : POLLIN;
+                    map[n++] = i;
+               }
+          }
+
+          if (poll(fds, n, 1000) < 0 && errno != EINTR) {
+               this->conf->log(error, "Artifacts poll failed: %s", strerror(errno));
+               running = false;
+          } else if (fds[0].revents & POLLIN) {
+               running = false;
+          } else {
+               now = time(NULL);
+               for (i = 2; i < n; i++) {
+                    c = this->connections[map[i]];
+                    if (fds[i].revents != 0) {
+                         c->last = now;
+                         switch(c->state) {
+                         case state_head:
+                              read_head(this, map[i]);
+                              break;
+                         case state_put:
+                              receive_object(this, map[i]);
+                              break;
+                         case state_post:
+                              receive_manifest(this, map[i]);
+                              break;
+                         case state_reply:
+                              send_reply(this, map[i]);
+                              break;
+                         case state_send:
+                              send_file(this, map[i]);
+                              break;
+                         }
+                    } else if (now - c->last > YACAD_HTTP_TIMEOUT) {
+                         close_connection(this, map[i]);
+                    }
+               }
+               if (fds[1].revents & POLLIN) {
+                    accept_connections(this, listener);
+               }
+          }
+     }
+
+     for (i = 0; i < MAX_CONNECTIONS; i++) {
+          if (this->connections[i] != NULL) {
+               close_connection(this, i);
+          }
+     }
+     if (listener >= 0) {
+          close(listener);
+     }
+     return this;
+}
+
+static void free_(yacad_artifacts_impl_t *this) {
+     if (this->started) {
+          if (write(this->stop[1], "", 1) != 1) {
+               this->conf->log(warn, "Could not stop the artifacts server: %s", strerror(errno));
+          }
+          pthread_join(this->worker, NULL);
+     }
+     close(this->stop[0]);
+     close(this->stop[1]);
+     free(this);
+}
+
+static yacad_artifacts_t impl_fn = {
+     .free = (yacad_artifacts_free_fn)free_,
+};
+
+yacad_artifacts_t *yacad_artifacts_new(yacad_conf_t *conf) {
+     yacad_artifacts_impl_t *result = malloc(sizeof(yacad_artifacts_impl_t));
+
+     result->fn = impl_fn;
+     result->conf = conf;
+     memset(result->connections, 0, sizeof(result->connections));
+     result->started = pipe2(result->stop, O_CLOEXEC) == 0
+          && pthread_create(&(result->worker), NULL, (void*(*)(void*))worker_routine, result) == 0;
+     if (!result->started) {
+          conf->log(error, "Could not start the artifacts server");
+     }
+
+     return I(result);
+}
@@ -0,0 +1,41 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __YACAD_ARTIFACTS_H__
+#define __YACAD_ARTIFACTS_H__
+
+#include "yacad.h"
+#include "core/conf/yacad_conf.h"
+
+/* The content-addressed artifacts store, served over HTTP on
+ * conf->get_artifacts_name() from a thread of its own:
+ * - objects/<hash>: the blobs, by SHA-256; HEAD tells whether one is
+ *   known, PUT uploads one (checked against its hash), GET sends it;
+ * - tasks/<id>/<path>: the artifacts of a task, hard links to the
+ *   blobs; POST tasks/<id> with "<hash> <path>" lines creates them.
+ * The files are sent with sendfile(2) and received with splice(2). */
+
+typedef struct yacad_artifacts_s yacad_artifacts_t;
+
+typedef void (*yacad_artifacts_free_fn)(yacad_artifacts_t *this);
+
+struct yacad_artifacts_s {
+     yacad_artifacts_free_fn free;
+};
+
+yacad_artifacts_t *yacad_artifacts_new(yacad_conf_t *conf);
+
+#endif /* __YACAD_ARTIFACTS_H__ */
@@ -0,0 +1,353 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <dirent.h>
+#include <fcntl.h>
+
+#include "yacad_cache.h"
+#include "common/hash/yacad_sha256.h"
+#include "common/json/yacad_json_finder.h"
+
+#define CACHE_KEY "cache_key"
+/* bytes; a task after a larger manifest is not cached, its hash would hold the scheduler too long */
+#define MANIFEST_MAX 1048576
+
+/* the hard links of a reused result, made by the linker thread */
+typedef struct {
+     char *from;
+     char *to;
+} link_job_t;
+
+typedef struct yacad_cache_impl_s {
+     yacad_cache_t fn;
+     logger_t log;
+     char *path; // of the artifacts
+     pthread_t linker;
+     bool_t started;
+     pthread_mutex_t lock;
+     pthread_cond_t cond;
+     cad_array_t *jobs; // link_job_t, protected by lock
+     bool_t stopping; // protected by lock
+} yacad_cache_impl_t;
+
+static char *new_path(const char *format, ...) {
+     va_list args;
+     char *result;
+     size_t n;
+
+     va_start(args, format);
+     n = vsnprintf("", 0, format, args) + 1;
+     va_end(args);
+     result = malloc(n);
+     va_start(args, format);
+     vsnprintf(result, n, format, args);
+     va_end(args);
+     return result;
+}
+
+static bool_t is_cached(yacad_cache_impl_t *this, yacad_task_t *task) {
+     bool_t result = false;
+     yacad_json_finder_t *v = yacad_json_finder_new(this->log, json_type_const, "%s");
+     json_value_t *jrun = task->get_run(task);
+     json_const_t *jcache;
+
+     if (jrun != NULL) {
+          v->visit(v, jrun, "cache");
+          jcache = v->get_const(v);
+          result = jcache != NULL && jcache->value(jcache) == json_true;
+     }
+
+     I(v)->free(I(v));
+     return result;
+}
+
+static void hash_string(yacad_sha256_t *sha, const char *string) {
+     // with its NUL, so that the fields cannot run into each other
+     yacad_sha256_update(sha, string == NULL ? "" : string, string == NULL ? 1 : strlen(string) + 1);
+}
+
+static void hash_json(yacad_sha256_t *sha, json_value_t *value) {
+     char *string = NULL;
+     json_output_stream_t *out;
+     json_visitor_t *writer;
+
+     if (value == NULL) {
+          hash_string(sha, NULL);
+     } else {
+          out = new_json_output_stream_from_string(&string, stdlib_memory);
+          writer = json_write_to(out, stdlib_memory, 0);
+          value->accept(value, writer);
+          hash_string(sha, string);
+          writer->free(writer);
+          out->free(out);
+          free(string);
+     }
+}
+
+static void hash_file(yacad_sha256_t *sha, const char *path) {
+     char buffer[4096];
+     ssize_t n = 1;
+     int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+     while (fd >= 0 && n > 0) {
+          n = read(fd, buffer, sizeof(buffer));
+          if (n > 0) {
+               yacad_sha256_update(sha, buffer, n);
+          }
+     }
+     hash_string(sha, NULL);
+     if (fd >= 0) {
+          close(fd);
+     }
+}
+
+static char *manifest_path(yacad_cache_impl_t *this, unsigned long id) {
+     return new_path("%s/tasks/%lu.manifest", this->path, id);
+}
+
+static bool_t manifest_fits(yacad_cache_impl_t *this, unsigned long upstream) {
+     bool_t result = true;
+     struct stat st;
+     char *path;
+
+     if (upstream > 0) {
+          path = manifest_path(this, upstream);
+          if (stat(path, &st) == 0 && st.st_size > MANIFEST_MAX) {
+               this->log(info, "Task after %lu not cached: its manifest is too large", upstream);
+               result = false;
+          }
+          free(path);
+     }
+     return result;
+}
+
+static void set_key(yacad_task_t *task, const char *key) {
+     cad_hash_t *env = task->get_env(task);
+     char *old = env->get(env, CACHE_KEY);
+
+     // the env goes down the pipeline: a key is only valid for its own task
+     if (old != NULL) {
+          env->del(env, CACHE_KEY);
+          free(old);
+     }
+     if (key != NULL) {
+          env->set(env, CACHE_KEY, strdup(key));
+     }
+}
+
+static unsigned long lookup(yacad_cache_impl_t *this, yacad_task_t *task, unsigned long upstream) {
+     unsigned long result = 0;
+     yacad_sha256_t sha;
+     yacad_runnerid_t *runnerid = task->get_runnerid(task);
+     cad_hash_t *env = task->get_env(task);
+     char key[YACAD_SHA256_HEX];
+     char *path;
+     FILE *entry;
+     int artifacts = 0;
+
+     if (!is_cached(this, task) || !manifest_fits(this, upstream)) {
+          set_key(task, NULL);
+     } else {
+          yacad_sha256_init(&sha);
+          hash_json(&sha, task->get_run(task));
+          hash_json(&sha, task->get_source(task));
+          hash_string(&sha, env->get(env, "ref"));
+          hash_string(&sha, runnerid->get_arch(runnerid));
+          if (upstream > 0) {
+               path = manifest_path(this, upstream);
+               hash_file(&sha, path);
+               free(path);
+          }
+          yacad_sha256_final(&sha, key);
+          set_key(task, key);
+
+          path = new_path("%s/cache/%s", this->path, key);
+          entry = fopen(path, "r");
+          if (entry != NULL) {
+               if (fscanf(entry, "%lu %d", &result, &artifacts) != 2) {
+                    result = 0;
+               }
+               fclose(entry);
+          }
+          if (result != 0 && artifacts) {
+               free(path);
+               path = manifest_path(this, result);
+               if (access(path, F_OK) != 0) {
+                    this->log(debug, "Cache entry %s: the artifacts of task %lu are gone", key, result);
+                    result = 0;
+               }
+          }
+          free(path);
+     }
+
+     return result;
+}
+
+static void link_tree(yacad_cache_impl_t *this, const char *from, const char *to) {
+     DIR *dir = opendir(from);
+     struct dirent *entry;
+     struct stat st;
+     char *source, *target;
+
+     if (dir != NULL) {
+          if (mkpath(to, 0700) != 0 && errno != EEXIST) {
+               this->log(warn, "Could not create directory: %s (%s)", to, strerror(errno));
+          }
+          while ((entry = readdir(dir)) != NULL) {
+               if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, "..")) {
+                    source = new_path("%s/%s", from, entry->d_name);
+                    target = new_path("%s/%s", to, entry->d_name);
+                    if (lstat(source, &st) == 0) {
+                         if (S_ISDIR(st.st_mode)) {
+                              link_tree(this, source, target);
+                         } else if (link(source, target) != 0 && errno != EEXIST) {
+                              this->log(warn, "Could not link %s: %s", target, strerror(errno));
+                         }
+                    }
+                    free(target);
+                    free(source);
+               }
+          }
+          closedir(dir);
+     }
+}
+
+static void *linker_routine(yacad_cache_impl_t *this) {
+     link_job_t job;
+     bool_t done = false;
+
+     set_thread_name("cache linker");
+
+     pthread_mutex_lock(&(this->lock));
+     while (!done) {
+          if (this->jobs->count(this->jobs) > 0) {
+               job = *(link_job_t*)this->jobs->get(this->jobs, 0);
+               this->jobs->del(this->jobs, 0);
+               pthread_mutex_unlock(&(this->lock));
+               link_tree(this, job.from, job.to);
+               free(job.to);
+               free(job.from);
+               pthread_mutex_lock(&(this->lock));
+          } else if (this->stopping) {
+               done = true;
+          } else {
+               pthread_cond_wait(&(this->cond), &(this->lock));
+          }
+     }
+     pthread_mutex_unlock(&(this->lock));
+
+     return this;
+}
+
+/* The manifest is linked at once: the next task needs it. The tree may be large, the linker thread links it. */
+static void reuse(yacad_cache_impl_t *this, yacad_task_t *task, unsigned long cached) {
+     unsigned long id = task->get_id(task);
+     link_job_t job = { new_path("%s/tasks/%lu", this->path, cached), new_path("%s/tasks/%lu", this->path, id) };
+     char *from_manifest = manifest_path(this, cached);
+     char *to_manifest = manifest_path(this, id);
+
+     if (link(from_manifest, to_manifest) != 0 && errno != ENOENT && errno != EEXIST) {
+          this->log(warn, "Could not link %s: %s", to_manifest, strerror(errno));
+     }
+     if (this->started) {
+          pthread_mutex_lock(&(this->lock));
+          this->jobs->insert(this->jobs, this->jobs->count(this->jobs), &job);
+          pthread_cond_signal(&(this->cond));
+          pthread_mutex_unlock(&(this->lock));
+     } else {
+          link_tree(this, job.from, job.to);
+          free(job.to);
+          free(job.from);
+     }
+     this->log(info, "Task %lu: result reused from task %lu", id, cached);
+
+     free(to_manifest);
+     free(from_manifest);
+}
+
+static void store(yacad_cache_impl_t *this, yacad_task_t *task) {
+     cad_hash_t *env = task->get_env(task);
+     const char *key = env->get(env, CACHE_KEY);
+     char *path, *tmp, *manifest;
+     FILE *entry;
+
+     if (key != NULL && strlen(key) == YACAD_SHA256_HEX - 1 && strchr(key, '/') == NULL) {
+          path = new_path("%s/cache/%s", this->path, key);
+          tmp = new_path("%s.tmp", path);
+          manifest = manifest_path(this, task->get_id(task));
+          entry = fopen(tmp, "w");
+          if (entry == NULL) {
+               this->log(warn, "Could not write cache entry %s: %s", tmp, strerror(errno));
+          } else {
+               fprintf(entry, "%lu %d\n", task->get_id(task), access(manifest, F_OK) == 0);
+               fclose(entry);
+               rename(tmp, path);
+               this->log(debug, "Task %lu: cached as %s", task->get_id(task), key);
+          }
+          free(manifest);
+          free(tmp);
+          free(path);
+     }
+}
+
+/* The pending links are made first */
+static void free_(yacad_cache_impl_t *this) {
+     if (this->started) {
+          pthread_mutex_lock(&(this->lock));
+          this->stopping = true;
+          pthread_cond_signal(&(this->cond));
+          pthread_mutex_unlock(&(this->lock));
+          pthread_join(this->linker, NULL);
+     }
+     this->jobs->free(this->jobs);
+     pthread_cond_destroy(&(this->cond));
+     pthread_mutex_destroy(&(this->lock));
+     free(this->path);
+     free(this);
+}
+
+static yacad_cache_t impl_fn = {
+     .lookup = (yacad_cache_lookup_fn)lookup,
+     .reuse = (yacad_cache_reuse_fn)reuse,
+     .store = (yacad_cache_store_fn)store,
+     .free = (yacad_cache_free_fn)free_,
+};
+
+yacad_cache_t *yacad_cache_new(yacad_conf_t *conf) {
+     yacad_cache_impl_t *result = malloc(sizeof(yacad_cache_impl_t));
+     char *cache_path;
+
+     result->fn = impl_fn;
+     result->log = conf->log;
+     result->path = strdup(conf->get_artifacts_path(conf));
+     result->jobs = cad_new_array(stdlib_memory, sizeof(link_job_t));
+     result->stopping = false;
+     pthread_mutex_init(&(result->lock), NULL);
+     pthread_cond_init(&(result->cond), NULL);
+
+     cache_path = new_path("%s/cache", result->path);
+     if (mkpath(cache_path, 0700) != 0 && errno != EEXIST) {
+          conf->log(warn, "Could not create directory: %s (%s)", cache_path, strerror(errno));
+     }
+     free(cache_path);
+
+     result->started = pthread_create(&(result->linker), NULL, (void*(*)(void*))linker_routine, result) == 0;
+     if (!result->started) {
+          conf->log(warn, "Could not start the cache linker, the reused results are linked by the scheduler");
+     }
+
+     return I(result);
+}
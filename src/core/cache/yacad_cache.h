@@ -0,0 +1,54 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __YACAD_CACHE_H__
+#define __YACAD_CACHE_H__
+
+#include "yacad.h"
+#include "common/task/yacad_task.h"
+#include "core/conf/yacad_conf.h"
+
+/**
+ * Task result cache, for the tasks whose run says "cache": true.
+ *
+ * The key is a hash of the resolved run and source, the ref, the
+ * runner arch and the artifacts manifest of the upstream task; it is
+ * kept in the task env as "cache_key". A successful task is recorded
+ * in <artifacts>/cache/<key>; a later task with the same key reuses
+ * its result and its artifacts instead of running again, as long as
+ * those artifacts were not collected.
+ */
+
+typedef struct yacad_cache_s yacad_cache_t;
+
+/* the id of the task whose result can be reused, 0 if none; upstream is the previous task in the pipeline, 0 if none */
+typedef unsigned long (*yacad_cache_lookup_fn)(yacad_cache_t *this, yacad_task_t *task, unsigned long upstream);
+/* links the artifacts of the cached task to the task, which must have its id; the manifest at once, the files in the background */
+typedef void (*yacad_cache_reuse_fn)(yacad_cache_t *this, yacad_task_t *task, unsigned long cached);
+/* records the result of a successful task */
+typedef void (*yacad_cache_store_fn)(yacad_cache_t *this, yacad_task_t *task);
+typedef void (*yacad_cache_free_fn)(yacad_cache_t *this);
+
+struct yacad_cache_s {
+     yacad_cache_lookup_fn lookup;
+     yacad_cache_reuse_fn reuse;
+     yacad_cache_store_fn store;
+     yacad_cache_free_fn free;
+};
+
+yacad_cache_t *yacad_cache_new(yacad_conf_t *conf);
+
+#endif /* __YACAD_CACHE_H__ */
@@ -0,0 +1,257 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "yacad_checker.h"
+#include "common/json/yacad_json_finder.h"
+#include "common/zmq/yacad_zmq.h"
+
+#define LOCAL_UPSTREAM "localhost"
+
+typedef struct {
+     yacad_project_t *project;
+     char *upstream;
+} job_t;
+
+typedef struct yacad_checker_impl_s {
+     yacad_checker_t fn;
+     yacad_conf_t *conf;
+     pthread_mutex_t lock;
+     pthread_cond_t cond;
+     cad_array_t *queue;    // job_t, oldest first
+     cad_hash_t *pending;   // project name -> project, queued or being checked
+     cad_hash_t *upstreams; // upstream host -> int *, checks running against that host
+     int per_upstream;
+     int nworkers;
+     bool_t running;
+     pthread_t *workers;
+     char *address; // -> _
+     char _[0];
+} yacad_checker_impl_t;
+
+/* The upstream host of the project: "host[:port]" of a "scheme://[user@]host[:port]/path" or
+ * "[user@]host:path" url; local repositories all share LOCAL_UPSTREAM. */
+static char *get_upstream(yacad_checker_impl_t *this, yacad_project_t *project) {
+     char *result = NULL;
+     yacad_scm_t *scm = project->get_scm(project);
+     yacad_json_finder_t *u = yacad_json_finder_new(this->conf->log, json_type_string, "upstream_url");
+     json_string_t *jurl = NULL;
+     char *url, *host, *end, *at;
+     size_t n;
+
+     if (scm != NULL) {
+          u->visit(u, scm->get_desc(scm));
+          jurl = u->get_string(u);
+     }
+     if (jurl != NULL) {
+          n = jurl->utf8(jurl, "", 0) + 1;
+          url = alloca(n);
+          jurl->utf8(jurl, url, n);
+
+          host = strstr(url, "://");
+          if (host != NULL) {
+               host += 3;
+               end = strchrnul(host, '/');
+          } else {
+               host = url;
+               end = strchrnul(host, ':');
+               if (*end == 0 || memchr(host, '/', end - host) != NULL) {
+                    // a local path
+                    host = end = url;
+               }
+          }
+          at = memchr(host, '@', end - host);
+          if (at != NULL) {
+               host = at + 1;
+          }
+          if (end > host && strncmp(host, "file", end - host)) {
+               result = strndup(host, end - host);
+          }
+     }
+     I(u)->free(I(u));
+
+     return result == NULL ? strdup(LOCAL_UPSTREAM) : result;
+}
+
+/* Takes the oldest queued job whose upstream is not busy; must be called with the lock held. */
+static bool_t take_job(yacad_checker_impl_t *this, job_t *job) {
+     int i, n = this->queue->count(this->queue);
+     job_t *candidate;
+     int *running;
+
+     for (i = 0; i < n; i++) {
+          candidate = this->queue->get(this->queue, i);
+          running = this->upstreams->get(this->upstreams, candidate->upstream);
+          if (running == NULL) {
+               running = malloc(sizeof(int));
+               *running = 0;
+               this->upstreams->set(this->upstreams, candidate->upstream, running);
+          }
+          if (*running < this->per_upstream) {
+               (*running)++;
+               *job = *candidate;
+               this->queue->del(this->queue, i);
+               return true;
+          }
+     }
+     return false;
+}
+
+/* Must be called with the lock held. */
+static void release_job(yacad_checker_impl_t *this, job_t *job) {
+     int *running = this->upstreams->get(this->upstreams, job->upstream);
+
+     if (running != NULL && --(*running) == 0) {
+          this->upstreams->del(this->upstreams, job->upstream);
+          free(running);
+     }
+     this->pending->del(this->pending, job->project->get_name(job->project));
+     free(job->upstream);
+}
+
+static void send_task(yacad_task_t *task, yacad_zmq_socket_t *zresult) {
+     const char *name = task->get_project_name(task);
+     char *serial = task->serialize(task);
+     size_t n = snprintf("", 0, "%s\n%s", name, serial) + 1;
+     char *message = malloc(n);
+
+     snprintf(message, n, "%s\n%s", name, serial);
+     zresult->send(zresult, message);
+
+     free(message);
+     free(serial);
+     task->free(task);
+}
+
+static void *worker_routine(yacad_checker_impl_t *this) {
+     yacad_zmq_socket_t *zresult;
+     job_t job;
+
+     set_thread_name("scm check");
+
+     zresult = yacad_zmq_socket_connect(this->conf->log, this->address, ZMQ_PUSH);
+     if (zresult == NULL) {
+          this->conf->log(error, "Could not connect the SCM check results to %s", this->address);
+          return this;
+     }
+
+     pthread_mutex_lock(&(this->lock));
+     while (this->running) {
+          if (!take_job(this, &job)) {
+               pthread_cond_wait(&(this->cond), &(this->lock));
+          } else {
+               pthread_mutex_unlock(&(this->lock));
+
+               this->conf->log(debug, "Checking project %s (upstream %s)", job.project->get_name(job.project), job.upstream);
+               job.project->check(job.project, (yacad_project_on_task_fn)send_task, zresult);
+
+               pthread_mutex_lock(&(this->lock));
+               release_job(this, &job);
+               // an upstream slot was freed
+               pthread_cond_broadcast(&(this->cond));
+          }
+     }
+     pthread_mutex_unlock(&(this->lock));
+
+     zresult->free(zresult);
+     return this;
+}
+
+static void check(yacad_checker_impl_t *this, yacad_project_t *project) {
+     const char *name = project->get_name(project);
+     job_t job;
+
+     pthread_mutex_lock(&(this->lock));
+     if (this->pending->get(this->pending, name) != NULL) {
+          this->conf->log(debug, "Project %s is already being checked", name);
+     } else {
+          job.project = project;
+          job.upstream = get_upstream(this, project);
+          this->pending->set(this->pending, name, project);
+          this->queue->insert(this->queue, this->queue->count(this->queue), &job);
+          pthread_cond_signal(&(this->cond));
+     }
+     pthread_mutex_unlock(&(this->lock));
+}
+
+static void clean_upstream(cad_hash_t *upstreams, int index, const char *key, int *running, yacad_checker_impl_t *this) {
+     free(running);
+}
+
+static void free_(yacad_checker_impl_t *this) {
+     int i;
+     job_t *job;
+
+     pthread_mutex_lock(&(this->lock));
+     this->running = false;
+     pthread_cond_broadcast(&(this->cond));
+     pthread_mutex_unlock(&(this->lock));
+
+     // running checks are not interrupted
+     for (i = 0; i < this->nworkers; i++) {
+          pthread_join(this->workers[i], NULL);
+     }
+
+     for (i = 0; i < this->queue->count(this->queue); i++) {
+          job = this->queue->get(this->queue, i);
+          free(job->upstream);
+     }
+     this->queue->free(this->queue);
+     this->pending->free(this->pending);
+     this->upstreams->clean(this->upstreams, (cad_hash_iterator_fn)clean_upstream, this);
+     this->upstreams->free(this->upstreams);
+     pthread_cond_destroy(&(this->cond));
+     pthread_mutex_destroy(&(this->lock));
+     free(this->workers);
+     free(this);
+}
+
+static yacad_checker_t impl_fn = {
+     .check = (yacad_checker_check_fn)check,
+     .free = (yacad_checker_free_fn)free_,
+};
+
+yacad_checker_t *yacad_checker_new(yacad_conf_t *conf, const char *address) {
+     size_t szaddress = strlen(address) + 1;
+     yacad_checker_impl_t *result = malloc(sizeof(yacad_checker_impl_t) + szaddress);
+     int i, n = conf->get_check_workers(conf);
+
+     result->fn = impl_fn;
+     result->conf = conf;
+     result->address = result->_;
+     strcpy(result->address, address);
+     pthread_mutex_init(&(result->lock), NULL);
+     pthread_cond_init(&(result->cond), NULL);
+     result->queue = cad_new_array(stdlib_memory, sizeof(job_t));
+     result->pending = cad_new_hash(stdlib_memory, cad_hash_strings);
+     result->upstreams = cad_new_hash(stdlib_memory, cad_hash_strings);
+     result->per_upstream = conf->get_check_per_upstream(conf);
+     result->running = true;
+     result->workers = malloc(n * sizeof(pthread_t));
+     result->nworkers = 0;
+
+     for (i = 0; i < n; i++) {
+          if (pthread_create(&(result->workers[result->nworkers]), NULL, (void*(*)(void*))worker_routine, result) == 0) {
+               result->nworkers++;
+          } else {
+               conf->log(warn, "Could not start SCM check worker %d", i);
+          }
+     }
+     if (result->nworkers == 0) {
+          conf->log(error, "No SCM check worker");
+     }
+
+     return I(result);
+}
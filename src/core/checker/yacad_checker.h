@@ -0,0 +1,41 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __YACAD_CHECKER_H__
+#define __YACAD_CHECKER_H__
+
+#include "yacad.h"
+#include "core/conf/yacad_conf.h"
+#include "core/project/yacad_project.h"
+
+/* Runs the projects SCM checks on a bounded pool of worker threads, at
+ * most conf->get_check_per_upstream() at a time against the same
+ * upstream host. Each task created by a check is pushed (ZMQ_PUSH) to
+ * the given inproc address as "<project name>\n<task serial>". */
+
+typedef struct yacad_checker_s yacad_checker_t;
+
+typedef void (*yacad_checker_check_fn)(yacad_checker_t *this, yacad_project_t *project);
+typedef void (*yacad_checker_free_fn)(yacad_checker_t *this);
+
+struct yacad_checker_s {
+     yacad_checker_check_fn check;
+     yacad_checker_free_fn free;
+};
+
+yacad_checker_t *yacad_checker_new(yacad_conf_t *conf, const char *address);
+
+#endif /* __YACAD_CHECKER_H__ */
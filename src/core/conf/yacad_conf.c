@@ -20,8 +20,21 @@
 #include "common/json/yacad_json_finder.h"
 
 #define DATABASE_NAME "yacad-core.db"
+#define ARCHIVE_NAME "yacad-archive.db"
+#define TASKLOG_NAME "yacad-tasks.log"
+#define DEFAULT_STORAGE "sqlite"
+#define DEFAULT_ORDERING "sjf"
+#define DEFAULT_CHECK_WORKERS 4
+#define DEFAULT_CHECK_PER_UPSTREAM 2
+#define DEFAULT_GC_RATE 16
 #define DEFAULT_ENDPOINT_PORT 1789
 #define DEFAULT_EVENTS_PORT 1791
+#define DEFAULT_QUERY_PORT 1792
+#define DEFAULT_NOTIFY_PORT 1793
+#define DEFAULT_LOGS_PORT 1794
+#define DEFAULT_ARTIFACTS_PORT 1795
+#define LOGS_DIR "logs"
+#define ARTIFACTS_DIR "artifacts"
 #define DEFAULT_ROOT_PATH "."
 
 static const char *dirs[] = {
@@ -43,6 +56,23 @@ typedef struct yacad_conf_impl_s {
      char *database_name;
      char *endpoint_name;
      char *events_name;
+     char *query_name;
+     char *notify_name;
+     char *logs_name;
+     char *logs_path;
+     char *artifacts_name;
+     char *artifacts_path;
+     char *archive_name;
+     int retention_builds;
+     int retention_days;
+     long gc_quota;
+     long gc_project_quota;
+     long gc_rate;
+     char *storage;
+     char *tasklog_name;
+     char *ordering;
+     int check_workers;
+     int check_per_upstream;
 } yacad_conf_impl_t;
 
 static const char *get_database_name(yacad_conf_impl_t *this) {
@@ -57,6 +87,74 @@ static const char *get_events_name(yacad_conf_impl_t *this) {
      return this->events_name;
 }
 
+static const char *get_query_name(yacad_conf_impl_t *this) {
+     return this->query_name;
+}
+
+static const char *get_notify_name(yacad_conf_impl_t *this) {
+     return this->notify_name;
+}
+
+static const char *get_logs_name(yacad_conf_impl_t *this) {
+     return this->logs_name;
+}
+
+static const char *get_logs_path(yacad_conf_impl_t *this) {
+     return this->logs_path;
+}
+
+static const char *get_artifacts_name(yacad_conf_impl_t *this) {
+     return this->artifacts_name;
+}
+
+static const char *get_artifacts_path(yacad_conf_impl_t *this) {
+     return this->artifacts_path;
+}
+
+static const char *get_archive_name(yacad_conf_impl_t *this) {
+     return this->archive_name;
+}
+
+static int get_retention_builds(yacad_conf_impl_t *this) {
+     return this->retention_builds;
+}
+
+static int get_retention_days(yacad_conf_impl_t *this) {
+     return this->retention_days;
+}
+
+static long get_gc_quota(yacad_conf_impl_t *this) {
+     return this->gc_quota;
+}
+
+static long get_gc_project_quota(yacad_conf_impl_t *this) {
+     return this->gc_project_quota;
+}
+
+static long get_gc_rate(yacad_conf_impl_t *this) {
+     return this->gc_rate;
+}
+
+static const char *get_storage(yacad_conf_impl_t *this) {
+     return this->storage;
+}
+
+static const char *get_tasklog_name(yacad_conf_impl_t *this) {
+     return this->tasklog_name;
+}
+
+static const char *get_ordering(yacad_conf_impl_t *this) {
+     return this->ordering;
+}
+
+static int get_check_workers(yacad_conf_impl_t *this) {
+     return this->check_workers;
+}
+
+static int get_check_per_upstream(yacad_conf_impl_t *this) {
+     return this->check_per_upstream;
+}
+
 static cad_hash_t *get_projects(yacad_conf_impl_t *this) {
      return this->projects;
 }
@@ -73,6 +171,16 @@ static void free_(yacad_conf_impl_t *this) {
      if (this->json != NULL) {
           this->json->accept(this->json, json_kill());
      }
+     free(this->ordering);
+     free(this->tasklog_name);
+     free(this->storage);
+     free(this->archive_name);
+     free(this->artifacts_path);
+     free(this->artifacts_name);
+     free(this->logs_path);
+     free(this->logs_name);
+     free(this->notify_name);
+     free(this->query_name);
      free(this->events_name);
      free(this->endpoint_name);
      free(this->database_name);
@@ -86,6 +194,23 @@ static yacad_conf_t impl_fn =  {
      .get_database_name = (yacad_conf_get_database_name_fn)get_database_name,
      .get_endpoint_name = (yacad_conf_get_endpoint_name_fn)get_endpoint_name,
      .get_events_name = (yacad_conf_get_events_name_fn)get_events_name,
+     .get_query_name = (yacad_conf_get_query_name_fn)get_query_name,
+     .get_notify_name = (yacad_conf_get_notify_name_fn)get_notify_name,
+     .get_logs_name = (yacad_conf_get_logs_name_fn)get_logs_name,
+     .get_logs_path = (yacad_conf_get_logs_path_fn)get_logs_path,
+     .get_artifacts_name = (yacad_conf_get_artifacts_name_fn)get_artifacts_name,
+     .get_artifacts_path = (yacad_conf_get_artifacts_path_fn)get_artifacts_path,
+     .get_archive_name = (yacad_conf_get_archive_name_fn)get_archive_name,
+     .get_retention_builds = (yacad_conf_get_retention_builds_fn)get_retention_builds,
+     .get_retention_days = (yacad_conf_get_retention_days_fn)get_retention_days,
+     .get_gc_quota = (yacad_conf_get_gc_quota_fn)get_gc_quota,
+     .get_gc_project_quota = (yacad_conf_get_gc_project_quota_fn)get_gc_project_quota,
+     .get_gc_rate = (yacad_conf_get_gc_rate_fn)get_gc_rate,
+     .get_storage = (yacad_conf_get_storage_fn)get_storage,
+     .get_tasklog_name = (yacad_conf_get_tasklog_name_fn)get_tasklog_name,
+     .get_ordering = (yacad_conf_get_ordering_fn)get_ordering,
+     .get_check_workers = (yacad_conf_get_check_workers_fn)get_check_workers,
+     .get_check_per_upstream = (yacad_conf_get_check_per_upstream_fn)get_check_per_upstream,
      .get_projects = (yacad_conf_get_projects_fn)get_projects,
      .get_runners = (yacad_conf_get_runners_fn)get_runners,
      .generation = (yacad_conf_generation_fn)generation,
@@ -193,14 +318,184 @@ static void set_root_path(yacad_conf_impl_t *this) {
           snprintf(this->events_name, n, "tcp://*:%d", DEFAULT_EVENTS_PORT);
      }
 
+     v->visit(v, this->json, "query");
+     jstring = v->get_string(v);
+     if (jstring != NULL) {
+          n = jstring->count(jstring) + 1;
+          this->query_name = realloc(this->query_name, n);
+          jstring->utf8(jstring, this->query_name, n);
+     } else {
+          n = snprintf("", 0, "tcp://*:%d", DEFAULT_QUERY_PORT) + 1;
+          this->query_name = realloc(this->query_name, n);
+          snprintf(this->query_name, n, "tcp://*:%d", DEFAULT_QUERY_PORT);
+     }
+
+     // local by default: only the repository hooks are expected to notify
+     v->visit(v, this->json, "notify");
+     jstring = v->get_string(v);
+     if (jstring != NULL) {
+          n = jstring->count(jstring) + 1;
+          this->notify_name = realloc(this->notify_name, n);
+          jstring->utf8(jstring, this->notify_name, n);
+     } else {
+          n = snprintf("", 0, "tcp://127.0.0.1:%d", DEFAULT_NOTIFY_PORT) + 1;
+          this->notify_name = realloc(this->notify_name, n);
+          snprintf(this->notify_name, n, "tcp://127.0.0.1:%d", DEFAULT_NOTIFY_PORT);
+     }
+
+     v->visit(v, this->json, "logs");
+     jstring = v->get_string(v);
+     if (jstring != NULL) {
+          n = jstring->count(jstring) + 1;
+          this->logs_name = realloc(this->logs_name, n);
+          jstring->utf8(jstring, this->logs_name, n);
+     } else {
+          n = snprintf("", 0, "tcp://*:%d", DEFAULT_LOGS_PORT) + 1;
+          this->logs_name = realloc(this->logs_name, n);
+          snprintf(this->logs_name, n, "tcp://*:%d", DEFAULT_LOGS_PORT);
+     }
+
+     v->visit(v, this->json, "artifacts");
+     jstring = v->get_string(v);
+     if (jstring != NULL) {
+          n = jstring->count(jstring) + 1;
+          this->artifacts_name = realloc(this->artifacts_name, n);
+          jstring->utf8(jstring, this->artifacts_name, n);
+     } else {
+          n = snprintf("", 0, "*:%d", DEFAULT_ARTIFACTS_PORT) + 1;
+          this->artifacts_name = realloc(this->artifacts_name, n);
+          snprintf(this->artifacts_name, n, "*:%d", DEFAULT_ARTIFACTS_PORT);
+     }
+
      I(v)->free(I(v));
 
+     n = snprintf("", 0, "%s/%s", this->root_path, LOGS_DIR) + 1;
+     this->logs_path = realloc(this->logs_path, n);
+     snprintf(this->logs_path, n, "%s/%s", this->root_path, LOGS_DIR);
+     if (mkpath(this->logs_path, 0700) != 0 && errno != EEXIST) {
+          I(this)->log(warn, "Could not create directory: %s (%s)", this->logs_path, strerror(errno));
+     }
+
+     n = snprintf("", 0, "%s/%s", this->root_path, ARTIFACTS_DIR) + 1;
+     this->artifacts_path = realloc(this->artifacts_path, n);
+     snprintf(this->artifacts_path, n, "%s/%s", this->root_path, ARTIFACTS_DIR);
+     if (mkpath(this->artifacts_path, 0700) != 0 && errno != EEXIST) {
+          I(this)->log(warn, "Could not create directory: %s (%s)", this->artifacts_path, strerror(errno));
+     }
+
      n = snprintf("", 0, "%s/%s", this->root_path, DATABASE_NAME) + 1;
      this->database_name = realloc(this->database_name, n);
      sprintf(this->database_name, "%s/%s", this->root_path, DATABASE_NAME);
      I(this)->log(debug, "Database is %s", this->database_name);
 }
 
+static void set_retention(yacad_conf_impl_t *this) {
+     yacad_json_finder_t *v = yacad_json_finder_new(I(this)->log, json_type_number, "core/retention/%s");
+     yacad_json_finder_t *s = yacad_json_finder_new(I(this)->log, json_type_string, "core/retention/%s");
+     json_number_t *jnumber;
+     json_string_t *jstring;
+     size_t n;
+
+     v->visit(v, this->json, "builds");
+     jnumber = v->get_number(v);
+     this->retention_builds = jnumber == NULL ? 0 : (int)jnumber->to_int(jnumber);
+
+     v->visit(v, this->json, "days");
+     jnumber = v->get_number(v);
+     this->retention_days = jnumber == NULL ? 0 : (int)jnumber->to_int(jnumber);
+
+     s->visit(s, this->json, "archive");
+     jstring = s->get_string(s);
+     if (jstring != NULL) {
+          n = jstring->count(jstring) + 1;
+          this->archive_name = realloc(this->archive_name, n);
+          jstring->utf8(jstring, this->archive_name, n);
+     } else {
+          n = snprintf("", 0, "%s/%s", this->root_path, ARCHIVE_NAME) + 1;
+          this->archive_name = realloc(this->archive_name, n);
+          snprintf(this->archive_name, n, "%s/%s", this->root_path, ARCHIVE_NAME);
+     }
+
+     I(s)->free(I(s));
+     I(v)->free(I(v));
+}
+
+static void set_gc(yacad_conf_impl_t *this) {
+     yacad_json_finder_t *v = yacad_json_finder_new(I(this)->log, json_type_number, "core/gc/%s");
+     json_number_t *jnumber;
+
+     v->visit(v, this->json, "quota");
+     jnumber = v->get_number(v);
+     this->gc_quota = jnumber == NULL ? 0 : (long)jnumber->to_int(jnumber);
+
+     v->visit(v, this->json, "project_quota");
+     jnumber = v->get_number(v);
+     this->gc_project_quota = jnumber == NULL ? 0 : (long)jnumber->to_int(jnumber);
+
+     v->visit(v, this->json, "rate");
+     jnumber = v->get_number(v);
+     this->gc_rate = jnumber == NULL || jnumber->to_int(jnumber) <= 0 ? DEFAULT_GC_RATE : (long)jnumber->to_int(jnumber);
+
+     I(v)->free(I(v));
+}
+
+static void set_storage(yacad_conf_impl_t *this) {
+     yacad_json_finder_t *v = yacad_json_finder_new(I(this)->log, json_type_string, "core/%s");
+     json_string_t *jstring;
+     size_t n;
+
+     v->visit(v, this->json, "storage");
+     jstring = v->get_string(v);
+     if (jstring != NULL) {
+          n = jstring->count(jstring) + 1;
+          this->storage = realloc(this->storage, n);
+          jstring->utf8(jstring, this->storage, n);
+     } else {
+          n = strlen(DEFAULT_STORAGE) + 1;
+          this->storage = realloc(this->storage, n);
+          snprintf(this->storage, n, "%s", DEFAULT_STORAGE);
+     }
+
+     v->visit(v, this->json, "ordering");
+     jstring = v->get_string(v);
+     if (jstring != NULL) {
+          n = jstring->count(jstring) + 1;
+          this->ordering = realloc(this->ordering, n);
+          jstring->utf8(jstring, this->ordering, n);
+     } else {
+          n = strlen(DEFAULT_ORDERING) + 1;
+          this->ordering = realloc(this->ordering, n);
+          snprintf(this->ordering, n, "%s", DEFAULT_ORDERING);
+     }
+
+     n = snprintf("", 0, "%s/%s", this->root_path, TASKLOG_NAME) + 1;
+     this->tasklog_name = realloc(this->tasklog_name, n);
+     snprintf(this->tasklog_name, n, "%s/%s", this->root_path, TASKLOG_NAME);
+
+     I(v)->free(I(v));
+}
+
+static void set_checks(yacad_conf_impl_t *this) {
+     yacad_json_finder_t *v = yacad_json_finder_new(I(this)->log, json_type_number, "core/checks/%s");
+     json_number_t *jnumber;
+
+     v->visit(v, this->json, "workers");
+     jnumber = v->get_number(v);
+     this->check_workers = jnumber == NULL ? DEFAULT_CHECK_WORKERS : (int)jnumber->to_int(jnumber);
+     if (this->check_workers < 1) {
+          this->check_workers = 1;
+     }
+
+     v->visit(v, this->json, "per_upstream");
+     jnumber = v->get_number(v);
+     this->check_per_upstream = jnumber == NULL ? DEFAULT_CHECK_PER_UPSTREAM : (int)jnumber->to_int(jnumber);
+     if (this->check_per_upstream < 1) {
+          this->check_per_upstream = 1;
+     }
+
+     I(v)->free(I(v));
+}
+
 static char *json_to_string(yacad_json_finder_t *v, json_value_t *value, ...) {
      va_list args;
      size_t n;
@@ -223,7 +518,9 @@ static void read_projects(yacad_conf_impl_t *this) {
      yacad_json_finder_t *vproject;
      yacad_json_finder_t *vobject;
      yacad_json_finder_t *varray;
+     yacad_json_finder_t *vnumber;
      json_value_t *jproject;
+     json_number_t *jjitter;
      json_array_t *jprojects;
      yacad_project_t *project;
      json_value_t *jscm;
@@ -240,6 +537,7 @@ static void read_projects(yacad_conf_impl_t *this) {
                vproject = yacad_json_finder_new(I(this)->log, json_type_string, "%s");
                vobject = yacad_json_finder_new(I(this)->log, json_type_object, "%s");
                varray = yacad_json_finder_new(I(this)->log, json_type_array, "%s");
+               vnumber = yacad_json_finder_new(I(this)->log, json_type_number, "%s");
                for (i = 0; i < np; i++) {
                     jproject = jprojects->get(jprojects, i);
                     name = json_to_string(vproject, jproject, "name");
@@ -270,7 +568,9 @@ static void read_projects(yacad_conf_impl_t *this) {
                          if (crondesc == NULL) {
                               crondesc = strdup("* * * * *");
                          }
-                         cron = yacad_cron_parse(I(this)->log, crondesc);
+                         vnumber->visit(vnumber, jproject, "cron_jitter");
+                         jjitter = vnumber->get_number(vnumber);
+                         cron = yacad_cron_parse(I(this)->log, crondesc, name, jjitter == NULL ? 0 : (int)jjitter->to_int(jjitter));
 
                          // Prepare jtasks
                          varray->visit(varray, jproject, "tasks");
@@ -303,6 +603,7 @@ static void read_projects(yacad_conf_impl_t *this) {
                     }
                     free(name);
                }
+               I(vnumber)->free(I(vnumber));
                I(varray)->free(I(varray));
                I(vobject)->free(I(vobject));
                I(vproject)->free(I(vproject));
@@ -323,7 +624,12 @@ yacad_conf_t *yacad_core_conf_new(void) {
 
      result->projects = cad_new_hash(stdlib_memory, cad_hash_strings);
      result->runners = cad_new_hash(stdlib_memory, cad_hash_strings);
-     result->filename = result->root_path = result->database_name = result->endpoint_name = result->events_name = NULL;
+     result->filename = result->root_path = result->database_name = result->endpoint_name = result->events_name = result->query_name = result->notify_name = result->logs_name = result->logs_path = result->artifacts_name = result->artifacts_path = result->archive_name = result->storage = result->tasklog_name = result->ordering = NULL;
+     result->retention_builds = result->retention_days = 0;
+     result->gc_quota = result->gc_project_quota = 0;
+     result->gc_rate = DEFAULT_GC_RATE;
+     result->check_workers = DEFAULT_CHECK_WORKERS;
+     result->check_per_upstream = DEFAULT_CHECK_PER_UPSTREAM;
      result->json = NULL;
      result->generation = 0;
 
@@ -338,6 +644,18 @@ yacad_conf_t *yacad_core_conf_new(void) {
                I(result)->log(info, "Projects root path is %s", result->root_path);
                I(result)->log(info, "Core 0MQ endpoint is %s", result->endpoint_name);
                I(result)->log(info, "Core 0MQ events is %s", result->events_name);
+               I(result)->log(info, "Core 0MQ query is %s", result->query_name);
+               I(result)->log(info, "Core 0MQ notify is %s", result->notify_name);
+               I(result)->log(info, "Core 0MQ logs is %s, task logs in %s", result->logs_name, result->logs_path);
+               I(result)->log(info, "Core HTTP artifacts is %s, artifacts in %s", result->artifacts_name, result->artifacts_path);
+               set_retention(result);
+               I(result)->log(info, "Retention: %d builds, %d days, archive is %s", result->retention_builds, result->retention_days, result->archive_name);
+               set_gc(result);
+               I(result)->log(info, "Artifacts GC: quota %ld MiB, %ld MiB per project, %ld MiB/s", result->gc_quota, result->gc_project_quota, result->gc_rate);
+               set_storage(result);
+               I(result)->log(info, "Task storage: %s, ordering: %s", result->storage, result->ordering);
+               set_checks(result);
+               I(result)->log(info, "SCM checks: %d workers, %d per upstream", result->check_workers, result->check_per_upstream);
                read_projects(result);
           }
           ref = result;
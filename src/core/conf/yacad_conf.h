@@ -24,6 +24,23 @@ typedef struct yacad_conf_s yacad_conf_t;
 typedef const char *(*yacad_conf_get_database_name_fn)(yacad_conf_t *this);
 typedef const char *(*yacad_conf_get_endpoint_name_fn)(yacad_conf_t *this);
 typedef const char *(*yacad_conf_get_events_name_fn)(yacad_conf_t *this);
+typedef const char *(*yacad_conf_get_query_name_fn)(yacad_conf_t *this);
+typedef const char *(*yacad_conf_get_notify_name_fn)(yacad_conf_t *this);
+typedef const char *(*yacad_conf_get_logs_name_fn)(yacad_conf_t *this);
+typedef const char *(*yacad_conf_get_logs_path_fn)(yacad_conf_t *this);
+typedef const char *(*yacad_conf_get_artifacts_name_fn)(yacad_conf_t *this);
+typedef const char *(*yacad_conf_get_artifacts_path_fn)(yacad_conf_t *this);
+typedef const char *(*yacad_conf_get_archive_name_fn)(yacad_conf_t *this);
+typedef int (*yacad_conf_get_retention_builds_fn)(yacad_conf_t *this);
+typedef int (*yacad_conf_get_retention_days_fn)(yacad_conf_t *this);
+typedef long (*yacad_conf_get_gc_quota_fn)(yacad_conf_t *this);
+typedef long (*yacad_conf_get_gc_project_quota_fn)(yacad_conf_t *this);
+typedef long (*yacad_conf_get_gc_rate_fn)(yacad_conf_t *this);
+typedef const char *(*yacad_conf_get_storage_fn)(yacad_conf_t *this);
+typedef const char *(*yacad_conf_get_tasklog_name_fn)(yacad_conf_t *this);
+typedef const char *(*yacad_conf_get_ordering_fn)(yacad_conf_t *this);
+typedef int (*yacad_conf_get_check_workers_fn)(yacad_conf_t *this);
+typedef int (*yacad_conf_get_check_per_upstream_fn)(yacad_conf_t *this);
 typedef cad_hash_t *(*yacad_conf_get_projects_fn)(yacad_conf_t *this);
 typedef cad_hash_t *(*yacad_conf_get_runners_fn)(yacad_conf_t *this);
 typedef int (*yacad_conf_generation_fn)(yacad_conf_t *this);
@@ -34,6 +51,23 @@ struct yacad_conf_s {
      yacad_conf_get_database_name_fn get_database_name;
      yacad_conf_get_endpoint_name_fn get_endpoint_name;
      yacad_conf_get_events_name_fn get_events_name;
+     yacad_conf_get_query_name_fn get_query_name;
+     yacad_conf_get_notify_name_fn get_notify_name;
+     yacad_conf_get_logs_name_fn get_logs_name;
+     yacad_conf_get_logs_path_fn get_logs_path;
+     yacad_conf_get_artifacts_name_fn get_artifacts_name; // host:port of the HTTP artifacts server
+     yacad_conf_get_artifacts_path_fn get_artifacts_path;
+     yacad_conf_get_archive_name_fn get_archive_name;
+     yacad_conf_get_retention_builds_fn get_retention_builds;
+     yacad_conf_get_retention_days_fn get_retention_days;
+     yacad_conf_get_gc_quota_fn get_gc_quota; // artifacts MiB, 0 if no limit
+     yacad_conf_get_gc_project_quota_fn get_gc_project_quota; // artifacts MiB per project, 0 if no limit
+     yacad_conf_get_gc_rate_fn get_gc_rate; // MiB removed per second at most
+     yacad_conf_get_storage_fn get_storage;
+     yacad_conf_get_tasklog_name_fn get_tasklog_name;
+     yacad_conf_get_ordering_fn get_ordering;
+     yacad_conf_get_check_workers_fn get_check_workers;
+     yacad_conf_get_check_per_upstream_fn get_check_per_upstream;
      yacad_conf_get_projects_fn get_projects;
      yacad_conf_get_runners_fn get_runners;
      yacad_conf_generation_fn generation;
@@ -0,0 +1,469 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <dirent.h>
+#include <fcntl.h>
+
+#include "yacad_gc.h"
+#include "common/database/yacad_database.h"
+
+/* max files looked at in one slice */
+#define SLICE_ENTRIES 1024
+/* delay between two slices when there is more work to do; the rate is per slice */
+#define SLICE_DELAY 1
+/* delay between two cycles */
+#define IDLE_DELAY 600
+/* an object unlinked, uploaded or asked for (HEAD, GET) more recently may be about to be linked by a manifest */
+#define GRACE_DELAY 3600
+#define MIB 1048576LL
+#define BUCKETS 256
+
+#define STMT_SELECT_PROJECT "select PROJECT from TASKLIST where ID=?"
+
+typedef enum {
+     phase_idle = 0,
+     phase_sweep, // remove the unlinked objects, measure the others
+     phase_scan, // measure the task artifacts
+     phase_remove, // remove the chosen task artifacts
+} phase_t;
+
+typedef struct {
+     unsigned long id;
+     char *project; // NULL if the task is not in TASKLIST any more
+     time_t used;
+     long long size; // of all its files
+     long long unique; // of the objects only this task links
+     bool_t victim;
+} task_usage_t;
+
+typedef struct {
+     long long size;
+     unsigned long last; // the last task of the project is never removed by quota
+} project_usage_t;
+
+typedef struct yacad_gc_impl_s {
+     yacad_gc_t fn;
+     logger_t log;
+     char *path;
+     yacad_database_t *database; // NULL if the references are not tracked
+     long long quota, project_quota, rate;
+     phase_t phase;
+     int bucket; // objects/<bucket>, being swept
+     DIR *dir; // being swept or scanned
+     long long objects_size; // of the live objects
+     int entries; // looked at in this slice
+     long long removed; // bytes, in this slice
+     cad_array_t *tasks; // task_usage_t
+     task_usage_t **order; // least recently used first
+     int next_victim;
+     int victims;
+     struct timeval next_slice;
+} yacad_gc_impl_t;
+
+static struct timeval next_slice(yacad_gc_impl_t *this) {
+     return this->next_slice;
+}
+
+static bool_t in_budget(yacad_gc_impl_t *this) {
+     return this->entries < SLICE_ENTRIES && this->removed < this->rate;
+}
+
+static DIR *open_dir(const char *format, ...) {
+     va_list args;
+     char *path;
+     size_t n;
+
+     va_start(args, format);
+     n = vsnprintf("", 0, format, args) + 1;
+     va_end(args);
+     path = alloca(n);
+     va_start(args, format);
+     vsnprintf(path, n, format, args);
+     va_end(args);
+     return opendir(path);
+}
+
+static DIR *open_subdir(DIR *dir, const char *name) {
+     DIR *result = NULL;
+     int fd = openat(dirfd(dir), name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+     if (fd >= 0) {
+          result = fdopendir(fd);
+          if (result == NULL) {
+               close(fd);
+          }
+     }
+     return result;
+}
+
+static bool_t is_dot(const char *name) {
+     return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+/* The uploads that never completed */
+static void clean_tmp(yacad_gc_impl_t *this) {
+     DIR *dir = open_dir("%s/tmp", this->path);
+     struct dirent *entry;
+     struct stat st;
+     time_t limit = time(NULL) - GRACE_DELAY;
+
+     if (dir != NULL) {
+          while ((entry = readdir(dir)) != NULL) {
+               if (!is_dot(entry->d_name) && fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && st.st_mtime < limit) {
+                    unlinkat(dirfd(dir), entry->d_name, 0);
+               }
+          }
+          closedir(dir);
+     }
+}
+
+/* An object only linked by the store itself belongs to no task */
+static bool_t sweep_slice(yacad_gc_impl_t *this) {
+     bool_t result = false;
+     struct dirent *entry;
+     struct stat st;
+     time_t limit = time(NULL) - GRACE_DELAY;
+
+     while (!result && in_budget(this)) {
+          if (this->dir == NULL) {
+               if (this->bucket == BUCKETS) {
+                    result = true;
+               } else {
+                    this->dir = open_dir("%s/objects/%02x", this->path, this->bucket);
+                    if (this->dir == NULL) {
+                         this->bucket++;
+                    }
+               }
+          } else {
+               entry = readdir(this->dir);
+               if (entry == NULL) {
+                    closedir(this->dir);
+                    this->dir = NULL;
+                    this->bucket++;
+               } else if (!is_dot(entry->d_name) && fstatat(dirfd(this->dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISREG(st.st_mode)) {
+                    this->entries++;
+                    if (st.st_nlink == 1 && st.st_ctime < limit && unlinkat(dirfd(this->dir), entry->d_name, 0) == 0) {
+                         this->removed += st.st_size;
+                    } else {
+                         this->objects_size += st.st_size;
+                    }
+               }
+          }
+     }
+
+     return result;
+}
+
+static void measure(yacad_gc_impl_t *this, DIR *dir, const char *name, task_usage_t *usage) {
+     struct stat st;
+     struct dirent *entry;
+     DIR *subdir;
+
+     if (fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+          this->entries++;
+          if (S_ISDIR(st.st_mode)) {
+               subdir = open_subdir(dir, name);
+               if (subdir != NULL) {
+                    while ((entry = readdir(subdir)) != NULL) {
+                         if (!is_dot(entry->d_name)) {
+                              measure(this, subdir, entry->d_name, usage);
+                         }
+                    }
+                    closedir(subdir);
+               }
+          } else if (S_ISREG(st.st_mode)) {
+               usage->size += st.st_size;
+               // the object itself, and this link
+               if (st.st_nlink <= 2) {
+                    usage->unique += st.st_size;
+               }
+          }
+     }
+}
+
+/* Returns the removed bytes, i.e. of the files that were not linked elsewhere */
+static long long remove_tree(yacad_gc_impl_t *this, DIR *dir, const char *name) {
+     long long result = 0;
+     struct stat st;
+     struct dirent *entry;
+     DIR *subdir;
+
+     if (fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+          this->entries++;
+          if (S_ISDIR(st.st_mode)) {
+               subdir = open_subdir(dir, name);
+               if (subdir != NULL) {
+                    while ((entry = readdir(subdir)) != NULL) {
+                         if (!is_dot(entry->d_name)) {
+                              result += remove_tree(this, subdir, entry->d_name);
+                         }
+                    }
+                    closedir(subdir);
+               }
+               if (unlinkat(dirfd(dir), name, AT_REMOVEDIR) != 0) {
+                    this->log(warn, "GC: could not remove %s: %s", name, strerror(errno));
+               }
+          } else if (unlinkat(dirfd(dir), name, 0) == 0 && st.st_nlink == 1) {
+               result += st.st_size;
+          }
+     }
+     return result;
+}
+
+static void get_project(yacad_statement_t *stmt, char **project) {
+     const char *name = stmt->get_string(stmt, 0);
+     if (name != NULL) {
+          free(*project);
+          *project = strdup(name);
+     }
+}
+
+static char *task_project(yacad_gc_impl_t *this, unsigned long id) {
+     char *result = NULL;
+     yacad_statement_t *stmt = this->database->select(this->database, STMT_SELECT_PROJECT);
+
+     if (stmt != NULL) {
+          stmt->bind_int(stmt, 0, (long)id);
+          stmt->run(stmt, (yacad_select_fn)get_project, &result);
+          stmt->free(stmt);
+     }
+     return result;
+}
+
+static bool_t scan_slice(yacad_gc_impl_t *this) {
+     bool_t result = false;
+     struct dirent *entry;
+     struct stat st;
+     task_usage_t usage;
+     char *end;
+
+     if (this->dir == NULL) {
+          this->dir = open_dir("%s/tasks", this->path);
+          result = this->dir == NULL;
+     }
+     while (!result && in_budget(this)) {
+          entry = readdir(this->dir);
+          if (entry == NULL) {
+               closedir(this->dir);
+               this->dir = NULL;
+               result = true;
+          } else if (!is_dot(entry->d_name) && fstatat(dirfd(this->dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode)) {
+               memset(&usage, 0, sizeof(usage));
+               usage.id = strtoul(entry->d_name, &end, 10);
+               if (*end == '\0') {
+                    // the artifacts server touches the directory when it is used
+                    usage.used = st.st_mtime;
+                    usage.project = this->database == NULL ? NULL : task_project(this, usage.id);
+                    measure(this, this->dir, entry->d_name, &usage);
+                    this->tasks->insert(this->tasks, this->tasks->count(this->tasks), &usage);
+               }
+          }
+     }
+
+     return result;
+}
+
+static int compare_usage(const void *a, const void *b) {
+     const task_usage_t *ua = *(task_usage_t* const*)a, *ub = *(task_usage_t* const*)b;
+     int result = (ua->used > ub->used) - (ua->used < ub->used);
+     if (result == 0) {
+          result = (ua->id > ub->id) - (ua->id < ub->id);
+     }
+     return result;
+}
+
+static void free_project(void *hash, int index, const char *key, project_usage_t *usage, void *data) {
+     free(usage);
+}
+
+static bool_t is_last(cad_hash_t *projects, task_usage_t *usage) {
+     project_usage_t *project = usage->project == NULL ? NULL : projects->get(projects, usage->project);
+     return project != NULL && project->last == usage->id;
+}
+
+/* Chooses the tasks to remove: unreferenced first, then over the project quota, then over the global quota, least recently used first */
+static void plan(yacad_gc_impl_t *this) {
+     int i, n = this->tasks->count(this->tasks);
+     task_usage_t *usage;
+     project_usage_t *project;
+     cad_hash_t *projects = cad_new_hash(stdlib_memory, cad_hash_strings);
+     long long total = this->objects_size;
+
+     this->order = malloc((n + 1) * sizeof(task_usage_t*));
+     for (i = 0; i < n; i++) {
+          usage = this->order[i] = this->tasks->get(this->tasks, i);
+          if (usage->project != NULL) {
+               project = projects->get(projects, usage->project);
+               if (project == NULL) {
+                    project = calloc(1, sizeof(project_usage_t));
+                    projects->set(projects, usage->project, project);
+               }
+               project->size += usage->size;
+               if (usage->id > project->last) {
+                    project->last = usage->id;
+               }
+          }
+     }
+     qsort(this->order, n, sizeof(task_usage_t*), compare_usage);
+
+     for (i = 0; i < n; i++) {
+          usage = this->order[i];
+          project = usage->project == NULL ? NULL : projects->get(projects, usage->project);
+          if (this->database != NULL && usage->project == NULL) {
+               usage->victim = true;
+          } else if (project != NULL && this->project_quota > 0 && project->size > this->project_quota && !is_last(projects, usage)) {
+               usage->victim = true;
+               project->size -= usage->size;
+          }
+          if (usage->victim) {
+               total -= usage->unique;
+          }
+     }
+     for (i = 0; this->quota > 0 && total > this->quota && i < n; i++) {
+          usage = this->order[i];
+          if (!usage->victim && !is_last(projects, usage)) {
+               usage->victim = true;
+               total -= usage->unique;
+          }
+     }
+
+     this->victims = 0;
+     for (i = 0; i < n; i++) {
+          if (this->order[i]->victim) {
+               this->victims++;
+          }
+     }
+     this->log(debug, "GC: %d task artifacts, %lld MiB of objects, %d to remove", n, this->objects_size / MIB, this->victims);
+
+     projects->clean(projects, (cad_hash_iterator_fn)free_project, NULL);
+     projects->free(projects);
+     this->next_victim = 0;
+}
+
+static bool_t remove_slice(yacad_gc_impl_t *this) {
+     int n = this->tasks->count(this->tasks);
+     task_usage_t *usage;
+     char name[32];
+
+     if (this->dir == NULL) {
+          this->dir = open_dir("%s/tasks", this->path);
+     }
+     while (this->dir != NULL && this->next_victim < n && in_budget(this)) {
+          usage = this->order[this->next_victim++];
+          if (usage->victim) {
+               snprintf(name, sizeof(name), "%lu", usage->id);
+               this->removed += remove_tree(this, this->dir, name);
+               snprintf(name, sizeof(name), "%lu.manifest", usage->id);
+               unlinkat(dirfd(this->dir), name, 0);
+          }
+     }
+
+     return this->dir == NULL || this->next_victim == n;
+}
+
+static void end_cycle(yacad_gc_impl_t *this) {
+     int i, n = this->tasks->count(this->tasks);
+
+     if (this->victims > 0) {
+          this->log(info, "GC: removed the artifacts of %d task%s", this->victims, this->victims == 1 ? "" : "s");
+     }
+     for (i = 0; i < n; i++) {
+          free(((task_usage_t*)this->tasks->get(this->tasks, i))->project);
+     }
+     this->tasks->clear(this->tasks);
+     free(this->order);
+     this->order = NULL;
+     if (this->dir != NULL) {
+          closedir(this->dir);
+          this->dir = NULL;
+     }
+}
+
+static void run_slice(yacad_gc_impl_t *this) {
+     this->entries = 0;
+     this->removed = 0;
+
+     if (this->phase == phase_idle) {
+          clean_tmp(this);
+          this->bucket = 0;
+          this->objects_size = 0;
+          this->phase = phase_sweep;
+     }
+     if (this->phase == phase_sweep && sweep_slice(this)) {
+          this->phase = phase_scan;
+     }
+     if (this->phase == phase_scan && scan_slice(this)) {
+          plan(this);
+          this->phase = phase_remove;
+     }
+     if (this->phase == phase_remove && remove_slice(this)) {
+          end_cycle(this);
+          this->phase = phase_idle;
+     }
+
+     gettimeofday(&(this->next_slice), NULL);
+     this->next_slice.tv_sec += this->phase == phase_idle ? IDLE_DELAY : SLICE_DELAY;
+}
+
+static void free_(yacad_gc_impl_t *this) {
+     // an interrupted cycle starts again next time
+     this->victims = 0;
+     end_cycle(this);
+     this->tasks->free(this->tasks);
+     if (this->database != NULL) {
+          this->database->free(this->database);
+     }
+     free(this->path);
+     free(this);
+}
+
+static yacad_gc_t impl_fn = {
+     .next_slice = (yacad_gc_next_slice_fn)next_slice,
+     .run_slice = (yacad_gc_run_slice_fn)run_slice,
+     .free = (yacad_gc_free_fn)free_,
+};
+
+yacad_gc_t *yacad_gc_new(yacad_conf_t *conf) {
+     yacad_gc_impl_t *result = malloc(sizeof(yacad_gc_impl_t));
+
+     result->fn = impl_fn;
+     result->log = conf->log;
+     result->path = strdup(conf->get_artifacts_path(conf));
+     result->quota = conf->get_gc_quota(conf) * MIB;
+     result->project_quota = conf->get_gc_project_quota(conf) * MIB;
+     result->rate = conf->get_gc_rate(conf) * MIB;
+     result->phase = phase_idle;
+     result->bucket = 0;
+     result->dir = NULL;
+     result->objects_size = 0;
+     result->tasks = cad_new_array(stdlib_memory, sizeof(task_usage_t));
+     result->order = NULL;
+     result->next_victim = result->victims = 0;
+
+     // the log storage has no TASKLIST: only the quotas apply
+     result->database = NULL;
+     if (!strcmp(conf->get_storage(conf), "sqlite")) {
+          result->database = yacad_database_new_readonly(conf->log, conf->get_database_name(conf));
+          if (result->database == NULL) {
+               conf->log(warn, "GC: could not open database, the artifact references are not tracked");
+          }
+     }
+
+     // first cycle as soon as possible
+     gettimeofday(&(result->next_slice), NULL);
+
+     return I(result);
+}
@@ -0,0 +1,52 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __YACAD_GC_H__
+#define __YACAD_GC_H__
+
+#include "yacad.h"
+#include "core/conf/yacad_conf.h"
+
+/**
+ * Artifacts garbage collection.
+ *
+ * The artifacts of a task (see core/artifacts/yacad_artifacts.h) are
+ * kept while the task is in TASKLIST; once retention archived it,
+ * they are removed. Beyond the per-project and global quotas, the
+ * least recently used task artifacts are removed too, except the
+ * last ones of each project. An object is removed once no task links
+ * it any more.
+ *
+ * Each cycle sweeps the objects, scans the tasks, then removes the
+ * chosen ones, in small slices run by the scheduler worker; the
+ * removed bytes per second are bounded by the configured rate.
+ */
+
+typedef struct yacad_gc_s yacad_gc_t;
+
+typedef struct timeval (*yacad_gc_next_slice_fn)(yacad_gc_t *this);
+typedef void (*yacad_gc_run_slice_fn)(yacad_gc_t *this);
+typedef void (*yacad_gc_free_fn)(yacad_gc_t *this);
+
+struct yacad_gc_s {
+     yacad_gc_next_slice_fn next_slice;
+     yacad_gc_run_slice_fn run_slice;
+     yacad_gc_free_fn free;
+};
+
+yacad_gc_t *yacad_gc_new(yacad_conf_t *conf);
+
+#endif /* __YACAD_GC_H__ */
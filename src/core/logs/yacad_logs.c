@@ -0,0 +1,227 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <dirent.h>
+#include <zlib.h>
+
+#include "yacad_logs.h"
+#include "yacad_logstore.h"
+#include "common/chunk/yacad_chunk.h"
+#include "common/zmq/yacad_zmq.h"
+
+#define IDLE_TIMEOUT 3600 // seconds; the poller wakes up earlier when there are logs to compact
+
+typedef struct {
+     yacad_logstore_t *store;
+     unsigned long seq; // the next expected chunk
+} logfile_t;
+
+typedef struct yacad_logs_impl_s {
+     yacad_logs_t fn;
+     yacad_conf_t *conf;
+     yacad_zmq_poller_t *zpoller;
+     cad_hash_t *files; // task id -> logfile_t
+     cad_array_t *complete; // task ids of the logs to compact, when idle
+     char *bytes; // uncompressed chunk
+     pthread_t worker;
+} yacad_logs_impl_t;
+
+static logfile_t *get_file(yacad_logs_impl_t *this, unsigned long id, const char *key) {
+     logfile_t *result = this->files->get(this->files, key);
+     yacad_logstore_t *store;
+
+     if (result == NULL) {
+          store = yacad_logstore_new(this->conf->log, this->conf->get_logs_path(this->conf), id);
+          if (store != NULL) {
+               result = malloc(sizeof(logfile_t));
+               result->store = store;
+               result->seq = 0;
+               this->files->set(this->files, key, result);
+          }
+     }
+
+     return result;
+}
+
+static void write_chunk(yacad_logs_impl_t *this, unsigned long id, unsigned long seq, char kind, size_t size, const char *bytes, size_t n) {
+     char key[32];
+     logfile_t *file;
+     uLongf zsize = YACAD_CHUNK_SIZE;
+
+     snprintf(key, 32, "%lu", id);
+     file = get_file(this, id, key);
+     if (file != NULL) {
+          if (seq != file->seq) {
+               this->conf->log(warn, "Task %lu: lost log chunks %lu to %lu", id, file->seq, seq - 1);
+          }
+          file->seq = seq + 1;
+
+          switch(kind) {
+          case YACAD_CHUNK_RAW:
+               file->store->append(file->store, bytes, n);
+               break;
+          case YACAD_CHUNK_ZLIB:
+               if (size > YACAD_CHUNK_SIZE || uncompress((Bytef*)this->bytes, &zsize, (const Bytef*)bytes, n) != Z_OK || zsize != size) {
+                    this->conf->log(warn, "Task %lu: invalid compressed log chunk %lu", id, seq);
+               } else {
+                    file->store->append(file->store, this->bytes, zsize);
+               }
+               break;
+          case YACAD_CHUNK_END:
+               this->conf->log(debug, "Task %lu: log complete", id);
+               file->store->complete(file->store);
+               file->store->free(file->store);
+               this->files->del(this->files, key);
+               free(file);
+               this->complete->insert(this->complete, this->complete->count(this->complete), &id);
+               break;
+          default:
+               this->conf->log(warn, "Task %lu: unknown log chunk kind: %c", id, kind);
+          }
+     }
+}
+
+static bool_t on_pollin_zlogs(yacad_zmq_poller_t *poller, yacad_zmq_socket_t *socket, const void *message, size_t size, void *data) {
+     yacad_logs_impl_t *this = (yacad_logs_impl_t*)data;
+     const char *eol = memchr(message, '\n', size < YACAD_CHUNK_HEADER_MAX ? size : YACAD_CHUNK_HEADER_MAX);
+     char header[YACAD_CHUNK_HEADER_MAX];
+     unsigned long id, seq;
+     char kind;
+     size_t raw, n;
+
+     if (eol != NULL) {
+          n = eol - (const char*)message;
+          memcpy(header, message, n);
+          header[n] = '\0';
+     }
+     if (eol == NULL || sscanf(header, "%lu %lu %c %zu", &id, &seq, &kind, &raw) != 4) {
+          this->conf->log(warn, "Received invalid log chunk");
+     } else {
+          write_chunk(this, id, seq, kind, raw, eol + 1, size - (n + 1));
+     }
+
+     return true;
+}
+
+static void close_file(cad_hash_t *files, int index, const char *key, logfile_t *file, yacad_logs_impl_t *this) {
+     this->conf->log(warn, "Task %s: log left incomplete", key);
+     file->store->free(file->store);
+     free(file);
+}
+
+static void logs_timeout(yacad_zmq_poller_t *poller, struct timeval *timeout, void *data) {
+     yacad_logs_impl_t *this = (yacad_logs_impl_t*)data;
+
+     gettimeofday(timeout, NULL);
+     if (this->complete->count(this->complete) == 0) {
+          timeout->tv_sec += IDLE_TIMEOUT;
+     }
+}
+
+/* Only called when no chunk is waiting: one log at a time, so that the chunks are not delayed */
+static bool_t logs_on_timeout(yacad_zmq_poller_t *poller, void *data) {
+     yacad_logs_impl_t *this = (yacad_logs_impl_t*)data;
+     yacad_logstore_t *store;
+     unsigned long id;
+
+     if (this->complete->count(this->complete) > 0) {
+          id = *(unsigned long*)this->complete->get(this->complete, 0);
+          this->complete->del(this->complete, 0);
+          store = yacad_logstore_new(this->conf->log, this->conf->get_logs_path(this->conf), id);
+          if (store != NULL) {
+               if (store->compact(store)) {
+                    this->conf->log(debug, "Task %lu: log compacted", id);
+               }
+               store->free(store);
+          }
+     }
+
+     return true;
+}
+
+/* The logs completed but not compacted before a restart */
+static void find_complete(yacad_logs_impl_t *this) {
+     const char *logs_path = this->conf->get_logs_path(this->conf);
+     DIR *dir = opendir(logs_path);
+     struct dirent *entry;
+     yacad_logstore_t *store;
+     unsigned long id;
+     int n;
+
+     if (dir != NULL) {
+          while ((entry = readdir(dir)) != NULL) {
+               if (sscanf(entry->d_name, "%lu.idx%n", &id, &n) == 1 && entry->d_name[n] == '\0') {
+                    store = yacad_logstore_open(this->conf->log, logs_path, id);
+                    if (store != NULL) {
+                         if (store->get_state(store) == logstore_complete) {
+                              this->complete->insert(this->complete, this->complete->count(this->complete), &id);
+                         }
+                         store->free(store);
+                    }
+               }
+          }
+          closedir(dir);
+     }
+}
+
+static void *worker_routine(yacad_logs_impl_t *this) {
+     yacad_zmq_socket_t *zlogs;
+
+     set_thread_name("task logs");
+
+     zlogs = yacad_zmq_socket_bind(this->conf->log, this->conf->get_logs_name(this->conf), ZMQ_PULL);
+     if (zlogs == NULL) {
+          this->conf->log(error, "Could not bind zlogs to %s", this->conf->get_logs_name(this->conf));
+     } else {
+          find_complete(this);
+          this->zpoller->on_pollin_bytes(this->zpoller, zlogs, on_pollin_zlogs);
+          this->zpoller->set_timeout(this->zpoller, logs_timeout, logs_on_timeout);
+          this->zpoller->run(this->zpoller, this);
+          zlogs->free(zlogs);
+     }
+
+     this->files->clean(this->files, (cad_hash_iterator_fn)close_file, this);
+     return this;
+}
+
+static void free_(yacad_logs_impl_t *this) {
+     this->zpoller->stop(this->zpoller);
+     pthread_join(this->worker, NULL);
+     this->zpoller->free(this->zpoller);
+     this->files->free(this->files);
+     this->complete->free(this->complete);
+     free(this->bytes);
+     free(this);
+}
+
+static yacad_logs_t impl_fn = {
+     .free = (yacad_logs_free_fn)free_,
+};
+
+yacad_logs_t *yacad_logs_new(yacad_conf_t *conf) {
+     yacad_logs_impl_t *result = malloc(sizeof(yacad_logs_impl_t));
+
+     result->fn = impl_fn;
+     result->conf = conf;
+     // created here, so that free() can stop it even if the worker did not start it yet
+     result->zpoller = yacad_zmq_poller_new(conf->log);
+     result->files = cad_new_hash(stdlib_memory, cad_hash_strings);
+     result->complete = cad_new_array(stdlib_memory, sizeof(unsigned long));
+     result->bytes = malloc(YACAD_CHUNK_SIZE);
+     pthread_create(&(result->worker), NULL, (void*(*)(void*))worker_routine, result);
+
+     return I(result);
+}
@@ -0,0 +1,38 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __YACAD_LOGS_H__
+#define __YACAD_LOGS_H__
+
+#include "yacad.h"
+#include "core/conf/yacad_conf.h"
+
+/* Receives the task output chunks (see common/chunk/yacad_chunk.h) on
+ * the conf->get_logs_name() endpoint, and appends them to the task log
+ * store (see yacad_logstore.h), on a thread of its own. The complete
+ * logs are compacted when no chunk is waiting. */
+
+typedef struct yacad_logs_s yacad_logs_t;
+
+typedef void (*yacad_logs_free_fn)(yacad_logs_t *this);
+
+struct yacad_logs_s {
+     yacad_logs_free_fn free;
+};
+
+yacad_logs_t *yacad_logs_new(yacad_conf_t *conf);
+
+#endif /* __YACAD_LOGS_H__ */
@@ -0,0 +1,506 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <zlib.h>
+
+#include "yacad_logstore.h"
+
+#define SEGMENT_SIZE 65536
+#define MAGIC "YLOG"
+
+typedef struct {
+     char magic[4];
+     uint32_t state;
+     uint32_t generation; // of the segments file
+     uint32_t reserved;
+} header_t;
+
+typedef struct {
+     uint64_t offset; // in the log
+     uint64_t line; // count of newlines before the segment
+     uint64_t zoffset; // in the segments file
+     uint32_t size;
+     uint32_t zsize;
+     uint32_t lines; // count of newlines in the segment
+     uint32_t reserved;
+} index_t;
+
+typedef struct yacad_logstore_impl_s {
+     yacad_logstore_t fn;
+     logger_t log;
+     char *logs_path;
+     unsigned long id;
+     bool_t writer;
+     header_t header;
+     int idx, seg, tail; // -1 if absent
+     size_t count; // of segments
+     index_t last; // valid if count > 0
+     size_t tail_size;
+     size_t tail_lines;
+     char *segment; // the tail bytes
+     char *zsegment; // a compressed segment
+     char *page; // a decompressed segment
+     size_t page_index; // of the page; count if none
+} yacad_logstore_impl_t;
+
+static char *new_path(const char *format, ...) {
+     va_list args;
+     char *result;
+     size_t n;
+
+     va_start(args, format);
+     n = vsnprintf("", 0, format, args) + 1;
+     va_end(args);
+     result = malloc(n);
+     va_start(args, format);
+     vsnprintf(result, n, format, args);
+     va_end(args);
+     return result;
+}
+
+static size_t count_lines(const char *bytes, size_t size) {
+     size_t result = 0;
+     const char *c = bytes, *end = bytes + size;
+
+     while ((c = memchr(c, '\n', end - c)) != NULL) {
+          result++;
+          c++;
+     }
+     return result;
+}
+
+/* The offset after the n-th newline (1-based), or size if there are fewer */
+static size_t find_line(const char *bytes, size_t size, size_t n) {
+     const char *c = bytes, *end = bytes + size;
+
+     while (n > 0 && (c = memchr(c, '\n', end - c)) != NULL) {
+          n--;
+          c++;
+     }
+     return n == 0 ? c - bytes : size;
+}
+
+static bool_t read_entry(yacad_logstore_impl_t *this, size_t i, index_t *entry) {
+     return pread(this->idx, entry, sizeof(index_t), sizeof(header_t) + i * sizeof(index_t)) == sizeof(index_t);
+}
+
+static size_t sealed_size(yacad_logstore_impl_t *this) {
+     return this->count == 0 ? 0 : this->last.offset + this->last.size;
+}
+
+static size_t sealed_lines(yacad_logstore_impl_t *this) {
+     return this->count == 0 ? 0 : this->last.line + this->last.lines;
+}
+
+static bool_t load_page(yacad_logstore_impl_t *this, size_t i, index_t *entry) {
+     bool_t result = this->page_index == i;
+     uLongf size = SEGMENT_SIZE;
+
+     if (!result && read_entry(this, i, entry) && pread(this->seg, this->zsegment, entry->zsize, entry->zoffset) == entry->zsize) {
+          result = uncompress((Bytef*)this->page, &size, (const Bytef*)this->zsegment, entry->zsize) == Z_OK && size == entry->size;
+          this->page_index = result ? i : this->count;
+     } else if (result) {
+          result = read_entry(this, i, entry);
+     }
+     if (!result) {
+          this->log(warn, "Task %lu: could not read log segment %zu", this->id, i);
+     }
+     return result;
+}
+
+/* The last segment that starts at or before the offset */
+static size_t find_offset(yacad_logstore_impl_t *this, size_t offset) {
+     size_t lo = 0, hi = this->count, mid;
+     index_t entry;
+
+     while (hi - lo > 1) {
+          mid = (lo + hi) / 2;
+          if (read_entry(this, mid, &entry) && entry.offset <= offset) {
+               lo = mid;
+          } else {
+               hi = mid;
+          }
+     }
+     return lo;
+}
+
+/* The last segment with fewer than n newlines before it, i.e. the one holding the n-th newline */
+static size_t find_newline(yacad_logstore_impl_t *this, size_t n) {
+     size_t lo = 0, hi = this->count, mid;
+     index_t entry;
+
+     while (hi - lo > 1) {
+          mid = (lo + hi) / 2;
+          if (read_entry(this, mid, &entry) && entry.line < n) {
+               lo = mid;
+          } else {
+               hi = mid;
+          }
+     }
+     return lo;
+}
+
+static void write_header(yacad_logstore_impl_t *this) {
+     if (pwrite(this->idx, &(this->header), sizeof(header_t), 0) != sizeof(header_t)) {
+          this->log(warn, "Task %lu: could not write the log index: %s", this->id, strerror(errno));
+     }
+}
+
+/* Moves the tail into a new segment */
+static void seal(yacad_logstore_impl_t *this, int level) {
+     index_t entry;
+     uLongf zsize = compressBound(SEGMENT_SIZE);
+
+     memset(&entry, 0, sizeof(index_t));
+     entry.offset = sealed_size(this);
+     entry.line = sealed_lines(this);
+     entry.zoffset = this->count == 0 ? 0 : this->last.zoffset + this->last.zsize;
+     entry.size = this->tail_size;
+     entry.lines = this->tail_lines;
+
+     if (compress2((Bytef*)this->zsegment, &zsize, (const Bytef*)this->segment, this->tail_size, level) != Z_OK) {
+          this->log(warn, "Task %lu: could not compress a log segment", this->id);
+     } else {
+          entry.zsize = zsize;
+          // the segment first, then its index entry, then the tail is emptied
+          if (pwrite(this->seg, this->zsegment, zsize, entry.zoffset) != zsize
+              || pwrite(this->idx, &entry, sizeof(index_t), sizeof(header_t) + this->count * sizeof(index_t)) != sizeof(index_t)) {
+               this->log(warn, "Task %lu: could not write a log segment: %s", this->id, strerror(errno));
+          } else {
+               this->last = entry;
+               this->count++;
+               this->page_index = this->count;
+               this->tail_size = this->tail_lines = 0;
+               if (ftruncate(this->tail, 0) != 0) {
+                    this->log(warn, "Task %lu: could not truncate the log tail: %s", this->id, strerror(errno));
+               }
+          }
+     }
+}
+
+static void append(yacad_logstore_impl_t *this, const char *bytes, size_t size) {
+     size_t n, done;
+
+     for (done = 0; done < size; done += n) {
+          n = SEGMENT_SIZE - this->tail_size;
+          if (n > size - done) {
+               n = size - done;
+          }
+          memcpy(this->segment + this->tail_size, bytes + done, n);
+          if (write(this->tail, bytes + done, n) != n) {
+               this->log(warn, "Task %lu: could not write the log tail: %s", this->id, strerror(errno));
+          }
+          this->tail_size += n;
+          this->tail_lines += count_lines(bytes + done, n);
+          if (this->tail_size == SEGMENT_SIZE) {
+               seal(this, Z_BEST_SPEED);
+          }
+     }
+}
+
+static void complete(yacad_logstore_impl_t *this) {
+     char *path;
+
+     if (this->tail_size > 0) {
+          seal(this, Z_BEST_SPEED);
+     }
+     if (this->tail_size == 0) {
+          path = new_path("%s/%lu.tail", this->logs_path, this->id);
+          unlink(path);
+          free(path);
+          this->header.state = logstore_complete;
+          write_header(this);
+     }
+}
+
+/* Recompresses the segments into a new generation, then switches the index atomically */
+static bool_t compact(yacad_logstore_impl_t *this) {
+     bool_t result = false;
+     char *seg_path, *idx_path, *tmp_path, *old_path;
+     int seg, idx;
+     size_t i;
+     index_t entry, last = this->last;
+     header_t header = this->header;
+     uLongf zsize;
+     uint64_t zoffset = 0;
+
+     if (this->header.state == logstore_complete) {
+          header.state = logstore_compacted;
+          header.generation++;
+          seg_path = new_path("%s/%lu.%u.seg", this->logs_path, this->id, header.generation);
+          old_path = new_path("%s/%lu.%u.seg", this->logs_path, this->id, this->header.generation);
+          idx_path = new_path("%s/%lu.idx", this->logs_path, this->id);
+          tmp_path = new_path("%s/%lu.idx.tmp", this->logs_path, this->id);
+          seg = open(seg_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+          idx = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+          result = seg >= 0 && idx >= 0 && pwrite(idx, &header, sizeof(header_t), 0) == sizeof(header_t);
+          for (i = 0; result && i < this->count; i++) {
+               zsize = compressBound(SEGMENT_SIZE);
+               result = load_page(this, i, &entry)
+                    && compress2((Bytef*)this->zsegment, &zsize, (const Bytef*)this->page, entry.size, Z_BEST_COMPRESSION) == Z_OK;
+               if (result) {
+                    entry.zoffset = zoffset;
+                    entry.zsize = zsize;
+                    result = pwrite(seg, this->zsegment, zsize, zoffset) == zsize
+                         && pwrite(idx, &entry, sizeof(index_t), sizeof(header_t) + i * sizeof(index_t)) == sizeof(index_t);
+                    zoffset += zsize;
+                    last = entry;
+               }
+          }
+          if (result) {
+               result = fdatasync(seg) == 0 && fdatasync(idx) == 0 && rename(tmp_path, idx_path) == 0;
+          }
+
+          if (result) {
+               // the readers that opened the previous generation keep their files
+               unlink(old_path);
+               close(this->seg);
+               close(this->idx);
+               this->seg = seg;
+               this->idx = idx;
+               this->header = header;
+               if (this->count > 0) {
+                    this->last = last;
+               }
+               this->page_index = this->count;
+          } else {
+               this->log(warn, "Task %lu: could not compact the log: %s", this->id, strerror(errno));
+               if (seg >= 0) {
+                    close(seg);
+               }
+               if (idx >= 0) {
+                    close(idx);
+               }
+               unlink(seg_path);
+               unlink(tmp_path);
+          }
+
+          free(tmp_path);
+          free(idx_path);
+          free(old_path);
+          free(seg_path);
+     }
+
+     return result;
+}
+
+static yacad_logstore_state_t get_state(yacad_logstore_impl_t *this) {
+     return this->header.state;
+}
+
+static size_t get_size(yacad_logstore_impl_t *this) {
+     return sealed_size(this) + this->tail_size;
+}
+
+static size_t read_(yacad_logstore_impl_t *this, size_t offset, char *buffer, size_t size) {
+     size_t result = 0, sealed = sealed_size(this), i, n;
+     index_t entry;
+     ssize_t r;
+     bool_t ok = true;
+
+     while (ok && result < size && offset < sealed) {
+          i = find_offset(this, offset);
+          ok = load_page(this, i, &entry);
+          if (ok) {
+               n = entry.offset + entry.size - offset;
+               if (n > size - result) {
+                    n = size - result;
+               }
+               memcpy(buffer + result, this->page + (offset - entry.offset), n);
+               result += n;
+               offset += n;
+          }
+     }
+     if (ok && result < size && offset < sealed + this->tail_size) {
+          n = sealed + this->tail_size - offset;
+          if (n > size - result) {
+               n = size - result;
+          }
+          r = pread(this->tail, buffer + result, n, offset - sealed);
+          if (r > 0) {
+               result += r;
+          }
+     }
+
+     return result;
+}
+
+static size_t line_offset(yacad_logstore_impl_t *this, size_t line) {
+     size_t result = get_size(this), lines = sealed_lines(this), i, n;
+     index_t entry;
+     ssize_t r;
+
+     if (line == 0) {
+          result = 0;
+     } else if (line <= lines) {
+          i = find_newline(this, line);
+          if (load_page(this, i, &entry)) {
+               result = entry.offset + find_line(this->page, entry.size, line - entry.line);
+          }
+     } else if (this->tail_size > 0) {
+          // the tail is at most one segment
+          r = pread(this->tail, this->page, this->tail_size, 0);
+          this->page_index = this->count;
+          if (r > 0) {
+               n = find_line(this->page, r, line - lines);
+               if (n < (size_t)r) {
+                    result = sealed_size(this) + n;
+               }
+          }
+     }
+
+     return result;
+}
+
+static size_t tail(yacad_logstore_impl_t *this, size_t lines) {
+     size_t size = get_size(this), count = sealed_lines(this) + this->tail_lines;
+     char last = '\n';
+
+     // a last line without its newline counts too
+     if (size > 0 && read_(this, size - 1, &last, 1) == 1 && last != '\n') {
+          count++;
+     }
+     return line_offset(this, count > lines ? count - lines : 0);
+}
+
+static void close_files(yacad_logstore_impl_t *this) {
+     if (this->idx >= 0) {
+          close(this->idx);
+     }
+     if (this->seg >= 0) {
+          close(this->seg);
+     }
+     if (this->tail >= 0) {
+          close(this->tail);
+     }
+     this->idx = this->seg = this->tail = -1;
+     this->count = this->tail_size = this->tail_lines = 0;
+}
+
+static void free_(yacad_logstore_impl_t *this) {
+     close_files(this);
+     free(this->segment);
+     free(this->zsegment);
+     free(this->page);
+     free(this->logs_path);
+     free(this);
+}
+
+static yacad_logstore_t impl_fn = {
+     .append = (yacad_logstore_append_fn)append,
+     .complete = (yacad_logstore_complete_fn)complete,
+     .compact = (yacad_logstore_compact_fn)compact,
+     .get_state = (yacad_logstore_get_state_fn)get_state,
+     .get_size = (yacad_logstore_get_size_fn)get_size,
+     .read = (yacad_logstore_read_fn)read_,
+     .line_offset = (yacad_logstore_line_offset_fn)line_offset,
+     .tail = (yacad_logstore_tail_fn)tail,
+     .free = (yacad_logstore_free_fn)free_,
+};
+
+/* Reads the header, the last index entry and the tail */
+static bool_t open_files(yacad_logstore_impl_t *this) {
+     bool_t result = false;
+     char *idx_path = new_path("%s/%lu.idx", this->logs_path, this->id);
+     char *tail_path = new_path("%s/%lu.tail", this->logs_path, this->id);
+     char *seg_path = NULL;
+     int flags = this->writer ? O_RDWR | O_CREAT : O_RDONLY;
+     struct stat st;
+     ssize_t r;
+
+     this->idx = open(idx_path, flags | O_CLOEXEC, 0644);
+     if (this->idx >= 0 && fstat(this->idx, &st) == 0) {
+          if (st.st_size < sizeof(header_t) && this->writer) {
+               memcpy(this->header.magic, MAGIC, 4);
+               this->header.state = logstore_open;
+               this->header.generation = 0;
+               this->header.reserved = 0;
+               write_header(this);
+               this->count = 0;
+               result = true;
+          } else if (pread(this->idx, &(this->header), sizeof(header_t), 0) == sizeof(header_t) && !memcmp(this->header.magic, MAGIC, 4)) {
+               // an entry being written is not counted
+               this->count = (st.st_size - sizeof(header_t)) / sizeof(index_t);
+               result = this->count == 0 || read_entry(this, this->count - 1, &(this->last));
+          }
+     }
+
+     if (result) {
+          seg_path = new_path("%s/%lu.%u.seg", this->logs_path, this->id, this->header.generation);
+          this->seg = open(seg_path, flags | O_CLOEXEC, 0644);
+          // a compaction may have removed it since the index was read
+          result = this->seg >= 0 || this->count == 0;
+
+          this->tail = open(tail_path, (this->writer ? flags | O_APPEND : flags) | O_CLOEXEC, 0644);
+          if (this->tail >= 0) {
+               r = pread(this->tail, this->segment, SEGMENT_SIZE, 0);
+               this->tail_size = r > 0 ? r : 0;
+               this->tail_lines = count_lines(this->segment, this->tail_size);
+          }
+     }
+     this->page_index = this->count;
+
+     free(seg_path);
+     free(tail_path);
+     free(idx_path);
+     return result;
+}
+
+static yacad_logstore_impl_t *logstore_new(logger_t log, const char *logs_path, unsigned long id, bool_t writer) {
+     yacad_logstore_impl_t *result = malloc(sizeof(yacad_logstore_impl_t));
+     int attempts;
+     bool_t ok = false;
+
+     result->fn = impl_fn;
+     result->log = log;
+     result->logs_path = strdup(logs_path);
+     result->id = id;
+     result->writer = writer;
+     result->idx = result->seg = result->tail = -1;
+     result->count = result->tail_size = result->tail_lines = 0;
+     result->segment = malloc(SEGMENT_SIZE);
+     result->zsegment = malloc(compressBound(SEGMENT_SIZE));
+     result->page = malloc(SEGMENT_SIZE);
+
+     for (attempts = 0; !ok && attempts < 2; attempts++) {
+          ok = open_files(result);
+          if (!ok) {
+               close_files(result);
+          }
+     }
+     if (!ok) {
+          free_(result);
+          result = NULL;
+     }
+
+     return result;
+}
+
+yacad_logstore_t *yacad_logstore_new(logger_t log, const char *logs_path, unsigned long id) {
+     yacad_logstore_impl_t *result = logstore_new(log, logs_path, id, true);
+     if (result == NULL) {
+          log(warn, "Task %lu: could not open the log in %s: %s", id, logs_path, strerror(errno));
+     }
+     return result == NULL ? NULL : I(result);
+}
+
+yacad_logstore_t *yacad_logstore_open(logger_t log, const char *logs_path, unsigned long id) {
+     yacad_logstore_impl_t *result = logstore_new(log, logs_path, id, false);
+     return result == NULL ? NULL : I(result);
+}
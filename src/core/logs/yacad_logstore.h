@@ -0,0 +1,63 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __YACAD_LOGSTORE_H__
+#define __YACAD_LOGSTORE_H__
+
+#include "yacad.h"
+
+/* The log of one task, in the logs path:
+ * - <id>.idx: a header, then the index of the compressed segments
+ *   (offset, first line, size) in order;
+ * - <id>.<generation>.seg: the segments, each one zlib-compressed;
+ * - <id>.tail: the bytes of the segment being filled.
+ * The reads find their segments in the index and decompress only them.
+ * Only one writer per log; a reader sees the log as it was when opened. */
+
+typedef struct yacad_logstore_s yacad_logstore_t;
+
+typedef enum {
+     logstore_open = 0, // still written
+     logstore_complete, // the task output is complete
+     logstore_compacted, // and recompressed
+} yacad_logstore_state_t;
+
+typedef void (*yacad_logstore_append_fn)(yacad_logstore_t *this, const char *bytes, size_t size);
+typedef void (*yacad_logstore_complete_fn)(yacad_logstore_t *this);
+typedef bool_t (*yacad_logstore_compact_fn)(yacad_logstore_t *this);
+typedef yacad_logstore_state_t (*yacad_logstore_get_state_fn)(yacad_logstore_t *this);
+typedef size_t (*yacad_logstore_get_size_fn)(yacad_logstore_t *this);
+typedef size_t (*yacad_logstore_read_fn)(yacad_logstore_t *this, size_t offset, char *buffer, size_t size);
+typedef size_t (*yacad_logstore_line_offset_fn)(yacad_logstore_t *this, size_t line);
+typedef size_t (*yacad_logstore_tail_fn)(yacad_logstore_t *this, size_t lines);
+typedef void (*yacad_logstore_free_fn)(yacad_logstore_t *this);
+
+struct yacad_logstore_s {
+     yacad_logstore_append_fn append; // writer only
+     yacad_logstore_complete_fn complete; // writer only: seals the last segment
+     yacad_logstore_compact_fn compact; // writer only: recompresses a complete log; false if nothing was done
+     yacad_logstore_get_state_fn get_state;
+     yacad_logstore_get_size_fn get_size;
+     yacad_logstore_read_fn read; // returns the count of bytes read
+     yacad_logstore_line_offset_fn line_offset; // of the start of a line (0-based); the size if there is no such line
+     yacad_logstore_tail_fn tail; // the offset of the last lines
+     yacad_logstore_free_fn free;
+};
+
+yacad_logstore_t *yacad_logstore_new(logger_t log, const char *logs_path, unsigned long id);
+yacad_logstore_t *yacad_logstore_open(logger_t log, const char *logs_path, unsigned long id);
+
+#endif /* __YACAD_LOGSTORE_H__ */
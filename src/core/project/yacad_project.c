@@ -42,20 +42,20 @@ static struct timeval next_check(yacad_project_impl_t *this) {
      return result;
 }
 
-static void env_cleaner(cad_hash_t *env, int index, const char *key, char *value, yacad_project_impl_t *this) {
-     free(value);
+typedef struct {
+     yacad_project_impl_t *project;
+     yacad_project_on_task_fn on_task;
+     void *data;
+} check_context_t;
+
+static void on_change(cad_hash_t *env, check_context_t *context) {
+     yacad_project_impl_t *this = context->project;
+     context->on_task(yacad_task_new(this->log, this->tasks->get(this->tasks, 0), env, this->name, 0), context->data);
 }
 
-static yacad_task_t *check(yacad_project_impl_t *this) {
-     yacad_task_t *result = NULL;
-     cad_hash_t *env = cad_new_hash(stdlib_memory, cad_hash_strings);
-     if (this->scm->check(this->scm)) {
-          this->scm->fill_env(this->scm, env);
-          result = yacad_task_new(this->log, this->tasks->get(this->tasks, 0), env, this->name, 0);
-     }
-     env->clean(env, (cad_hash_iterator_fn)env_cleaner, this);
-     env->free(env);
-     return result;
+static int check(yacad_project_impl_t *this, yacad_project_on_task_fn on_task, void *data) {
+     check_context_t context = { this, on_task, data };
+     return this->scm->check(this->scm, (yacad_scm_on_change_fn)on_change, &context);
 }
 
 static yacad_task_t *next_task(yacad_project_impl_t *this, yacad_task_t *previous) {
@@ -28,7 +28,11 @@ typedef struct yacad_project_s yacad_project_t;
 
 typedef const char *(*yacad_project_get_name_fn)(yacad_project_t *this);
 typedef struct timeval (*yacad_project_next_check_fn)(yacad_project_t *this);
-typedef yacad_task_t *(*yacad_project_check_fn)(yacad_project_t *this);
+/* called with each new task, which belongs to the callee */
+typedef void (*yacad_project_on_task_fn)(yacad_task_t *task, void *data);
+
+/* creates a task for each changed scm ref; returns the number of tasks */
+typedef int (*yacad_project_check_fn)(yacad_project_t *this, yacad_project_on_task_fn on_task, void *data);
 typedef yacad_task_t *(*yacad_project_next_task_fn)(yacad_project_t *this, yacad_task_t *previous);
 typedef yacad_scm_t *(*yacad_project_get_scm_fn)(yacad_project_t *this);
 typedef void (*yacad_project_free_fn)(yacad_project_t *this);
@@ -0,0 +1,233 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <limits.h>
+
+#include "yacad_query.h"
+#include "common/database/yacad_database.h"
+#include "common/message/yacad_message_visitor.h"
+#include "common/zmq/yacad_zmq.h"
+
+#define INPROC_STOP_ADDRESS "inproc://query-stop"
+#define MSG_STOP "stop"
+
+#define DEFAULT_LIMIT 50
+#define MAX_LIMIT 500
+
+/* keyset pagination: the filters use the TASKLIST_PROJECT_ID, TASKLIST_PROJECT and TASKLIST_STATUS indexes */
+#define STMT_SELECT "select ID, STATUS, PROJECT, TIMESTAMP, DISPATCHED, FINISHED, ETA from TASKLIST where ID<?"
+#define STMT_AND_PROJECT " and PROJECT=?"
+#define STMT_AND_STATUS " and STATUS=?"
+#define STMT_AND_SINCE " and TIMESTAMP>=?"
+#define STMT_AND_UNTIL " and TIMESTAMP<?"
+#define STMT_ORDER " order by ID desc limit ?"
+
+typedef struct yacad_query_impl_s {
+     yacad_query_t fn;
+     yacad_conf_t *conf;
+     pthread_t thread;
+     bool_t started;
+     yacad_zmq_socket_t *zstop; // bound before the thread starts, so that free_ can always stop it
+} yacad_query_impl_t;
+
+typedef struct {
+     yacad_message_visitor_t fn;
+     yacad_query_impl_t *query;
+     yacad_database_t *database;
+     yacad_message_t *reply;
+} query_visitor_t;
+
+typedef struct {
+     yacad_message_reply_list_tasks_t *reply;
+     int limit;
+     int count;
+} list_context_t;
+
+static void list_task(yacad_statement_t *stmt, list_context_t *context) {
+     yacad_task_summary_t task;
+
+     context->count++;
+     if (context->count > context->limit) {
+          // one more than asked: there is a next page
+          context->reply->set_next(context->reply, context->reply->get(context->reply, context->limit - 1)->id);
+     } else {
+          task.id = (unsigned long)stmt->get_int(stmt, 0);
+          task.status = (yacad_task_status_t)stmt->get_int(stmt, 1);
+          task.project = stmt->get_string(stmt, 2);
+          task.timestamp = (time_t)stmt->get_int(stmt, 3);
+          task.dispatched = (time_t)stmt->get_int(stmt, 4);
+          task.finished = (time_t)stmt->get_int(stmt, 5);
+          task.eta = (time_t)stmt->get_int(stmt, 6);
+          context->reply->add(context->reply, &task);
+     }
+}
+
+static void visit_query_list_tasks(query_visitor_t *this, yacad_message_query_list_tasks_t *message) {
+     const yacad_task_filter_t *filter = message->get_filter(message);
+     list_context_t context = { yacad_message_reply_list_tasks_new(this->query->conf->log), filter->limit, 0 };
+     yacad_statement_t *stmt;
+     char *statement;
+     int n, index = 0;
+
+     if (context.limit <= 0) {
+          context.limit = DEFAULT_LIMIT;
+     } else if (context.limit > MAX_LIMIT) {
+          context.limit = MAX_LIMIT;
+     }
+
+     // only the clauses are concatenated, the values are all bound
+     n = snprintf("", 0, "%s%s%s%s%s%s", STMT_SELECT,
+                  filter->project == NULL ? "" : STMT_AND_PROJECT,
+                  filter->by_status ? STMT_AND_STATUS : "",
+                  filter->since == 0 ? "" : STMT_AND_SINCE,
+                  filter->until == 0 ? "" : STMT_AND_UNTIL,
+                  STMT_ORDER) + 1;
+     statement = alloca(n);
+     snprintf(statement, n, "%s%s%s%s%s%s", STMT_SELECT,
+              filter->project == NULL ? "" : STMT_AND_PROJECT,
+              filter->by_status ? STMT_AND_STATUS : "",
+              filter->since == 0 ? "" : STMT_AND_SINCE,
+              filter->until == 0 ? "" : STMT_AND_UNTIL,
+              STMT_ORDER);
+
+     stmt = this->database->select(this->database, statement);
+     if (stmt != NULL) {
+          stmt->bind_int(stmt, index++, filter->before == 0 ? LONG_MAX : (long)filter->before);
+          if (filter->project != NULL) {
+               stmt->bind_string(stmt, index++, filter->project);
+          }
+          if (filter->by_status) {
+               stmt->bind_int(stmt, index++, filter->status);
+          }
+          if (filter->since != 0) {
+               stmt->bind_int(stmt, index++, (long)filter->since);
+          }
+          if (filter->until != 0) {
+               stmt->bind_int(stmt, index++, (long)filter->until);
+          }
+          stmt->bind_int(stmt, index, context.limit + 1);
+          stmt->run(stmt, (yacad_select_fn)list_task, &context);
+          stmt->free(stmt);
+     }
+
+     this->reply = I(context.reply);
+}
+
+static void visit_unexpected(query_visitor_t *this, yacad_message_t *message) {
+     this->query->conf->log(warn, "Unexpected message on the query endpoint");
+}
+
+static yacad_message_visitor_t query_visitor_fn = {
+     .visit_query_get_task = (yacad_message_visitor_visit_query_get_task_fn)visit_unexpected,
+     .visit_reply_get_task = (yacad_message_visitor_visit_reply_get_task_fn)visit_unexpected,
+     .visit_query_set_result = (yacad_message_visitor_visit_query_set_result_fn)visit_unexpected,
+     .visit_reply_set_result = (yacad_message_visitor_visit_reply_set_result_fn)visit_unexpected,
+     .visit_query_list_tasks = (yacad_message_visitor_visit_query_list_tasks_fn)visit_query_list_tasks,
+     .visit_reply_list_tasks = (yacad_message_visitor_visit_reply_list_tasks_fn)visit_unexpected,
+};
+
+static bool_t on_pollin_stop(yacad_zmq_poller_t *poller, yacad_zmq_socket_t *socket, const char *strmsg, void *data) {
+     return strmsg == NULL || strcmp(strmsg, MSG_STOP);
+}
+
+static bool_t on_pollin_query(yacad_zmq_poller_t *poller, yacad_zmq_socket_t *socket, const char *strmsg, void *data) {
+     query_visitor_t *v = (query_visitor_t*)data;
+     yacad_message_t *message;
+     char *serial;
+
+     v->reply = NULL;
+     message = yacad_message_unserialize(v->query->conf->log, strmsg, NULL);
+     if (message == NULL) {
+          v->query->conf->log(warn, "Received invalid message: %s", strmsg);
+     } else {
+          message->accept(message, I(v));
+          message->free(message);
+     }
+
+     // always reply, the socket expects it
+     if (v->reply == NULL) {
+          v->reply = I(yacad_message_reply_list_tasks_new(v->query->conf->log));
+     }
+     serial = v->reply->serialize(v->reply);
+     socket->send(socket, serial);
+     free(serial);
+     v->reply->free(v->reply);
+
+     return true;
+}
+
+static void *query_routine(yacad_query_impl_t *this) {
+     query_visitor_t v = { query_visitor_fn, this, NULL, NULL };
+     yacad_zmq_socket_t *zquery;
+     yacad_zmq_poller_t *zpoller;
+
+     set_thread_name("query");
+
+     v.database = yacad_database_new_readonly(this->conf->log, this->conf->get_database_name(this->conf));
+     if (v.database == NULL) {
+          this->conf->log(error, "Could not open the database for queries");
+          return this;
+     }
+
+     zquery = yacad_zmq_socket_bind(this->conf->log, this->conf->get_query_name(this->conf), ZMQ_REP);
+     if (zquery == NULL) {
+          this->conf->log(error, "Could not bind zquery to %s", this->conf->get_query_name(this->conf));
+     } else {
+          zpoller = yacad_zmq_poller_new(this->conf->log);
+          zpoller->on_pollin(zpoller, this->zstop, on_pollin_stop);
+          zpoller->on_pollin(zpoller, zquery, on_pollin_query);
+          zpoller->run(zpoller, &v);
+          zpoller->free(zpoller);
+          zquery->free(zquery);
+     }
+
+     v.database->free(v.database);
+     return this;
+}
+
+static void free_(yacad_query_impl_t *this) {
+     yacad_zmq_socket_t *zstop;
+     if (this->started) {
+          zstop = yacad_zmq_socket_connect(this->conf->log, INPROC_STOP_ADDRESS, ZMQ_PAIR);
+          if (zstop != NULL) {
+               zstop->send(zstop, MSG_STOP);
+               zstop->free(zstop);
+          }
+          pthread_join(this->thread, NULL);
+     }
+     if (this->zstop != NULL) {
+          this->zstop->free(this->zstop);
+     }
+     free(this);
+}
+
+static yacad_query_t impl_fn = {
+     .free = (yacad_query_free_fn)free_,
+};
+
+yacad_query_t *yacad_query_new(yacad_conf_t *conf) {
+     yacad_query_impl_t *result = malloc(sizeof(yacad_query_impl_t));
+     result->fn = impl_fn;
+     result->conf = conf;
+     result->started = false;
+     result->zstop = yacad_zmq_socket_bind(conf->log, INPROC_STOP_ADDRESS, ZMQ_PAIR);
+     if (result->zstop == NULL) {
+          conf->log(error, "Could not bind %s", INPROC_STOP_ADDRESS);
+     } else {
+          result->started = pthread_create(&(result->thread), NULL, (void*(*)(void*))query_routine, result) == 0;
+     }
+     return I(result);
+}
@@ -0,0 +1,35 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __YACAD_QUERY_H__
+#define __YACAD_QUERY_H__
+
+#include "yacad.h"
+#include "core/conf/yacad_conf.h"
+
+/* Serves the task queries (query_list_tasks) on the query endpoint,
+ * from its own thread and read-only database connection. */
+
+typedef struct yacad_query_s yacad_query_t;
+
+typedef void (*yacad_query_free_fn)(yacad_query_t *this);
+
+struct yacad_query_s {
+     yacad_query_free_fn free;
+};
+
+yacad_query_t *yacad_query_new(yacad_conf_t *conf);
+
+#endif /* __YACAD_QUERY_H__ */
@@ -0,0 +1,93 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "yacad_refs.h"
+#include "core/project/yacad_project.h"
+
+#define STMT_CREATE_TABLE "create table if not exists SCMREFS (" \
+     "PROJECT not null, "                                        \
+     "REFNAME not null, "                                        \
+     "OID not null, "                                            \
+     "primary key (PROJECT, REFNAME)"                            \
+     ")"
+#define STMT_SELECT "select PROJECT, REFNAME, OID from SCMREFS"
+#define STMT_UPDATE "insert or replace into SCMREFS (PROJECT,REFNAME,OID) values (?,?,?)"
+
+typedef struct yacad_refs_impl_s {
+     yacad_refs_t fn;
+     logger_t log;
+     yacad_database_t *database;
+     cad_hash_t *projects;
+     int count;
+} yacad_refs_impl_t;
+
+static void save(yacad_refs_impl_t *this, const char *project_name, const char *refname, const char *oid) {
+     yacad_statement_t *stmt = this->database->update(this->database, STMT_UPDATE);
+     if (stmt != NULL) {
+          stmt->bind_string(stmt, 0, project_name);
+          stmt->bind_string(stmt, 1, refname);
+          stmt->bind_string(stmt, 2, oid);
+          stmt->run(stmt, NULL, NULL);
+          stmt->free(stmt);
+     }
+}
+
+static void free_(yacad_refs_impl_t *this) {
+     free(this);
+}
+
+static yacad_refs_t impl_fn = {
+     .save = (yacad_refs_save_fn)save,
+     .free = (yacad_refs_free_fn)free_,
+};
+
+static void load_ref(yacad_statement_t *stmt, yacad_refs_impl_t *this) {
+     yacad_project_t *project = this->projects->get(this->projects, stmt->get_string(stmt, 0));
+     yacad_scm_t *scm;
+
+     // the project may have been removed from the configuration
+     if (project != NULL) {
+          scm = project->get_scm(project);
+          scm->set_built(scm, stmt->get_string(stmt, 1), stmt->get_string(stmt, 2));
+          this->count++;
+     }
+}
+
+yacad_refs_t *yacad_refs_new(logger_t log, yacad_database_t *database, cad_hash_t *projects) {
+     yacad_refs_impl_t *result = malloc(sizeof(yacad_refs_impl_t));
+     yacad_statement_t *stmt;
+
+     result->fn = impl_fn;
+     result->log = log;
+     result->database = database;
+     result->projects = projects;
+     result->count = 0;
+
+     stmt = database->update(database, STMT_CREATE_TABLE);
+     if (stmt != NULL) {
+          stmt->run(stmt, NULL, NULL);
+          stmt->free(stmt);
+     }
+
+     stmt = database->select(database, STMT_SELECT);
+     if (stmt != NULL) {
+          stmt->run(stmt, (yacad_select_fn)load_ref, result);
+          stmt->free(stmt);
+     }
+     log(info, "Restored %d built scm refs", result->count);
+
+     return I(result);
+}
@@ -0,0 +1,39 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __YACAD_REFS_H__
+#define __YACAD_REFS_H__
+
+#include "yacad.h"
+#include "common/database/yacad_database.h"
+
+/* The oid of the last build of each tracked scm ref, per project. The
+ * scms keep them in memory; they are only persisted here, and restored
+ * into the projects scms at creation. */
+
+typedef struct yacad_refs_s yacad_refs_t;
+
+typedef void (*yacad_refs_save_fn)(yacad_refs_t *this, const char *project_name, const char *refname, const char *oid);
+typedef void (*yacad_refs_free_fn)(yacad_refs_t *this);
+
+struct yacad_refs_s {
+     yacad_refs_save_fn save;
+     yacad_refs_free_fn free;
+};
+
+yacad_refs_t *yacad_refs_new(logger_t log, yacad_database_t *database, cad_hash_t *projects);
+
+#endif /* __YACAD_REFS_H__ */
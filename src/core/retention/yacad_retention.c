@@ -0,0 +1,236 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "yacad_retention.h"
+#include "common/database/yacad_database.h"
+#include "common/task/yacad_task.h"
+
+/* max rows archived in one slice */
+#define SLICE_ROWS 64
+/* max pages vacuumed in one slice */
+#define SLICE_PAGES 32
+/* delay between two slices when there is more work to do */
+#define SLICE_DELAY 1
+/* delay between two slices when there is nothing left to do */
+#define IDLE_DELAY 600
+
+#define STR(x) #x
+#define XSTR(x) STR(x)
+
+#define STMT_ATTACH "attach database ? as ARCHIVE"
+#define STMT_CREATE_TABLE "create table if not exists ARCHIVE.TASKARCHIVE (" \
+     "ID integer primary key, "                                         \
+     "STATUS integer not null, "                                        \
+     "PROJECT, "                                                        \
+     "TIMESTAMP integer not null default 0, "                           \
+     "SERIAL not null"                                                  \
+     ")"
+#define STMT_SELECT "select ID from TASKLIST t "                        \
+     "where STATUS in (?,?) "                                           \
+     "and (TIMESTAMP<? "                                                \
+     "or (select count(*) from TASKLIST u where u.PROJECT is t.PROJECT and u.STATUS in (?,?) and u.ID>t.ID)>=?) " \
+     "order by ID asc limit ?"
+#define STMT_ARCHIVE "insert or replace into ARCHIVE.TASKARCHIVE (ID,STATUS,PROJECT,TIMESTAMP,SERIAL) " \
+     "select ID,STATUS,PROJECT,TIMESTAMP,SERIAL from TASKLIST where ID=?"
+#define STMT_DELETE "delete from TASKLIST where ID=?"
+#define STMT_COMMIT "commit"
+#define STMT_ROLLBACK "rollback"
+#define STMT_FREELIST "pragma freelist_count"
+#define STMT_VACUUM "pragma incremental_vacuum(" XSTR(SLICE_PAGES) ")"
+
+typedef struct yacad_retention_impl_s {
+     yacad_retention_t fn;
+     logger_t log;
+     yacad_database_t *database;
+     int builds;
+     int days;
+     bool_t enabled;
+     struct timeval next_slice;
+} yacad_retention_impl_t;
+
+static struct timeval next_slice(yacad_retention_impl_t *this) {
+     return this->next_slice;
+}
+
+static void run_statement(yacad_retention_impl_t *this, const char *statement) {
+     yacad_statement_t *stmt = this->database->update(this->database, statement);
+     if (stmt != NULL) {
+          stmt->run(stmt, NULL, NULL);
+          stmt->free(stmt);
+     }
+}
+
+/* true if the statement ran */
+static bool_t run_id_statement(yacad_retention_impl_t *this, const char *statement, long id) {
+     bool_t result = false;
+     yacad_statement_t *stmt = this->database->update(this->database, statement);
+     if (stmt != NULL) {
+          stmt->bind_int(stmt, 0, id);
+          result = stmt->run(stmt, NULL, NULL);
+          stmt->free(stmt);
+     }
+     return result;
+}
+
+static void collect_id(yacad_statement_t *stmt, cad_array_t *ids) {
+     long id = stmt->get_int(stmt, 0);
+     ids->insert(ids, ids->count(ids), &id);
+}
+
+static int archive_slice(yacad_retention_impl_t *this) {
+     int i, result = 0;
+     bool_t ok = true;
+     long id;
+     time_t limit = 0;
+     yacad_statement_t *stmt;
+     cad_array_t *ids;
+
+     if (this->days > 0) {
+          limit = time(NULL) - (time_t)this->days * 86400;
+     }
+
+     stmt = this->database->select(this->database, STMT_SELECT);
+     if (stmt != NULL) {
+          ids = cad_new_array(stdlib_memory, sizeof(long));
+          stmt->bind_int(stmt, 0, task_done);
+          stmt->bind_int(stmt, 1, task_aborted);
+          stmt->bind_int(stmt, 2, (long)limit);
+          stmt->bind_int(stmt, 3, task_done);
+          stmt->bind_int(stmt, 4, task_aborted);
+          stmt->bind_int(stmt, 5, this->builds > 0 ? (long)this->builds : (long)(~0UL >> 1));
+          stmt->bind_int(stmt, 6, SLICE_ROWS);
+          stmt->run(stmt, (yacad_select_fn)collect_id, ids);
+          stmt->free(stmt);
+
+          result = ids->count(ids);
+          if (result > 0 && !this->database->begin(this->database)) {
+               // the scheduler holds the database: try again in the next slice
+               this->log(info, "Retention: database busy, %d task%s not archived yet", result, result == 1 ? "" : "s");
+               result = SLICE_ROWS;
+          } else if (result > 0) {
+               for (i = 0; ok && i < result; i++) {
+                    id = *(long*)ids->get(ids, i);
+                    ok = run_id_statement(this, STMT_ARCHIVE, id) && run_id_statement(this, STMT_DELETE, id);
+               }
+               if (ok) {
+                    run_statement(this, STMT_COMMIT);
+                    this->log(info, "Archived %d task%s", result, result == 1 ? "" : "s");
+               } else {
+                    // never deleted if not archived: the whole slice is undone, and tried again when idle
+                    run_statement(this, STMT_ROLLBACK);
+                    this->log(warn, "Retention: could not archive task %ld, %d task%s kept", id, result, result == 1 ? "" : "s");
+                    result = 0;
+               }
+          }
+
+          ids->free(ids);
+     }
+
+     return result;
+}
+
+static void get_freelist(yacad_statement_t *stmt, long *freelist) {
+     *freelist = stmt->get_int(stmt, 0);
+}
+
+static long freelist_count(yacad_retention_impl_t *this) {
+     long result = 0;
+     yacad_statement_t *stmt = this->database->select(this->database, STMT_FREELIST);
+     if (stmt != NULL) {
+          stmt->run(stmt, (yacad_select_fn)get_freelist, &result);
+          stmt->free(stmt);
+     }
+     return result;
+}
+
+static void run_slice(yacad_retention_impl_t *this) {
+     bool_t more = false;
+     long freelist;
+
+     if (this->enabled) {
+          if (archive_slice(this) == SLICE_ROWS) {
+               more = true;
+          } else {
+               freelist = freelist_count(this);
+               if (freelist > 0) {
+                    this->log(debug, "Incremental vacuum: %ld free pages", freelist);
+                    run_statement(this, STMT_VACUUM);
+                    more = freelist > SLICE_PAGES;
+               }
+          }
+     }
+
+     gettimeofday(&(this->next_slice), NULL);
+     this->next_slice.tv_sec += more ? SLICE_DELAY : IDLE_DELAY;
+}
+
+static void free_(yacad_retention_impl_t *this) {
+     if (this->database != NULL) {
+          this->database->free(this->database);
+     }
+     free(this);
+}
+
+static yacad_retention_t impl_fn = {
+     .next_slice = (yacad_retention_next_slice_fn)next_slice,
+     .run_slice = (yacad_retention_run_slice_fn)run_slice,
+     .free = (yacad_retention_free_fn)free_,
+};
+
+yacad_retention_t *yacad_retention_new(yacad_conf_t *conf) {
+     yacad_retention_impl_t *result = malloc(sizeof(yacad_retention_impl_t));
+     yacad_database_t *archive;
+     yacad_statement_t *stmt;
+     const char *archive_name = conf->get_archive_name(conf);
+
+     result->fn = impl_fn;
+     result->log = conf->log;
+     result->builds = conf->get_retention_builds(conf);
+     result->days = conf->get_retention_days(conf);
+     result->enabled = result->builds > 0 || result->days > 0;
+     result->database = NULL;
+     gettimeofday(&(result->next_slice), NULL);
+     result->next_slice.tv_sec += IDLE_DELAY;
+
+     if (result->enabled) {
+          // attach does not create the file when the database was opened without SQLITE_OPEN_CREATE
+          archive = yacad_database_new(conf->log, archive_name);
+          if (archive != NULL) {
+               archive->free(archive);
+          }
+          result->database = yacad_database_new(conf->log, conf->get_database_name(conf));
+          if (result->database == NULL) {
+               conf->log(warn, "Retention disabled: could not open database");
+               result->enabled = false;
+          } else {
+               stmt = result->database->update(result->database, STMT_ATTACH);
+               if (stmt == NULL) {
+                    conf->log(warn, "Retention disabled: could not attach archive %s", archive_name);
+                    result->enabled = false;
+               } else {
+                    stmt->bind_string(stmt, 0, archive_name);
+                    stmt->run(stmt, NULL, NULL);
+                    stmt->free(stmt);
+                    run_statement(result, STMT_CREATE_TABLE);
+                    // first slice as soon as possible
+                    gettimeofday(&(result->next_slice), NULL);
+               }
+          }
+     }
+
+     return I(result);
+}
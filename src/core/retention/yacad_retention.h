@@ -0,0 +1,50 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __YACAD_RETENTION_H__
+#define __YACAD_RETENTION_H__
+
+#include "yacad.h"
+#include "core/conf/yacad_conf.h"
+
+/**
+ * Build-history retention.
+ *
+ * Finished tasks older than the configured number of days, or beyond
+ * the configured number of builds per project, are moved from
+ * TASKLIST to an attached archive database. The freed pages are then
+ * given back to the file system by incremental vacuum.
+ *
+ * All the work is done in small slices, on a database connection of
+ * its own, so that the scheduler is never blocked for long.
+ */
+
+typedef struct yacad_retention_s yacad_retention_t;
+
+typedef struct timeval (*yacad_retention_next_slice_fn)(yacad_retention_t *this);
+typedef void (*yacad_retention_run_slice_fn)(yacad_retention_t *this);
+typedef void (*yacad_retention_free_fn)(yacad_retention_t *this);
+
+struct yacad_retention_s {
+     yacad_retention_next_slice_fn next_slice;
+     yacad_retention_run_slice_fn run_slice;
+     yacad_retention_free_fn free;
+};
+
+yacad_retention_t *yacad_retention_new(yacad_conf_t *conf);
+
+#endif /* __YACAD_RETENTION_H__ */
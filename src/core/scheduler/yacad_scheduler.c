@@ -15,20 +15,41 @@
 */
 
 #include "yacad_scheduler.h"
+#include "core/artifacts/yacad_artifacts.h"
+#include "core/cache/yacad_cache.h"
+#include "core/checker/yacad_checker.h"
+#include "core/gc/yacad_gc.h"
+#include "core/logs/yacad_logs.h"
 #include "core/project/yacad_project.h"
+#include "core/query/yacad_query.h"
+#include "core/refs/yacad_refs.h"
+#include "core/retention/yacad_retention.h"
+#include "core/stats/yacad_stats.h"
 #include "core/tasklist/yacad_tasklist.h"
+#include "common/hash/yacad_sha256.h"
+#include "common/json/yacad_json_finder.h"
 #include "common/message/yacad_message_visitor.h"
 #include "common/zmq/yacad_zmq.h"
 
 #define INPROC_CHECK_ADDRESS "inproc://scheduler-check"
 #define INPROC_RUN_ADDRESS "inproc://scheduler-run"
+#define INPROC_CHECKED_ADDRESS "inproc://scheduler-checked"
 #define MSG_START "start"
 #define MSG_CHECK "check"
 #define MSG_STOP  "stop"
 #define MSG_EVENT "event"
 
+#define UPSTREAM_HASHES 32 // enough to tell a runner that holds them
+
+typedef struct {
+     struct timeval time; // time of the next check, on the monotonic clock
+     yacad_project_t *project;
+} deadline_t;
+
 typedef struct {
-     struct timeval time; // time of the next check
+     deadline_t *heap; // min-heap on time
+     int count;
+     int capacity;
      int confgen;
 } next_check_t;
 
@@ -36,7 +57,12 @@ typedef struct yacad_scheduler_impl_s {
      yacad_scheduler_t fn;
      yacad_conf_t *conf;
      yacad_database_t *database;
+     yacad_taskstore_t *taskstore;
+     yacad_stats_t *stats;
+     yacad_refs_t *refs;
      yacad_tasklist_t *tasklist;
+     yacad_cache_t *cache;
+     yacad_checker_t *checker;
      next_check_t worker_next_check;
      pthread_t worker;
      bool_t running;
@@ -59,57 +85,165 @@ static void stop(yacad_scheduler_impl_t *this) {
 }
 
 static void free_(yacad_scheduler_impl_t *this) {
+     this->cache->free(this->cache);
      this->tasklist->free(this->tasklist);
+     this->taskstore->free(this->taskstore);
+     this->stats->free(this->stats);
+     this->refs->free(this->refs);
      this->database->free(this->database);
      this->conf->free(this->conf);
+     free(this->worker_next_check.heap);
      free(this);
 }
 
-static void iterate_next_check(cad_hash_t *projects, int index, const char *key, yacad_project_t *project, yacad_scheduler_impl_t *this) {
-     struct timeval tm = project->next_check(project);
-     if (this->worker_next_check.time.tv_sec == 0 || timercmp(&tm, &(this->worker_next_check.time), <)) {
-          this->worker_next_check.time = tm;
+static struct timeval monotonic_now(void) {
+     struct timeval result;
+     struct timespec ts;
+
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     result.tv_sec = ts.tv_sec;
+     result.tv_usec = ts.tv_nsec / 1000;
+     return result;
+}
+
+/* The deadlines are kept on the monotonic clock: a wall clock step (e.g. NTP on a machine without
+ * RTC) neither delays the checks nor makes them all due at once. */
+static struct timeval to_monotonic(struct timeval wall) {
+     struct timeval now, mono = monotonic_now(), delta, result;
+
+     gettimeofday(&now, NULL);
+     timersub(&wall, &now, &delta);
+     timeradd(&mono, &delta, &result);
+     return result;
+}
+
+static struct timeval to_wall(struct timeval monotonic) {
+     struct timeval now, mono = monotonic_now(), delta, result;
+
+     gettimeofday(&now, NULL);
+     timersub(&monotonic, &mono, &delta);
+     timeradd(&now, &delta, &result);
+     return result;
+}
+
+static void heap_swap(next_check_t *next_check, int i, int j) {
+     deadline_t tmp = next_check->heap[i];
+     next_check->heap[i] = next_check->heap[j];
+     next_check->heap[j] = tmp;
+}
+
+static void heap_push(next_check_t *next_check, struct timeval time, yacad_project_t *project) {
+     int i, parent;
+
+     if (next_check->count == next_check->capacity) {
+          next_check->capacity = next_check->capacity == 0 ? 16 : 2 * next_check->capacity;
+          next_check->heap = realloc(next_check->heap, next_check->capacity * sizeof(deadline_t));
      }
+     i = next_check->count++;
+     next_check->heap[i].time = time;
+     next_check->heap[i].project = project;
+     while (i > 0) {
+          parent = (i - 1) / 2;
+          if (!timercmp(&(next_check->heap[i].time), &(next_check->heap[parent].time), <)) {
+               break;
+          }
+          heap_swap(next_check, i, parent);
+          i = parent;
+     }
+}
+
+static yacad_project_t *heap_pop(next_check_t *next_check) {
+     yacad_project_t *result = next_check->heap[0].project;
+     int i = 0, child;
+
+     next_check->heap[0] = next_check->heap[--next_check->count];
+     for (child = 1; child < next_check->count; child = 2 * i + 1) {
+          if (child + 1 < next_check->count && timercmp(&(next_check->heap[child + 1].time), &(next_check->heap[child].time), <)) {
+               child++;
+          }
+          if (!timercmp(&(next_check->heap[child].time), &(next_check->heap[i].time), <)) {
+               break;
+          }
+          heap_swap(next_check, i, child);
+          i = child;
+     }
+     return result;
+}
+
+static void iterate_next_check(cad_hash_t *projects, int index, const char *key, yacad_project_t *project, yacad_scheduler_impl_t *this) {
+     heap_push(&(this->worker_next_check), to_monotonic(project->next_check(project)), project);
 }
 
+/* Rebuilds the whole heap; only needed when the configuration changed. */
 static void worker_next_check(yacad_scheduler_impl_t *this) {
      cad_hash_t *projects = this->conf->get_projects(this->conf);
-     struct timeval tmzero = {0,0}, save_tm = this->worker_next_check.time;
      char tmbuf[20];
 
-     this->worker_next_check.time = tmzero;
+     this->worker_next_check.count = 0;
      projects->iterate(projects, (cad_hash_iterator_fn)iterate_next_check, this);
 
-     if (timercmp(&save_tm, &(this->worker_next_check.time), !=)) {
-          this->conf->log(debug, "Next check time: %s", datetime(this->worker_next_check.time.tv_sec, tmbuf));
+     if (this->worker_next_check.count > 0) {
+          this->conf->log(debug, "Next check time: %s", datetime(to_wall(this->worker_next_check.heap[0].time).tv_sec, tmbuf));
      }
 }
 
 typedef struct {
      bool_t running;
-     bool_t check;
      yacad_scheduler_impl_t *this;
      yacad_zmq_socket_t *zscheduler_check;
+     yacad_retention_t *retention;
+     yacad_gc_t *gc;
 } worker_context_t;
 
 static bool_t worker_wait_start(yacad_zmq_poller_t *poller, yacad_zmq_socket_t *socket, const char *message, void *data) {
      worker_context_t *context = (worker_context_t*)data;
 
-     if (data != NULL && !strcmp(data, MSG_START)) {
+     if (message != NULL && !strcmp(message, MSG_START)) {
           context->running = true;
           return false;
      }
      return true;
 }
 
+static void send_check(worker_context_t *context, yacad_project_t *project) {
+     const char *name = project->get_name(project);
+     size_t n = snprintf("", 0, "%s\n%s", MSG_CHECK, name) + 1;
+     char *message = malloc(n);
+
+     snprintf(message, n, "%s\n%s", MSG_CHECK, name);
+     context->zscheduler_check->send(context->zscheduler_check, message);
+     free(message);
+}
+
 static bool_t worker_on_timeout(yacad_zmq_poller_t *poller, void *data) {
      worker_context_t *context = (worker_context_t*)data;
-     struct timeval now;
+     next_check_t *next_check = &(context->this->worker_next_check);
+     yacad_project_t *project;
+     struct timeval now, mono;
+     struct timeval retention_time, gc_time;
+     char tmbuf[20];
 
      gettimeofday(&now, NULL);
-     if (timercmp(&(context->this->worker_next_check.time), &now, <)) {
-          context->zscheduler_check->send(context->zscheduler_check, MSG_CHECK);
-          context->check = true;
+     mono = monotonic_now();
+
+     // only the due projects are checked, and only their next check time is computed again
+     if (next_check->count > 0 && !timercmp(&mono, &(next_check->heap[0].time), <)) {
+          while (next_check->count > 0 && !timercmp(&mono, &(next_check->heap[0].time), <)) {
+               project = heap_pop(next_check);
+               send_check(context, project);
+               heap_push(next_check, to_monotonic(project->next_check(project)), project);
+          }
+          context->this->conf->log(debug, "Next check time: %s", datetime(to_wall(next_check->heap[0].time).tv_sec, tmbuf));
+     }
+
+     retention_time = context->retention->next_slice(context->retention);
+     if (!timercmp(&now, &retention_time, <)) {
+          context->retention->run_slice(context->retention);
+     }
+
+     gc_time = context->gc->next_slice(context->gc);
+     if (!timercmp(&now, &gc_time, <)) {
+          context->gc->run_slice(context->gc);
      }
 
      return true;
@@ -117,16 +251,28 @@ static bool_t worker_on_timeout(yacad_zmq_poller_t *poller, void *data) {
 
 static void worker_timeout(yacad_zmq_poller_t *poller, struct timeval *timeout, void *data) {
      worker_context_t *context = (worker_context_t*)data;
+     next_check_t *next_check = &(context->this->worker_next_check);
+     struct timeval retention_time, gc_time, check_time;
      int confgen;
 
      confgen = context->this->conf->generation(context->this->conf);
-     if (context->check || confgen != context->this->worker_next_check.confgen) {
+     if (confgen != next_check->confgen) {
           worker_next_check(context->this);
-          context->this->worker_next_check.confgen = confgen;
-          context->check = false;
+          next_check->confgen = confgen;
      }
 
-     *timeout = context->this->worker_next_check.time;
+     retention_time = context->retention->next_slice(context->retention);
+     *timeout = retention_time;
+     gc_time = context->gc->next_slice(context->gc);
+     if (!timercmp(timeout, &gc_time, <)) {
+          *timeout = gc_time;
+     }
+     if (next_check->count > 0) {
+          check_time = to_wall(next_check->heap[0].time);
+          if (!timercmp(timeout, &check_time, <)) {
+               *timeout = check_time;
+          }
+     }
 }
 
 static bool_t worker_on_pollin(yacad_zmq_poller_t *poller, yacad_zmq_socket_t *socket, const char *message, void *data) {
@@ -140,7 +286,7 @@ static bool_t worker_on_pollin(yacad_zmq_poller_t *poller, yacad_zmq_socket_t *s
 }
 
 static void *worker_routine(yacad_scheduler_impl_t *this) {
-     worker_context_t context = {false, false, this};
+     worker_context_t context = {false, this, NULL, NULL, NULL};
      yacad_zmq_socket_t *zscheduler_run;
      yacad_zmq_poller_t *zpoller;
 
@@ -161,10 +307,15 @@ static void *worker_routine(yacad_scheduler_impl_t *this) {
                if(context.zscheduler_check == NULL) {
                     this->conf->log(error, "Invalid 0MQ scheduler check socket");
                } else {
+                    context.retention = yacad_retention_new(this->conf);
+                    context.gc = yacad_gc_new(this->conf);
+
                     zpoller->set_timeout(zpoller, worker_timeout, worker_on_timeout);
                     zpoller->on_pollin(zpoller, zscheduler_run, worker_on_pollin);
                     zpoller->run(zpoller, &context);
 
+                    context.gc->free(context.gc);
+                    context.retention->free(context.retention);
                     context.zscheduler_check->free(context.zscheduler_check);
                }
                zpoller->free(zpoller);
@@ -175,14 +326,6 @@ static void *worker_routine(yacad_scheduler_impl_t *this) {
      return this;
 }
 
-static void iterate_check_project(cad_hash_t *projects, int index, const char *project_name, yacad_project_t *project, yacad_scheduler_impl_t *this) {
-     yacad_task_t *task = project->check(project);
-     if (task != NULL) {
-          this->tasklist->add(this->tasklist, task);
-          this->publish = true;
-     }
-}
-
 static void reply_get_task(yacad_scheduler_impl_t *this, yacad_runnerid_t *runnerid, yacad_task_t *task) {
      yacad_message_reply_get_task_t *message;
      yacad_scm_t *scm = NULL;
@@ -219,6 +362,87 @@ static void reply_set_result(yacad_scheduler_impl_t *this, yacad_runnerid_t *run
      I(message)->free(I(message));
 }
 
+static void set_env(cad_hash_t *env, const char *key, char *value) {
+     char *old = env->get(env, key);
+     if (old != NULL) {
+          env->del(env, key);
+          free(old);
+     }
+     if (value != NULL) {
+          env->set(env, key, value);
+     }
+}
+
+/* Records in the task env the artifacts published by its upstream task, as a hint for the locality-aware dispatch */
+static void set_upstream(yacad_scheduler_impl_t *this, yacad_task_t *task, unsigned long upstream) {
+     cad_hash_t *env = task->get_env(task);
+     char *path, *artifacts = NULL, *id = NULL;
+     char hash[YACAD_SHA256_HEX];
+     size_t size = 0;
+     FILE *manifest, *out;
+     int n, count = 0;
+
+     // the env goes down the pipeline: stale values must go
+     if (upstream > 0) {
+          n = snprintf("", 0, "%s/tasks/%lu.manifest", this->conf->get_artifacts_path(this->conf), upstream) + 1;
+          path = malloc(n);
+          snprintf(path, n, "%s/tasks/%lu.manifest", this->conf->get_artifacts_path(this->conf), upstream);
+          manifest = fopen(path, "r");
+          if (manifest != NULL) {
+               out = open_memstream(&artifacts, &size);
+               while (count < UPSTREAM_HASHES && fscanf(manifest, "%64s %*[^\n]", hash) == 1) {
+                    fprintf(out, "%s%s", count == 0 ? "" : " ", hash);
+                    count++;
+               }
+               fclose(out);
+               fclose(manifest);
+               if (count == 0) {
+                    free(artifacts);
+                    artifacts = NULL;
+               }
+          }
+          free(path);
+
+          n = snprintf("", 0, "%lu", upstream) + 1;
+          id = malloc(n);
+          snprintf(id, n, "%lu", upstream);
+     }
+     set_env(env, "upstream_task", id);
+     set_env(env, "upstream_artifacts", artifacts);
+}
+
+/* Queues the task; if its result is cached, records it done instead and goes on down the pipeline. True if a task was queued. */
+static bool_t add_task(yacad_scheduler_impl_t *this, yacad_task_t *task, unsigned long upstream) {
+     bool_t result = false;
+     cad_hash_t *projects = this->conf->get_projects(this->conf);
+     yacad_project_t *project;
+     yacad_task_t *next_task;
+     unsigned long cached;
+
+     while (task != NULL) {
+          cached = this->cache->lookup(this->cache, task, upstream);
+          if (cached == 0) {
+               set_upstream(this, task, upstream);
+               this->tasklist->add(this->tasklist, task);
+               result = true;
+               task = NULL;
+          } else {
+               this->tasklist->add_done(this->tasklist, task);
+               next_task = NULL;
+               if (task->get_id(task) != 0) {
+                    this->cache->reuse(this->cache, task, cached);
+                    project = projects->get(projects, task->get_project_name(task));
+                    next_task = project == NULL ? NULL : project->next_task(project, task);
+                    upstream = task->get_id(task);
+               }
+               task->free(task);
+               task = next_task;
+          }
+     }
+
+     return result;
+}
+
 typedef struct {
      yacad_message_visitor_t fn;
      yacad_scheduler_impl_t *scheduler;
@@ -227,18 +451,23 @@ typedef struct {
 static void visit_query_get_task(yacad_scheduler_message_visitor_t *this, yacad_message_query_get_task_t *message) {
      yacad_runnerid_t *runnerid = message->get_runnerid(message);
      yacad_task_t *task;
+     char tmbuf[20];
 
      if (runnerid == NULL) {
           this->scheduler->conf->log(warn, "Missing runnerid");
      } else {
-          task = this->scheduler->tasklist->get(this->scheduler->tasklist, runnerid);
+          task = this->scheduler->tasklist->get(this->scheduler->tasklist, runnerid, message->get_locality(message));
           if (task == NULL) {
                this->scheduler->conf->log(info, "No suitable task for runnerid: %s", runnerid->serialize(runnerid));
                reply_get_task(this->scheduler, runnerid, NULL);
           } else {
-               this->scheduler->conf->log(info, "Sending task %lu to runnerid: %s", task->get_id(task), runnerid->serialize(runnerid));
+               if (task->get_eta(task) == 0) {
+                    this->scheduler->conf->log(info, "Sending task %lu to runnerid: %s", task->get_id(task), runnerid->serialize(runnerid));
+               } else {
+                    this->scheduler->conf->log(info, "Sending task %lu to runnerid: %s, ETA %s", task->get_id(task), runnerid->serialize(runnerid), datetime(task->get_eta(task), tmbuf));
+               }
                reply_get_task(this->scheduler, runnerid, task);
-               task->set_status(task, task_running);
+               task->free(task);
           }
      }
 }
@@ -267,9 +496,9 @@ static void visit_query_set_result(yacad_scheduler_message_visitor_t *this, yaca
                reply_set_result(this->scheduler, runnerid);
           } else {
                this->scheduler->tasklist->set_task_done(this->scheduler->tasklist, task);
+               this->scheduler->cache->store(this->scheduler->cache, task);
                next_task = project->next_task(project, task);
-               if (next_task != NULL) {
-                    this->scheduler->tasklist->add(this->scheduler->tasklist, next_task);
+               if (next_task != NULL && add_task(this->scheduler, next_task, task->get_id(task))) {
                     this->scheduler->publish = true;
                }
                reply_set_result(this->scheduler, runnerid);
@@ -281,28 +510,144 @@ static void visit_reply_set_result(yacad_scheduler_message_visitor_t *this, yaca
      this->scheduler->conf->log(warn, "Unexpected message");
 }
 
+static void visit_query_list_tasks(yacad_scheduler_message_visitor_t *this, yacad_message_query_list_tasks_t *message) {
+     yacad_message_reply_list_tasks_t *reply;
+     char *serial;
+
+     // tasks are listed by yacad_query, away from the scheduler loop; reply anyway so that the client is not stuck
+     this->scheduler->conf->log(warn, "Tasks must be listed on the query endpoint %s", this->scheduler->conf->get_query_name(this->scheduler->conf));
+     reply = yacad_message_reply_list_tasks_new(this->scheduler->conf->log);
+     serial = I(reply)->serialize(I(reply));
+     this->scheduler->zrunner->send(this->scheduler->zrunner, serial);
+     free(serial);
+     I(reply)->free(I(reply));
+}
+
+static void visit_reply_list_tasks(yacad_scheduler_message_visitor_t *this, yacad_message_reply_list_tasks_t *message) {
+     this->scheduler->conf->log(warn, "Unexpected message");
+}
+
 static yacad_message_visitor_t scheduler_message_visitor_fn = {
      .visit_query_get_task = (yacad_message_visitor_visit_query_get_task_fn)visit_query_get_task,
      .visit_reply_get_task = (yacad_message_visitor_visit_reply_get_task_fn)visit_reply_get_task,
      .visit_query_set_result = (yacad_message_visitor_visit_query_set_result_fn)visit_query_set_result,
      .visit_reply_set_result = (yacad_message_visitor_visit_reply_set_result_fn)visit_reply_set_result,
+     .visit_query_list_tasks = (yacad_message_visitor_visit_query_list_tasks_fn)visit_query_list_tasks,
+     .visit_reply_list_tasks = (yacad_message_visitor_visit_reply_list_tasks_fn)visit_reply_list_tasks,
 };
 
 static bool_t on_pollin_zworker_check(yacad_zmq_poller_t *poller, yacad_zmq_socket_t *socket, const char *strmsg, void *data) {
      yacad_scheduler_impl_t *this = (yacad_scheduler_impl_t*)data;
      cad_hash_t *projects;
+     yacad_project_t *project;
+     size_t n = strlen(MSG_CHECK);
 
      if (strmsg != NULL) {
           if (!strcmp(strmsg, MSG_STOP)) {
                this->running = false;
-          } else if (!strcmp(strmsg, MSG_CHECK)) {
-               this->publish = false;
-
-               this->conf->log(debug, "Checking projects");
+          } else if (!strncmp(strmsg, MSG_CHECK, n) && strmsg[n] == '\n') {
                projects = this->conf->get_projects(this->conf);
-               projects->iterate(projects, (cad_hash_iterator_fn)iterate_check_project, this);
+               project = projects->get(projects, strmsg + n + 1);
+               if (project == NULL) {
+                    this->conf->log(warn, "Unknown project: %s", strmsg + n + 1);
+               } else {
+                    // the result comes back on INPROC_CHECKED_ADDRESS, see on_pollin_zchecked
+                    this->checker->check(this->checker, project);
+               }
+          }
+     }
+
+     return this->running;
+}
+
+typedef struct {
+     yacad_scheduler_impl_t *scheduler;
+     yacad_json_finder_t *finder;
+     const char *url;
+     int count;
+} notify_context_t;
+
+static void iterate_notify(cad_hash_t *projects, int index, const char *key, yacad_project_t *project, notify_context_t *context) {
+     yacad_scm_t *scm = project->get_scm(project);
+     json_string_t *jurl = NULL;
+     size_t n;
+     char *url;
+
+     if (scm != NULL) {
+          context->finder->visit(context->finder, scm->get_desc(scm));
+          jurl = context->finder->get_string(context->finder);
+     }
+     if (jurl != NULL) {
+          n = jurl->utf8(jurl, "", 0) + 1;
+          url = alloca(n);
+          jurl->utf8(jurl, url, n);
+          if (!strcmp(url, context->url)) {
+               context->scheduler->checker->check(context->scheduler->checker, project);
+               context->count++;
+          }
+     }
+}
 
-               if (this->publish) {
+/* A repository hook notifies ref updates: one project name or upstream url per line. The
+ * matching projects are checked at once; their cron schedule is only a fallback. */
+static bool_t on_pollin_znotify(yacad_zmq_poller_t *poller, yacad_zmq_socket_t *socket, const char *strmsg, void *data) {
+     yacad_scheduler_impl_t *this = (yacad_scheduler_impl_t*)data;
+     cad_hash_t *projects = this->conf->get_projects(this->conf);
+     notify_context_t context = { this, yacad_json_finder_new(this->conf->log, json_type_string, "upstream_url"), NULL, 0 };
+     yacad_project_t *project;
+     char *lines, *line, *saveptr;
+
+     if (strmsg != NULL) {
+          lines = strdup(strmsg);
+          for (line = strtok_r(lines, "\n", &saveptr); line != NULL; line = strtok_r(NULL, "\n", &saveptr)) {
+               project = projects->get(projects, line);
+               if (project != NULL) {
+                    this->conf->log(debug, "Notified: %s", line);
+                    this->checker->check(this->checker, project);
+               } else {
+                    context.url = line;
+                    context.count = 0;
+                    projects->iterate(projects, (cad_hash_iterator_fn)iterate_notify, &context);
+                    if (context.count == 0) {
+                         this->conf->log(warn, "Notified unknown project or upstream: %s", line);
+                    } else {
+                         this->conf->log(debug, "Notified: %s (%d projects)", line, context.count);
+                    }
+               }
+          }
+          free(lines);
+     }
+
+     I(context.finder)->free(I(context.finder));
+     return this->running;
+}
+
+static bool_t on_pollin_zchecked(yacad_zmq_poller_t *poller, yacad_zmq_socket_t *socket, const char *strmsg, void *data) {
+     yacad_scheduler_impl_t *this = (yacad_scheduler_impl_t*)data;
+     const char *serial;
+     char *task_serial;
+     yacad_task_t *task;
+     cad_hash_t *env;
+     const char *refname, *oid;
+
+     serial = strmsg == NULL ? NULL : strchr(strmsg, '\n');
+     if (serial == NULL) {
+          this->conf->log(warn, "Received invalid check result: %s", strmsg);
+     } else if (*++serial != 0) {
+          task_serial = strdup(serial);
+          task = yacad_task_unserialize(this->conf->log, task_serial);
+          free(task_serial);
+          if (task == NULL) {
+               this->conf->log(warn, "Received invalid check task: %s", serial);
+          } else {
+               // the ref is built from now on
+               env = task->get_env(task);
+               refname = env->get(env, "refname");
+               oid = env->get(env, "ref");
+               if (refname != NULL && oid != NULL) {
+                    this->refs->save(this->refs, task->get_project_name(task), refname, oid);
+               }
+               if (add_task(this, task, 0)) {
                     this->conf->log(debug, "Publishing event to %s", this->conf->get_events_name(this->conf));
                     this->zevents->send(this->zevents, MSG_EVENT);
                }
@@ -338,8 +683,13 @@ static bool_t on_pollin_zrunner(yacad_zmq_poller_t *poller, yacad_zmq_socket_t *
 
 static void run(yacad_scheduler_impl_t *this) {
      yacad_zmq_socket_t *zworker_check;
+     yacad_zmq_socket_t *zchecked;
+     yacad_zmq_socket_t *znotify;
      yacad_zmq_socket_t *zworker_run;
      yacad_zmq_poller_t *zpoller;
+     yacad_query_t *query;
+     yacad_logs_t *logs;
+     yacad_artifacts_t *artifacts;
 
      zworker_check = yacad_zmq_socket_bind(this->conf->log, INPROC_CHECK_ADDRESS, ZMQ_PAIR);
      if (zworker_check == NULL) {
@@ -361,13 +711,46 @@ static void run(yacad_scheduler_impl_t *this) {
                          zworker_run->free(zworker_run);
                          this->running = true;
 
-                         zpoller = yacad_zmq_poller_new(this->conf->log);
-                         zpoller->on_pollin(zpoller, zworker_check, on_pollin_zworker_check);
-                         zpoller->on_pollin(zpoller, this->zrunner, on_pollin_zrunner);
-
-                         zpoller->run(zpoller, this);
-
-                         zpoller->free(zpoller);
+                         zchecked = yacad_zmq_socket_bind(this->conf->log, INPROC_CHECKED_ADDRESS, ZMQ_PULL);
+                         if (zchecked == NULL) {
+                              this->conf->log(error, "Could not bind zchecked\n");
+                         } else {
+                              this->checker = yacad_checker_new(this->conf, INPROC_CHECKED_ADDRESS);
+
+                              // the tables are installed by now
+                              query = yacad_query_new(this->conf);
+
+                              // the task output never goes through this thread
+                              logs = yacad_logs_new(this->conf);
+                              artifacts = yacad_artifacts_new(this->conf);
+
+                              // without it, the projects are only checked by their cron schedule
+                              znotify = yacad_zmq_socket_bind(this->conf->log, this->conf->get_notify_name(this->conf), ZMQ_PULL);
+                              if (znotify == NULL) {
+                                   this->conf->log(warn, "Could not bind znotify to %s", this->conf->get_notify_name(this->conf));
+                              }
+
+                              zpoller = yacad_zmq_poller_new(this->conf->log);
+                              zpoller->on_pollin(zpoller, zworker_check, on_pollin_zworker_check);
+                              zpoller->on_pollin(zpoller, zchecked, on_pollin_zchecked);
+                              zpoller->on_pollin(zpoller, this->zrunner, on_pollin_zrunner);
+                              if (znotify != NULL) {
+                                   zpoller->on_pollin(zpoller, znotify, on_pollin_znotify);
+                              }
+
+                              zpoller->run(zpoller, this);
+
+                              zpoller->free(zpoller);
+                              if (znotify != NULL) {
+                                   znotify->free(znotify);
+                              }
+                              artifacts->free(artifacts);
+                              logs->free(logs);
+                              query->free(query);
+                              this->checker->free(this->checker);
+                              this->checker = NULL;
+                              zchecked->free(zchecked);
+                         }
                     }
                     this->zevents->free(this->zevents);
                }
@@ -387,15 +770,20 @@ static yacad_scheduler_t impl_fn = {
 yacad_scheduler_t *yacad_scheduler_new(yacad_conf_t *conf) {
      yacad_scheduler_impl_t *result = malloc(sizeof(yacad_scheduler_impl_t));
      yacad_database_t *database = yacad_database_new(conf->log, conf->get_database_name(conf));
-     struct timeval now;
-     gettimeofday(&now, NULL);
      result->fn = impl_fn;
      result->conf = conf;
      result->running = false;
+     result->checker = NULL;
+     result->worker_next_check.heap = NULL;
+     result->worker_next_check.count = result->worker_next_check.capacity = 0;
      result->worker_next_check.confgen = -1;
-     result->worker_next_check.time = now;
      result->database = database;
-     result->tasklist = yacad_tasklist_new(conf->log, database);
+     result->taskstore = yacad_taskstore_new(conf, database);
+     result->stats = yacad_stats_new(conf->log, database);
+     result->refs = yacad_refs_new(conf->log, database, conf->get_projects(conf));
+     result->tasklist = yacad_tasklist_new(conf->log, result->taskstore, result->stats,
+                                           strcmp(conf->get_ordering(conf), "fifo") ? tasklist_sjf : tasklist_fifo);
+     result->cache = yacad_cache_new(conf);
      pthread_create(&(result->worker), NULL, (void*(*)(void*))worker_routine, result);
      return I(result);
 }
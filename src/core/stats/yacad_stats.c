@@ -0,0 +1,211 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "yacad_stats.h"
+
+/* weight of the last duration in the moving average */
+#define EWMA_ALPHA 0.25
+/* number of recent durations kept for the percentiles */
+#define SAMPLE_COUNT 32
+
+#define STMT_CREATE_TABLE "create table if not exists TASKSTATS (" \
+     "KEY primary key, "                                           \
+     "PROJECT not null, "                                          \
+     "TASKINDEX integer not null, "                                \
+     "ARCH not null, "                                             \
+     "COUNT integer not null, "                                    \
+     "EWMA integer not null, "                                     \
+     "SAMPLES not null"                                            \
+     ")"
+#define STMT_SELECT "select KEY, COUNT, EWMA, SAMPLES from TASKSTATS"
+#define STMT_UPDATE "insert or replace into TASKSTATS (KEY,PROJECT,TASKINDEX,ARCH,COUNT,EWMA,SAMPLES) values (?,?,?,?,?,?,?)"
+
+typedef struct {
+     long count;
+     double ewma;
+     long samples[SAMPLE_COUNT]; // circular, samples[count % SAMPLE_COUNT] is the next one
+} stats_t;
+
+typedef struct yacad_stats_impl_s {
+     yacad_stats_t fn;
+     logger_t log;
+     yacad_database_t *database;
+     cad_hash_t *stats;
+} yacad_stats_impl_t;
+
+static char *stats_key(const char *project_name, int taskindex, const char *arch) {
+     char *result;
+     int n;
+     if (arch == NULL) {
+          arch = "*";
+     }
+     n = snprintf("", 0, "%s/%d/%s", project_name, taskindex, arch) + 1;
+     result = malloc(n);
+     snprintf(result, n, "%s/%d/%s", project_name, taskindex, arch);
+     return result;
+}
+
+static stats_t *get_stats(yacad_stats_impl_t *this, const char *project_name, int taskindex, const char *arch) {
+     char *key = stats_key(project_name, taskindex, arch);
+     stats_t *result = this->stats->get(this->stats, key);
+     free(key);
+     return result;
+}
+
+static void save(yacad_stats_impl_t *this, const char *key, const char *project_name, int taskindex, const char *arch, stats_t *stats) {
+     yacad_statement_t *stmt;
+     char samples[SAMPLE_COUNT * 21 + 1] = "";
+     int i, n = stats->count < SAMPLE_COUNT ? stats->count : SAMPLE_COUNT, len = 0;
+
+     // oldest first
+     for (i = 0; i < n; i++) {
+          len += snprintf(samples + len, sizeof(samples) - len, "%s%ld", i == 0 ? "" : ",", stats->samples[(stats->count - n + i) % SAMPLE_COUNT]);
+     }
+
+     stmt = this->database->update(this->database, STMT_UPDATE);
+     if (stmt != NULL) {
+          stmt->bind_string(stmt, 0, key);
+          stmt->bind_string(stmt, 1, project_name);
+          stmt->bind_int(stmt, 2, taskindex);
+          stmt->bind_string(stmt, 3, arch == NULL ? "*" : arch);
+          stmt->bind_int(stmt, 4, stats->count);
+          stmt->bind_int(stmt, 5, (long)(stats->ewma * 1000.0)); // milliseconds
+          stmt->bind_string(stmt, 6, samples);
+          stmt->run(stmt, NULL, NULL);
+          stmt->free(stmt);
+     }
+}
+
+static int compare_long(const void *a, const void *b) {
+     long x = *(const long *)a, y = *(const long *)b;
+     return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static long stats_percentile(stats_t *stats, int percent) {
+     long sorted[SAMPLE_COUNT];
+     int n = stats->count < SAMPLE_COUNT ? stats->count : SAMPLE_COUNT;
+     if (n == 0) {
+          return -1;
+     }
+     memcpy(sorted, stats->samples, n * sizeof(long));
+     qsort(sorted, n, sizeof(long), compare_long);
+     return sorted[(n - 1) * percent / 100];
+}
+
+static void add_sample(yacad_stats_impl_t *this, const char *project_name, int taskindex, const char *arch, long duration) {
+     char *key = stats_key(project_name, taskindex, arch);
+     stats_t *stats = this->stats->get(this->stats, key);
+
+     if (duration < 0) {
+          duration = 0;
+     }
+     if (stats == NULL) {
+          stats = malloc(sizeof(stats_t));
+          stats->count = 0;
+          stats->ewma = (double)duration;
+          this->stats->set(this->stats, key, stats);
+     } else {
+          stats->ewma = EWMA_ALPHA * (double)duration + (1.0 - EWMA_ALPHA) * stats->ewma;
+     }
+     stats->samples[stats->count % SAMPLE_COUNT] = duration;
+     stats->count++;
+
+     this->log(info, "Task %s took %lds (average %lds, p50 %lds, p95 %lds)", key, duration,
+               (long)stats->ewma, stats_percentile(stats, 50), stats_percentile(stats, 95));
+
+     save(this, key, project_name, taskindex, arch, stats);
+     free(key);
+}
+
+static long estimate(yacad_stats_impl_t *this, const char *project_name, int taskindex, const char *arch) {
+     stats_t *stats = get_stats(this, project_name, taskindex, arch);
+     return stats == NULL ? -1 : (long)(stats->ewma + 0.5);
+}
+
+static long percentile(yacad_stats_impl_t *this, const char *project_name, int taskindex, const char *arch, int percent) {
+     stats_t *stats = get_stats(this, project_name, taskindex, arch);
+     return stats == NULL ? -1 : stats_percentile(stats, percent);
+}
+
+static void clean_stats(cad_hash_t *hash, int index, const char *key, stats_t *stats, yacad_stats_impl_t *this) {
+     free(stats);
+}
+
+static void free_(yacad_stats_impl_t *this) {
+     this->stats->clean(this->stats, (cad_hash_iterator_fn)clean_stats, this);
+     this->stats->free(this->stats);
+     free(this);
+}
+
+static yacad_stats_t impl_fn = {
+     .add_sample = (yacad_stats_add_sample_fn)add_sample,
+     .estimate = (yacad_stats_estimate_fn)estimate,
+     .percentile = (yacad_stats_percentile_fn)percentile,
+     .free = (yacad_stats_free_fn)free_,
+};
+
+static void load_stats(yacad_statement_t *stmt, yacad_stats_impl_t *this) {
+     const char *key = stmt->get_string(stmt, 0);
+     const char *samples = stmt->get_string(stmt, 3);
+     stats_t *stats = malloc(sizeof(stats_t));
+     long parsed[SAMPLE_COUNT];
+     char *end;
+     int i, n;
+
+     stats->count = stmt->get_int(stmt, 1);
+     stats->ewma = (double)stmt->get_int(stmt, 2) / 1000.0;
+
+     n = stats->count < SAMPLE_COUNT ? stats->count : SAMPLE_COUNT;
+     for (i = 0; i < n && samples != NULL && *samples != '\0'; i++) {
+          parsed[i] = strtol(samples, &end, 10);
+          samples = *end == ',' ? end + 1 : end;
+     }
+     if (i < n) {
+          // truncated samples, keep what could be read
+          stats->count = n = i;
+     }
+     // the samples are saved oldest first
+     for (i = 0; i < n; i++) {
+          stats->samples[(stats->count - n + i) % SAMPLE_COUNT] = parsed[i];
+     }
+
+     this->stats->set(this->stats, key, stats);
+}
+
+yacad_stats_t *yacad_stats_new(logger_t log, yacad_database_t *database) {
+     yacad_stats_impl_t *result = malloc(sizeof(yacad_stats_impl_t));
+     yacad_statement_t *stmt;
+
+     result->fn = impl_fn;
+     result->log = log;
+     result->database = database;
+     result->stats = cad_new_hash(stdlib_memory, cad_hash_strings);
+
+     stmt = database->update(database, STMT_CREATE_TABLE);
+     if (stmt != NULL) {
+          stmt->run(stmt, NULL, NULL);
+          stmt->free(stmt);
+     }
+
+     stmt = database->select(database, STMT_SELECT);
+     if (stmt != NULL) {
+          stmt->run(stmt, (yacad_select_fn)load_stats, result);
+          stmt->free(stmt);
+     }
+     log(info, "Loaded %d task duration statistics", result->stats->count(result->stats));
+
+     return I(result);
+}
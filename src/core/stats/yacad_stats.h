@@ -0,0 +1,42 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __YACAD_STATS_H__
+#define __YACAD_STATS_H__
+
+#include "yacad.h"
+#include "common/database/yacad_database.h"
+
+/* Build durations per (project, taskindex, arch), in seconds. */
+
+typedef struct yacad_stats_s yacad_stats_t;
+
+typedef void (*yacad_stats_add_sample_fn)(yacad_stats_t *this, const char *project_name, int taskindex, const char *arch, long duration);
+/* returns the expected duration, or -1 if unknown */
+typedef long (*yacad_stats_estimate_fn)(yacad_stats_t *this, const char *project_name, int taskindex, const char *arch);
+/* returns the given percentile of the recent durations, or -1 if unknown */
+typedef long (*yacad_stats_percentile_fn)(yacad_stats_t *this, const char *project_name, int taskindex, const char *arch, int percent);
+typedef void (*yacad_stats_free_fn)(yacad_stats_t *this);
+
+struct yacad_stats_s {
+     yacad_stats_add_sample_fn add_sample;
+     yacad_stats_estimate_fn estimate;
+     yacad_stats_percentile_fn percentile;
+     yacad_stats_free_fn free;
+};
+
+yacad_stats_t *yacad_stats_new(logger_t log, yacad_database_t *database);
+
+#endif /* __YACAD_STATS_H__ */
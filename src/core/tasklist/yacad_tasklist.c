@@ -16,33 +16,117 @@
 
 #include "yacad_tasklist.h"
 
-#define STMT_DROP_TABLE "drop table if exists TASKLIST"
-
-#define STMT_CREATE_TABLE "create table TASKLIST ("       \
-     "ID integer primary key asc autoincrement, "         \
-     "STATUS integer not null, "                          \
-     "SERIAL not null"                                    \
-     ")"
-
-#define STMT_SELECT "select ID, STATUS, SERIAL from TASKLIST where STATUS=? order by ID asc"
-#define STMT_INSERT "insert into TASKLIST (STATUS,SERIAL) values (?,?)"
-#define STMT_UPDATE "update TASKLIST set STATUS=? where ID=?"
+/* number of tasks restored per batch */
+#define RESTORE_BATCH 256
+/* seconds of order key within which the locality may reorder the tasks */
+#define AFFINITY_BAND 60
 
 typedef struct yacad_tasklist_impl_s {
      yacad_tasklist_t fn;
      logger_t log;
      cad_array_t *tasklist;
-     yacad_database_t *db;
+     yacad_taskstore_t *store;
+     yacad_stats_t *stats;
+     yacad_tasklist_order_t order;
+
+     /* Pending tasks are restored by a background thread, so that the
+      * core can serve runners immediately. The restored tasks are merged
+      * into the tasklist by the scheduler thread. */
+     pthread_t restorer;
+     pthread_mutex_t restore_lock;
+     cad_array_t *restored; // protected by restore_lock
+     bool_t restoring;      // protected by restore_lock
+     cad_array_t *added;    // copies of the tasks added until merged, to drop their restored duplicates
+     volatile bool_t stopping;
+     bool_t merged;
+     unsigned long restore_max_id;
+     struct timeval restore_start;
 } yacad_tasklist_impl_t;
 
+static void free_tasks(cad_array_t *tasks) {
+     int i, n = tasks->count(tasks);
+     yacad_task_t *task;
+     for (i = 0; i < n; i++) {
+          task = *(yacad_task_t **)tasks->get(tasks, i);
+          task->free(task);
+     }
+     tasks->free(tasks);
+}
+
+/* A task added during the restore was not deduplicated against the tasks still in the store. The added one is
+ * kept, it may already be dispatched; the restored duplicate is marked aborted so that it is not restored again. */
+static bool_t is_added(yacad_tasklist_impl_t *this, yacad_task_t *task) {
+     bool_t result = false;
+     int i, n = this->added->count(this->added);
+     yacad_task_t *other;
+
+     for (i = 0; !result && i < n; i++) {
+          other = *(yacad_task_t **)this->added->get(this->added, i);
+          result = task->same_as(task, other);
+     }
+     if (result) {
+          this->log(info, "Dropped restored task %lu, added again during the restore", task->get_id(task));
+          this->store->set_status(this->store, task->get_id(task), task_aborted, time(NULL));
+     }
+     return result;
+}
+
+static void merge_restored(yacad_tasklist_impl_t *this) {
+     int i, n, index;
+     yacad_task_t *task, *other;
+     bool_t done;
+     struct timeval now, elapsed;
+
+     if (this->merged) {
+          return;
+     }
+
+     pthread_mutex_lock(&(this->restore_lock));
+     n = this->restored->count(this->restored);
+     if (n > 0) {
+          // restored tasks are older than the ones added since startup, put them before
+          task = *(yacad_task_t **)this->restored->get(this->restored, 0);
+          index = this->tasklist->count(this->tasklist);
+          while (index > 0) {
+               other = *(yacad_task_t **)this->tasklist->get(this->tasklist, index - 1);
+               if (other->get_id(other) < task->get_id(task)) {
+                    break;
+               }
+               index--;
+          }
+          for (i = 0; i < n; i++) {
+               task = *(yacad_task_t **)this->restored->get(this->restored, i);
+               if (is_added(this, task)) {
+                    task->free(task);
+               } else {
+                    this->tasklist->insert(this->tasklist, index++, &task);
+               }
+          }
+          this->restored->clear(this->restored);
+     }
+     done = !this->restoring;
+     pthread_mutex_unlock(&(this->restore_lock));
+
+     if (done) {
+          pthread_join(this->restorer, NULL);
+          this->merged = true;
+          free_tasks(this->added);
+          this->added = NULL;
+          gettimeofday(&now, NULL);
+          timersub(&now, &(this->restore_start), &elapsed);
+          this->log(info, "Tasks restored in %ld.%06lds", (long)elapsed.tv_sec, (long)elapsed.tv_usec);
+     }
+}
+
 static void add(yacad_tasklist_impl_t *this, yacad_task_t *task) {
      int i, n;
      bool_t found = false;
-     yacad_task_t *other;
-     yacad_statement_t *query = NULL;
-     yacad_task_status_t status = task->get_status(task);
+     yacad_task_t *other, *copy;
+     unsigned long id;
      char *serial;
 
+     merge_restored(this);
+
      n = this->tasklist->count(this->tasklist);
      for (i = 0; !found && i < n; i++) {
           other = *(yacad_task_t**)this->tasklist->get(this->tasklist, i);
@@ -52,62 +136,178 @@ static void add(yacad_tasklist_impl_t *this, yacad_task_t *task) {
           task->free(task);
      } else {
           serial = task->serialize(task);
-          query = this->db->update(this->db, STMT_INSERT);
-          if (query == NULL) {
+          id = this->store->insert(this->store, task->get_status(task), serial, task->get_project_name(task), task->get_timestamp(task));
+          if (id == 0) {
                this->log(warn, "LOST task: %s", serial);
           } else {
-               query->bind_int(query, 0, status);
-               query->bind_string(query, 1, serial);
-               query->run(query, NULL, NULL);
-               task->set_id(task, query->get_rowid(query));
-               query->free(query);
+               task->set_id(task, id);
 
                free(serial);
                serial = task->serialize(task); // to get the right id
 
                this->log(info, "Added task: %s", serial);
                this->tasklist->insert(this->tasklist, n, &task);
+               if (!this->merged) {
+                    copy = yacad_task_unserialize(this->log, serial);
+                    this->added->insert(this->added, this->added->count(this->added), &copy);
+               }
           }
 
           free(serial);
      }
 }
 
-static yacad_task_t *get(yacad_tasklist_impl_t *this, yacad_runnerid_t *runnerid) {
+static void add_done(yacad_tasklist_impl_t *this, yacad_task_t *task) {
+     unsigned long id;
+     char *serial;
+
+     task->set_status(task, task_done);
+     serial = task->serialize(task);
+     id = this->store->insert(this->store, task_done, serial, task->get_project_name(task), task->get_timestamp(task));
+     if (id == 0) {
+          this->log(warn, "LOST task: %s", serial);
+     } else {
+          task->set_id(task, id);
+          this->store->set_status(this->store, id, task_done, time(NULL));
+
+          free(serial);
+          serial = task->serialize(task); // to get the right id
+
+          this->log(info, "Added done task: %s", serial);
+     }
+
+     free(serial);
+}
+
+static long expected_duration(yacad_tasklist_impl_t *this, yacad_task_t *task) {
+     yacad_runnerid_t *runnerid = task->get_runnerid(task);
+     return this->stats->estimate(this->stats, task->get_project_name(task), task->get_taskindex(task), runnerid->get_arch(runnerid));
+}
+
+/* the lower, the sooner; in seconds */
+static long order_key(yacad_tasklist_impl_t *this, yacad_task_t *task, time_t now) {
+     long result = -(long)(now - task->get_timestamp(task));
+     long duration;
+     if (this->order == tasklist_sjf) {
+          // unknown tasks go first, so that their duration gets known; the waiting time prevents starvation
+          duration = expected_duration(this, task);
+          result += duration < 0 ? 0 : duration;
+     }
+     return result;
+}
+
+/* rounded down, the keys may be negative */
+static long order_band(long key) {
+     return key >= 0 ? key / AFFINITY_BAND : -((-key + AFFINITY_BAND - 1) / AFFINITY_BAND);
+}
+
+/* bonus for the tasks whose inputs the runner already holds: the project workspace, and the artifacts of the upstream task */
+static int affinity(yacad_task_t *task, yacad_locality_t *locality) {
+     int result = 0, held = 0, missing = 0;
+     cad_hash_t *env;
+     const char *artifacts;
+     char *hashes, *hash, *saveptr = NULL;
+
+     if (locality != NULL) {
+          if (locality->has_workspace(locality, task->get_project_name(task))) {
+               result++;
+          }
+          env = task->get_env(task);
+          artifacts = env->get(env, "upstream_artifacts");
+          if (artifacts != NULL) {
+               hashes = strdup(artifacts);
+               for (hash = strtok_r(hashes, " ", &saveptr); hash != NULL; hash = strtok_r(NULL, " ", &saveptr)) {
+                    if (locality->has_artifact(locality, hash)) {
+                         held++;
+                    } else {
+                         missing++;
+                    }
+               }
+               free(hashes);
+               if (held > 0) {
+                    result += missing == 0 ? 2 : 1;
+               }
+          }
+     }
+
+     return result;
+}
+
+typedef struct {
+     int match; // of the runner, -1 if none
+     long key;
+     int affinity;
+     unsigned int index;
+} candidate_t;
+
+/* The runner match first, then the order; the locality only reorders the tasks of the same order band, so that
+ * a task is never passed over for long. Among equals, the first in the list. */
+static bool_t is_better(candidate_t *candidate, candidate_t *best) {
+     bool_t result = candidate->match > best->match;
+     long band, best_band;
+
+     if (candidate->match == best->match && candidate->match >= 0) {
+          band = order_band(candidate->key);
+          best_band = order_band(best->key);
+          if (band != best_band) {
+               result = band < best_band;
+          } else if (candidate->affinity != best->affinity) {
+               result = candidate->affinity > best->affinity;
+          } else {
+               result = candidate->key < best->key;
+          }
+     }
+     return result;
+}
+
+static yacad_task_t *get(yacad_tasklist_impl_t *this, yacad_runnerid_t *runnerid, yacad_locality_t *locality) {
      yacad_task_t *result = NULL, *task;
-     unsigned int best_index, index, count = this->tasklist->count(this->tasklist);
-     int best_match = -1, match;
-     yacad_runnerid_t *task_runnerid;
-     for (index = 0; result == NULL && index < count; index++) {
+     unsigned int index, count;
+     candidate_t best = {-1, 0, 0, 0}, candidate;
+     long duration;
+     time_t now = time(NULL);
+
+     merge_restored(this);
+
+     count = this->tasklist->count(this->tasklist);
+     for (index = 0; index < count; index++) {
           task = *(yacad_task_t **)this->tasklist->get(this->tasklist, index);
           if (task->get_status(task) == task_new) {
-               task_runnerid = task->get_runnerid(task);
-               match = runnerid->match(runnerid, task_runnerid);
-               if (match > best_match) {
-                    best_match = match;
-                    best_index = index;
+               candidate.match = runnerid->match(runnerid, task->get_runnerid(task));
+               if (candidate.match >= 0) {
+                    candidate.key = order_key(this, task, now);
+                    candidate.affinity = affinity(task, locality);
+                    candidate.index = index;
+                    if (is_better(&candidate, &best)) {
+                         best = candidate;
+                    }
                }
           }
      }
-     if (best_match >= 0) {
-          result = *(yacad_task_t **)this->tasklist->get(this->tasklist, best_index);
-          this->tasklist->del(this->tasklist, best_index);
+     if (best.match >= 0) {
+          result = *(yacad_task_t **)this->tasklist->get(this->tasklist, best.index);
+          this->tasklist->del(this->tasklist, best.index);
+
+          duration = expected_duration(this, result);
+          result->set_status(result, task_running);
+          result->set_dispatched(result, now);
+          result->set_eta(result, duration < 0 ? 0 : now + duration);
+          this->store->set_running(this->store, result->get_id(result), now, result->get_eta(result));
      }
      return result;
 }
 
 static void update_task_status(yacad_tasklist_impl_t *this, yacad_task_t *task, yacad_task_status_t status) {
-     yacad_statement_t *query = NULL;
      char *serial;
-     unsigned long id = task->get_id(task);
+     time_t now = time(NULL);
+     yacad_runnerid_t *runnerid;
 
-     query = this->db->update(this->db, STMT_UPDATE);
-     if (query != NULL) {
-          query->bind_int(query, 0, status);
-          query->bind_int(query, 1, id);
-          query->run(query, NULL, NULL);
-          query->free(query);
+     if (status == task_done && task->get_dispatched(task) > 0) {
+          runnerid = task->get_runnerid(task);
+          this->stats->add_sample(this->stats, task->get_project_name(task), task->get_taskindex(task), runnerid->get_arch(runnerid), (long)(now - task->get_dispatched(task)));
+     }
 
+     if (this->store->set_status(this->store, task->get_id(task), status, now)) {
           serial = task->serialize(task);
           this->log(info, "Updated task: %s", serial);
           free(serial);
@@ -123,69 +323,95 @@ static void set_task_done(yacad_tasklist_impl_t *this, yacad_task_t *task) {
 }
 
 static void free_(yacad_tasklist_impl_t *this) {
-     int i, n = this->tasklist->count(this->tasklist);
-     yacad_task_t *task;
-     for (i = 0; i < n; i++) {
-          task = *(yacad_task_t **)this->tasklist->get(this->tasklist, i);
-          task->free(task);
+     this->stopping = true;
+     if (!this->merged) {
+          pthread_join(this->restorer, NULL);
+          free_tasks(this->added);
      }
-     this->tasklist->free(this->tasklist);
+     free_tasks(this->restored);
+     pthread_mutex_destroy(&(this->restore_lock));
+
+     free_tasks(this->tasklist);
      free(this);
 }
 
 static yacad_tasklist_t impl_fn = {
      .add = (yacad_tasklist_add_fn)add,
+     .add_done = (yacad_tasklist_add_done_fn)add_done,
      .get = (yacad_tasklist_get_fn)get,
      .set_task_aborted = (yacad_tasklist_set_task_aborted_fn)set_task_aborted,
      .set_task_done = (yacad_tasklist_set_task_done_fn)set_task_done,
      .free = (yacad_tasklist_free_fn)free_,
 };
 
-static void add_task(yacad_statement_t *stmt, yacad_tasklist_impl_t *this) {
-     long sql_id = stmt->get_int(stmt, 0);
-     long sql_status = stmt->get_int(stmt, 1);
-     const char *sql_serial = stmt->get_string(stmt, 2);
-     yacad_task_t *task = yacad_task_unserialize(this->log, (char*)sql_serial);
-     char *serial;
-     task->set_id(task, (unsigned long)sql_id);
-     task->set_status(task, (yacad_task_status_t)sql_status);
-     this->tasklist->insert(this->tasklist, this->tasklist->count(this->tasklist), &task);
-     serial = task->serialize(task);
-     this->log(info, "Restored task: %s", serial);
-     free(serial);
+typedef struct {
+     yacad_tasklist_impl_t *this;
+     unsigned long last_id;
+} restore_context_t;
+
+static void restore_task(unsigned long id, yacad_task_status_t status, const char *serial, restore_context_t *context) {
+     yacad_tasklist_impl_t *this = context->this;
+     yacad_task_t *task = yacad_task_unserialize(this->log, (char*)serial);
+     task->set_id(task, id);
+     task->set_status(task, status);
+     this->log(debug, "Restored task: %lu", id);
+
+     pthread_mutex_lock(&(this->restore_lock));
+     this->restored->insert(this->restored, this->restored->count(this->restored), &task);
+     pthread_mutex_unlock(&(this->restore_lock));
+
+     context->last_id = id;
+}
+
+static void *restore_routine(yacad_tasklist_impl_t *this) {
+     restore_context_t context = {this, 0};
+     bool_t more = true;
+     int count;
+
+     set_thread_name("restore");
+
+     while (more && !this->stopping) {
+          count = this->store->restore(this->store, context.last_id, this->restore_max_id, RESTORE_BATCH, (yacad_taskstore_restore_cb)restore_task, &context);
+          if (count < 0) {
+               this->log(warn, "Could not restore tasks");
+          }
+          more = count == RESTORE_BATCH;
+     }
+
+     pthread_mutex_lock(&(this->restore_lock));
+     this->restoring = false;
+     pthread_mutex_unlock(&(this->restore_lock));
+
+     return this;
 }
 
-yacad_tasklist_t *yacad_tasklist_new(logger_t log, yacad_database_t *database) {
+yacad_tasklist_t *yacad_tasklist_new(logger_t log, yacad_taskstore_t *store, yacad_stats_t *stats, yacad_tasklist_order_t order) {
      yacad_tasklist_impl_t *result;
-     yacad_statement_t *stmt;
 
      result = malloc(sizeof(yacad_tasklist_impl_t));
      result->fn = impl_fn;
      result->log = log;
      result->tasklist = cad_new_array(stdlib_memory, sizeof(yacad_task_t*));
-     result->db = database;
+     result->store = store;
+     result->stats = stats;
+     result->order = order;
 
-     if (database->need_install(database)) {
-          stmt = database->update(database, STMT_DROP_TABLE);
-          if (stmt != NULL) {
-               stmt->run(stmt, NULL, NULL);
-               stmt->free(stmt);
-          }
-          stmt = database->update(database, STMT_CREATE_TABLE);
-          if (stmt != NULL) {
-               stmt->run(stmt, NULL, NULL);
-               stmt->free(stmt);
-          }
-          database->set_installed(database);
-     }
+     pthread_mutex_init(&(result->restore_lock), NULL);
+     result->restored = cad_new_array(stdlib_memory, sizeof(yacad_task_t*));
+     result->restoring = false;
+     result->added = NULL;
+     result->stopping = false;
+     result->merged = true;
+     gettimeofday(&(result->restore_start), NULL);
 
-     stmt = database->select(database, STMT_SELECT);
-     if (stmt == NULL) {
-          log(warn, "Could not restore tasks");
-     } else {
-          stmt->bind_int(stmt, 0, task_new);
-          stmt->run(stmt, (yacad_select_fn)add_task, result);
-          stmt->free(stmt);
+     // Only the tasks that exist now are restored; the ones added later are already in memory.
+     result->restore_max_id = store->get_max_id(store);
+
+     if (result->restore_max_id > 0) {
+          result->restoring = true;
+          result->added = cad_new_array(stdlib_memory, sizeof(yacad_task_t*));
+          result->merged = false;
+          pthread_create(&(result->restorer), NULL, (void*(*)(void*))restore_routine, result);
      }
 
      return I(result);
@@ -18,26 +18,39 @@
 #define __YACAD_TASKLIST_H__
 
 #include "yacad.h"
-#include "common/database/yacad_database.h"
+#include "common/locality/yacad_locality.h"
 #include "common/runnerid/yacad_runnerid.h"
 #include "common/task/yacad_task.h"
+#include "core/stats/yacad_stats.h"
+#include "core/tasklist/yacad_taskstore.h"
 
 typedef struct yacad_tasklist_s yacad_tasklist_t;
 
+typedef enum {
+     /* oldest task first */
+     tasklist_fifo=0,
+     /* shortest expected task first, aged by the waiting time */
+     tasklist_sjf,
+} yacad_tasklist_order_t;
+
 typedef void (*yacad_tasklist_add_fn)(yacad_tasklist_t *this, yacad_task_t *task);
+/* the task needs no runner: it is stored as done, not queued, and still belongs to the caller */
+typedef void (*yacad_tasklist_add_done_fn)(yacad_tasklist_t *this, yacad_task_t *task);
 typedef void (*yacad_tasklist_free_fn)(yacad_tasklist_t *this);
-typedef yacad_task_t *(*yacad_tasklist_get_fn)(yacad_tasklist_t *this, yacad_runnerid_t *runnerid);
+/* the returned task is marked running and belongs to the caller; the locality (may be NULL) favours the tasks whose inputs the runner already holds, among the tasks of about the same order */
+typedef yacad_task_t *(*yacad_tasklist_get_fn)(yacad_tasklist_t *this, yacad_runnerid_t *runnerid, yacad_locality_t *locality);
 typedef void (*yacad_tasklist_set_task_aborted_fn)(yacad_tasklist_t *this, yacad_task_t *task);
 typedef void (*yacad_tasklist_set_task_done_fn)(yacad_tasklist_t *this, yacad_task_t *task);
 
 struct yacad_tasklist_s {
      yacad_tasklist_add_fn add;
+     yacad_tasklist_add_done_fn add_done;
      yacad_tasklist_get_fn get;
      yacad_tasklist_set_task_aborted_fn set_task_aborted;
      yacad_tasklist_set_task_done_fn set_task_done;
      yacad_tasklist_free_fn free;
 };
 
-yacad_tasklist_t *yacad_tasklist_new(logger_t log, yacad_database_t *database);
+yacad_tasklist_t *yacad_tasklist_new(logger_t log, yacad_taskstore_t *store, yacad_stats_t *stats, yacad_tasklist_order_t order);
 
 #endif /* __YACAD_TASKLIST_H__ */
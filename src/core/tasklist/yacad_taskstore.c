@@ -0,0 +1,35 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "yacad_taskstore.h"
+#include "yacad_taskstore_log.h"
+#include "yacad_taskstore_sqlite3.h"
+
+yacad_taskstore_t *yacad_taskstore_new(yacad_conf_t *conf, yacad_database_t *database) {
+     yacad_taskstore_t *result = NULL;
+     const char *storage = conf->get_storage(conf);
+
+     if (!strcmp(storage, "log")) {
+          result = yacad_taskstore_log_new(conf->log, conf->get_tasklog_name(conf), conf->get_retention_days(conf));
+     } else if (strcmp(storage, "sqlite")) {
+          conf->log(warn, "storage not supported: %s", storage);
+     }
+     if (result == NULL) {
+          result = yacad_taskstore_sqlite3_new(conf->log, database, conf->get_database_name(conf));
+     }
+
+     return result;
+}
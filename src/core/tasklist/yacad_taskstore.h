@@ -0,0 +1,54 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __YACAD_TASKSTORE_H__
+#define __YACAD_TASKSTORE_H__
+
+#include "yacad.h"
+#include "common/database/yacad_database.h"
+#include "common/task/yacad_task.h"
+#include "core/conf/yacad_conf.h"
+
+/* Persistent storage of the tasklist. When a store is opened, the tasks
+ * left running by the previous core are set back to new, so that they are
+ * restored and dispatched again. */
+
+typedef struct yacad_taskstore_s yacad_taskstore_t;
+
+typedef void (*yacad_taskstore_restore_cb)(unsigned long id, yacad_task_status_t status, const char *serial, void *data);
+
+/* returns the new task id, or 0 if the task could not be stored */
+typedef unsigned long (*yacad_taskstore_insert_fn)(yacad_taskstore_t *this, yacad_task_status_t status, const char *serial, const char *project_name, time_t timestamp);
+/* when is the dispatch time for task_running, the finish time for task_done and task_aborted */
+typedef bool_t (*yacad_taskstore_set_status_fn)(yacad_taskstore_t *this, unsigned long id, yacad_task_status_t status, time_t when);
+/* task_running, dispatched at when and expected to finish at eta (0 if unknown) */
+typedef bool_t (*yacad_taskstore_set_running_fn)(yacad_taskstore_t *this, unsigned long id, time_t when, time_t eta);
+typedef unsigned long (*yacad_taskstore_get_max_id_fn)(yacad_taskstore_t *this);
+/* calls cb for at most limit new tasks with after_id < id <= max_id, in id order; returns the count, or -1 on error */
+typedef int (*yacad_taskstore_restore_fn)(yacad_taskstore_t *this, unsigned long after_id, unsigned long max_id, int limit, yacad_taskstore_restore_cb cb, void *data);
+typedef void (*yacad_taskstore_free_fn)(yacad_taskstore_t *this);
+
+struct yacad_taskstore_s {
+     yacad_taskstore_insert_fn insert;
+     yacad_taskstore_set_status_fn set_status;
+     yacad_taskstore_set_running_fn set_running;
+     yacad_taskstore_get_max_id_fn get_max_id;
+     yacad_taskstore_restore_fn restore;
+     yacad_taskstore_free_fn free;
+};
+
+yacad_taskstore_t *yacad_taskstore_new(yacad_conf_t *conf, yacad_database_t *database);
+
+#endif /* __YACAD_TASKSTORE_H__ */
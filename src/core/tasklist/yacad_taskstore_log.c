@@ -0,0 +1,689 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file Append-only tasklist storage.
+ *
+ * Every change is appended to the file as a record, so that writes are
+ * sequential; the current state of each task is kept in memory, indexed
+ * by task id. Each record is a text header followed by its payload:
+ *
+ *     <kind> <id> <status> <timestamp> <project length> <serial length> <checksum>\n<project><serial>\n
+ *
+ * where kind is 'A' (task added) or 'S' (status changed, empty payload),
+ * and checksum is the FNV-1a hash of the header fields and the payload.
+ * The timestamp of an 'S' record is the dispatch time for task_running,
+ * the finish time for task_done and task_aborted.
+ *
+ * At startup the file is replayed; replay stops at the first incomplete
+ * or corrupt record (a write interrupted by a crash) and the file is
+ * truncated there. When superseded status records outnumber the tasks,
+ * the file is compacted by rewriting the current state of each task; a
+ * compactor thread does it, so that the status updates do not wait for it.
+ *
+ * The log is bounded: the compaction drops the tasks finished for longer
+ * than the retention days (at once if none), except the last task, which
+ * holds the last id. The compactor also runs when enough tasks expired.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+
+#include "yacad_taskstore_log.h"
+
+#define RECORD_ADD 'A'
+#define RECORD_STATUS 'S'
+
+/* minimum number of superseded records before compaction */
+#define COMPACT_MIN 1024
+/* seconds between two counts of the expired tasks */
+#define EXPIRE_PERIOD 3600
+
+#define HEADER_FORMAT "%c %lu %d %ld %zu %zu"
+
+typedef struct {
+     unsigned long id;
+     yacad_task_status_t status;
+     time_t timestamp;
+     time_t dispatched;
+     time_t finished;
+     off_t offset; // of the payload in the file
+     size_t project_len;
+     size_t serial_len;
+} entry_t;
+
+typedef struct yacad_taskstore_log_impl_s {
+     yacad_taskstore_t fn;
+     logger_t log;
+     char *filename;
+     int fd;
+     off_t size;
+     cad_array_t *entries; // entry_t, in id order
+     unsigned long max_id;
+     long keep; // seconds a finished task is kept
+     unsigned long garbage; // superseded records
+     pthread_mutex_t lock; // the tasklist restores from its own thread
+     pthread_t compactor;
+     bool_t started;
+     pthread_cond_t cond;
+     bool_t compacting; // protected by lock
+     bool_t stopping; // protected by lock
+} yacad_taskstore_log_impl_t;
+
+static uint32_t fnv1a(uint32_t hash, const char *data, size_t n) {
+     size_t i;
+     for (i = 0; i < n; i++) {
+          hash = (hash ^ (unsigned char)data[i]) * 16777619U;
+     }
+     return hash;
+}
+
+/* returns a malloc'ed record of *len bytes; *header_len is the offset of the payload */
+static char *format_record(char kind, unsigned long id, yacad_task_status_t status, time_t timestamp, const char *project, size_t project_len, const char *serial, size_t serial_len, size_t *header_len, size_t *len) {
+     char *result;
+     uint32_t checksum;
+     int n = snprintf("", 0, HEADER_FORMAT, kind, id, (int)status, (long)timestamp, project_len, serial_len);
+
+     result = malloc(n + 10 + project_len + serial_len + 1);
+     snprintf(result, n + 1, HEADER_FORMAT, kind, id, (int)status, (long)timestamp, project_len, serial_len);
+     checksum = fnv1a(2166136261U, result, n);
+     checksum = fnv1a(checksum, project, project_len);
+     checksum = fnv1a(checksum, serial, serial_len);
+     n += sprintf(result + n, " %08x\n", checksum);
+
+     *header_len = n;
+     memcpy(result + n, project, project_len);
+     memcpy(result + n + project_len, serial, serial_len);
+     result[n + project_len + serial_len] = '\n';
+     *len = n + project_len + serial_len + 1;
+     return result;
+}
+
+static bool_t write_fully(int fd, const char *data, size_t len) {
+     ssize_t n;
+     while (len > 0) {
+          n = write(fd, data, len);
+          if (n < 0) {
+               if (errno != EINTR) {
+                    return false;
+               }
+          } else {
+               data += n;
+               len -= n;
+          }
+     }
+     return true;
+}
+
+/* must be called with the lock held */
+static bool_t append(yacad_taskstore_log_impl_t *this, const char *record, size_t len) {
+     if (!write_fully(this->fd, record, len) || fdatasync(this->fd) != 0) {
+          this->log(warn, "Could not write %s: %s", this->filename, strerror(errno));
+          // drop the partial record, it would stop the replay
+          if (ftruncate(this->fd, this->size) != 0) {
+               this->log(error, "Could not truncate %s: %s", this->filename, strerror(errno));
+          }
+          return false;
+     }
+     this->size += len;
+     return true;
+}
+
+/* must be called with the lock held; returns a malloc'ed copy of the payload */
+static char *read_payload(yacad_taskstore_log_impl_t *this, entry_t *entry) {
+     size_t n = entry->project_len + entry->serial_len;
+     char *result = malloc(n + 1);
+     if (pread(this->fd, result, n, entry->offset) != (ssize_t)n) {
+          this->log(warn, "Could not read %s: %s", this->filename, strerror(errno));
+          free(result);
+          return NULL;
+     }
+     result[n] = '\0';
+     return result;
+}
+
+/* must be called with the lock held; the index of the first entry with an id not lower than id */
+static int lower_bound(yacad_taskstore_log_impl_t *this, unsigned long id) {
+     int low = 0, high = this->entries->count(this->entries), mid;
+     entry_t *entry;
+
+     while (low < high) {
+          mid = (low + high) / 2;
+          entry = this->entries->get(this->entries, mid);
+          if (entry->id < id) {
+               low = mid + 1;
+          } else {
+               high = mid;
+          }
+     }
+     return low;
+}
+
+/* must be called with the lock held; NULL if the task is unknown or dropped */
+static entry_t *find_entry(yacad_taskstore_log_impl_t *this, unsigned long id) {
+     entry_t *result = NULL;
+     int index = lower_bound(this, id);
+
+     if (index < this->entries->count(this->entries)) {
+          result = this->entries->get(this->entries, index);
+          if (result->id != id) {
+               result = NULL;
+          }
+     }
+     return result;
+}
+
+static bool_t is_expired(entry_t *entry, time_t limit) {
+     bool_t result = false;
+     if (entry->status == task_done || entry->status == task_aborted) {
+          result = (entry->finished != 0 ? entry->finished : entry->timestamp) < limit;
+     }
+     return result;
+}
+
+/* returns true if the status record supersedes a previous one */
+static bool_t apply_status(entry_t *entry, yacad_task_status_t status, time_t when) {
+     bool_t result = true;
+     entry->status = status;
+     if (when != 0) {
+          switch (status) {
+          case task_running:
+               result = entry->dispatched != 0;
+               entry->dispatched = when;
+               break;
+          case task_done:
+          case task_aborted:
+               result = entry->finished != 0;
+               entry->finished = when;
+               break;
+          default:
+               break;
+          }
+     }
+     return result;
+}
+
+static bool_t write_status(int fd, unsigned long id, yacad_task_status_t status, time_t when, off_t *size) {
+     size_t header_len, len;
+     char *record = format_record(RECORD_STATUS, id, status, when, "", 0, "", 0, &header_len, &len);
+     bool_t result = write_fully(fd, record, len);
+     *size += len;
+     free(record);
+     return result;
+}
+
+/* writes the records that replay to the current state of the task */
+static bool_t write_entry(yacad_taskstore_log_impl_t *this, int fd, unsigned long id, entry_t *entry, off_t *offset, off_t *size) {
+     bool_t result;
+     char *payload, *record;
+     size_t header_len, len;
+     bool_t finished = entry->finished != 0 && (entry->status == task_done || entry->status == task_aborted);
+     yacad_task_status_t status = entry->dispatched != 0 || finished ? task_new : entry->status;
+
+     payload = read_payload(this, entry);
+     if (payload == NULL) {
+          return false;
+     }
+     record = format_record(RECORD_ADD, id, status, entry->timestamp, payload, entry->project_len, payload + entry->project_len, entry->serial_len, &header_len, &len);
+     result = write_fully(fd, record, len);
+     *offset = *size + header_len;
+     *size += len;
+     free(record);
+     free(payload);
+
+     if (result && entry->dispatched != 0) {
+          status = task_running;
+          result = write_status(fd, id, status, entry->dispatched, size);
+     }
+     if (result && finished) {
+          status = entry->status;
+          result = write_status(fd, id, status, entry->finished, size);
+     }
+     if (result && status != entry->status) {
+          result = write_status(fd, id, entry->status, 0, size);
+     }
+     return result;
+}
+
+/* must be called with the lock held */
+static bool_t must_compact(yacad_taskstore_log_impl_t *this) {
+     return !this->compacting && this->garbage > COMPACT_MIN && this->garbage > this->entries->count(this->entries);
+}
+
+/* must be called with the lock held; counts all the entries, not worth it on each status update */
+static bool_t must_expire(yacad_taskstore_log_impl_t *this) {
+     int i, expired = 0, n = this->entries->count(this->entries);
+     time_t limit = time(NULL) - this->keep;
+
+     for (i = 0; i < n - 1; i++) {
+          if (is_expired(this->entries->get(this->entries, i), limit)) {
+               expired++;
+          }
+     }
+     return !this->compacting && (expired > COMPACT_MIN || 2 * expired > n);
+}
+
+/* copies the records appended to the log since from */
+static bool_t copy_tail(yacad_taskstore_log_impl_t *this, int fd, off_t from) {
+     char buffer[4096];
+     ssize_t n = 1;
+     bool_t result = true;
+
+     while (result && n > 0 && from < this->size) {
+          n = pread(this->fd, buffer, this->size - from < (off_t)sizeof(buffer) ? (size_t)(this->size - from) : sizeof(buffer), from);
+          if (n < 0) {
+               result = false;
+          } else {
+               result = write_fully(fd, buffer, n);
+               from += n;
+          }
+     }
+     return result;
+}
+
+/* the rename is durable only once the directory is synced */
+static bool_t sync_dir(yacad_taskstore_log_impl_t *this) {
+     bool_t result = false;
+     int fd = open(dirname(strdupa(this->filename)), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+     if (fd >= 0) {
+          result = fsync(fd) == 0;
+          close(fd);
+     }
+     return result;
+}
+
+/* Must be called with the lock held. The lock is released while the tasks
+ * are rewritten; the records appended meanwhile are copied after them. */
+static bool_t compact(yacad_taskstore_log_impl_t *this) {
+     int i, dropped = 0, n = this->entries->count(this->entries);
+     int fd;
+     entry_t *entries, *entry;
+     cad_array_t *kept;
+     off_t *offsets; // -1 if dropped
+     off_t size = 0, from = this->size;
+     unsigned long garbage = this->garbage;
+     time_t limit = time(NULL) - this->keep;
+     bool_t result = true;
+     size_t m = strlen(this->filename) + 5;
+     char *tmpname = alloca(m);
+
+     snprintf(tmpname, m, "%s.tmp", this->filename);
+     fd = open(tmpname, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0600);
+     if (fd < 0) {
+          this->log(warn, "Could not compact %s: %s", this->filename, strerror(errno));
+          return false;
+     }
+
+     entries = malloc(n * sizeof(entry_t));
+     offsets = malloc(n * sizeof(off_t));
+     for (i = 0; i < n; i++) {
+          entries[i] = *(entry_t*)this->entries->get(this->entries, i);
+     }
+     this->compacting = true;
+     pthread_mutex_unlock(&(this->lock));
+
+     for (i = 0; result && i < n; i++) {
+          if (i < n - 1 && is_expired(entries + i, limit)) {
+               offsets[i] = -1;
+               dropped++;
+          } else {
+               result = write_entry(this, fd, entries[i].id, entries + i, offsets + i, &size);
+          }
+     }
+
+     pthread_mutex_lock(&(this->lock));
+     this->compacting = false;
+
+     result = result && copy_tail(this, fd, from);
+     if (result && fdatasync(fd) == 0 && rename(tmpname, this->filename) == 0) {
+          if (!sync_dir(this)) {
+               this->log(warn, "Could not sync the directory of %s: %s", this->filename, strerror(errno));
+          }
+          close(this->fd);
+          this->fd = fd;
+          kept = cad_new_array(stdlib_memory, sizeof(entry_t));
+          for (i = 0; i < this->entries->count(this->entries); i++) {
+               entry = this->entries->get(this->entries, i);
+               if (i >= n || offsets[i] >= 0) {
+                    entry->offset = i < n ? offsets[i] : entry->offset - from + size;
+                    kept->insert(kept, kept->count(kept), entry);
+               }
+          }
+          this->entries->free(this->entries);
+          this->entries = kept;
+          this->size = size + this->size - from;
+          this->garbage -= garbage;
+          this->log(info, "Compacted %s: %d tasks, %d dropped, %ld bytes", this->filename, n - dropped, dropped, (long)this->size);
+     } else {
+          this->log(warn, "Could not compact %s: %s", this->filename, strerror(errno));
+          close(fd);
+          unlink(tmpname);
+          result = false;
+     }
+
+     free(offsets);
+     free(entries);
+     return result;
+}
+
+/* A failed compaction is retried at the next superseded record; the pending one is made before stopping */
+static void *compactor_routine(yacad_taskstore_log_impl_t *this) {
+     bool_t done = false, failed = false, expire = false;
+     struct timeval now;
+     struct timespec deadline;
+
+     set_thread_name("task log compactor");
+
+     gettimeofday(&now, NULL);
+     deadline.tv_sec = now.tv_sec + EXPIRE_PERIOD;
+     deadline.tv_nsec = 0;
+
+     pthread_mutex_lock(&(this->lock));
+     while (!done) {
+          if (!failed && (expire || must_compact(this))) {
+               expire = false;
+               failed = !compact(this);
+          } else if (this->stopping) {
+               done = true;
+          } else if (pthread_cond_timedwait(&(this->cond), &(this->lock), &deadline) == ETIMEDOUT) {
+               expire = must_expire(this);
+               deadline.tv_sec += EXPIRE_PERIOD;
+          } else {
+               failed = false;
+          }
+     }
+     pthread_mutex_unlock(&(this->lock));
+
+     return this;
+}
+
+static unsigned long insert(yacad_taskstore_log_impl_t *this, yacad_task_status_t status, const char *serial, const char *project_name, time_t timestamp) {
+     unsigned long result = 0;
+     entry_t entry;
+     char *record;
+     size_t header_len, len;
+
+     pthread_mutex_lock(&(this->lock));
+
+     result = this->max_id + 1;
+     entry.id = result;
+     entry.status = status;
+     entry.timestamp = timestamp;
+     entry.dispatched = entry.finished = 0;
+     entry.project_len = project_name == NULL ? 0 : strlen(project_name);
+     entry.serial_len = strlen(serial);
+     record = format_record(RECORD_ADD, result, status, timestamp, project_name, entry.project_len, serial, entry.serial_len, &header_len, &len);
+     entry.offset = this->size + header_len;
+     if (append(this, record, len)) {
+          this->entries->insert(this->entries, this->entries->count(this->entries), &entry);
+          this->max_id = result;
+     } else {
+          result = 0;
+     }
+     free(record);
+
+     pthread_mutex_unlock(&(this->lock));
+
+     return result;
+}
+
+static bool_t set_status(yacad_taskstore_log_impl_t *this, unsigned long id, yacad_task_status_t status, time_t when) {
+     bool_t result = false;
+     entry_t *entry;
+     char *record;
+     size_t header_len, len;
+
+     pthread_mutex_lock(&(this->lock));
+
+     entry = find_entry(this, id);
+     if (entry == NULL) {
+          this->log(warn, "Unknown task: %lu", id);
+     } else {
+          record = format_record(RECORD_STATUS, id, status, when, "", 0, "", 0, &header_len, &len);
+          if (append(this, record, len)) {
+               if (apply_status(entry, status, when)) {
+                    this->garbage++;
+               }
+               result = true;
+          }
+          free(record);
+
+          if (must_compact(this)) {
+               if (this->started) {
+                    pthread_cond_signal(&(this->cond));
+               } else {
+                    compact(this);
+               }
+          }
+     }
+
+     pthread_mutex_unlock(&(this->lock));
+
+     return result;
+}
+
+/* Nothing queries the log for the running tasks: the ETA is not kept */
+static bool_t set_running(yacad_taskstore_log_impl_t *this, unsigned long id, time_t when, time_t eta) {
+     return set_status(this, id, task_running, when);
+}
+
+static unsigned long get_max_id(yacad_taskstore_log_impl_t *this) {
+     unsigned long result;
+     pthread_mutex_lock(&(this->lock));
+     result = this->max_id;
+     pthread_mutex_unlock(&(this->lock));
+     return result;
+}
+
+static int restore(yacad_taskstore_log_impl_t *this, unsigned long after_id, unsigned long max_id, int limit, yacad_taskstore_restore_cb cb, void *data) {
+     int result = 0, i, n;
+     entry_t *entry;
+     char *payload;
+
+     pthread_mutex_lock(&(this->lock));
+
+     n = lower_bound(this, max_id + 1);
+     for (i = lower_bound(this, after_id + 1); result >= 0 && result < limit && i < n; i++) {
+          entry = this->entries->get(this->entries, i);
+          if (entry->status == task_new) {
+               payload = read_payload(this, entry);
+               if (payload == NULL) {
+                    result = -1;
+               } else {
+                    cb(entry->id, entry->status, payload + entry->project_len, data);
+                    free(payload);
+                    result++;
+               }
+          }
+     }
+
+     pthread_mutex_unlock(&(this->lock));
+
+     return result;
+}
+
+static void free_(yacad_taskstore_log_impl_t *this) {
+     if (this->started) {
+          pthread_mutex_lock(&(this->lock));
+          this->stopping = true;
+          pthread_cond_signal(&(this->cond));
+          pthread_mutex_unlock(&(this->lock));
+          pthread_join(this->compactor, NULL);
+     }
+     close(this->fd);
+     this->entries->free(this->entries);
+     pthread_cond_destroy(&(this->cond));
+     pthread_mutex_destroy(&(this->lock));
+     free(this->filename);
+     free(this);
+}
+
+static yacad_taskstore_t impl_fn = {
+     .insert = (yacad_taskstore_insert_fn)insert,
+     .set_status = (yacad_taskstore_set_status_fn)set_status,
+     .set_running = (yacad_taskstore_set_running_fn)set_running,
+     .get_max_id = (yacad_taskstore_get_max_id_fn)get_max_id,
+     .restore = (yacad_taskstore_restore_fn)restore,
+     .free = (yacad_taskstore_free_fn)free_,
+};
+
+/* returns false at the end of the file, or if the record is incomplete or corrupt */
+static bool_t replay_record(yacad_taskstore_log_impl_t *this, FILE *in, off_t file_size, char **line, size_t *line_size) {
+     ssize_t n = getline(line, line_size, in);
+     char kind;
+     unsigned long id;
+     int status, header_len = 0;
+     long timestamp;
+     size_t project_len, serial_len, payload_len, remaining;
+     unsigned int checksum;
+     char *payload;
+     entry_t entry, *e;
+     bool_t result = false;
+
+     if (n <= 0 || (*line)[n - 1] != '\n') {
+          return false;
+     }
+     if (sscanf(*line, HEADER_FORMAT "%n %x", &kind, &id, &status, &timestamp, &project_len, &serial_len, &header_len, &checksum) != 7) {
+          return false;
+     }
+     remaining = (size_t)(file_size - this->size - n);
+     payload_len = project_len + serial_len;
+     if (project_len >= remaining || serial_len >= remaining || payload_len >= remaining) {
+          return false; // truncated, or garbage length not worth allocating
+     }
+
+     payload = malloc(payload_len + 1);
+     if (fread(payload, 1, payload_len + 1, in) == payload_len + 1 && payload[payload_len] == '\n'
+         && fnv1a(fnv1a(2166136261U, *line, header_len), payload, payload_len) == checksum) {
+          switch (kind) {
+          case RECORD_ADD:
+               if (id > this->max_id) {
+                    entry.id = id;
+                    entry.status = (yacad_task_status_t)status;
+                    entry.timestamp = (time_t)timestamp;
+                    entry.dispatched = entry.finished = 0;
+                    entry.offset = this->size + n;
+                    entry.project_len = project_len;
+                    entry.serial_len = serial_len;
+                    this->entries->insert(this->entries, this->entries->count(this->entries), &entry);
+                    this->max_id = id;
+                    result = true;
+               }
+               break;
+          case RECORD_STATUS:
+               e = find_entry(this, id);
+               if (e != NULL) {
+                    if (apply_status(e, (yacad_task_status_t)status, (time_t)timestamp)) {
+                         this->garbage++;
+                    }
+                    result = true;
+               } else {
+                    // a task dropped while the record was appended, during a compaction
+                    result = id > 0 && id <= this->max_id;
+               }
+               break;
+          }
+     }
+     free(payload);
+
+     if (result) {
+          this->size += n + payload_len + 1;
+     }
+     return result;
+}
+
+static void replay(yacad_taskstore_log_impl_t *this) {
+     FILE *in = fopen(this->filename, "r");
+     char *line = NULL;
+     size_t line_size = 0;
+     struct stat st;
+
+     if (in == NULL || fstat(this->fd, &st) != 0) {
+          this->log(error, "Could not read %s: %s", this->filename, strerror(errno));
+          if (in != NULL) {
+               fclose(in);
+          }
+          return;
+     }
+     while (replay_record(this, in, st.st_size, &line, &line_size)) {
+          // replayed
+     }
+     free(line);
+     fclose(in);
+
+     if (st.st_size > this->size) {
+          this->log(warn, "Truncating %s at %ld: dropped %ld bytes of incomplete record", this->filename, (long)this->size, (long)(st.st_size - this->size));
+          if (ftruncate(this->fd, this->size) != 0) {
+               this->log(error, "Could not truncate %s: %s", this->filename, strerror(errno));
+          }
+     }
+}
+
+/* The tasks left running by the previous core are dispatched again; their dispatch time is kept */
+static void requeue(yacad_taskstore_log_impl_t *this) {
+     int i, n = this->entries->count(this->entries);
+     entry_t *entry;
+     char *record;
+     size_t header_len, len;
+
+     for (i = 0; i < n; i++) {
+          entry = this->entries->get(this->entries, i);
+          if (entry->status == task_running) {
+               record = format_record(RECORD_STATUS, entry->id, task_new, 0, "", 0, "", 0, &header_len, &len);
+               if (append(this, record, len) && apply_status(entry, task_new, 0)) {
+                    this->garbage++;
+               }
+               free(record);
+          }
+     }
+}
+
+yacad_taskstore_t *yacad_taskstore_log_new(logger_t log, const char *filename, int days) {
+     yacad_taskstore_log_impl_t *result;
+     int fd = open(filename, O_RDWR | O_CREAT | O_APPEND, 0600);
+
+     if (fd < 0) {
+          log(error, "Could not open %s: %s", filename, strerror(errno));
+          return NULL;
+     }
+
+     result = malloc(sizeof(yacad_taskstore_log_impl_t));
+     result->fn = impl_fn;
+     result->log = log;
+     result->filename = strdup(filename);
+     result->fd = fd;
+     result->size = 0;
+     result->entries = cad_new_array(stdlib_memory, sizeof(entry_t));
+     result->max_id = 0;
+     result->keep = days * 86400L;
+     result->garbage = 0;
+     result->compacting = false;
+     result->stopping = false;
+     pthread_mutex_init(&(result->lock), NULL);
+     pthread_cond_init(&(result->cond), NULL);
+
+     replay(result);
+     requeue(result);
+     log(info, "Task log %s: %d tasks", filename, result->entries->count(result->entries));
+
+     result->started = pthread_create(&(result->compactor), NULL, (void*(*)(void*))compactor_routine, result) == 0;
+     if (!result->started) {
+          log(warn, "Could not start the task log compactor, the log is compacted by the status updates");
+     }
+
+     return I(result);
+}
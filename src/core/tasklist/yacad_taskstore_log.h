@@ -0,0 +1,24 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __YACAD_TASKSTORE_LOG_H__
+#define __YACAD_TASKSTORE_LOG_H__
+
+#include "yacad_taskstore.h"
+
+/* the finished tasks are dropped from the log after days (at the first compaction if 0) */
+yacad_taskstore_t *yacad_taskstore_log_new(logger_t log, const char *filename, int days);
+
+#endif /* __YACAD_TASKSTORE_LOG_H__ */
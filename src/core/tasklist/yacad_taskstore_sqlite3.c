@@ -0,0 +1,306 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "yacad_taskstore_sqlite3.h"
+
+#define STMT_DROP_TABLE "drop table if exists TASKLIST"
+
+#define STMT_CREATE_TABLE "create table TASKLIST ("       \
+     "ID integer primary key asc autoincrement, "         \
+     "STATUS integer not null, "                          \
+     "SERIAL not null"                                    \
+     ")"
+
+#define STMT_ALTER_TABLE_PROJECT "alter table TASKLIST add column PROJECT"
+#define STMT_ALTER_TABLE_TIMESTAMP "alter table TASKLIST add column TIMESTAMP integer not null default 0"
+#define STMT_CREATE_INDEX_PROJECT "create index if not exists TASKLIST_PROJECT on TASKLIST (PROJECT, STATUS, ID)"
+#define STMT_ALTER_TABLE_DISPATCHED "alter table TASKLIST add column DISPATCHED integer not null default 0"
+#define STMT_ALTER_TABLE_FINISHED "alter table TASKLIST add column FINISHED integer not null default 0"
+#define STMT_CREATE_INDEX_STATUS "create index if not exists TASKLIST_STATUS on TASKLIST (STATUS, ID)"
+#define STMT_CREATE_INDEX_PROJECT_ID "create index if not exists TASKLIST_PROJECT_ID on TASKLIST (PROJECT, ID)"
+#define STMT_ALTER_TABLE_ETA "alter table TASKLIST add column ETA integer not null default 0"
+#define STMT_PRAGMA_AUTO_VACUUM "pragma auto_vacuum=incremental"
+#define STMT_VACUUM "vacuum"
+
+#define STMT_SELECT_MAX_ID "select max(ID) from TASKLIST"
+#define STMT_SELECT_BATCH "select ID, STATUS, SERIAL from TASKLIST where STATUS=? and ID>? and ID<=? order by ID asc limit ?"
+#define STMT_INSERT "insert into TASKLIST (STATUS,SERIAL,PROJECT,TIMESTAMP) values (?,?,?,?)"
+#define STMT_UPDATE "update TASKLIST set STATUS=? where ID=?"
+#define STMT_UPDATE_DISPATCHED "update TASKLIST set STATUS=?, DISPATCHED=? where ID=?"
+#define STMT_UPDATE_FINISHED "update TASKLIST set STATUS=?, FINISHED=? where ID=?"
+#define STMT_UPDATE_RUNNING "update TASKLIST set STATUS=?, DISPATCHED=?, ETA=? where ID=?"
+#define STMT_SELECT_BACKFILL "select ID, SERIAL from TASKLIST where PROJECT is null"
+#define STMT_UPDATE_BACKFILL "update TASKLIST set PROJECT=?, TIMESTAMP=? where ID=?"
+#define STMT_UPDATE_REQUEUE "update TASKLIST set STATUS=? where STATUS=?"
+
+typedef struct yacad_taskstore_sqlite3_impl_s {
+     yacad_taskstore_t fn;
+     logger_t log;
+     yacad_database_t *db;
+     char *database_name;
+     yacad_database_t *reader; // the restorer connection, opened on the first restore
+} yacad_taskstore_sqlite3_impl_t;
+
+static unsigned long insert(yacad_taskstore_sqlite3_impl_t *this, yacad_task_status_t status, const char *serial, const char *project_name, time_t timestamp) {
+     unsigned long result = 0;
+     yacad_statement_t *query = this->db->update(this->db, STMT_INSERT);
+     if (query != NULL) {
+          query->bind_int(query, 0, status);
+          query->bind_string(query, 1, serial);
+          query->bind_string(query, 2, project_name);
+          query->bind_int(query, 3, (long)timestamp);
+          query->run(query, NULL, NULL);
+          result = (unsigned long)query->get_rowid(query);
+          query->free(query);
+     }
+     return result;
+}
+
+static bool_t set_status(yacad_taskstore_sqlite3_impl_t *this, unsigned long id, yacad_task_status_t status, time_t when) {
+     bool_t result = false;
+     yacad_statement_t *query;
+     const char *statement = STMT_UPDATE;
+     int index = 1;
+
+     if (when != 0) {
+          switch (status) {
+          case task_running:
+               statement = STMT_UPDATE_DISPATCHED;
+               index = 2;
+               break;
+          case task_done:
+          case task_aborted:
+               statement = STMT_UPDATE_FINISHED;
+               index = 2;
+               break;
+          default:
+               break;
+          }
+     }
+
+     query = this->db->update(this->db, statement);
+     if (query != NULL) {
+          query->bind_int(query, 0, status);
+          if (index == 2) {
+               query->bind_int(query, 1, (long)when);
+          }
+          query->bind_int(query, index, (long)id);
+          query->run(query, NULL, NULL);
+          query->free(query);
+          result = true;
+     }
+     return result;
+}
+
+static bool_t set_running(yacad_taskstore_sqlite3_impl_t *this, unsigned long id, time_t when, time_t eta) {
+     bool_t result = false;
+     yacad_statement_t *query = this->db->update(this->db, STMT_UPDATE_RUNNING);
+     if (query != NULL) {
+          query->bind_int(query, 0, task_running);
+          query->bind_int(query, 1, (long)when);
+          query->bind_int(query, 2, (long)eta);
+          query->bind_int(query, 3, (long)id);
+          query->run(query, NULL, NULL);
+          query->free(query);
+          result = true;
+     }
+     return result;
+}
+
+static void get_max_id_(yacad_statement_t *stmt, unsigned long *max_id) {
+     *max_id = (unsigned long)stmt->get_int(stmt, 0);
+}
+
+static unsigned long get_max_id(yacad_taskstore_sqlite3_impl_t *this) {
+     unsigned long result = 0;
+     yacad_statement_t *stmt = this->db->select(this->db, STMT_SELECT_MAX_ID);
+     if (stmt != NULL) {
+          stmt->run(stmt, (yacad_select_fn)get_max_id_, &result);
+          stmt->free(stmt);
+     }
+     return result;
+}
+
+typedef struct {
+     yacad_taskstore_restore_cb cb;
+     void *data;
+     int count;
+} restore_context_t;
+
+static void restore_task(yacad_statement_t *stmt, restore_context_t *context) {
+     context->cb((unsigned long)stmt->get_int(stmt, 0), (yacad_task_status_t)stmt->get_int(stmt, 1), stmt->get_string(stmt, 2), context->data);
+     context->count++;
+}
+
+/* Runs on the restorer thread: on a read-only connection of its own, not the one the scheduler writes to */
+static int restore(yacad_taskstore_sqlite3_impl_t *this, unsigned long after_id, unsigned long max_id, int limit, yacad_taskstore_restore_cb cb, void *data) {
+     restore_context_t context = {cb, data, 0};
+     yacad_statement_t *stmt;
+     if (this->reader == NULL) {
+          this->reader = yacad_database_new_readonly(this->log, this->database_name);
+          if (this->reader == NULL) {
+               return -1;
+          }
+     }
+     stmt = this->reader->select(this->reader, STMT_SELECT_BATCH);
+     if (stmt == NULL) {
+          return -1;
+     }
+     stmt->bind_int(stmt, 0, task_new);
+     stmt->bind_int(stmt, 1, (long)after_id);
+     stmt->bind_int(stmt, 2, (long)max_id);
+     stmt->bind_int(stmt, 3, limit);
+     stmt->run(stmt, (yacad_select_fn)restore_task, &context);
+     stmt->free(stmt);
+     return context.count;
+}
+
+static void free_(yacad_taskstore_sqlite3_impl_t *this) {
+     if (this->reader != NULL) {
+          this->reader->free(this->reader);
+     }
+     free(this->database_name);
+     free(this);
+}
+
+static yacad_taskstore_t impl_fn = {
+     .insert = (yacad_taskstore_insert_fn)insert,
+     .set_status = (yacad_taskstore_set_status_fn)set_status,
+     .set_running = (yacad_taskstore_set_running_fn)set_running,
+     .get_max_id = (yacad_taskstore_get_max_id_fn)get_max_id,
+     .restore = (yacad_taskstore_restore_fn)restore,
+     .free = (yacad_taskstore_free_fn)free_,
+};
+
+static void install_statement(yacad_database_t *database, const char *statement) {
+     yacad_statement_t *stmt = database->update(database, statement);
+     if (stmt != NULL) {
+          stmt->run(stmt, NULL, NULL);
+          stmt->free(stmt);
+     }
+}
+
+typedef struct {
+     unsigned long id;
+     char *project_name;
+     time_t timestamp;
+} backfill_t;
+
+typedef struct {
+     logger_t log;
+     cad_array_t *rows; // backfill_t
+} backfill_context_t;
+
+static void backfill_task(yacad_statement_t *stmt, backfill_context_t *context) {
+     yacad_task_t *task = yacad_task_unserialize(context->log, (char*)stmt->get_string(stmt, 1));
+     backfill_t row = {(unsigned long)stmt->get_int(stmt, 0), strdup(task->get_project_name(task)), task->get_timestamp(task)};
+     context->rows->insert(context->rows, context->rows->count(context->rows), &row);
+     task->free(task);
+}
+
+/* The rows inserted before PROJECT and TIMESTAMP existed: copy them from the serial, or retention never sees them */
+static void backfill(yacad_taskstore_sqlite3_impl_t *this, yacad_database_t *database) {
+     backfill_context_t context = {this->log, cad_new_array(stdlib_memory, sizeof(backfill_t))};
+     yacad_statement_t *stmt = database->select(database, STMT_SELECT_BACKFILL);
+     backfill_t *row;
+     int i, n;
+
+     // collected first: the rows are not updated under a running select
+     if (stmt != NULL) {
+          stmt->run(stmt, (yacad_select_fn)backfill_task, &context);
+          stmt->free(stmt);
+     }
+     n = context.rows->count(context.rows);
+     this->log(info, "Backfilling %d task%s", n, n == 1 ? "" : "s");
+     for (i = 0; i < n; i++) {
+          row = context.rows->get(context.rows, i);
+          stmt = database->update(database, STMT_UPDATE_BACKFILL);
+          if (stmt != NULL) {
+               stmt->bind_string(stmt, 0, row->project_name);
+               stmt->bind_int(stmt, 1, (long)row->timestamp);
+               stmt->bind_int(stmt, 2, (long)row->id);
+               stmt->run(stmt, NULL, NULL);
+               stmt->free(stmt);
+          }
+          free(row->project_name);
+     }
+     context.rows->free(context.rows);
+}
+
+static void install(yacad_taskstore_sqlite3_impl_t *this, yacad_database_t *database) {
+     long version = database->get_version(database);
+
+     this->log(info, "Upgrading database from version %ld", version);
+
+     if (version < 1) {
+          install_statement(database, STMT_DROP_TABLE);
+          install_statement(database, STMT_CREATE_TABLE);
+     }
+     if (version < 2) {
+          // PROJECT and TIMESTAMP are copies of the serial fields, needed by yacad_retention
+          install_statement(database, STMT_ALTER_TABLE_PROJECT);
+          install_statement(database, STMT_ALTER_TABLE_TIMESTAMP);
+          install_statement(database, STMT_CREATE_INDEX_PROJECT);
+          if (version > 0) {
+               backfill(this, database);
+               // older databases were created without incremental auto_vacuum; the vacuum is needed to switch
+               install_statement(database, STMT_PRAGMA_AUTO_VACUUM);
+               install_statement(database, STMT_VACUUM);
+          }
+     }
+     if (version < 3) {
+          install_statement(database, STMT_ALTER_TABLE_DISPATCHED);
+          install_statement(database, STMT_ALTER_TABLE_FINISHED);
+     }
+     if (version < 4) {
+          // for yacad_query
+          install_statement(database, STMT_CREATE_INDEX_STATUS);
+          install_statement(database, STMT_CREATE_INDEX_PROJECT_ID);
+     }
+     if (version < 5) {
+          // the ETA of the running tasks, for yacad_query
+          install_statement(database, STMT_ALTER_TABLE_ETA);
+     }
+
+     database->set_installed(database);
+}
+
+/* The tasks left running by the previous core are dispatched again; DISPATCHED and ETA are kept for the stats */
+static void requeue(yacad_taskstore_sqlite3_impl_t *this) {
+     yacad_statement_t *stmt = this->db->update(this->db, STMT_UPDATE_REQUEUE);
+     if (stmt != NULL) {
+          stmt->bind_int(stmt, 0, task_new);
+          stmt->bind_int(stmt, 1, task_running);
+          stmt->run(stmt, NULL, NULL);
+          stmt->free(stmt);
+     }
+}
+
+yacad_taskstore_t *yacad_taskstore_sqlite3_new(logger_t log, yacad_database_t *database, const char *database_name) {
+     yacad_taskstore_sqlite3_impl_t *result = malloc(sizeof(yacad_taskstore_sqlite3_impl_t));
+     result->fn = impl_fn;
+     result->log = log;
+     result->db = database;
+     result->database_name = strdup(database_name);
+     result->reader = NULL;
+
+     if (database->need_install(database)) {
+          install(result, database);
+     }
+     requeue(result);
+
+     return I(result);
+}
@@ -0,0 +1,23 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __YACAD_TASKSTORE_SQLITE3_H__
+#define __YACAD_TASKSTORE_SQLITE3_H__
+
+#include "yacad_taskstore.h"
+
+yacad_taskstore_t *yacad_taskstore_sqlite3_new(logger_t log, yacad_database_t *database, const char *database_name);
+
+#endif /* __YACAD_TASKSTORE_SQLITE3_H__ */
@@ -0,0 +1,304 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fcntl.h>
+#include <glob.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+
+#include "yacad_publisher.h"
+#include "common/hash/yacad_sha256.h"
+#include "common/http/yacad_http.h"
+
+typedef struct {
+     unsigned long task_id;
+     char *dir;
+     char *patterns;
+} job_t;
+
+typedef struct {
+     unsigned long task_id;
+     bool_t success;
+} outcome_t;
+
+typedef struct yacad_publisher_impl_s {
+     yacad_publisher_t fn;
+     yacad_conf_t *conf;
+     cad_array_t *jobs;
+     cad_array_t *published; // char[YACAD_SHA256_HEX], not collected yet
+     pthread_mutex_t lock;
+     pthread_cond_t wakeup;
+     int outcomes[2];
+     pthread_t worker;
+     bool_t started;
+     bool_t running;
+} yacad_publisher_impl_t;
+
+static bool_t send_all(int fd, const char *bytes, size_t size) {
+     ssize_t n = 1;
+
+     while (n > 0 && size > 0) {
+          n = send(fd, bytes, size, MSG_NOSIGNAL);
+          if (n > 0) {
+               bytes += n;
+               size -= n;
+          }
+     }
+     return size == 0;
+}
+
+/* One request on its own connection, which times out (see yacad_http_connect); the body is either bytes or a whole
+ * file. The status, 0 on error. */
+static int request(yacad_publisher_impl_t *this, const char *method, const char *target, const char *body, size_t size, int file) {
+     int result = 0;
+     int fd = yacad_http_connect(this->conf->log, this->conf->get_artifacts_name(this->conf));
+     off_t offset = 0;
+     ssize_t n = 1;
+     char *head;
+     size_t h;
+
+     if (fd >= 0) {
+          h = snprintf("", 0, "%s %s HTTP/1.0\r\nHost: %s\r\nContent-Length: %zu\r\n\r\n", method, target, this->conf->get_artifacts_name(this->conf), size) + 1;
+          head = alloca(h);
+          snprintf(head, h, "%s %s HTTP/1.0\r\nHost: %s\r\nContent-Length: %zu\r\n\r\n", method, target, this->conf->get_artifacts_name(this->conf), size);
+          if (send_all(fd, head, h - 1) && (body == NULL || send_all(fd, body, size))) {
+               while (file >= 0 && n > 0 && offset < size) {
+                    n = sendfile(fd, file, &offset, size - offset);
+               }
+               if (file < 0 || offset == size) {
+                    result = yacad_http_status(fd);
+               }
+          }
+          close(fd);
+     }
+     return result;
+}
+
+/* Uploads the file unless the Core already has its content */
+static bool_t publish_file(yacad_publisher_impl_t *this, const char *path, char hash[YACAD_SHA256_HEX]) {
+     bool_t result = false;
+     int fd = open(path, O_RDONLY | O_CLOEXEC), status;
+     struct stat st;
+     char target[YACAD_SHA256_HEX + 16];
+
+     if (fd < 0 || fstat(fd, &st) != 0 || !yacad_sha256_file(fd, hash)) {
+          this->conf->log(warn, "Could not read artifact %s: %s", path, strerror(errno));
+     } else {
+          snprintf(target, sizeof(target), "/objects/%s", hash);
+          status = request(this, "HEAD", target, NULL, 0, -1);
+          if (status == 404) {
+               status = request(this, "PUT", target, NULL, st.st_size, fd);
+               result = status == 201;
+               this->conf->log(debug, "Uploaded artifact %s (%s): %d", path, hash, status);
+          } else {
+               result = status == 200;
+          }
+          if (!result) {
+               this->conf->log(warn, "Could not publish artifact %s: status %d", path, status);
+          }
+     }
+     if (fd >= 0) {
+          close(fd);
+     }
+     return result;
+}
+
+static bool_t publish_job(yacad_publisher_impl_t *this, job_t *job) {
+     bool_t result = true;
+     glob_t matches;
+     char *patterns = strdupa(job->patterns), *pattern, *saveptr = NULL, *path, *manifest = NULL;
+     char hash[YACAD_SHA256_HEX], target[64];
+     size_t i, n, skip = strlen(job->dir) + 1, manifest_size = 0;
+     int flags = 0, status;
+     struct stat st;
+     FILE *out = open_memstream(&manifest, &manifest_size);
+     cad_array_t *hashes = cad_new_array(stdlib_memory, YACAD_SHA256_HEX);
+
+     memset(&matches, 0, sizeof(matches));
+     for (pattern = strtok_r(patterns, " ", &saveptr); pattern != NULL; pattern = strtok_r(NULL, " ", &saveptr)) {
+          n = snprintf("", 0, "%s/%s", job->dir, pattern) + 1;
+          path = alloca(n);
+          snprintf(path, n, "%s/%s", job->dir, pattern);
+          if (glob(path, flags, NULL, &matches) == 0) {
+               flags = GLOB_APPEND;
+          }
+     }
+
+     for (i = 0; result && i < matches.gl_pathc; i++) {
+          path = matches.gl_pathv[i];
+          if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+               result = publish_file(this, path, hash);
+               if (result) {
+                    fprintf(out, "%s %s\n", hash, path + skip);
+                    hashes->insert(hashes, hashes->count(hashes), hash);
+               }
+          }
+     }
+     fclose(out);
+
+     if (result) {
+          snprintf(target, sizeof(target), "/tasks/%lu", job->task_id);
+          status = request(this, "POST", target, manifest, manifest_size, -1);
+          result = status == 200;
+          if (!result) {
+               this->conf->log(warn, "Task %lu: could not post the artifacts manifest: status %d", job->task_id, status);
+          }
+     }
+
+     if (result) {
+          pthread_mutex_lock(&this->lock);
+          n = hashes->count(hashes);
+          for (i = 0; i < n; i++) {
+               if (this->published->count(this->published) == YACAD_LOCALITY_ARTIFACTS) {
+                    this->published->del(this->published, 0);
+               }
+               this->published->insert(this->published, this->published->count(this->published), hashes->get(hashes, i));
+          }
+          pthread_mutex_unlock(&this->lock);
+     }
+     hashes->free(hashes);
+
+     if (flags != 0) {
+          globfree(&matches);
+     }
+     free(manifest);
+     return result;
+}
+
+static void *worker_routine(yacad_publisher_impl_t *this) {
+     job_t job;
+     outcome_t outcome;
+     bool_t found;
+
+     set_thread_name("publisher");
+
+     pthread_mutex_lock(&this->lock);
+     while (this->running) {
+          found = this->jobs->count(this->jobs) > 0;
+          if (!found) {
+               pthread_cond_wait(&this->wakeup, &this->lock);
+          } else {
+               job = *(job_t*)this->jobs->get(this->jobs, 0);
+               this->jobs->del(this->jobs, 0);
+               pthread_mutex_unlock(&this->lock);
+
+               outcome.task_id = job.task_id;
+               outcome.success = publish_job(this, &job);
+               free(job.dir);
+               free(job.patterns);
+               // small enough to be atomic
+               if (write(this->outcomes[1], &outcome, sizeof(outcome)) != sizeof(outcome)) {
+                    this->conf->log(error, "Task %lu: could not report the artifacts: %s", outcome.task_id, strerror(errno));
+               }
+
+               pthread_mutex_lock(&this->lock);
+          }
+     }
+     pthread_mutex_unlock(&this->lock);
+
+     return this;
+}
+
+static void publish(yacad_publisher_impl_t *this, unsigned long task_id, const char *dir, const char *patterns) {
+     job_t job = { task_id, strdup(dir), strdup(patterns) };
+
+     pthread_mutex_lock(&this->lock);
+     this->jobs->insert(this->jobs, this->jobs->count(this->jobs), &job);
+     pthread_cond_signal(&this->wakeup);
+     pthread_mutex_unlock(&this->lock);
+}
+
+static int get_fd(yacad_publisher_impl_t *this) {
+     return this->outcomes[0];
+}
+
+static bool_t next(yacad_publisher_impl_t *this, unsigned long *task_id, bool_t *success) {
+     outcome_t outcome;
+     bool_t result = read(this->outcomes[0], &outcome, sizeof(outcome)) == sizeof(outcome);
+
+     if (result) {
+          *task_id = outcome.task_id;
+          *success = outcome.success;
+     }
+     return result;
+}
+
+static void collect(yacad_publisher_impl_t *this, yacad_locality_t *locality) {
+     int i, n;
+
+     pthread_mutex_lock(&this->lock);
+     n = this->published->count(this->published);
+     for (i = 0; i < n; i++) {
+          locality->add_artifact(locality, this->published->get(this->published, i));
+     }
+     this->published->clear(this->published);
+     pthread_mutex_unlock(&this->lock);
+}
+
+static void free_(yacad_publisher_impl_t *this) {
+     job_t *job;
+     int i, n;
+
+     if (this->started) {
+          pthread_mutex_lock(&this->lock);
+          this->running = false;
+          pthread_cond_signal(&this->wakeup);
+          pthread_mutex_unlock(&this->lock);
+          pthread_join(this->worker, NULL);
+     }
+
+     // the jobs not started yet are dropped
+     n = this->jobs->count(this->jobs);
+     for (i = 0; i < n; i++) {
+          job = this->jobs->get(this->jobs, i);
+          free(job->dir);
+          free(job->patterns);
+     }
+     this->jobs->free(this->jobs);
+     this->published->free(this->published);
+     pthread_cond_destroy(&this->wakeup);
+     pthread_mutex_destroy(&this->lock);
+     close(this->outcomes[0]);
+     close(this->outcomes[1]);
+     free(this);
+}
+
+static yacad_publisher_t impl_fn = {
+     .publish = (yacad_publisher_publish_fn)publish,
+     .get_fd = (yacad_publisher_get_fd_fn)get_fd,
+     .next = (yacad_publisher_next_fn)next,
+     .collect = (yacad_publisher_collect_fn)collect,
+     .free = (yacad_publisher_free_fn)free_,
+};
+
+yacad_publisher_t *yacad_publisher_new(yacad_conf_t *conf) {
+     yacad_publisher_impl_t *result = malloc(sizeof(yacad_publisher_impl_t));
+
+     result->fn = impl_fn;
+     result->conf = conf;
+     result->jobs = cad_new_array(stdlib_memory, sizeof(job_t));
+     result->published = cad_new_array(stdlib_memory, YACAD_SHA256_HEX);
+     pthread_mutex_init(&result->lock, NULL);
+     pthread_cond_init(&result->wakeup, NULL);
+     result->running = true;
+     result->started = pipe2(result->outcomes, O_CLOEXEC | O_NONBLOCK) == 0
+          && pthread_create(&(result->worker), NULL, (void*(*)(void*))worker_routine, result) == 0;
+     if (!result->started) {
+          conf->log(error, "Could not start the artifacts publisher");
+     }
+
+     return I(result);
+}
@@ -0,0 +1,48 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __YACAD_PUBLISHER_H__
+#define __YACAD_PUBLISHER_H__
+
+#include "yacad.h"
+#include "common/locality/yacad_locality.h"
+#include "runner/conf/yacad_conf.h"
+
+/* Publishes the artifacts of the finished tasks to the Core store (see
+ * core/artifacts/yacad_artifacts.h), on a thread of its own: each file
+ * is hashed, uploaded only if the Core does not know its hash yet, then
+ * the task manifest is posted. The engine watches get_fd() and collects
+ * the outcomes with next(). */
+
+typedef struct yacad_publisher_s yacad_publisher_t;
+
+typedef void (*yacad_publisher_publish_fn)(yacad_publisher_t *this, unsigned long task_id, const char *dir, const char *patterns);
+typedef int (*yacad_publisher_get_fd_fn)(yacad_publisher_t *this);
+typedef bool_t (*yacad_publisher_next_fn)(yacad_publisher_t *this, unsigned long *task_id, bool_t *success);
+typedef void (*yacad_publisher_collect_fn)(yacad_publisher_t *this, yacad_locality_t *locality);
+typedef void (*yacad_publisher_free_fn)(yacad_publisher_t *this);
+
+struct yacad_publisher_s {
+     yacad_publisher_publish_fn publish; // patterns: space-separated globs, relative to dir
+     yacad_publisher_get_fd_fn get_fd; // readable when an outcome is ready
+     yacad_publisher_next_fn next; // false when no outcome is ready
+     yacad_publisher_collect_fn collect; // moves the hashes published since the last call into the locality
+     yacad_publisher_free_fn free;
+};
+
+yacad_publisher_t *yacad_publisher_new(yacad_conf_t *conf);
+
+#endif /* __YACAD_PUBLISHER_H__ */
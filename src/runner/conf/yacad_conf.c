@@ -19,6 +19,8 @@
 
 #define DEFAULT_ENDPOINT_PORT 1789
 #define DEFAULT_EVENTS_PORT 1791
+#define DEFAULT_LOGS_PORT 1794
+#define DEFAULT_ARTIFACTS_PORT 1795
 #define DEFAULT_WORK_PATH "."
 
 static const char *dirs[] = {
@@ -38,6 +40,11 @@ typedef struct yacad_conf_impl_s {
      char *work_path;
      char *endpoint_name;
      char *events_name;
+     char *logs_name;
+     char *artifacts_name;
+     char *mirrors_url;
+     int slots;
+     bool_t compress_logs;
 } yacad_conf_impl_t;
 
 static yacad_runnerid_t *get_runnerid(yacad_conf_impl_t *this) {
@@ -52,10 +59,30 @@ static const char *get_events_name(yacad_conf_impl_t *this) {
      return this->events_name;
 }
 
+static const char *get_logs_name(yacad_conf_impl_t *this) {
+     return this->logs_name;
+}
+
+static const char *get_artifacts_name(yacad_conf_impl_t *this) {
+     return this->artifacts_name;
+}
+
+static const char *get_mirrors_url(yacad_conf_impl_t *this) {
+     return this->mirrors_url;
+}
+
 static const char *get_work_path(yacad_conf_impl_t *this) {
      return this->work_path;
 }
 
+static int get_slots(yacad_conf_impl_t *this) {
+     return this->slots;
+}
+
+static bool_t get_compress_logs(yacad_conf_impl_t *this) {
+     return this->compress_logs;
+}
+
 static int generation(yacad_conf_impl_t *this) {
      return this->generation;
 }
@@ -64,7 +91,12 @@ static void free_(yacad_conf_impl_t *this) {
      if (this->json != NULL) {
           this->json->accept(this->json, json_kill());
      }
-     this->runnerid->free(this->runnerid);
+     if (this->runnerid != NULL) {
+          this->runnerid->free(this->runnerid);
+     }
+     free(this->mirrors_url);
+     free(this->artifacts_name);
+     free(this->logs_name);
      free(this->events_name);
      free(this->endpoint_name);
      free(this->work_path);
@@ -77,7 +109,12 @@ static yacad_conf_t impl_fn =  {
      .get_runnerid = (yacad_conf_get_runnerid_fn)get_runnerid,
      .get_endpoint_name = (yacad_conf_get_endpoint_name_fn)get_endpoint_name,
      .get_events_name = (yacad_conf_get_events_name_fn)get_events_name,
+     .get_logs_name = (yacad_conf_get_logs_name_fn)get_logs_name,
+     .get_artifacts_name = (yacad_conf_get_artifacts_name_fn)get_artifacts_name,
+     .get_mirrors_url = (yacad_conf_get_mirrors_url_fn)get_mirrors_url,
      .get_work_path = (yacad_conf_get_work_path_fn)get_work_path,
+     .get_slots = (yacad_conf_get_slots_fn)get_slots,
+     .get_compress_logs = (yacad_conf_get_compress_logs_fn)get_compress_logs,
      .generation = (yacad_conf_generation_fn)generation,
      .free = (yacad_conf_free_fn)free_,
 };
@@ -166,9 +203,9 @@ static void set_work_path(yacad_conf_impl_t *this) {
           this->endpoint_name = realloc(this->endpoint_name, n);
           jstring->utf8(jstring, this->endpoint_name, n);
      } else {
-          n = snprintf("", 0, "tcp://*:%d", DEFAULT_ENDPOINT_PORT) + 1;
+          n = snprintf("", 0, "tcp://localhost:%d", DEFAULT_ENDPOINT_PORT) + 1;
           this->endpoint_name = realloc(this->endpoint_name, n);
-          snprintf(this->endpoint_name, n, "tcp://*:%d", DEFAULT_ENDPOINT_PORT);
+          snprintf(this->endpoint_name, n, "tcp://localhost:%d", DEFAULT_ENDPOINT_PORT);
      }
 
      v->visit(v, this->json, "core/events");
@@ -178,12 +215,79 @@ static void set_work_path(yacad_conf_impl_t *this) {
           this->events_name = realloc(this->events_name, n);
           jstring->utf8(jstring, this->events_name, n);
      } else {
-          n = snprintf("", 0, "tcp://*:%d", DEFAULT_EVENTS_PORT) + 1;
+          n = snprintf("", 0, "tcp://localhost:%d", DEFAULT_EVENTS_PORT) + 1;
           this->events_name = realloc(this->events_name, n);
-          snprintf(this->events_name, n, "tcp://*:%d", DEFAULT_EVENTS_PORT);
+          snprintf(this->events_name, n, "tcp://localhost:%d", DEFAULT_EVENTS_PORT);
      }
 
+     v->visit(v, this->json, "core/logs");
+     jstring = v->get_string(v);
+     if (jstring != NULL) {
+          n = jstring->count(jstring) + 1;
+          this->logs_name = realloc(this->logs_name, n);
+          jstring->utf8(jstring, this->logs_name, n);
+     } else {
+          n = snprintf("", 0, "tcp://localhost:%d", DEFAULT_LOGS_PORT) + 1;
+          this->logs_name = realloc(this->logs_name, n);
+          snprintf(this->logs_name, n, "tcp://localhost:%d", DEFAULT_LOGS_PORT);
+     }
+
+     v->visit(v, this->json, "core/artifacts");
+     jstring = v->get_string(v);
+     if (jstring != NULL) {
+          n = jstring->count(jstring) + 1;
+          this->artifacts_name = realloc(this->artifacts_name, n);
+          jstring->utf8(jstring, this->artifacts_name, n);
+     } else {
+          n = snprintf("", 0, "localhost:%d", DEFAULT_ARTIFACTS_PORT) + 1;
+          this->artifacts_name = realloc(this->artifacts_name, n);
+          snprintf(this->artifacts_name, n, "localhost:%d", DEFAULT_ARTIFACTS_PORT);
+     }
+
+     // optional: without it, the sources are fetched from the upstreams
+     v->visit(v, this->json, "core/mirrors");
+     jstring = v->get_string(v);
+     if (jstring != NULL) {
+          n = jstring->count(jstring) + 1;
+          this->mirrors_url = realloc(this->mirrors_url, n);
+          jstring->utf8(jstring, this->mirrors_url, n);
+     }
+
+     I(v)->free(I(v));
+}
+
+static void set_runner(yacad_conf_impl_t *this) {
+     yacad_json_finder_t *o = yacad_json_finder_new(I(this)->log, json_type_object, "runner");
+     yacad_json_finder_t *v = yacad_json_finder_new(I(this)->log, json_type_number, "runner/slots");
+     yacad_json_finder_t *c = yacad_json_finder_new(I(this)->log, json_type_const, "runner/compress_logs");
+     json_number_t *jslots;
+     json_const_t *jcompress;
+
+     o->visit(o, this->json);
+     if (o->get_value(o) != NULL) {
+          this->runnerid = yacad_runnerid_new(I(this)->log, o->get_value(o));
+     }
+
+     // by default, one task per core
+     v->visit(v, this->json);
+     jslots = v->get_number(v);
+     if (jslots != NULL) {
+          this->slots = (int)jslots->to_int(jslots);
+     } else {
+          this->slots = (int)sysconf(_SC_NPROCESSORS_ONLN);
+     }
+     if (this->slots < 1) {
+          this->slots = 1;
+     }
+
+     c->visit(c, this->json);
+     jcompress = c->get_const(c);
+     this->compress_logs = jcompress != NULL && jcompress->value(jcompress) == json_true;
+
+     I(c)->free(I(c));
+
      I(v)->free(I(v));
+     I(o)->free(I(o));
 }
 
 yacad_conf_t *yacad_runner_conf_new(void) {
@@ -196,8 +300,11 @@ yacad_conf_t *yacad_runner_conf_new(void) {
      result->fn = impl_fn;
      result->fn.log = get_logger(debug);
 
-     result->filename = result->work_path = result->endpoint_name = result->events_name = NULL;
+     result->filename = result->work_path = result->endpoint_name = result->events_name = result->logs_name = result->artifacts_name = result->mirrors_url = NULL;
      result->json = NULL;
+     result->runnerid = NULL;
+     result->slots = 1;
+     result->compress_logs = false;
      result->generation = 0;
 
      if (ref == NULL) {
@@ -211,6 +318,11 @@ yacad_conf_t *yacad_runner_conf_new(void) {
                I(result)->log(info, "Work path is %s", result->work_path);
                I(result)->log(info, "Core 0MQ endpoint is %s", result->endpoint_name);
                I(result)->log(info, "Core 0MQ events is %s", result->events_name);
+               I(result)->log(info, "Core 0MQ logs is %s", result->logs_name);
+               I(result)->log(info, "Core HTTP artifacts is %s", result->artifacts_name);
+               I(result)->log(info, "Core git mirrors are %s", result->mirrors_url == NULL ? "not used" : result->mirrors_url);
+               set_runner(result);
+               I(result)->log(info, "Runner slots: %d, compressed logs: %s", result->slots, result->compress_logs ? "yes" : "no");
           }
           ref = result;
      } else {
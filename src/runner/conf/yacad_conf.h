@@ -25,7 +25,12 @@ typedef struct yacad_conf_s yacad_conf_t;
 typedef yacad_runnerid_t *(*yacad_conf_get_runnerid_fn)(yacad_conf_t *this);
 typedef const char *(*yacad_conf_get_endpoint_name_fn)(yacad_conf_t *this);
 typedef const char *(*yacad_conf_get_events_name_fn)(yacad_conf_t *this);
+typedef const char *(*yacad_conf_get_logs_name_fn)(yacad_conf_t *this);
+typedef const char *(*yacad_conf_get_artifacts_name_fn)(yacad_conf_t *this);
+typedef const char *(*yacad_conf_get_mirrors_url_fn)(yacad_conf_t *this);
 typedef const char *(*yacad_conf_get_work_path_fn)(yacad_conf_t *this);
+typedef int (*yacad_conf_get_slots_fn)(yacad_conf_t *this);
+typedef bool_t (*yacad_conf_get_compress_logs_fn)(yacad_conf_t *this);
 typedef int (*yacad_conf_generation_fn)(yacad_conf_t *this);
 typedef void (*yacad_conf_free_fn)(yacad_conf_t *this);
 
@@ -34,7 +39,12 @@ struct yacad_conf_s {
      yacad_conf_get_runnerid_fn get_runnerid;
      yacad_conf_get_endpoint_name_fn get_endpoint_name;
      yacad_conf_get_events_name_fn get_events_name;
+     yacad_conf_get_logs_name_fn get_logs_name;
+     yacad_conf_get_artifacts_name_fn get_artifacts_name; // host:port of the Core HTTP artifacts server
+     yacad_conf_get_mirrors_url_fn get_mirrors_url; // where the Core git mirrors can be fetched from, NULL if not set
      yacad_conf_get_work_path_fn get_work_path;
+     yacad_conf_get_slots_fn get_slots;
+     yacad_conf_get_compress_logs_fn get_compress_logs;
      yacad_conf_generation_fn generation;
      yacad_conf_free_fn free;
 };
@@ -0,0 +1,915 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/signalfd.h>
+#include <zlib.h>
+
+#include "yacad_engine.h"
+#include "runner/artifacts/yacad_publisher.h"
+#include "common/chunk/yacad_chunk.h"
+#include "common/locality/yacad_locality.h"
+#include "common/json/yacad_json_finder.h"
+#include "common/message/yacad_message_visitor.h"
+#include "common/zmq/yacad_zmq.h"
+
+#define MSG_EVENT "event"
+#define IDLE_POLL 60 // seconds between two task requests when the Core has no task for us
+#define KILL_GRACE 10 // seconds given to the tasks to stop before they are killed
+#define REQUEST_TIMEOUT 30 // seconds without a reply before the query is sent again on a new socket
+#define OUTPUT_RING 65536 // task output bytes kept per slot; the task blocks when the ring is full
+
+extern char **environ;
+
+typedef enum {
+     artifacts_none = 0,
+     artifacts_publishing,
+     artifacts_published,
+     artifacts_failed,
+} artifacts_t;
+
+typedef struct {
+     pid_t pid; // 0 if the slot is free
+     yacad_task_t *task;
+     bool_t exited;
+     int status; // valid once exited
+     int out; // the read end of the task output pipe; -1 when closed
+     char *ring;
+     size_t head, size; // the output not sent yet
+     unsigned long seq; // of the next chunk
+     bool_t ended; // the end chunk was sent
+     bool_t polled; // out is in the poller
+     artifacts_t artifacts;
+} slot_t;
+
+typedef struct yacad_engine_impl_s {
+     yacad_engine_t fn;
+     yacad_conf_t *conf;
+     yacad_zmq_socket_t *zcore; // REQ to the Core endpoint
+     yacad_zmq_socket_t *zevents; // SUB to the Core events
+     yacad_zmq_socket_t *zlogs; // PUSH to the Core logs
+     yacad_publisher_t *publisher;
+     yacad_locality_t *locality; // sent with each task query
+     bool_t polled_out; // zlogs is in the poller, waiting for room
+     char *chunk; // header and bytes of the chunk being sent
+     char *zchunk; // compressed bytes
+     int sigchld; // signalfd
+     slot_t *slots;
+     int slot_count;
+     int busy;
+     cad_array_t *results; // serialized query_set_result, waiting for the REQ socket
+     bool_t pending; // a query is waiting for its reply
+     char *request; // the pending query, sent again if its reply does not come
+     struct timeval sent; // when the pending query was last sent
+     bool_t reconnected; // zcore was replaced: the poller must be rebuilt
+     bool_t idle; // the Core had no task: wait for an event
+     volatile bool_t running;
+} yacad_engine_impl_t;
+
+/* The REQ socket allows one query at a time: the results first, then a new task if a slot is free */
+static void send_next(yacad_engine_impl_t *this) {
+     yacad_message_query_get_task_t *query;
+     char *serial = NULL;
+
+     if (!this->pending) {
+          if (this->results->count(this->results) > 0) {
+               serial = *(char**)this->results->get(this->results, 0);
+               this->results->del(this->results, 0);
+          } else if (!this->idle && this->busy < this->slot_count) {
+               query = yacad_message_query_get_task_new(this->conf->log, this->conf->get_runnerid(this->conf), this->locality);
+               serial = I(query)->serialize(I(query));
+               I(query)->free(I(query));
+          }
+          if (serial != NULL) {
+               this->zcore->send(this->zcore, serial);
+               gettimeofday(&this->sent, NULL);
+               this->pending = true;
+               this->request = serial;
+          }
+     }
+}
+
+/* Lazy pirate: a REQ socket whose reply is lost (e.g. the Core restarted) cannot send anymore; replace it and send
+ * the pending query again */
+static void resend(yacad_engine_impl_t *this) {
+     yacad_zmq_socket_t *zcore;
+
+     this->conf->log(warn, "No reply from the Core after %d seconds, reconnecting to %s", REQUEST_TIMEOUT, this->conf->get_endpoint_name(this->conf));
+     zcore = yacad_zmq_socket_connect(this->conf->log, this->conf->get_endpoint_name(this->conf), ZMQ_REQ);
+     if (zcore == NULL) {
+          this->conf->log(error, "Could not connect zcore to %s", this->conf->get_endpoint_name(this->conf));
+     } else {
+          this->zcore->free(this->zcore);
+          this->zcore = zcore;
+          this->reconnected = true;
+          this->zcore->send(this->zcore, this->request);
+     }
+     // try again later anyway
+     gettimeofday(&this->sent, NULL);
+}
+
+static void add_result(yacad_engine_impl_t *this, yacad_task_t *task, bool_t success) {
+     yacad_message_query_set_result_t *message = yacad_message_query_set_result_new(this->conf->log, this->conf->get_runnerid(this->conf), task, success);
+     char *serial = I(message)->serialize(I(message));
+
+     this->results->insert(this->results, this->results->count(this->results), &serial);
+     I(message)->free(I(message));
+}
+
+static void fill_env(cad_hash_t *env, int index, const char *key, const char *value, cad_array_t *envp) {
+     size_t n = snprintf("", 0, "YACAD_%s=%s", key, value) + 1;
+     char *var = malloc(n), *c;
+
+     snprintf(var, n, "YACAD_%s=%s", key, value);
+     for (c = var + 6; *c != '='; c++) {
+          *c = toupper(*c);
+     }
+     envp->insert(envp, envp->count(envp), &var);
+}
+
+static void add_env(cad_array_t *envp, const char *format, ...) __PRINTF__;
+static void add_env(cad_array_t *envp, const char *format, ...) {
+     va_list args;
+     char *var;
+     size_t n;
+
+     va_start(args, format);
+     n = vsnprintf("", 0, format, args) + 1;
+     va_end(args);
+     var = malloc(n);
+     va_start(args, format);
+     vsnprintf(var, n, format, args);
+     va_end(args);
+     envp->insert(envp, envp->count(envp), &var);
+}
+
+static void free_envp(cad_array_t *envp) {
+     int i, n = envp->count(envp);
+     for (i = 0; i < n; i++) {
+          free(*(char**)envp->get(envp, i));
+     }
+     envp->free(envp);
+}
+
+/* The inherited environment, plus the task env as YACAD_* variables */
+static char **task_env(yacad_engine_impl_t *this, yacad_task_t *task, cad_array_t *envp) {
+     cad_hash_t *env = task->get_env(task);
+     char **e, *null = NULL;
+
+     for (e = environ; *e != NULL; e++) {
+          add_env(envp, "%s", *e);
+     }
+     add_env(envp, "YACAD_PROJECT=%s", task->get_project_name(task));
+     add_env(envp, "YACAD_TASK_ID=%lu", task->get_id(task));
+     add_env(envp, "YACAD_ARTIFACTS=http://%s", this->conf->get_artifacts_name(this->conf));
+     if (env != NULL) {
+          env->iterate(env, (cad_hash_iterator_fn)fill_env, envp);
+     }
+     envp->insert(envp, envp->count(envp), &null);
+     return envp->get(envp, 0);
+}
+
+/* The run string field, if any */
+static char *task_run_string(yacad_engine_impl_t *this, yacad_task_t *task, const char *field) {
+     char *result = NULL;
+     yacad_json_finder_t *v = yacad_json_finder_new(this->conf->log, json_type_string, "%s");
+     json_value_t *jrun = task->get_run(task);
+     json_string_t *jstring = NULL;
+     size_t n;
+
+     if (jrun != NULL) {
+          v->visit(v, jrun, field);
+          jstring = v->get_string(v);
+     }
+     if (jstring != NULL) {
+          n = jstring->utf8(jstring, "", 0) + 1;
+          result = malloc(n);
+          jstring->utf8(jstring, result, n);
+     }
+
+     I(v)->free(I(v));
+     return result;
+}
+
+static char *task_command(yacad_engine_impl_t *this, yacad_task_t *task) {
+     char *result = NULL;
+     yacad_json_finder_t *v = yacad_json_finder_new(this->conf->log, json_type_string, "%s");
+     json_string_t *jtype, *jcommand = NULL;
+     json_value_t *jrun = task->get_run(task);
+     char *type;
+     size_t n;
+
+     if (jrun != NULL) {
+          v->visit(v, jrun, "type");
+          jtype = v->get_string(v);
+          if (jtype != NULL) {
+               n = jtype->utf8(jtype, "", 0) + 1;
+               type = alloca(n);
+               jtype->utf8(jtype, type, n);
+               if (!strcmp(type, "spawn")) {
+                    v->visit(v, jrun, "command");
+                    jcommand = v->get_string(v);
+               } else {
+                    this->conf->log(warn, "Task %lu: unsupported run type: %s", task->get_id(task), type);
+               }
+          }
+     }
+     if (jcommand != NULL) {
+          n = jcommand->utf8(jcommand, "", 0) + 1;
+          result = malloc(n);
+          jcommand->utf8(jcommand, result, n);
+     }
+
+     I(v)->free(I(v));
+     return result;
+}
+
+/* <work_path>/<project>/<slot>: the slots running tasks of the same project do not share their build tree */
+static char *task_dir(yacad_engine_impl_t *this, yacad_task_t *task, slot_t *slot) {
+     const char *work_path = this->conf->get_work_path(this->conf);
+     const char *project_name = task->get_project_name(task);
+     int index = (int)(slot - this->slots);
+     size_t n = snprintf("", 0, "%s/%s/%d", work_path, project_name, index) + 1;
+     char *result = malloc(n);
+
+     snprintf(result, n, "%s/%s/%d", work_path, project_name, index);
+     return result;
+}
+
+/* The commands that check the sources of the task out in its directory, or NULL if the task or its scm do not say how */
+static char *task_checkout(yacad_engine_impl_t *this, yacad_task_t *task, slot_t *slot, yacad_scm_t *scm) {
+     char *result = NULL;
+     yacad_json_finder_t *v = yacad_json_finder_new(this->conf->log, json_type_string, "%s");
+     json_value_t *jsource = task->get_source(task);
+     json_string_t *jtype, *jref;
+     char *type, *ref, *dir;
+     size_t n;
+
+     if (scm != NULL && jsource != NULL) {
+          v->visit(v, jsource, "type");
+          jtype = v->get_string(v);
+          v->visit(v, jsource, "ref");
+          jref = v->get_string(v);
+          if (jtype != NULL && jref != NULL) {
+               n = jtype->utf8(jtype, "", 0) + 1;
+               type = alloca(n);
+               jtype->utf8(jtype, type, n);
+               n = jref->utf8(jref, "", 0) + 1;
+               ref = alloca(n);
+               jref->utf8(jref, ref, n);
+               if (!strcmp(type, "scm")) {
+                    dir = task_dir(this, task, slot);
+                    result = scm->get_checkout(scm, ref, dir, this->conf->get_mirrors_url(this->conf));
+                    free(dir);
+               }
+          }
+     }
+
+     I(v)->free(I(v));
+     return result;
+}
+
+/* Spawns the task command in its directory, after the checkout if any; its output goes to the slot pipe */
+static pid_t spawn_task(yacad_engine_impl_t *this, yacad_task_t *task, slot_t *slot, const char *checkout) {
+     pid_t result = 0;
+     char *command = task_command(this, task);
+     char *dir;
+     char *argv[7];
+     cad_array_t *envp;
+     posix_spawn_file_actions_t actions;
+     posix_spawnattr_t attr;
+     sigset_t mask;
+     int err, out[2];
+
+     if (command != NULL && pipe2(out, O_CLOEXEC) != 0) {
+          this->conf->log(warn, "Task %lu: could not create the output pipe: %s", task->get_id(task), strerror(errno));
+     } else if (command != NULL) {
+          fcntl(out[0], F_SETFL, O_NONBLOCK);
+          dir = task_dir(this, task, slot);
+          if (mkpath(dir, 0700) != 0 && errno != EEXIST) {
+               this->conf->log(warn, "Could not create directory: %s (%s)", dir, strerror(errno));
+          } else {
+               this->locality->add_workspace(this->locality, task->get_project_name(task));
+          }
+
+          posix_spawn_file_actions_init(&actions);
+          posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+          posix_spawn_file_actions_adddup2(&actions, out[1], 1);
+          posix_spawn_file_actions_adddup2(&actions, out[1], 2);
+
+          // the child must not inherit the blocked SIGCHLD; its own process group, to be killed as a whole
+          posix_spawnattr_init(&attr);
+          sigemptyset(&mask);
+          posix_spawnattr_setsigmask(&attr, &mask);
+          posix_spawnattr_setpgroup(&attr, 0);
+          posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETPGROUP);
+
+          argv[0] = "/bin/sh";
+          argv[1] = "-c";
+          // the checkout output goes to the task log, and a failed checkout fails the task
+          argv[2] = "eval \"$2\" && cd \"$0\" && eval \"$1\"";
+          argv[3] = dir;
+          argv[4] = command;
+          argv[5] = (char*)(checkout == NULL ? ":" : checkout);
+          argv[6] = NULL;
+
+          envp = cad_new_array(stdlib_memory, sizeof(char*));
+          err = posix_spawn(&result, argv[0], &actions, &attr, argv, task_env(this, task, envp));
+          close(out[1]);
+          if (err != 0) {
+               this->conf->log(warn, "Task %lu: could not spawn: %s", task->get_id(task), strerror(err));
+               close(out[0]);
+               result = 0;
+          } else {
+               this->conf->log(info, "Task %lu: started process %d in %s", task->get_id(task), (int)result, dir);
+               slot->out = out[0];
+          }
+
+          free_envp(envp);
+          posix_spawnattr_destroy(&attr);
+          posix_spawn_file_actions_destroy(&actions);
+          free(dir);
+     }
+
+     free(command);
+     return result;
+}
+
+static void start_task(yacad_engine_impl_t *this, yacad_task_t *task, yacad_scm_t *scm) {
+     slot_t *slot = NULL;
+     char *checkout;
+     int i;
+
+     for (i = 0; slot == NULL && i < this->slot_count; i++) {
+          if (this->slots[i].pid == 0) {
+               slot = this->slots + i;
+          }
+     }
+
+     if (slot == NULL) {
+          // should not happen: tasks are only asked for when a slot is free
+          this->conf->log(warn, "Task %lu: no free slot", task->get_id(task));
+          add_result(this, task, false);
+          task->free(task);
+     } else {
+          checkout = task_checkout(this, task, slot, scm);
+          slot->pid = spawn_task(this, task, slot, checkout);
+          free(checkout);
+          if (slot->pid == 0) {
+               add_result(this, task, false);
+               task->free(task);
+          } else {
+               slot->task = task;
+               this->busy++;
+          }
+     }
+}
+
+static bool_t keep_polling(yacad_engine_impl_t *this);
+
+typedef struct {
+     yacad_message_visitor_t fn;
+     yacad_engine_impl_t *engine;
+} yacad_engine_message_visitor_t;
+
+static void visit_unexpected(yacad_engine_message_visitor_t *this, yacad_message_t *message) {
+     this->engine->conf->log(warn, "Unexpected message");
+}
+
+static void visit_reply_get_task(yacad_engine_message_visitor_t *this, yacad_message_reply_get_task_t *message) {
+     yacad_task_t *task = message->get_task(message);
+     char *serial;
+
+     if (task == NULL) {
+          this->engine->conf->log(debug, "No task");
+          this->engine->idle = true;
+     } else {
+          // the message owns its task
+          serial = task->serialize(task);
+          task = yacad_task_unserialize(this->engine->conf->log, serial);
+          free(serial);
+          if (task != NULL) {
+               start_task(this->engine, task, message->get_scm(message));
+          }
+     }
+}
+
+static void visit_reply_set_result(yacad_engine_message_visitor_t *this, yacad_message_reply_set_result_t *message) {
+     this->engine->conf->log(debug, "Result acknowledged");
+}
+
+static yacad_message_visitor_t engine_message_visitor_fn = {
+     .visit_query_get_task = (yacad_message_visitor_visit_query_get_task_fn)visit_unexpected,
+     .visit_reply_get_task = (yacad_message_visitor_visit_reply_get_task_fn)visit_reply_get_task,
+     .visit_query_set_result = (yacad_message_visitor_visit_query_set_result_fn)visit_unexpected,
+     .visit_reply_set_result = (yacad_message_visitor_visit_reply_set_result_fn)visit_reply_set_result,
+     .visit_query_list_tasks = (yacad_message_visitor_visit_query_list_tasks_fn)visit_unexpected,
+     .visit_reply_list_tasks = (yacad_message_visitor_visit_reply_list_tasks_fn)visit_unexpected,
+};
+
+static bool_t on_pollin_zcore(yacad_zmq_poller_t *poller, yacad_zmq_socket_t *socket, const char *strmsg, void *data) {
+     yacad_engine_impl_t *this = (yacad_engine_impl_t*)data;
+     yacad_engine_message_visitor_t v = { engine_message_visitor_fn, this };
+     yacad_message_t *message;
+     cad_hash_t *env = cad_new_hash(stdlib_memory, cad_hash_strings);
+     const char *work_path = this->conf->get_work_path(this->conf);
+     size_t n = strlen(work_path) + 2;
+     char *root_path = alloca(n);
+
+     // the scm puts its mirror next to its root path: in <work_path>/mirrors
+     snprintf(root_path, n, "%s/", work_path);
+     env->set(env, "root_path", root_path);
+
+     this->pending = false;
+     free(this->request);
+     this->request = NULL;
+     message = yacad_message_unserialize(this->conf->log, strmsg, env);
+     if (message == NULL) {
+          this->conf->log(warn, "Received invalid message: %s", strmsg);
+     } else {
+          message->accept(message, I(&v));
+          message->free(message);
+     }
+     env->free(env);
+     send_next(this);
+
+     return keep_polling(this);
+}
+
+static bool_t on_pollin_zevents(yacad_zmq_poller_t *poller, yacad_zmq_socket_t *socket, const char *strmsg, void *data) {
+     yacad_engine_impl_t *this = (yacad_engine_impl_t*)data;
+
+     if (strmsg != NULL && !strcmp(strmsg, MSG_EVENT)) {
+          this->idle = false;
+          send_next(this);
+     }
+
+     return keep_polling(this);
+}
+
+static void reset_slot(slot_t *slot) {
+     if (slot->out >= 0) {
+          close(slot->out);
+     }
+     slot->pid = 0;
+     slot->task = NULL;
+     slot->exited = false;
+     slot->status = 0;
+     slot->out = -1;
+     slot->head = slot->size = 0;
+     slot->seq = 0;
+     slot->ended = false;
+     slot->artifacts = artifacts_none;
+}
+
+static void finish_task(yacad_engine_impl_t *this, slot_t *slot) {
+     yacad_task_t *task = slot->task;
+     int status = slot->status;
+     bool_t success = WIFEXITED(status) && WEXITSTATUS(status) == 0 && slot->artifacts != artifacts_failed;
+
+     if (WIFEXITED(status)) {
+          this->conf->log(info, "Task %lu: process %d exited with status %d", task->get_id(task), (int)slot->pid, WEXITSTATUS(status));
+     } else if (WIFSIGNALED(status)) {
+          this->conf->log(info, "Task %lu: process %d killed by signal %d", task->get_id(task), (int)slot->pid, WTERMSIG(status));
+     }
+     if (slot->artifacts == artifacts_failed) {
+          this->conf->log(info, "Task %lu: the artifacts could not be published", task->get_id(task));
+     }
+     add_result(this, task, success);
+
+     task->free(task);
+     reset_slot(slot);
+     this->busy--;
+}
+
+/* Non-blocking: false if the Core does not keep up (the chunk is sent again later) */
+static bool_t send_chunk(yacad_engine_impl_t *this, slot_t *slot, char kind, const char *bytes, size_t size) {
+     bool_t result;
+     const char *payload = bytes;
+     uLongf zsize = compressBound(YACAD_CHUNK_SIZE);
+     size_t n, psize = size;
+
+     if (kind == YACAD_CHUNK_RAW && this->conf->get_compress_logs(this->conf)
+         && compress2((Bytef*)this->zchunk, &zsize, (const Bytef*)bytes, size, Z_BEST_SPEED) == Z_OK && zsize < size) {
+          kind = YACAD_CHUNK_ZLIB;
+          payload = this->zchunk;
+          psize = zsize;
+     }
+
+     n = snprintf(this->chunk, YACAD_CHUNK_HEADER_MAX, YACAD_CHUNK_HEADER, slot->task->get_id(slot->task), slot->seq, kind, size);
+     if (psize > 0) {
+          memcpy(this->chunk + n, payload, psize);
+     }
+     result = this->zlogs->send_bytes(this->zlogs, this->chunk, n + psize);
+     if (result) {
+          slot->seq++;
+     }
+     return result;
+}
+
+/* Reads the task output into the ring, until there is no more room or nothing to read */
+static size_t read_output(yacad_engine_impl_t *this, slot_t *slot) {
+     size_t result = 0, tail, room;
+     ssize_t n = 1;
+
+     while (slot->out >= 0 && n > 0 && slot->size < OUTPUT_RING) {
+          tail = (slot->head + slot->size) % OUTPUT_RING;
+          room = tail < slot->head ? slot->head - tail : OUTPUT_RING - tail;
+          n = read(slot->out, slot->ring + tail, room);
+          if (n > 0) {
+               slot->size += n;
+               result += n;
+          } else if (n == 0 || (errno != EAGAIN && errno != EINTR) || (errno == EAGAIN && slot->exited)) {
+               // the end of the output; once the process exited, what its children may still write is lost
+               close(slot->out);
+               slot->out = -1;
+          }
+     }
+
+     return result;
+}
+
+/* Sends the ring as chunks, then the end chunk once the output is closed */
+static size_t ship_output(yacad_engine_impl_t *this, slot_t *slot) {
+     size_t result = 0, n;
+     bool_t sent = true;
+
+     while (sent && slot->size > 0) {
+          n = OUTPUT_RING - slot->head;
+          if (n > slot->size) {
+               n = slot->size;
+          }
+          if (n > YACAD_CHUNK_SIZE) {
+               n = YACAD_CHUNK_SIZE;
+          }
+          sent = send_chunk(this, slot, YACAD_CHUNK_RAW, slot->ring + slot->head, n);
+          if (sent) {
+               slot->head = (slot->head + n) % OUTPUT_RING;
+               slot->size -= n;
+               result += n;
+          }
+     }
+     if (sent && slot->out < 0 && !slot->ended) {
+          slot->ended = send_chunk(this, slot, YACAD_CHUNK_END, NULL, 0);
+     }
+
+     return result;
+}
+
+/* The task is finished when its process exited, all its output was sent, and its artifacts were published */
+static void service_slot(yacad_engine_impl_t *this, slot_t *slot) {
+     size_t r, s;
+     char *patterns, *dir;
+
+     do {
+          r = read_output(this, slot);
+          s = ship_output(this, slot);
+     } while (slot->exited && (r > 0 || s > 0));
+
+     if (slot->exited && slot->ended && slot->artifacts == artifacts_none) {
+          // a failed task publishes nothing
+          patterns = WIFEXITED(slot->status) && WEXITSTATUS(slot->status) == 0 ? task_run_string(this, slot->task, "artifacts") : NULL;
+          if (patterns == NULL) {
+               finish_task(this, slot);
+          } else {
+               dir = task_dir(this, slot->task, slot);
+               this->publisher->publish(this->publisher, slot->task->get_id(slot->task), dir, patterns);
+               slot->artifacts = artifacts_publishing;
+               free(dir);
+               free(patterns);
+          }
+     }
+}
+
+/* The poller watches each pipe only while its ring has room, and zlogs only while some output waits */
+static bool_t wants_out(yacad_engine_impl_t *this) {
+     bool_t result = false;
+     int i;
+
+     for (i = 0; !result && i < this->slot_count; i++) {
+          result = this->slots[i].pid != 0 && (this->slots[i].size > 0 || (this->slots[i].out < 0 && !this->slots[i].ended));
+     }
+     return result;
+}
+
+static bool_t wants_fd(slot_t *slot) {
+     return slot->out >= 0 && slot->size < OUTPUT_RING;
+}
+
+/* false to stop the poller: either the engine is stopped, or the poller must be built again */
+static bool_t keep_polling(yacad_engine_impl_t *this) {
+     bool_t result = this->running && !this->reconnected && wants_out(this) == this->polled_out;
+     int i;
+
+     for (i = 0; result && i < this->slot_count; i++) {
+          result = wants_fd(this->slots + i) == this->slots[i].polled;
+     }
+     return result;
+}
+
+static bool_t on_output(yacad_zmq_poller_t *poller, int fd, void *data) {
+     yacad_engine_impl_t *this = (yacad_engine_impl_t*)data;
+     int i;
+
+     for (i = 0; i < this->slot_count; i++) {
+          if (this->slots[i].out == fd) {
+               service_slot(this, this->slots + i);
+          }
+     }
+     send_next(this);
+
+     return keep_polling(this);
+}
+
+static bool_t on_pollout_zlogs(yacad_zmq_poller_t *poller, yacad_zmq_socket_t *socket, char * const *message, void *data) {
+     yacad_engine_impl_t *this = (yacad_engine_impl_t*)data;
+     int i;
+
+     *(const char**)message = NULL; // the chunks are sent by send_chunk
+     for (i = 0; i < this->slot_count; i++) {
+          if (this->slots[i].pid != 0) {
+               service_slot(this, this->slots + i);
+          }
+     }
+     send_next(this);
+
+     return keep_polling(this);
+}
+
+static bool_t on_published(yacad_zmq_poller_t *poller, int fd, void *data) {
+     yacad_engine_impl_t *this = (yacad_engine_impl_t*)data;
+     unsigned long task_id;
+     bool_t success;
+     int i;
+
+     while (this->publisher->next(this->publisher, &task_id, &success)) {
+          for (i = 0; i < this->slot_count; i++) {
+               if (this->slots[i].artifacts == artifacts_publishing && this->slots[i].task->get_id(this->slots[i].task) == task_id) {
+                    this->slots[i].artifacts = success ? artifacts_published : artifacts_failed;
+                    finish_task(this, this->slots + i);
+               }
+          }
+     }
+     this->publisher->collect(this->publisher, this->locality);
+     send_next(this);
+
+     return keep_polling(this);
+}
+
+static bool_t on_sigchld(yacad_zmq_poller_t *poller, int fd, void *data) {
+     yacad_engine_impl_t *this = (yacad_engine_impl_t*)data;
+     struct signalfd_siginfo info;
+     pid_t pid;
+     int status, i;
+
+     // the signals are merged: drain them all, then reap every exited child
+     while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+     }
+     while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+          for (i = 0; i < this->slot_count; i++) {
+               if (this->slots[i].pid == pid) {
+                    this->slots[i].exited = true;
+                    this->slots[i].status = status;
+                    service_slot(this, this->slots + i);
+               }
+          }
+     }
+     send_next(this);
+
+     return keep_polling(this);
+}
+
+static void engine_timeout(yacad_zmq_poller_t *poller, struct timeval *timeout, void *data) {
+     yacad_engine_impl_t *this = (yacad_engine_impl_t*)data;
+
+     if (this->pending) {
+          *timeout = this->sent;
+          timeout->tv_sec += REQUEST_TIMEOUT;
+     } else {
+          gettimeofday(timeout, NULL);
+          timeout->tv_sec += IDLE_POLL;
+     }
+}
+
+static bool_t engine_on_timeout(yacad_zmq_poller_t *poller, void *data) {
+     yacad_engine_impl_t *this = (yacad_engine_impl_t*)data;
+     struct timeval now, deadline;
+
+     gettimeofday(&now, NULL);
+     if (this->pending) {
+          deadline = this->sent;
+          deadline.tv_sec += REQUEST_TIMEOUT;
+          if (!timercmp(&now, &deadline, <)) {
+               resend(this);
+          }
+     } else {
+          // in case an event was missed
+          this->idle = false;
+          send_next(this);
+     }
+
+     return keep_polling(this);
+}
+
+static yacad_zmq_poller_t *new_poller(yacad_engine_impl_t *this) {
+     yacad_zmq_poller_t *result = yacad_zmq_poller_new(this->conf->log);
+     int i;
+
+     result->on_pollin(result, this->zcore, on_pollin_zcore);
+     result->on_pollin(result, this->zevents, on_pollin_zevents);
+     result->on_fdin(result, this->sigchld, on_sigchld);
+     result->on_fdin(result, this->publisher->get_fd(this->publisher), on_published);
+     for (i = 0; i < this->slot_count; i++) {
+          this->slots[i].polled = wants_fd(this->slots + i);
+          if (this->slots[i].polled) {
+               result->on_fdin(result, this->slots[i].out, on_output);
+          }
+     }
+     this->polled_out = wants_out(this);
+     if (this->polled_out) {
+          result->on_pollout(result, this->zlogs, on_pollout_zlogs);
+     }
+     result->set_timeout(result, engine_timeout, engine_on_timeout);
+
+     return result;
+}
+
+/* Stops the running tasks: each one is a process group, killed if it does not stop within KILL_GRACE */
+static void kill_tasks(yacad_engine_impl_t *this) {
+     int i, status, left = 0;
+     time_t deadline = time(NULL) + KILL_GRACE;
+
+     for (i = 0; i < this->slot_count; i++) {
+          if (this->slots[i].pid != 0) {
+               this->conf->log(info, "Task %lu: stopping process %d", this->slots[i].task->get_id(this->slots[i].task), (int)this->slots[i].pid);
+               kill(-this->slots[i].pid, SIGTERM);
+               left++;
+          }
+     }
+     while (left > 0) {
+          for (i = 0; i < this->slot_count; i++) {
+               if (this->slots[i].pid != 0 && waitpid(this->slots[i].pid, &status, WNOHANG) != 0) {
+                    this->slots[i].task->free(this->slots[i].task);
+                    reset_slot(this->slots + i);
+                    left--;
+               }
+          }
+          if (left > 0 && time(NULL) < deadline) {
+               usleep(100000);
+          } else if (left > 0) {
+               for (i = 0; i < this->slot_count; i++) {
+                    if (this->slots[i].pid != 0) {
+                         this->conf->log(warn, "Task %lu: killing process %d", this->slots[i].task->get_id(this->slots[i].task), (int)this->slots[i].pid);
+                         kill(-this->slots[i].pid, SIGKILL);
+                    }
+               }
+               // cannot be ignored: the next waits are short
+               deadline = time(NULL) + KILL_GRACE;
+          }
+     }
+     this->busy = 0;
+}
+
+static void run(yacad_engine_impl_t *this) {
+     yacad_zmq_poller_t *zpoller;
+     sigset_t mask;
+
+     if (this->conf->get_runnerid(this->conf) == NULL) {
+          this->conf->log(error, "No runner identification");
+     } else {
+          sigemptyset(&mask);
+          sigaddset(&mask, SIGCHLD);
+          sigprocmask(SIG_BLOCK, &mask, NULL);
+          this->sigchld = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+          if (this->sigchld < 0) {
+               this->conf->log(error, "Could not create signalfd: %s", strerror(errno));
+          } else {
+               this->zcore = yacad_zmq_socket_connect(this->conf->log, this->conf->get_endpoint_name(this->conf), ZMQ_REQ);
+               if (this->zcore == NULL) {
+                    this->conf->log(error, "Could not connect zcore to %s", this->conf->get_endpoint_name(this->conf));
+               } else {
+                    this->zevents = yacad_zmq_socket_connect(this->conf->log, this->conf->get_events_name(this->conf), ZMQ_SUB);
+                    if (this->zevents == NULL) {
+                         this->conf->log(error, "Could not connect zevents to %s", this->conf->get_events_name(this->conf));
+                    } else {
+                         this->zlogs = yacad_zmq_socket_connect(this->conf->log, this->conf->get_logs_name(this->conf), ZMQ_PUSH);
+                         if (this->zlogs == NULL) {
+                              this->conf->log(error, "Could not connect zlogs to %s", this->conf->get_logs_name(this->conf));
+                         } else {
+                              this->publisher = yacad_publisher_new(this->conf);
+                              // the poller also stops on interrupted system calls, and when the watched pipes change:
+                              // start again unless stopped
+                              while (this->running) {
+                                   zpoller = new_poller(this);
+                                   this->reconnected = false;
+                                   send_next(this);
+                                   zpoller->run(zpoller, this);
+                                   zpoller->free(zpoller);
+                              }
+                              kill_tasks(this);
+                              this->publisher->free(this->publisher);
+                              this->publisher = NULL;
+                              this->zlogs->free(this->zlogs);
+                         }
+                         this->zevents->free(this->zevents);
+                    }
+                    this->zcore->free(this->zcore);
+               }
+               close(this->sigchld);
+          }
+          sigprocmask(SIG_UNBLOCK, &mask, NULL);
+     }
+}
+
+static void stop(yacad_engine_impl_t *this) {
+     this->running = false;
+}
+
+static void free_(yacad_engine_impl_t *this) {
+     int i, n = this->results->count(this->results);
+
+     for (i = 0; i < n; i++) {
+          free(*(char**)this->results->get(this->results, i));
+     }
+     this->results->free(this->results);
+     free(this->request);
+     for (i = 0; i < this->slot_count; i++) {
+          free(this->slots[i].ring);
+     }
+     free(this->slots);
+     this->locality->free(this->locality);
+     free(this->zchunk);
+     free(this->chunk);
+     free(this);
+}
+
+/* The workspaces left by a previous run are still there */
+static void scan_workspaces(yacad_engine_impl_t *this) {
+     const char *work_path = this->conf->get_work_path(this->conf);
+     DIR *dir = opendir(work_path);
+     struct dirent *entry;
+
+     if (dir != NULL) {
+          for (entry = readdir(dir); entry != NULL; entry = readdir(dir)) {
+               if (entry->d_type == DT_DIR && entry->d_name[0] != '.' && strcmp(entry->d_name, "mirrors")) {
+                    this->locality->add_workspace(this->locality, entry->d_name);
+               }
+          }
+          closedir(dir);
+     }
+}
+
+static yacad_engine_t impl_fn = {
+     .run = (yacad_engine_run_fn)run,
+     .stop = (yacad_engine_stop_fn)stop,
+     .free = (yacad_engine_free_fn)free_,
+};
+
+yacad_engine_t *yacad_engine_new(yacad_conf_t *conf) {
+     yacad_engine_impl_t *result = malloc(sizeof(yacad_engine_impl_t));
+     int i;
+
+     result->fn = impl_fn;
+     result->conf = conf;
+     result->zcore = result->zevents = result->zlogs = NULL;
+     result->publisher = NULL;
+     result->locality = yacad_locality_new();
+     scan_workspaces(result);
+     result->polled_out = false;
+     result->chunk = malloc(YACAD_CHUNK_HEADER_MAX + compressBound(YACAD_CHUNK_SIZE));
+     result->zchunk = malloc(compressBound(YACAD_CHUNK_SIZE));
+     result->sigchld = -1;
+     result->slot_count = conf->get_slots(conf);
+     result->slots = calloc(result->slot_count, sizeof(slot_t));
+     for (i = 0; i < result->slot_count; i++) {
+          result->slots[i].out = -1;
+          reset_slot(result->slots + i);
+          result->slots[i].ring = malloc(OUTPUT_RING);
+     }
+     result->busy = 0;
+     result->results = cad_new_array(stdlib_memory, sizeof(char*));
+     result->pending = false;
+     result->request = NULL;
+     result->reconnected = false;
+     result->idle = false;
+     result->running = true;
+
+     return I(result);
+}
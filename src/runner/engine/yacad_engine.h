@@ -0,0 +1,42 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __YACAD_ENGINE_H__
+#define __YACAD_ENGINE_H__
+
+#include "yacad.h"
+#include "runner/conf/yacad_conf.h"
+
+/**
+ * The runner execution engine: keeps up to conf->get_slots() tasks running at the same time,
+ * asking the Core for tasks and sending back their results.
+ */
+
+typedef struct yacad_engine_s yacad_engine_t;
+
+typedef void (*yacad_engine_run_fn)(yacad_engine_t *this);
+typedef void (*yacad_engine_stop_fn)(yacad_engine_t *this);
+typedef void (*yacad_engine_free_fn)(yacad_engine_t *this);
+
+struct yacad_engine_s {
+     yacad_engine_run_fn run;
+     yacad_engine_stop_fn stop; // safe in a signal handler
+     yacad_engine_free_fn free;
+};
+
+yacad_engine_t *yacad_engine_new(yacad_conf_t *conf);
+
+#endif /* __YACAD_ENGINE_H__ */
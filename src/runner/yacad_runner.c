@@ -18,13 +18,11 @@
 
 #include "yacad.h"
 #include "runner/conf/yacad_conf.h"
+#include "runner/engine/yacad_engine.h"
 #include "common/zmq/yacad_zmq.h"
 
-#define INPROC_RUN_ADDRESS "inproc://scheduler-run"
-#define MSG_STOP  "stop"
-#define MSG_EVENT "event"
-
 static yacad_conf_t *conf = NULL;
+static yacad_engine_t *engine = NULL;
 static bool_t running = true;
 
 static void handle_signal(int sig) {
@@ -32,9 +30,18 @@ static void handle_signal(int sig) {
           conf->log(info, "Received signal %d: %s", sig, strsignal(sig));
      }
      running = false;
+     if (engine != NULL) {
+          engine->stop(engine);
+     }
 }
 
 static void run() {
+     engine = yacad_engine_new(conf);
+     if (running) {
+          engine->run(engine);
+     }
+     engine->free(engine);
+     engine = NULL;
 }
 
 int main(int argc, const char * const *argv) {
@@ -0,0 +1,87 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/**
+ * @file Cost of yacad_cron::next, computed from scratch and from the cache.
+ */
+
+#include "test.h"
+
+#include "common/cron/yacad_cron.h"
+
+#define CALLS 1000000
+
+static const char *specs[] = {
+     "* * * * *",
+     "*/5 * * * *",
+     "0 3 1 */6 *",
+     "0 0 29 1 *",
+     "*/15 8-17 * * 1-5",
+     NULL
+};
+
+static struct tm current;
+
+static struct tm get_current_minute(void) {
+     return current;
+}
+
+static long elapsed_us(struct timeval *start) {
+     struct timeval now, elapsed;
+     gettimeofday(&now, NULL);
+     timersub(&now, start, &elapsed);
+     return elapsed.tv_sec * 1000000L + elapsed.tv_usec;
+}
+
+int test(void) {
+     int result = 0;
+     logger_t log = get_logger(warn);
+     yacad_cron_t *cron;
+     struct timeval start, next;
+     time_t t0 = 1420070400, t;
+     long walking, cached;
+     int i, s;
+
+     set_get_current_minute_fn(get_current_minute);
+
+     for (s = 0; specs[s] != NULL; s++) {
+          cron = yacad_cron_parse(log, specs[s], NULL, 0);
+
+          // a new minute at each call: computed again each time the clock passes the last result
+          gettimeofday(&start, NULL);
+          for (i = 0; i < CALLS; i++) {
+               t = t0 + 60L * i;
+               localtime_r(&t, &current);
+               next = cron->next(cron);
+          }
+          walking = elapsed_us(&start);
+          assert(next.tv_sec > t);
+
+          // the same minute: the cache answers
+          gettimeofday(&start, NULL);
+          for (i = 0; i < CALLS; i++) {
+               next = cron->next(cron);
+          }
+          cached = elapsed_us(&start);
+
+          fprintf(stderr, "%-20s %d calls: %ld ms walking the clock (%ld ns/call, localtime included), %ld ms on the same minute\n",
+                  specs[s], CALLS, walking / 1000, walking * 1000 / CALLS, cached / 1000);
+          cron->free(cron);
+     }
+
+     return result;
+}
@@ -0,0 +1,122 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/**
+ * @file Time-to-first-dispatch after a restart with many pending tasks.
+ */
+
+#include "test.h"
+
+#include "common/database/yacad_database.h"
+#include "common/runnerid/yacad_runnerid.h"
+#include "core/stats/yacad_stats.h"
+#include "core/tasklist/yacad_tasklist.h"
+#include "core/tasklist/yacad_taskstore_sqlite3.h"
+
+#define DATABASE_NAME "bench_tasklist_restore.db"
+#define TASK_COUNT 50000
+
+#define STMT_INSERT "insert into TASKLIST (STATUS,SERIAL,PROJECT,TIMESTAMP) values (?,?,?,?)"
+#define TASK_SERIAL "{\"id\":0,\"timestamp\":%ld,\"status\":0,\"taskindex\":0," \
+     "\"task\":{\"source\":{\"type\":\"scm\",\"ref\":\"%08d\"},\"runner\":{\"arch\":\"foo\"},\"run\":{\"type\":\"spawn\",\"command\":\"make\"}}," \
+     "\"project_name\":\"bench\",\"env\":{\"ref\":\"%08d\",\"branch\":\"master\"}}"
+
+static void run_statement(yacad_database_t *db, const char *statement) {
+     yacad_statement_t *stmt = db->update(db, statement);
+     if (stmt != NULL) {
+          stmt->run(stmt, NULL, NULL);
+          stmt->free(stmt);
+     }
+}
+
+static void fill_database(logger_t log) {
+     yacad_database_t *db = yacad_database_new(log, DATABASE_NAME);
+     yacad_taskstore_t *store = yacad_taskstore_sqlite3_new(log, db, DATABASE_NAME); // installs the tables
+     yacad_statement_t *stmt;
+     char serial[1024];
+     time_t now = time(NULL);
+     int i;
+
+     store->free(store);
+
+     run_statement(db, "begin");
+     for (i = 0; i < TASK_COUNT; i++) {
+          snprintf(serial, 1024, TASK_SERIAL, (long)now, i, i);
+          stmt = db->update(db, STMT_INSERT);
+          stmt->bind_int(stmt, 0, 0);
+          stmt->bind_string(stmt, 1, serial);
+          stmt->bind_string(stmt, 2, "bench");
+          stmt->bind_int(stmt, 3, (long)now);
+          stmt->run(stmt, NULL, NULL);
+          stmt->free(stmt);
+     }
+     run_statement(db, "commit");
+
+     db->free(db);
+}
+
+static long elapsed_ms(struct timeval *start) {
+     struct timeval now, elapsed;
+     gettimeofday(&now, NULL);
+     timersub(&now, start, &elapsed);
+     return elapsed.tv_sec * 1000L + elapsed.tv_usec / 1000L;
+}
+
+int test(void) {
+     int result = 0;
+     logger_t log = get_logger(warn);
+     yacad_database_t *db;
+     yacad_taskstore_t *store;
+     yacad_stats_t *stats;
+     yacad_tasklist_t *tasklist;
+     yacad_runnerid_t *runnerid;
+     yacad_task_t *task = NULL;
+     struct timeval start;
+     long ready, dispatch;
+
+     unlink(DATABASE_NAME);
+     fill_database(log);
+
+     runnerid = yacad_runnerid_unserialize(log, "{\"name\":\"bench\",\"arch\":\"foo\"}");
+
+     gettimeofday(&start, NULL);
+     db = yacad_database_new(log, DATABASE_NAME);
+     store = yacad_taskstore_sqlite3_new(log, db, DATABASE_NAME);
+     stats = yacad_stats_new(log, db);
+     tasklist = yacad_tasklist_new(log, store, stats, tasklist_fifo);
+     ready = elapsed_ms(&start);
+     while (task == NULL) {
+          task = tasklist->get(tasklist, runnerid, NULL);
+          if (task == NULL) {
+               usleep(1000);
+          }
+     }
+     dispatch = elapsed_ms(&start);
+
+     assert(task->get_id(task) == 1);
+     fprintf(stderr, "%d pending tasks: tasklist ready in %ld ms, first dispatch in %ld ms\n", TASK_COUNT, ready, dispatch);
+
+     task->free(task);
+     tasklist->free(tasklist);
+     store->free(store);
+     stats->free(stats);
+     db->free(db);
+     runnerid->free(runnerid);
+     unlink(DATABASE_NAME);
+
+     return result;
+}
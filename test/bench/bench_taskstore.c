@@ -0,0 +1,101 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file Tasklist storage backends: sqlite vs. append-only log.
+ */
+
+#include "test.h"
+
+#include "common/database/yacad_database.h"
+#include "core/tasklist/yacad_taskstore_log.h"
+#include "core/tasklist/yacad_taskstore_sqlite3.h"
+
+#define DATABASE_NAME "bench_taskstore.db"
+#define TASKLOG_NAME "bench_taskstore.log"
+#define TASK_COUNT 2000
+
+#define TASK_SERIAL "{\"id\":0,\"timestamp\":%ld,\"status\":0,\"taskindex\":0," \
+     "\"task\":{\"source\":{\"type\":\"scm\",\"ref\":\"%08d\"},\"runner\":{\"arch\":\"foo\"},\"run\":{\"type\":\"spawn\",\"command\":\"make\"}}," \
+     "\"project_name\":\"bench\",\"env\":{\"ref\":\"%08d\",\"branch\":\"master\"}}"
+
+static long elapsed_ms(struct timeval *start) {
+     struct timeval now, elapsed;
+     gettimeofday(&now, NULL);
+     timersub(&now, start, &elapsed);
+     return elapsed.tv_sec * 1000L + elapsed.tv_usec / 1000L;
+}
+
+static void count_task(unsigned long id, yacad_task_status_t status, const char *serial, int *count) {
+     (*count)++;
+}
+
+/* the same workload as the tasklist: add tasks, then mark them done */
+static int run(logger_t log, const char *name, yacad_taskstore_t *store) {
+     int result = 0;
+     char serial[1024];
+     time_t now = time(NULL);
+     struct timeval start;
+     long insert_ms, update_ms, restore_ms;
+     unsigned long id;
+     int i, count = 0;
+
+     gettimeofday(&start, NULL);
+     for (i = 0; i < TASK_COUNT; i++) {
+          snprintf(serial, 1024, TASK_SERIAL, (long)now, i, i);
+          id = store->insert(store, task_new, serial, "bench", now);
+          assert(id == (unsigned long)i + 1);
+     }
+     insert_ms = elapsed_ms(&start);
+
+     gettimeofday(&start, NULL);
+     for (i = 0; i < TASK_COUNT; i += 2) {
+          store->set_status(store, i + 1, task_done, now);
+     }
+     update_ms = elapsed_ms(&start);
+
+     gettimeofday(&start, NULL);
+     store->restore(store, 0, store->get_max_id(store), TASK_COUNT, (yacad_taskstore_restore_cb)count_task, &count);
+     restore_ms = elapsed_ms(&start);
+     assert(count == TASK_COUNT / 2);
+
+     fprintf(stderr, "%-6s: %d inserts in %ld ms, %d updates in %ld ms, restore in %ld ms\n", name, TASK_COUNT, insert_ms, TASK_COUNT / 2, update_ms, restore_ms);
+
+     return result;
+}
+
+int test(void) {
+     int result = 0;
+     logger_t log = get_logger(warn);
+     yacad_database_t *db;
+     yacad_taskstore_t *store;
+
+     unlink(DATABASE_NAME);
+     db = yacad_database_new(log, DATABASE_NAME);
+     store = yacad_taskstore_sqlite3_new(log, db, DATABASE_NAME);
+     result += run(log, "sqlite", store);
+     store->free(store);
+     db->free(db);
+     unlink(DATABASE_NAME);
+
+     unlink(TASKLOG_NAME);
+     store = yacad_taskstore_log_new(log, TASKLOG_NAME, 0);
+     result += run(log, "log", store);
+     store->free(store);
+     unlink(TASKLOG_NAME);
+
+     return result;
+}
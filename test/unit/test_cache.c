@@ -0,0 +1,195 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fcntl.h>
+#include <ftw.h>
+
+#include "test.h"
+
+#include "core/cache/yacad_cache.h"
+
+#define ARTIFACTS_PATH "test_cache.artifacts"
+#define TASK_SERIAL "{\"id\":0,\"timestamp\":0,\"status\":0,\"taskindex\":0," \
+     "\"task\":{\"source\":{\"type\":\"scm\"},\"runner\":{\"arch\":\"foo\"},\"run\":{\"type\":\"spawn\",\"command\":\"make\",\"cache\":%s}}," \
+     "\"project_name\":\"foo\",\"env\":{\"ref\":\"%s\"}}"
+
+typedef struct {
+     yacad_conf_t fn;
+} conf_t;
+
+static const char *get_artifacts_path(conf_t *this) {
+     return ARTIFACTS_PATH;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+     return remove(path);
+}
+
+static void clean(void) {
+     nftw(ARTIFACTS_PATH, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+static yacad_cache_t *new_cache(logger_t log, conf_t *conf) {
+     memset(conf, 0, sizeof(conf_t));
+     conf->fn.log = log;
+     conf->fn.get_artifacts_path = (yacad_conf_get_artifacts_path_fn)get_artifacts_path;
+     clean();
+     mkdir(ARTIFACTS_PATH, 0755);
+     mkdir(ARTIFACTS_PATH "/tasks", 0755);
+     return yacad_cache_new(I(conf));
+}
+
+static yacad_task_t *new_task(logger_t log, bool_t cache, const char *ref, unsigned long id) {
+     char serial[1024];
+     yacad_task_t *result;
+     snprintf(serial, sizeof(serial), TASK_SERIAL, cache ? "true" : "false", ref);
+     result = yacad_task_unserialize(log, serial);
+     result->set_id(result, id);
+     return result;
+}
+
+static void write_file(const char *path, const char *content) {
+     int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+     if (fd >= 0) {
+          if (write(fd, content, strlen(content)) < 0) {
+               perror(path);
+          }
+          close(fd);
+     }
+}
+
+/* the key of the task after lookup, to free; NULL if none */
+static char *lookup_key(yacad_cache_t *cache, yacad_task_t *task, unsigned long upstream) {
+     cad_hash_t *env;
+     const char *key;
+     cache->lookup(cache, task, upstream);
+     env = task->get_env(task);
+     key = env->get(env, "cache_key");
+     return key == NULL ? NULL : strdup(key);
+}
+
+static int test_key(logger_t log) {
+     int result = 0;
+     conf_t conf;
+     yacad_cache_t *cache = new_cache(log, &conf);
+     yacad_task_t *task;
+     char *key, *other;
+
+     task = new_task(log, true, "abc", 1);
+     key = lookup_key(cache, task, 0);
+     assert(key != NULL && strlen(key) == 64);
+     task->free(task);
+
+     // the same task, the same key
+     task = new_task(log, true, "abc", 2);
+     other = lookup_key(cache, task, 0);
+     assert(other != NULL && !strcmp(key, other));
+     free(other);
+     task->free(task);
+
+     // another ref
+     task = new_task(log, true, "abd", 3);
+     other = lookup_key(cache, task, 0);
+     assert(other != NULL && strcmp(key, other));
+     free(other);
+     task->free(task);
+
+     // another upstream manifest
+     write_file(ARTIFACTS_PATH "/tasks/7.manifest", "{\"a\":\"0123\"}");
+     task = new_task(log, true, "abc", 4);
+     other = lookup_key(cache, task, 7);
+     assert(other != NULL && strcmp(key, other));
+     free(key);
+     key = other;
+     task->free(task);
+     write_file(ARTIFACTS_PATH "/tasks/7.manifest", "{\"a\":\"4567\"}");
+     task = new_task(log, true, "abc", 5);
+     other = lookup_key(cache, task, 7);
+     assert(other != NULL && strcmp(key, other));
+     free(other);
+     task->free(task);
+
+     // not cached
+     task = new_task(log, false, "abc", 6);
+     assert(lookup_key(cache, task, 0) == NULL);
+     task->free(task);
+
+     free(key);
+     cache->free(cache);
+     clean();
+     return result;
+}
+
+static int test_lookup(logger_t log) {
+     int result = 0;
+     conf_t conf;
+     yacad_cache_t *cache = new_cache(log, &conf);
+     yacad_task_t *task;
+     struct stat st;
+
+     // miss, then stored
+     task = new_task(log, true, "abc", 5);
+     assert(cache->lookup(cache, task, 0) == 0);
+     cache->store(cache, task);
+     task->free(task);
+
+     // hit
+     task = new_task(log, true, "abc", 6);
+     assert(cache->lookup(cache, task, 0) == 5);
+     task->free(task);
+     task = new_task(log, true, "abd", 6);
+     assert(cache->lookup(cache, task, 0) == 0);
+     task->free(task);
+
+     // with artifacts: a hit as long as they are there
+     mkdir(ARTIFACTS_PATH "/tasks/8", 0755);
+     mkdir(ARTIFACTS_PATH "/tasks/8/dir", 0755);
+     write_file(ARTIFACTS_PATH "/tasks/8/dir/file", "data");
+     write_file(ARTIFACTS_PATH "/tasks/8.manifest", "{\"dir/file\":\"0123\"}");
+     task = new_task(log, true, "xyz", 8);
+     assert(cache->lookup(cache, task, 0) == 0);
+     cache->store(cache, task);
+     task->free(task);
+
+     task = new_task(log, true, "xyz", 9);
+     assert(cache->lookup(cache, task, 0) == 8);
+     cache->reuse(cache, task, 8);
+     task->free(task);
+     // the pending links are made before free returns
+     cache->free(cache);
+     assert(stat(ARTIFACTS_PATH "/tasks/9/dir/file", &st) == 0 && st.st_nlink == 2);
+     assert(stat(ARTIFACTS_PATH "/tasks/9.manifest", &st) == 0);
+
+     cache = yacad_cache_new(I(&conf));
+     unlink(ARTIFACTS_PATH "/tasks/8.manifest");
+     task = new_task(log, true, "xyz", 10);
+     assert(cache->lookup(cache, task, 0) == 0);
+     task->free(task);
+
+     cache->free(cache);
+     clean();
+     return result;
+}
+
+int test(void) {
+     int result = 0;
+     logger_t log = get_logger(warn);
+
+     result += test_key(log);
+     result += test_lookup(log);
+
+     return result;
+}
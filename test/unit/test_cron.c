@@ -63,7 +63,7 @@ static int run_test(const char *format, int min, int hour, int mday, int mon, in
      t = mktime(&expected);
      localtime_r(&t, &expected);
 
-     cron = yacad_cron_parse(log, format);
+     cron = yacad_cron_parse(log, format, NULL, 0);
 
      tv = cron->next(cron);
      localtime_r(&tv.tv_sec, &actual);
@@ -79,13 +79,219 @@ static int run_test(const char *format, int min, int hour, int mday, int mon, in
           && expected.tm_year == actual.tm_year;
 }
 
+/**
+ * The exhaustive check: the "current minute" walks forward in time
+ */
+static struct tm scan_minute;
+
+static struct tm scan_get_current_minute_fn(void) {
+     return scan_minute;
+}
+
+typedef struct {
+     const char *format;
+     unsigned long min, hour, dom, mon, dow; // the expected bits, as the parser sets them
+} spec_t;
+
+#define ALL(n) ((1UL << (n)) - 1)
+
+static spec_t specs[] = {
+     { "* * * * *",           ALL(60),           ALL(24),           ALL(31),                ALL(12),           ALL(7) },
+     { "10 * * * *",          1UL << 10,         ALL(24),           ALL(31),                ALL(12),           ALL(7) },
+     { "5,35 */4 10-20 * *",  1UL << 5 | 1UL << 35, 0x111111UL,     ALL(21) & ~ALL(10),     ALL(12),           ALL(7) },
+     { "0 0 29 * *",          1UL,               1UL,               1UL << 29,              ALL(12),           ALL(7) },
+     { "0 3 1 */6 *",         1UL,               1UL << 3,          1UL << 1,               1UL | 1UL << 6,    ALL(7) },
+     { "*/15 8-17 * * 1-5",   1UL | 1UL << 15 | 1UL << 30 | 1UL << 45, ALL(18) & ~ALL(8), ALL(31),           ALL(12),           ALL(7) & ~1UL & ~(1UL << 6) },
+     { "30 12 * * 0",         1UL << 30,         1UL << 12,         ALL(31),                ALL(12),           1UL },
+     { "0 0 29 1 *",          1UL,               1UL,               1UL << 29,              1UL << 1,          ALL(7) },
+     { "0 0 13 * 5",          1UL,               1UL,               1UL << 13,              ALL(12),           1UL << 5 },
+     { NULL },
+};
+
+static bool_t matches(spec_t *spec, struct tm *tm) {
+     return ((spec->min >> tm->tm_min) & 1UL)
+          && ((spec->hour >> tm->tm_hour) & 1UL)
+          && ((spec->dom >> tm->tm_mday) & 1UL)
+          && ((spec->mon >> tm->tm_mon) & 1UL)
+          && ((spec->dow >> tm->tm_wday) & 1UL);
+}
+
+/* The reference: a plain scan, skipping the days and hours that cannot match */
+static time_t scan_next(spec_t *spec, time_t t) {
+     struct tm tm;
+     t += 60;
+     for (localtime_r(&t, &tm); !matches(spec, &tm); localtime_r(&t, &tm)) {
+          if (!((spec->mon >> tm.tm_mon) & 1UL) || !((spec->dom >> tm.tm_mday) & 1UL) || !((spec->dow >> tm.tm_wday) & 1UL)) {
+               t += 60 * (60 * (24 - tm.tm_hour) - tm.tm_min);
+          } else if (!((spec->hour >> tm.tm_hour) & 1UL)) {
+               t += 60 * (60 - tm.tm_min);
+          } else {
+               t += 60;
+          }
+     }
+     return t;
+}
+
+/* The previous implementation, which only terminates when all the months and weekdays match */
+static bool_t old_lookup(unsigned long field, int *min, int max) {
+     int i;
+     bool_t result = false, done = false;
+     if ((field >> *min) & 1UL) {
+          result = true;
+     } else {
+          for (i = *min + 1; !done && i < max; i++) {
+               if ((field >> i) & 1UL) {
+                    *min = i;
+                    done = true;
+               }
+          }
+          if (!done) {
+               (*min)++;
+          }
+     }
+     return result;
+}
+
+static time_t old_next(spec_t *spec, struct tm tm) {
+     time_t t;
+     bool_t done = false;
+     tm.tm_min++;
+     do {
+          t = mktime(&tm);
+          localtime_r(&t, &tm);
+          if (!old_lookup(spec->mon, &(tm.tm_mon), 12)) {
+               tm.tm_mday = tm.tm_wday = tm.tm_hour = tm.tm_min = 0;
+          } else if (!old_lookup(spec->dom, &(tm.tm_mday), 31)) {
+               tm.tm_hour = tm.tm_min = 0;
+          } else if (!old_lookup(spec->dow, &(tm.tm_wday), 7)) {
+               tm.tm_hour = tm.tm_min = 0;
+          } else if (!old_lookup(spec->hour, &(tm.tm_hour), 24)) {
+               tm.tm_min = 0;
+          } else if (!old_lookup(spec->min, &(tm.tm_min), 60)) {
+          } else {
+               done = true;
+          }
+     } while (!done);
+     return mktime(&tm);
+}
+
+/* Compares all the specs from start, by steps of step minutes */
+static int run_scan(logger_t log, time_t start, int step, int count) {
+     int result = 0;
+     spec_t *spec;
+     yacad_cron_t *cron;
+     time_t t, expected;
+     struct timeval actual;
+     int i;
+
+     for (spec = specs; spec->format != NULL; spec++) {
+          cron = yacad_cron_parse(log, spec->format, NULL, 0);
+          for (i = 0, t = start; i < count; i++, t += 60 * step) {
+               localtime_r(&t, &scan_minute);
+               actual = cron->next(cron);
+               expected = scan_next(spec, t);
+               if (actual.tv_sec != expected) {
+                    log(warn, "%s from %ld: expected %ld, got %ld", spec->format, (long)t, (long)expected, (long)actual.tv_sec);
+                    result++;
+               } else if (spec->mon == ALL(12) && spec->dow == ALL(7) && old_next(spec, scan_minute) != expected) {
+                    log(warn, "%s from %ld: the previous implementation disagrees", spec->format, (long)t);
+                    result++;
+               }
+          }
+          cron->free(cron);
+     }
+
+     return result;
+}
+
+/* "H" fields: stable for a key, within their range, and spread over the keys */
+static int run_hash(logger_t log) {
+     int result = 0;
+     yacad_cron_t *cron1, *cron2;
+     struct timeval tv1, tv2;
+     struct tm tm;
+     char key[16];
+     unsigned long seen = 0;
+     time_t t = 1420070400; // 2015-01-01 00:00
+     int i;
+
+     localtime_r(&t, &scan_minute);
+     for (i = 0; i < 100; i++) {
+          snprintf(key, 16, "project%d", i);
+          cron1 = yacad_cron_parse(log, "H(10-29) * * * *", key, 0);
+          cron2 = yacad_cron_parse(log, "H(10-29) * * * *", key, 0);
+          tv1 = cron1->next(cron1);
+          tv2 = cron2->next(cron2);
+          localtime_r(&tv1.tv_sec, &tm);
+          assert(tv1.tv_sec == tv2.tv_sec);
+          assert(tm.tm_hour == 0 && tm.tm_min >= 10 && tm.tm_min <= 29);
+          seen |= 1UL << tm.tm_min;
+          cron1->free(cron1);
+          cron2->free(cron2);
+
+          cron1 = yacad_cron_parse(log, "* * * * *", key, 30);
+          tv1 = cron1->next(cron1);
+          assert(tv1.tv_sec >= t + 60 && tv1.tv_sec <= t + 90);
+          cron1->free(cron1);
+     }
+     assert(__builtin_popcountl(seen) >= 15);
+
+     return result;
+}
+
+/* The seconds field and the "@every" intervals */
+static int run_seconds(logger_t log) {
+     int result = 0;
+     yacad_cron_t *cron;
+     time_t t = 1420070405; // 2015-01-01 00:00:05
+
+     localtime_r(&t, &scan_minute);
+
+     cron = yacad_cron_parse(log, "*/10 * * * * *", NULL, 0);
+     assert(cron->next(cron).tv_sec == t + 5);
+     cron->free(cron);
+
+     cron = yacad_cron_parse(log, "0 30 0 * * *", NULL, 0);
+     assert(cron->next(cron).tv_sec == t - 5 + 30 * 60);
+     cron->free(cron);
+
+     cron = yacad_cron_parse(log, "0 * * * * *", NULL, 0);
+     assert(cron->next(cron).tv_sec == t + 55);
+     cron->free(cron);
+
+     cron = yacad_cron_parse(log, "@every 10s", NULL, 0);
+     assert(cron->next(cron).tv_sec == t + 10);
+     cron->free(cron);
+
+     cron = yacad_cron_parse(log, "@every 1h30m", NULL, 0);
+     assert(cron->next(cron).tv_sec == t + 5400);
+     cron->free(cron);
+
+     assert(yacad_cron_parse(log, "@every 0s", NULL, 0) == NULL);
+
+     return result;
+}
+
 int test(void) {
      int result = 0;
+     logger_t log = get_logger(info);
      set_get_current_minute_fn(mock_get_current_minute_fn);
 
      assert(run_test("* * * * *", 2, 1, 1, 1, 2015));
      assert(run_test("10 * * * *", 10, 1, 1, 1, 2015));
      assert(run_test("1 * * * *", 1, 2, 1, 1, 2015));
+     assert(run_test("0 3 1 */6 *", 0, 3, 1, 6, 2015));
+     assert(run_test("0 0 29 1 *", 0, 0, 29, 1, 2016));
+
+     setenv("TZ", "UTC", 1);
+     tzset();
+     set_get_current_minute_fn(scan_get_current_minute_fn);
+
+     // every 61 minutes around a leap day (2016-01-15 to 2016-03-15), then every 7919 minutes for ten years
+     assert(run_scan(log, 1452816000, 61, 1416) == 0);
+     assert(run_scan(log, 1420070400, 7919, 664) == 0);
+     assert(run_hash(log) == 0);
+     assert(run_seconds(log) == 0);
 
      return result;
 }
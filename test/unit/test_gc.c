@@ -0,0 +1,220 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fcntl.h>
+#include <ftw.h>
+
+#include "test.h"
+
+#include "core/gc/yacad_gc.h"
+#include "core/tasklist/yacad_taskstore_sqlite3.h"
+
+#define ARTIFACTS_PATH "test_gc.artifacts"
+#define DATABASE_NAME "test_gc.db"
+#define MIB 1048576
+
+typedef struct {
+     yacad_conf_t fn;
+     const char *storage;
+     long quota, project_quota;
+} conf_t;
+
+static const char *get_database_name(conf_t *this) {
+     return DATABASE_NAME;
+}
+
+static const char *get_artifacts_path(conf_t *this) {
+     return ARTIFACTS_PATH;
+}
+
+static long get_gc_quota(conf_t *this) {
+     return this->quota;
+}
+
+static long get_gc_project_quota(conf_t *this) {
+     return this->project_quota;
+}
+
+static long get_gc_rate(conf_t *this) {
+     return 1024;
+}
+
+static const char *get_storage(conf_t *this) {
+     return this->storage;
+}
+
+static void init_conf(conf_t *conf, logger_t log, const char *storage, long quota, long project_quota) {
+     memset(conf, 0, sizeof(conf_t));
+     conf->fn.log = log;
+     conf->fn.get_database_name = (yacad_conf_get_database_name_fn)get_database_name;
+     conf->fn.get_artifacts_path = (yacad_conf_get_artifacts_path_fn)get_artifacts_path;
+     conf->fn.get_gc_quota = (yacad_conf_get_gc_quota_fn)get_gc_quota;
+     conf->fn.get_gc_project_quota = (yacad_conf_get_gc_project_quota_fn)get_gc_project_quota;
+     conf->fn.get_gc_rate = (yacad_conf_get_gc_rate_fn)get_gc_rate;
+     conf->fn.get_storage = (yacad_conf_get_storage_fn)get_storage;
+     conf->storage = storage;
+     conf->quota = quota;
+     conf->project_quota = project_quota;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+     return remove(path);
+}
+
+static void clean(void) {
+     nftw(ARTIFACTS_PATH, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+     unlink(DATABASE_NAME);
+}
+
+/* The task artifacts: one MiB object, linked by the task; the older "used", the less recently used */
+static void add_task(unsigned long id, time_t used) {
+     char object[256], task[256];
+     struct timespec times[2] = {{ used, 0 }, { used, 0 }};
+     int fd;
+
+     snprintf(object, sizeof(object), ARTIFACTS_PATH "/objects/00/%016lx", id);
+     fd = open(object, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+     if (fd >= 0) {
+          if (ftruncate(fd, MIB) != 0) {
+               perror(object);
+          }
+          close(fd);
+     }
+     snprintf(task, sizeof(task), ARTIFACTS_PATH "/tasks/%lu", id);
+     mkdir(task, 0755);
+     snprintf(task, sizeof(task), ARTIFACTS_PATH "/tasks/%lu/file", id);
+     link(object, task);
+     snprintf(task, sizeof(task), ARTIFACTS_PATH "/tasks/%lu", id);
+     utimensat(AT_FDCWD, task, times, 0);
+}
+
+static bool_t has_task(unsigned long id) {
+     char task[256];
+     struct stat st;
+     snprintf(task, sizeof(task), ARTIFACTS_PATH "/tasks/%lu", id);
+     return stat(task, &st) == 0;
+}
+
+static void init_artifacts(void) {
+     clean();
+     mkdir(ARTIFACTS_PATH, 0755);
+     mkdir(ARTIFACTS_PATH "/objects", 0755);
+     mkdir(ARTIFACTS_PATH "/objects/00", 0755);
+     mkdir(ARTIFACTS_PATH "/tasks", 0755);
+}
+
+/* Runs the slices until the cycle is over, i.e. the next slice is the next cycle */
+static void run_cycle(yacad_gc_t *gc) {
+     struct timeval now;
+     int i;
+
+     for (i = 0; i < 100; i++) {
+          gc->run_slice(gc);
+          gettimeofday(&now, NULL);
+          if (gc->next_slice(gc).tv_sec > now.tv_sec + 60) {
+               i = 100;
+          }
+     }
+}
+
+static int test_quota(logger_t log) {
+     int result = 0;
+     conf_t conf;
+     yacad_gc_t *gc;
+     time_t now = time(NULL);
+
+     init_artifacts();
+     add_task(1, now - 100);
+     add_task(2, now - 400);
+     add_task(3, now - 300);
+     add_task(4, now - 200);
+
+     // 4 MiB, 2 MiB allowed: the least recently used go first, whatever their id
+     init_conf(&conf, log, "log", 2, 0);
+     gc = yacad_gc_new(I(&conf));
+     assert(gc != NULL);
+     run_cycle(gc);
+     gc->free(gc);
+
+     assert(has_task(1));
+     assert(!has_task(2));
+     assert(!has_task(3));
+     assert(has_task(4));
+
+     clean();
+     return result;
+}
+
+static int test_project_quota(logger_t log) {
+     int result = 0;
+     conf_t conf;
+     yacad_database_t *database;
+     yacad_taskstore_t *store;
+     yacad_gc_t *gc;
+     time_t now = time(NULL);
+
+     init_artifacts();
+     database = yacad_database_new(log, DATABASE_NAME);
+     store = yacad_taskstore_sqlite3_new(log, database, DATABASE_NAME);
+     assert(store->insert(store, task_done, "{}", "foo", now) == 1);
+     assert(store->insert(store, task_done, "{}", "foo", now) == 2);
+     assert(store->insert(store, task_done, "{}", "foo", now) == 3);
+     assert(store->insert(store, task_done, "{}", "bar", now) == 4);
+
+     add_task(3, now - 500);
+     add_task(1, now - 400);
+     add_task(2, now - 300);
+     add_task(4, now - 200);
+     // not in TASKLIST any more
+     add_task(5, now - 100);
+
+     // foo is over its 2 MiB: 1 goes, 3 is the last one of foo and is kept
+     init_conf(&conf, log, "sqlite", 0, 2);
+     gc = yacad_gc_new(I(&conf));
+     run_cycle(gc);
+     gc->free(gc);
+
+     assert(!has_task(1));
+     assert(has_task(2));
+     assert(has_task(3));
+     assert(has_task(4));
+     assert(!has_task(5));
+
+     // over the global quota, the last tasks of each project are kept
+     init_conf(&conf, log, "sqlite", 1, 0);
+     gc = yacad_gc_new(I(&conf));
+     run_cycle(gc);
+     gc->free(gc);
+
+     assert(!has_task(2));
+     assert(has_task(3));
+     assert(has_task(4));
+
+     store->free(store);
+     database->free(database);
+     clean();
+     return result;
+}
+
+int test(void) {
+     int result = 0;
+     logger_t log = get_logger(warn);
+
+     result += test_quota(log);
+     result += test_project_quota(log);
+
+     return result;
+}
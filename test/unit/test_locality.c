@@ -0,0 +1,84 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+#include "common/locality/yacad_locality.h"
+
+static yacad_locality_t *reparse(logger_t log, yacad_locality_t *locality) {
+     yacad_locality_t *result;
+     char *serial = locality->serialize(locality);
+     json_input_stream_t *stream = new_json_input_stream_from_string(serial, stdlib_memory);
+     json_value_t *desc = json_parse(stream, NULL, stdlib_memory);
+
+     result = yacad_locality_unserialize(log, desc);
+     desc->free(desc);
+     stream->free(stream);
+     free(serial);
+     return result;
+}
+
+static int test_serialize(logger_t log) {
+     int result = 0;
+     yacad_locality_t *locality = yacad_locality_new(), *ser;
+
+     locality->add_workspace(locality, "foo");
+     locality->add_workspace(locality, "foo");
+     locality->add_workspace(locality, "bar \"baz\"\\");
+     locality->add_artifact(locality, "abc");
+     ser = reparse(log, locality);
+     assert(ser->has_workspace(ser, "foo"));
+     assert(ser->has_workspace(ser, "bar \"baz\"\\"));
+     assert(!ser->has_workspace(ser, "bar"));
+     assert(ser->has_artifact(ser, "abc"));
+     assert(!ser->has_artifact(ser, "foo"));
+     ser->free(ser);
+     locality->free(locality);
+
+     return result;
+}
+
+static int test_eviction(logger_t log) {
+     int result = 0;
+     yacad_locality_t *locality = yacad_locality_new();
+     char hash[16];
+     int i;
+
+     for (i = 0; i <= YACAD_LOCALITY_ARTIFACTS; i++) {
+          snprintf(hash, sizeof(hash), "%d", i);
+          locality->add_artifact(locality, hash);
+          if (i == 1) {
+               // used again: no longer the oldest
+               locality->add_artifact(locality, "0");
+          }
+     }
+     assert(locality->has_artifact(locality, "0"));
+     assert(!locality->has_artifact(locality, "1"));
+     assert(locality->has_artifact(locality, "2"));
+     locality->free(locality);
+
+     return result;
+}
+
+int test(void) {
+     int result = 0;
+     logger_t log = get_logger(info);
+
+     result += test_serialize(log);
+     result += test_eviction(log);
+
+     return result;
+}
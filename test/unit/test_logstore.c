@@ -0,0 +1,156 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+#include "core/logs/yacad_logstore.h"
+
+#define LOGS_PATH "."
+#define TASK_ID 42
+#define LINE_SIZE 12 // "line 000000\n"
+#define LINES 30000
+
+static char *expected;
+static size_t expected_size;
+
+static void clean(void) {
+     unlink(LOGS_PATH "/42.idx");
+     unlink(LOGS_PATH "/42.tail");
+     unlink(LOGS_PATH "/42.0.seg");
+     unlink(LOGS_PATH "/42.1.seg");
+}
+
+static void fill(void) {
+     int i;
+
+     expected_size = LINES * LINE_SIZE + 4;
+     expected = malloc(expected_size + 1);
+     for (i = 0; i < LINES; i++) {
+          snprintf(expected + i * LINE_SIZE, LINE_SIZE + 1, "line %06d\n", i);
+     }
+     // the last line has no newline
+     memcpy(expected + LINES * LINE_SIZE, "last", 4);
+}
+
+static int check_reads(yacad_logstore_t *store, size_t size) {
+     int result = 0;
+     char buffer[100000];
+     size_t offsets[] = { 0, 1, 65535, 65536, 65537, 131000, 200000, 359990, size - 10 };
+     size_t i, n;
+
+     assert(store->get_size(store) == size);
+     for (i = 0; i < sizeof(offsets) / sizeof(size_t); i++) {
+          if (offsets[i] < size) {
+               n = store->read(store, offsets[i], buffer, sizeof(buffer));
+               assert(n == (size - offsets[i] < sizeof(buffer) ? size - offsets[i] : sizeof(buffer)));
+               assert(!memcmp(buffer, expected + offsets[i], n));
+          }
+     }
+     return result;
+}
+
+static int check_lines(yacad_logstore_t *store, size_t lines) {
+     int result = 0;
+     size_t samples[] = { 0, 1, 5461, 5462, 10000, 29999 };
+     size_t i;
+
+     for (i = 0; i < sizeof(samples) / sizeof(size_t); i++) {
+          if (samples[i] < lines) {
+               assert(store->line_offset(store, samples[i]) == samples[i] * LINE_SIZE);
+          }
+     }
+     assert(store->line_offset(store, lines + 10) == store->get_size(store));
+     return result;
+}
+
+static int test_write_read(logger_t log) {
+     int result = 0;
+     yacad_logstore_t *writer, *reader;
+     size_t done, n, half = 15000 * LINE_SIZE;
+
+     clean();
+     writer = yacad_logstore_new(log, LOGS_PATH, TASK_ID);
+     assert(writer != NULL);
+
+     // odd chunk sizes, across the segment boundaries
+     for (done = 0, n = 1; done < half; done += n, n = (n * 7 + 3) % 20000) {
+          if (n > half - done) {
+               n = half - done;
+          }
+          writer->append(writer, expected + done, n);
+     }
+
+     // while the task runs: the sealed segments and the tail
+     reader = yacad_logstore_open(log, LOGS_PATH, TASK_ID);
+     assert(reader != NULL);
+     assert(reader->get_state(reader) == logstore_open);
+     result += check_reads(reader, half);
+     result += check_lines(reader, 15000);
+     assert(reader->tail(reader, 200) == half - 200 * LINE_SIZE);
+     reader->free(reader);
+
+     writer->append(writer, expected + half, expected_size - half);
+     writer->complete(writer);
+     writer->free(writer);
+
+     reader = yacad_logstore_open(log, LOGS_PATH, TASK_ID);
+     assert(reader->get_state(reader) == logstore_complete);
+     result += check_reads(reader, expected_size);
+     result += check_lines(reader, LINES);
+     // the last line without its newline is one of the 200
+     assert(reader->tail(reader, 200) == (LINES - 199) * LINE_SIZE);
+     assert(reader->tail(reader, LINES + 100) == 0);
+     reader->free(reader);
+
+     return result;
+}
+
+static int test_compact(logger_t log) {
+     int result = 0;
+     yacad_logstore_t *writer, *reader, *before;
+
+     writer = yacad_logstore_new(log, LOGS_PATH, TASK_ID);
+     before = yacad_logstore_open(log, LOGS_PATH, TASK_ID);
+     assert(writer->compact(writer));
+     assert(!writer->compact(writer));
+     assert(writer->get_state(writer) == logstore_compacted);
+     writer->free(writer);
+
+     // still reading the previous generation
+     result += check_reads(before, expected_size);
+     before->free(before);
+
+     reader = yacad_logstore_open(log, LOGS_PATH, TASK_ID);
+     assert(reader->get_state(reader) == logstore_compacted);
+     result += check_reads(reader, expected_size);
+     result += check_lines(reader, LINES);
+     reader->free(reader);
+
+     clean();
+     return result;
+}
+
+int test(void) {
+     int result = 0;
+     logger_t log = get_logger(warn);
+
+     fill();
+     result += test_write_read(log);
+     result += test_compact(log);
+     free(expected);
+
+     return result;
+}
@@ -0,0 +1,101 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+#include "common/message/yacad_message_visitor.h"
+
+static int test_query(logger_t log) {
+     int result = 0;
+     yacad_task_filter_t filter = { "foo", true, task_done, 1000, 2000, 42, 10 };
+     yacad_message_query_list_tasks_t *query = yacad_message_query_list_tasks_new(log, &filter), *unser;
+     char *serial = I(query)->serialize(I(query));
+     const yacad_task_filter_t *f;
+
+     unser = (yacad_message_query_list_tasks_t *)yacad_message_unserialize(log, serial, NULL);
+     assert(unser != NULL);
+     f = unser->get_filter(unser);
+     assert(f->project != NULL && !strcmp(f->project, "foo"));
+     assert(f->by_status && f->status == task_done);
+     assert(f->since == 1000 && f->until == 2000);
+     assert(f->before == 42 && f->limit == 10);
+     I(unser)->free(I(unser));
+     free(serial);
+     I(query)->free(I(query));
+
+     // the project name is escaped
+     filter.project = "foo \"bar\"\\";
+     query = yacad_message_query_list_tasks_new(log, &filter);
+     serial = I(query)->serialize(I(query));
+     unser = (yacad_message_query_list_tasks_t *)yacad_message_unserialize(log, serial, NULL);
+     assert(unser != NULL);
+     f = unser->get_filter(unser);
+     assert(f->project != NULL && !strcmp(f->project, "foo \"bar\"\\"));
+     I(unser)->free(I(unser));
+     free(serial);
+     I(query)->free(I(query));
+
+     // no filter at all
+     unser = (yacad_message_query_list_tasks_t *)yacad_message_unserialize(log, "{\"type\":\"query_list_tasks\"}", NULL);
+     assert(unser != NULL);
+     f = unser->get_filter(unser);
+     assert(f->project == NULL && !f->by_status);
+     assert(f->since == 0 && f->until == 0 && f->before == 0 && f->limit == 0);
+     I(unser)->free(I(unser));
+
+     return result;
+}
+
+static int test_reply(logger_t log) {
+     int result = 0;
+     yacad_task_summary_t task1 = { 12, task_done, "foo", 1000, 1010, 1015, 1020 };
+     yacad_task_summary_t task2 = { 11, task_new, "bar \"baz\"", 999, 0, 0, 0 };
+     yacad_message_reply_list_tasks_t *reply = yacad_message_reply_list_tasks_new(log), *unser;
+     const yacad_task_summary_t *t;
+     char *serial;
+
+     reply->add(reply, &task1);
+     reply->add(reply, &task2);
+     reply->set_next(reply, 11);
+     serial = I(reply)->serialize(I(reply));
+
+     unser = (yacad_message_reply_list_tasks_t *)yacad_message_unserialize(log, serial, NULL);
+     assert(unser != NULL);
+     assert(unser->count(unser) == 2);
+     assert(unser->get_next(unser) == 11);
+     t = unser->get(unser, 0);
+     assert(t->id == 12 && t->status == task_done && !strcmp(t->project, "foo"));
+     assert(t->timestamp == 1000 && t->dispatched == 1010 && t->eta == 1015 && t->finished == 1020);
+     t = unser->get(unser, 1);
+     assert(t->id == 11 && t->status == task_new && !strcmp(t->project, "bar \"baz\""));
+     assert(t->timestamp == 999 && t->dispatched == 0 && t->eta == 0 && t->finished == 0);
+
+     I(unser)->free(I(unser));
+     free(serial);
+     I(reply)->free(I(reply));
+
+     return result;
+}
+
+int test(void) {
+     int result = 0;
+     logger_t log = get_logger(info);
+
+     result += test_query(log);
+     result += test_reply(log);
+
+     return result;
+}
@@ -0,0 +1,214 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+#include "core/retention/yacad_retention.h"
+#include "core/tasklist/yacad_taskstore_sqlite3.h"
+
+#define DATABASE_NAME "test_retention.db"
+#define ARCHIVE_NAME "test_retention_archive.db"
+#define DAY 86400
+
+typedef struct {
+     yacad_conf_t fn;
+     int builds, days;
+} conf_t;
+
+static const char *get_database_name(conf_t *this) {
+     return DATABASE_NAME;
+}
+
+static const char *get_archive_name(conf_t *this) {
+     return ARCHIVE_NAME;
+}
+
+static int get_retention_builds(conf_t *this) {
+     return this->builds;
+}
+
+static int get_retention_days(conf_t *this) {
+     return this->days;
+}
+
+static void init_conf(conf_t *conf, logger_t log, int builds, int days) {
+     memset(conf, 0, sizeof(conf_t));
+     conf->fn.log = log;
+     conf->fn.get_database_name = (yacad_conf_get_database_name_fn)get_database_name;
+     conf->fn.get_archive_name = (yacad_conf_get_archive_name_fn)get_archive_name;
+     conf->fn.get_retention_builds = (yacad_conf_get_retention_builds_fn)get_retention_builds;
+     conf->fn.get_retention_days = (yacad_conf_get_retention_days_fn)get_retention_days;
+     conf->builds = builds;
+     conf->days = days;
+}
+
+static void clean(void) {
+     unlink(DATABASE_NAME);
+     unlink(DATABASE_NAME "-wal");
+     unlink(DATABASE_NAME "-shm");
+     unlink(ARCHIVE_NAME);
+}
+
+static void collect_id(yacad_statement_t *stmt, unsigned long *ids) {
+     ids[++ids[0]] = (unsigned long)stmt->get_int(stmt, 0);
+}
+
+/* ids[0] is the count, the ids follow */
+static void select_ids(yacad_database_t *database, const char *statement, unsigned long *ids) {
+     yacad_statement_t *stmt = database->select(database, statement);
+     ids[0] = 0;
+     if (stmt != NULL) {
+          stmt->run(stmt, (yacad_select_fn)collect_id, ids);
+          stmt->free(stmt);
+     }
+}
+
+static void run_retention(logger_t log, int builds, int days) {
+     conf_t conf;
+     yacad_retention_t *retention;
+
+     init_conf(&conf, log, builds, days);
+     retention = yacad_retention_new(I(&conf));
+     retention->run_slice(retention);
+     retention->free(retention);
+}
+
+static int test_builds(logger_t log) {
+     int result = 0;
+     yacad_database_t *database;
+     yacad_taskstore_t *store;
+     unsigned long ids[16];
+     time_t now = time(NULL);
+
+     clean();
+     database = yacad_database_new(log, DATABASE_NAME);
+     store = yacad_taskstore_sqlite3_new(log, database, DATABASE_NAME);
+     store->insert(store, task_done, "{}", "foo", now);
+     store->insert(store, task_aborted, "{}", "foo", now);
+     store->insert(store, task_done, "{}", "bar", now);
+     store->insert(store, task_done, "{}", "foo", now);
+     store->insert(store, task_done, "{}", "foo", now);
+     // not finished: neither archived nor counted
+     store->insert(store, task_new, "{}", "foo", now);
+
+     // the last two finished builds of each project are kept
+     run_retention(log, 2, 0);
+
+     select_ids(database, "select ID from TASKLIST order by ID", ids);
+     assert(ids[0] == 4);
+     assert(ids[1] == 3 && ids[2] == 4 && ids[3] == 5 && ids[4] == 6);
+
+     store->free(store);
+     database->free(database);
+
+     database = yacad_database_new_readonly(log, ARCHIVE_NAME);
+     select_ids(database, "select ID from TASKARCHIVE order by ID", ids);
+     assert(ids[0] == 2);
+     assert(ids[1] == 1 && ids[2] == 2);
+     database->free(database);
+
+     clean();
+     return result;
+}
+
+static int test_days(logger_t log) {
+     int result = 0;
+     yacad_database_t *database;
+     yacad_taskstore_t *store;
+     unsigned long ids[16];
+     time_t now = time(NULL);
+
+     clean();
+     database = yacad_database_new(log, DATABASE_NAME);
+     store = yacad_taskstore_sqlite3_new(log, database, DATABASE_NAME);
+     store->insert(store, task_done, "{}", "foo", now - 20 * DAY);
+     store->insert(store, task_new, "{}", "foo", now - 20 * DAY);
+     store->insert(store, task_aborted, "{}", "bar", now - 11 * DAY);
+     store->insert(store, task_done, "{}", "foo", now - 5 * DAY);
+     store->insert(store, task_done, "{}", "bar", now);
+     store->insert(store, task_done, "{}", "foo", now - DAY);
+
+     // finished more than ten days ago, whatever the project
+     run_retention(log, 0, 10);
+
+     select_ids(database, "select ID from TASKLIST order by ID", ids);
+     assert(ids[0] == 4);
+     assert(ids[1] == 2 && ids[2] == 4 && ids[3] == 5 && ids[4] == 6);
+
+     // with both: older than ten days, or beyond the last build of its project
+     run_retention(log, 1, 10);
+
+     select_ids(database, "select ID from TASKLIST order by ID", ids);
+     assert(ids[0] == 3);
+     assert(ids[1] == 2 && ids[2] == 5 && ids[3] == 6);
+
+     store->free(store);
+     database->free(database);
+     clean();
+     return result;
+}
+
+static int test_archive_failure(logger_t log) {
+     int result = 0;
+     yacad_database_t *database;
+     yacad_taskstore_t *store;
+     yacad_statement_t *stmt;
+     unsigned long ids[16];
+     time_t now = time(NULL);
+
+     clean();
+     // an archive the rows cannot be inserted into
+     database = yacad_database_new(log, ARCHIVE_NAME);
+     stmt = database->update(database, "create table TASKARCHIVE (ID integer primary key, STATUS integer not null, PROJECT, TIMESTAMP integer, SERIAL not null check (SERIAL<>'{}'))");
+     assert(stmt != NULL && stmt->run(stmt, NULL, NULL));
+     stmt->free(stmt);
+     database->free(database);
+
+     database = yacad_database_new(log, DATABASE_NAME);
+     store = yacad_taskstore_sqlite3_new(log, database, DATABASE_NAME);
+     store->insert(store, task_done, "{\"archived\":true}", "foo", now - 20 * DAY);
+     store->insert(store, task_done, "{}", "foo", now - 20 * DAY);
+     store->insert(store, task_done, "{}", "foo", now);
+
+     // the second task cannot be archived: none is deleted
+     run_retention(log, 0, 10);
+
+     select_ids(database, "select ID from TASKLIST order by ID", ids);
+     assert(ids[0] == 3);
+     assert(ids[1] == 1 && ids[2] == 2 && ids[3] == 3);
+
+     store->free(store);
+     database->free(database);
+
+     database = yacad_database_new_readonly(log, ARCHIVE_NAME);
+     select_ids(database, "select ID from TASKARCHIVE order by ID", ids);
+     assert(ids[0] == 0);
+     database->free(database);
+
+     clean();
+     return result;
+}
+
+int test(void) {
+     int result = 0;
+     logger_t log = get_logger(warn);
+
+     result += test_builds(log);
+     result += test_days(log);
+     result += test_archive_failure(log);
+
+     return result;
+}
@@ -0,0 +1,50 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+#include "common/hash/yacad_sha256.h"
+
+static int check(const char *data, size_t size, int repeat, const char *expected) {
+     int result = 0;
+     yacad_sha256_t sha;
+     char hex[YACAD_SHA256_HEX];
+     int i;
+
+     yacad_sha256_init(&sha);
+     for (i = 0; i < repeat; i++) {
+          yacad_sha256_update(&sha, data, size);
+     }
+     yacad_sha256_final(&sha, hex);
+     assert(!strcmp(hex, expected));
+     return result;
+}
+
+int test(void) {
+     int result = 0;
+
+     // FIPS 180-4 examples
+     result += check("", 0, 1, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+     result += check("abc", 3, 1, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+     result += check("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 56, 1,
+                     "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+     result += check("aaaaaaaaaa", 10, 100000, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+     // across the block boundaries
+     result += check("0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ!", 63, 3,
+                     "4f107e055567c195d34b175c30b785ef167677e32827ba22a0d817523e77c211");
+
+     return result;
+}
@@ -0,0 +1,115 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+#include "core/stats/yacad_stats.h"
+
+#define DATABASE_NAME "test_stats.db"
+
+static void clean(void) {
+     unlink(DATABASE_NAME);
+     unlink(DATABASE_NAME "-wal");
+     unlink(DATABASE_NAME "-shm");
+}
+
+static int test_estimate(logger_t log) {
+     int result = 0;
+     yacad_database_t *database;
+     yacad_stats_t *stats;
+
+     clean();
+     database = yacad_database_new(log, DATABASE_NAME);
+     stats = yacad_stats_new(log, database);
+
+     assert(stats->estimate(stats, "foo", 0, "x86") == -1);
+     assert(stats->percentile(stats, "foo", 0, "x86", 50) == -1);
+
+     // the first sample, then a moving average weighing the last one by a quarter
+     stats->add_sample(stats, "foo", 0, "x86", 100);
+     assert(stats->estimate(stats, "foo", 0, "x86") == 100);
+     stats->add_sample(stats, "foo", 0, "x86", 200);
+     assert(stats->estimate(stats, "foo", 0, "x86") == 125);
+     stats->add_sample(stats, "foo", 0, "x86", 20);
+     assert(stats->estimate(stats, "foo", 0, "x86") == 99);
+
+     assert(stats->percentile(stats, "foo", 0, "x86", 0) == 20);
+     assert(stats->percentile(stats, "foo", 0, "x86", 50) == 100);
+     assert(stats->percentile(stats, "foo", 0, "x86", 100) == 200);
+
+     // each project, task index and arch on its own
+     assert(stats->estimate(stats, "foo", 1, "x86") == -1);
+     assert(stats->estimate(stats, "foo", 0, "arm") == -1);
+     assert(stats->estimate(stats, "bar", 0, "x86") == -1);
+     stats->add_sample(stats, "foo", 0, NULL, -5);
+     assert(stats->estimate(stats, "foo", 0, NULL) == 0);
+
+     stats->free(stats);
+     database->free(database);
+     clean();
+     return result;
+}
+
+static int test_reload(logger_t log) {
+     int result = 0;
+     yacad_database_t *database;
+     yacad_stats_t *stats;
+     int i;
+
+     clean();
+     database = yacad_database_new(log, DATABASE_NAME);
+     stats = yacad_stats_new(log, database);
+     stats->add_sample(stats, "foo", 0, "x86", 100);
+     stats->add_sample(stats, "foo", 0, "x86", 200);
+     stats->add_sample(stats, "foo", 0, "x86", 20);
+     // only the last 32 durations count for the percentiles
+     for (i = 0; i < 8; i++) {
+          stats->add_sample(stats, "bar", 0, "x86", 10);
+     }
+     for (i = 0; i < 32; i++) {
+          stats->add_sample(stats, "bar", 0, "x86", 1000 + i);
+     }
+     assert(stats->percentile(stats, "bar", 0, "x86", 0) == 1000);
+     stats->free(stats);
+     database->free(database);
+
+     database = yacad_database_new(log, DATABASE_NAME);
+     stats = yacad_stats_new(log, database);
+     assert(stats->estimate(stats, "foo", 0, "x86") == 99);
+     assert(stats->percentile(stats, "foo", 0, "x86", 0) == 20);
+     assert(stats->percentile(stats, "foo", 0, "x86", 100) == 200);
+     assert(stats->percentile(stats, "bar", 0, "x86", 0) == 1000);
+     assert(stats->percentile(stats, "bar", 0, "x86", 100) == 1031);
+     // the samples go on after the last one
+     stats->add_sample(stats, "bar", 0, "x86", 2000);
+     assert(stats->percentile(stats, "bar", 0, "x86", 0) == 1001);
+     assert(stats->percentile(stats, "bar", 0, "x86", 100) == 2000);
+     stats->free(stats);
+     database->free(database);
+
+     clean();
+     return result;
+}
+
+int test(void) {
+     int result = 0;
+     logger_t log = get_logger(warn);
+
+     result += test_estimate(log);
+     result += test_reload(log);
+
+     return result;
+}
@@ -0,0 +1,213 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+#include "common/runnerid/yacad_runnerid.h"
+#include "core/stats/yacad_stats.h"
+#include "core/tasklist/yacad_tasklist.h"
+#include "core/tasklist/yacad_taskstore_sqlite3.h"
+
+#define DATABASE_NAME "test_tasklist.db"
+#define TASK_SERIAL "{\"id\":0,\"timestamp\":%ld,\"status\":0,\"taskindex\":0," \
+     "\"task\":{\"source\":{\"type\":\"scm\",\"ref\":\"%d\"},\"runner\":{\"arch\":\"foo\"},\"run\":{\"type\":\"spawn\",\"command\":\"make\"}}," \
+     "\"project_name\":\"%s\",\"env\":{}}"
+
+typedef struct {
+     yacad_database_t *database;
+     yacad_taskstore_t *store;
+     yacad_stats_t *stats;
+     yacad_tasklist_t *tasklist;
+     yacad_runnerid_t *runnerid;
+     yacad_locality_t *foo, *bar; // the localities of two runners
+} fixture_t;
+
+static void clean(void) {
+     unlink(DATABASE_NAME);
+     unlink(DATABASE_NAME "-wal");
+     unlink(DATABASE_NAME "-shm");
+}
+
+static void setup(logger_t log, fixture_t *fixture) {
+     clean();
+     fixture->database = yacad_database_new(log, DATABASE_NAME);
+     fixture->store = yacad_taskstore_sqlite3_new(log, fixture->database, DATABASE_NAME);
+     fixture->stats = yacad_stats_new(log, fixture->database);
+     fixture->tasklist = yacad_tasklist_new(log, fixture->store, fixture->stats, tasklist_fifo);
+     fixture->runnerid = yacad_runnerid_unserialize(log, "{\"name\":\"test\",\"arch\":\"foo\"}");
+     fixture->foo = yacad_locality_new();
+     fixture->foo->add_workspace(fixture->foo, "foo");
+     fixture->bar = yacad_locality_new();
+     fixture->bar->add_workspace(fixture->bar, "bar");
+}
+
+static void teardown(fixture_t *fixture) {
+     fixture->bar->free(fixture->bar);
+     fixture->foo->free(fixture->foo);
+     fixture->runnerid->free(fixture->runnerid);
+     fixture->tasklist->free(fixture->tasklist);
+     fixture->stats->free(fixture->stats);
+     fixture->store->free(fixture->store);
+     fixture->database->free(fixture->database);
+     clean();
+}
+
+static void add_task(logger_t log, fixture_t *fixture, int ref, const char *project_name, time_t timestamp) {
+     char serial[1024];
+     snprintf(serial, sizeof(serial), TASK_SERIAL, (long)timestamp, ref, project_name);
+     fixture->tasklist->add(fixture->tasklist, yacad_task_unserialize(log, serial));
+}
+
+/* the project of the dispatched task, NULL if none */
+static const char *get_project(fixture_t *fixture, yacad_locality_t *locality, char *project_name) {
+     const char *result = NULL;
+     yacad_task_t *task = fixture->tasklist->get(fixture->tasklist, fixture->runnerid, locality);
+     if (task != NULL) {
+          strcpy(project_name, task->get_project_name(task));
+          result = project_name;
+          task->free(task);
+     }
+     return result;
+}
+
+/* the core restarts: the pending and running tasks are restored in the background */
+static void restart(logger_t log, fixture_t *fixture) {
+     fixture->tasklist->free(fixture->tasklist);
+     fixture->store->free(fixture->store);
+     fixture->store = yacad_taskstore_sqlite3_new(log, fixture->database, DATABASE_NAME);
+     fixture->tasklist = yacad_tasklist_new(log, fixture->store, fixture->stats, tasklist_fifo);
+}
+
+/* like get_project, waiting up to one second for the restore */
+static const char *wait_project(fixture_t *fixture, char *project_name) {
+     int i;
+     const char *result = get_project(fixture, NULL, project_name);
+     for (i = 0; result == NULL && i < 100; i++) {
+          usleep(10000);
+          result = get_project(fixture, NULL, project_name);
+     }
+     return result;
+}
+
+static int test_affinity(logger_t log) {
+     int result = 0;
+     fixture_t fixture;
+     char project_name[16];
+     const char *got;
+     time_t now = time(NULL);
+
+     setup(log, &fixture);
+     add_task(log, &fixture, 1, "bar", now - 10);
+     add_task(log, &fixture, 2, "foo", now - 9);
+     add_task(log, &fixture, 3, "bar", now - 8);
+
+     // about the same age: each runner gets the project it holds
+     got = get_project(&fixture, fixture.foo, project_name);
+     assert(got != NULL && !strcmp(got, "foo"));
+     got = get_project(&fixture, fixture.bar, project_name);
+     assert(got != NULL && !strcmp(got, "bar"));
+     // nothing left for foo: it gets bar anyway
+     got = get_project(&fixture, fixture.foo, project_name);
+     assert(got != NULL && !strcmp(got, "bar"));
+     got = get_project(&fixture, fixture.bar, project_name);
+     assert(got == NULL);
+
+     teardown(&fixture);
+     return result;
+}
+
+static int test_order_first(logger_t log) {
+     int result = 0;
+     fixture_t fixture;
+     char project_name[16];
+     const char *got;
+     time_t now = time(NULL);
+
+     setup(log, &fixture);
+     add_task(log, &fixture, 1, "bar", now - 600);
+     add_task(log, &fixture, 2, "foo", now);
+
+     // the bar task waited much longer: the locality does not pass it over
+     got = get_project(&fixture, fixture.foo, project_name);
+     assert(got != NULL && !strcmp(got, "bar"));
+     got = get_project(&fixture, fixture.bar, project_name);
+     assert(got != NULL && !strcmp(got, "foo"));
+
+     teardown(&fixture);
+     return result;
+}
+
+static int test_restart_running(logger_t log) {
+     int result = 0;
+     fixture_t fixture;
+     char project_name[16];
+     const char *got;
+     time_t now = time(NULL);
+
+     setup(log, &fixture);
+     add_task(log, &fixture, 1, "foo", now - 10);
+     add_task(log, &fixture, 2, "bar", now);
+     got = get_project(&fixture, NULL, project_name);
+     assert(got != NULL && !strcmp(got, "foo"));
+
+     // the core restarts while the foo task is running
+     restart(log, &fixture);
+
+     got = wait_project(&fixture, project_name);
+     assert(got != NULL && !strcmp(got, "foo"));
+     got = get_project(&fixture, NULL, project_name);
+     assert(got != NULL && !strcmp(got, "bar"));
+     got = get_project(&fixture, NULL, project_name);
+     assert(got == NULL);
+
+     teardown(&fixture);
+     return result;
+}
+
+static int test_restore_duplicate(logger_t log) {
+     int result = 0;
+     fixture_t fixture;
+     char project_name[16];
+     const char *got;
+     time_t now = time(NULL);
+
+     setup(log, &fixture);
+     add_task(log, &fixture, 1, "foo", now);
+
+     // the same task is checked again while it is being restored
+     restart(log, &fixture);
+     add_task(log, &fixture, 1, "foo", now);
+
+     got = wait_project(&fixture, project_name);
+     assert(got != NULL && !strcmp(got, "foo"));
+     got = wait_project(&fixture, project_name);
+     assert(got == NULL);
+
+     teardown(&fixture);
+     return result;
+}
+
+int test(void) {
+     int result = 0;
+     logger_t log = get_logger(warn);
+
+     result += test_affinity(log);
+     result += test_order_first(log);
+     result += test_restart_running(log);
+     result += test_restore_duplicate(log);
+
+     return result;
+}
@@ -0,0 +1,280 @@
+/*
+  This file is part of yaCAD.
+
+  yaCAD is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  yaCAD is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with yaCAD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fcntl.h>
+
+#include "test.h"
+
+#include "core/tasklist/yacad_taskstore_log.h"
+
+#define TASKLOG_NAME "test_taskstore_log.log"
+#define DAY 86400
+
+typedef struct {
+     int count;
+     unsigned long ids[16];
+     char serials[16][64];
+} restored_t;
+
+static void restore_cb(unsigned long id, yacad_task_status_t status, const char *serial, restored_t *restored) {
+     if (restored->count < 16) {
+          restored->ids[restored->count] = id;
+          snprintf(restored->serials[restored->count], 64, "%s", serial);
+     }
+     restored->count++;
+}
+
+static restored_t restore_all(yacad_taskstore_t *store) {
+     restored_t result;
+     memset(&result, 0, sizeof(restored_t));
+     store->restore(store, 0, store->get_max_id(store), 16, (yacad_taskstore_restore_cb)restore_cb, &result);
+     return result;
+}
+
+static void append_raw(const char *data) {
+     int fd = open(TASKLOG_NAME, O_WRONLY | O_APPEND);
+     if (fd >= 0) {
+          if (write(fd, data, strlen(data)) < 0) {
+               perror(TASKLOG_NAME);
+          }
+          close(fd);
+     }
+}
+
+static off_t file_size(void) {
+     struct stat st;
+     return stat(TASKLOG_NAME, &st) == 0 ? st.st_size : -1;
+}
+
+static int test_replay(logger_t log) {
+     int result = 0;
+     yacad_taskstore_t *store;
+     restored_t restored;
+
+     unlink(TASKLOG_NAME);
+
+     store = yacad_taskstore_log_new(log, TASKLOG_NAME, 1);
+     assert(store != NULL);
+     assert(store->get_max_id(store) == 0);
+     assert(store->insert(store, task_new, "{\"serial\":1}", "foo", 1000) == 1);
+     assert(store->insert(store, task_new, "{\"serial\":2}", "bar", 1001) == 2);
+     assert(store->insert(store, task_new, "{\"serial\":3}", "foo", 1002) == 3);
+     assert(store->set_status(store, 2, task_done, 2000));
+     assert(!store->set_status(store, 4, task_done, 2000));
+     store->free(store);
+
+     store = yacad_taskstore_log_new(log, TASKLOG_NAME, 1);
+     assert(store->get_max_id(store) == 3);
+     restored = restore_all(store);
+     assert(restored.count == 2);
+     assert(restored.ids[0] == 1 && !strcmp(restored.serials[0], "{\"serial\":1}"));
+     assert(restored.ids[1] == 3 && !strcmp(restored.serials[1], "{\"serial\":3}"));
+     store->free(store);
+
+     unlink(TASKLOG_NAME);
+     return result;
+}
+
+static int test_torn_record(logger_t log) {
+     int result = 0;
+     yacad_taskstore_t *store;
+     restored_t restored;
+     off_t size;
+
+     unlink(TASKLOG_NAME);
+
+     store = yacad_taskstore_log_new(log, TASKLOG_NAME, 1);
+     store->insert(store, task_new, "{\"serial\":1}", "foo", 1000);
+     store->insert(store, task_new, "{\"serial\":2}", "foo", 1001);
+     store->free(store);
+     size = file_size();
+
+     // crash in the middle of a record
+     append_raw("A 3 0 1002 3 12 ");
+     store = yacad_taskstore_log_new(log, TASKLOG_NAME, 1);
+     assert(store->get_max_id(store) == 2);
+     assert(file_size() == size);
+     assert(store->insert(store, task_new, "{\"serial\":3}", "foo", 1002) == 3);
+     store->free(store);
+
+     // crash in the middle of a payload
+     size = file_size();
+     append_raw("S 1 -1 0 0 0 00000000\n");
+     append_raw("A 4 0 1003 3 12 00000000\nfoo{\"ser");
+     store = yacad_taskstore_log_new(log, TASKLOG_NAME, 1);
+     assert(store->get_max_id(store) == 3);
+     assert(file_size() == size);
+     restored = restore_all(store);
+     assert(restored.count == 3);
+     store->free(store);
+
+     unlink(TASKLOG_NAME);
+     return result;
+}
+
+static int test_corrupt_record(logger_t log) {
+     int result = 0;
+     yacad_taskstore_t *store;
+     restored_t restored;
+     off_t size;
+     int fd;
+
+     unlink(TASKLOG_NAME);
+
+     store = yacad_taskstore_log_new(log, TASKLOG_NAME, 1);
+     store->insert(store, task_new, "{\"serial\":1}", "foo", 1000);
+     size = file_size();
+     store->insert(store, task_new, "{\"serial\":2}", "foo", 1001);
+     store->free(store);
+
+     // flip one byte of the last payload: the checksum does not match anymore
+     fd = open(TASKLOG_NAME, O_WRONLY);
+     assert(pwrite(fd, "X", 1, file_size() - 3) == 1);
+     close(fd);
+
+     store = yacad_taskstore_log_new(log, TASKLOG_NAME, 1);
+     assert(store->get_max_id(store) == 1);
+     assert(file_size() == size);
+     restored = restore_all(store);
+     assert(restored.count == 1);
+     assert(restored.ids[0] == 1);
+     store->free(store);
+
+     unlink(TASKLOG_NAME);
+     return result;
+}
+
+static int test_compact(logger_t log) {
+     int result = 0;
+     yacad_taskstore_t *store;
+     restored_t restored;
+     off_t size;
+     int i;
+
+     unlink(TASKLOG_NAME);
+
+     store = yacad_taskstore_log_new(log, TASKLOG_NAME, 1);
+     store->insert(store, task_new, "{\"serial\":1}", "foo", 1000);
+     store->insert(store, task_new, "{\"serial\":2}", "foo", 1001);
+     for (i = 0; i < 1000; i++) {
+          store->set_status(store, 1, i % 2 ? task_new : task_done, 2000 + i);
+     }
+     size = file_size();
+     for (i = 0; i < 100; i++) {
+          store->set_status(store, 1, i % 2 ? task_new : task_done, 2000 + i);
+     }
+     store->set_status(store, 1, task_done, 3000);
+     store->insert(store, task_new, "{\"serial\":3}", "foo", 1002);
+     // the pending compaction is made before free returns: three tasks, the first one is done
+     store->free(store);
+     assert(file_size() < size);
+
+     store = yacad_taskstore_log_new(log, TASKLOG_NAME, 1);
+     assert(store->get_max_id(store) == 3);
+     restored = restore_all(store);
+     assert(restored.count == 2);
+     assert(restored.ids[0] == 2 && !strcmp(restored.serials[0], "{\"serial\":2}"));
+     assert(restored.ids[1] == 3 && !strcmp(restored.serials[1], "{\"serial\":3}"));
+     store->free(store);
+
+     unlink(TASKLOG_NAME);
+     return result;
+}
+
+static int test_restart_running(logger_t log) {
+     int result = 0;
+     yacad_taskstore_t *store;
+     restored_t restored;
+
+     unlink(TASKLOG_NAME);
+
+     store = yacad_taskstore_log_new(log, TASKLOG_NAME, 1);
+     store->insert(store, task_new, "{\"serial\":1}", "foo", 1000);
+     store->insert(store, task_new, "{\"serial\":2}", "foo", 1001);
+     assert(store->set_running(store, 1, 2000, 2100));
+     restored = restore_all(store);
+     assert(restored.count == 1 && restored.ids[0] == 2);
+     store->free(store);
+
+     // the core restarted while task 1 was running: it is restored
+     store = yacad_taskstore_log_new(log, TASKLOG_NAME, 1);
+     restored = restore_all(store);
+     assert(restored.count == 2);
+     assert(restored.ids[0] == 1 && restored.ids[1] == 2);
+     store->free(store);
+
+     // and still after a replay of the requeue record
+     store = yacad_taskstore_log_new(log, TASKLOG_NAME, 1);
+     restored = restore_all(store);
+     assert(restored.count == 2);
+     store->free(store);
+
+     unlink(TASKLOG_NAME);
+     return result;
+}
+
+static int test_expire(logger_t log) {
+     int result = 0;
+     yacad_taskstore_t *store;
+     restored_t restored;
+     time_t now = time(NULL);
+     int i;
+
+     unlink(TASKLOG_NAME);
+
+     store = yacad_taskstore_log_new(log, TASKLOG_NAME, 1);
+     store->insert(store, task_new, "{\"serial\":1}", "foo", now - 3 * DAY);
+     store->insert(store, task_new, "{\"serial\":2}", "foo", now - 2 * DAY);
+     store->insert(store, task_new, "{\"serial\":3}", "foo", now);
+     store->insert(store, task_new, "{\"serial\":4}", "foo", now - 3 * DAY);
+     store->set_status(store, 1, task_done, now - 2 * DAY);
+     store->set_status(store, 2, task_aborted, now - DAY / 2);
+     store->set_status(store, 4, task_done, now - 2 * DAY);
+     // enough superseded records to compact
+     for (i = 0; i < 1100; i++) {
+          store->set_running(store, 3, now + i, 0);
+     }
+     store->free(store);
+
+     // task 1 finished for more than a day: dropped; task 4 is the last one, it holds the last id
+     store = yacad_taskstore_log_new(log, TASKLOG_NAME, 1);
+     assert(store->get_max_id(store) == 4);
+     assert(!store->set_status(store, 1, task_done, now));
+     assert(store->set_status(store, 2, task_aborted, now));
+     assert(store->set_status(store, 4, task_done, now));
+     assert(store->insert(store, task_new, "{\"serial\":5}", "foo", now) == 5);
+     restored = restore_all(store);
+     assert(restored.count == 2);
+     assert(restored.ids[0] == 3 && restored.ids[1] == 5);
+     store->free(store);
+
+     unlink(TASKLOG_NAME);
+     return result;
+}
+
+int test(void) {
+     int result = 0;
+     logger_t log = get_logger(warn);
+
+     result += test_replay(log);
+     result += test_torn_record(log);
+     result += test_corrupt_record(log);
+     result += test_compact(log);
+     result += test_restart_running(log);
+     result += test_expire(log);
+
+     return result;
+}